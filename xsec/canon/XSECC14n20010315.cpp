@@ -32,16 +32,19 @@
 //XSEC includes
 #include <xsec/framework/XSECDefs.hpp>
 #include <xsec/framework/XSECError.hpp>
+#include <xsec/framework/XSECTrace.hpp>
 #include <xsec/canon/XSECC14n20010315.hpp>
 #include <xsec/utils/XSECSafeBufferFormatter.hpp>
 
 #include "../utils/XSECDOMUtils.hpp"
+#include "../utils/XSECThreadPool.hpp"
 
 // Xerces includes
 #include <xercesc/dom/DOMElement.hpp>
 #include <xercesc/dom/DOMNamedNodeMap.hpp>
 #include <xercesc/util/Janitor.hpp>
 #include <xercesc/util/XMLUniDefs.hpp>
+#include <xercesc/util/XMLUni.hpp>
 
 XERCES_CPP_NAMESPACE_USE
 
@@ -188,7 +191,7 @@ bool visiblyUtilises(DOMNode *node, safeBuffer &ns) {
 	for (XMLSize_t i = 0; i < size; ++i) {
 
 		if (strEquals(atts->item(i)->getPrefix(), (char *) ns.rawBuffer()) &&
-			!strEquals(atts->item(i)->getLocalName(), "xmlns"))
+			!strEquals(atts->item(i)->getLocalName(), XMLUni::fgXMLNSString))
 			return true;
 
 	}
@@ -197,13 +200,16 @@ bool visiblyUtilises(DOMNode *node, safeBuffer &ns) {
 
 }
 
-bool XSECC14n20010315::inNonExclNSList(safeBuffer &ns) {
+bool XSECC14n20010315::inNonExclNSList(const XMLCh * prefix) {
 
-	int size = (int) m_exclNSList.size();
+	// The list is held in UTF-16 so a namespace node's local name can be
+	// checked directly, without transcoding it for every attribute
 
-	for (int i = 0; i < size; ++i) {
+	XMLSize_t size = m_exclNSList.size();
+
+	for (XMLSize_t i = 0; i < size; ++i) {
 
-		if (!strcmp((char *) ns.rawBuffer(), m_exclNSList[i]))
+		if (XMLString::equals(prefix, m_exclNSList[i]))
 			return true;
 
 	}
@@ -280,7 +286,7 @@ void XSECC14n20010315::setExclusive(char * xmlnsList) {
 		else {
 
 			// Add this to the list
-			m_exclNSList.push_back(strdup(nsBuf));
+			m_exclNSList.push_back(XMLString::transcode(nsBuf));
 
 		}
 
@@ -318,7 +324,7 @@ void XSECC14n20010315::stackInit(DOMNode * n) {
 
 	for (i = 0; i < size; ++i) {
 
-		currentName << (*mp_formatter << tmpAtts->item(i)->getNodeName());
+		currentName.sbUTF8In(tmpAtts->item(i)->getNodeName());
 
 		if (currentName.sbStrncmp("xmlns", 5) == 0)
 			m_nsStack.addNamespace(tmpAtts->item(i));
@@ -334,11 +340,6 @@ void XSECC14n20010315::init() {
 
 	// This does the work of setting us up and checks to make sure everyhing is OK
 
-	// Set up the Xerces formatter
-
-	XSECnew(mp_formatter, XSECSafeBufferFormatter("UTF-8",XMLFormatter::NoEscapes,
-												XMLFormatter::UnRep_CharRef));
-
 	// Set up for first attribute list
 
 	mp_attributes = mp_currentAttribute = mp_firstNonNsAttribute = NULL;
@@ -355,6 +356,7 @@ void XSECC14n20010315::init() {
 	// XPath setup
 	m_XPathSelection = false;
 	m_XPathMap.clear();
+	mp_XPathMap = &m_XPathMap;
 
 	// Exclusive Canonicalisation setup
 
@@ -367,6 +369,15 @@ void XSECC14n20010315::init() {
 
 	// Namespace handling
 	m_useNamespaceStack = true;
+	m_virtualNamespaceNodes = false;
+
+	// Serial unless asked otherwise
+	m_parallelThreads = 1;
+	m_partitioning = false;
+	mp_partitionNext = NULL;
+	m_partitionSize = 1;
+	m_partitionIndex = 0;
+	mp_partitionPool = NULL;
 
 	// INitialise the stack - even if we don't use it later, at least this sets us up
 	if (mp_startNode != NULL) {
@@ -395,15 +406,17 @@ XSECC14n20010315::XSECC14n20010315(DOMDocument *newDoc,
 
 XSECC14n20010315::~XSECC14n20010315() {
 
-	if (mp_formatter != NULL)
-		delete mp_formatter;
+	clearPartitions();
+
+	if (mp_partitionPool != NULL)
+		delete mp_partitionPool;
 
 	// Clear out the exclusive namespace list
 	int size = (int) m_exclNSList.size();
 
 	for (int i = 0; i < size; ++i) {
 
-		free(m_exclNSList[i]);
+		XSEC_RELEASE_XMLCH(m_exclNSList[i]);
 
 	}
 
@@ -539,6 +552,207 @@ void XSECC14n20010315::setXPathMap(const XSECXPathNodeList & map) {
 
 }
 
+// --------------------------------------------------------------------------------
+//           Parallel canonicalisation of the document element's children
+// --------------------------------------------------------------------------------
+
+// Each child of the document element is independent of its siblings.  The only
+// shared state is the namespace (and xml: attribute) context inherited from the
+// document element, so a partition can be done by a separate canonicaliser that
+// has the same "apex" element and a namespace stack initialised from the parent
+// chain.  Namespaces rendered on the apex are not marked as printed in the
+// partition stack, but checkRenderNameSpaceNode() finds the same declaration on
+// the apex and so still declines to render them.
+
+class XSECC14nPartitionTask : public XSECThreadTask {
+
+public:
+
+	XSECC14nPartitionTask(XSECC14n20010315 * parent, DOMNode * first, XMLSize_t count) :
+		mp_parent(parent), mp_first(first), m_count(count), m_outputLength(0),
+		mp_reference(XSECTrace::getReference()) {}
+	virtual ~XSECC14nPartitionTask() {}
+
+	virtual void run(void) {
+
+		if (!XSECTrace::isEnabled()) {
+			mp_parent->canonicalisePartition(mp_first, m_count, m_output, m_outputLength);
+			return;
+		}
+
+		// Attribute the work to the Reference the caller is processing
+		const XMLCh * previous = XSECTrace::getReference();
+		XSECTrace::setReference(mp_reference);
+		{
+			XSECTraceScope trace("c14n_partition");
+			mp_parent->canonicalisePartition(mp_first, m_count, m_output, m_outputLength);
+		}
+		XSECTrace::setReference(previous);
+
+	}
+
+	XSECC14n20010315	* mp_parent;
+	DOMNode				* mp_first;
+	XMLSize_t			m_count;
+	safeBuffer			m_output;
+	XMLSize_t			m_outputLength;
+	const XMLCh			* mp_reference;
+
+};
+
+bool XSECC14n20010315::startPartitions(DOMNode * firstChild) {
+
+	// Count the children to decide how to split them up
+	XMLSize_t count = 0;
+	DOMNode * n = firstChild;
+
+	while (n != NULL) {
+		++count;
+		n = n->getNextSibling();
+	}
+
+	if (count < XSECC14N_PARALLEL_MIN_CHILDREN)
+		return false;
+
+	XMLSize_t partitions = m_parallelThreads * XSECC14N_PARTITIONS_PER_THREAD;
+	m_partitionSize = (count + partitions - 1) / partitions;
+	if (m_partitionSize == 0)
+		m_partitionSize = 1;
+
+	// One pool serves every wave
+	if (mp_partitionPool == NULL)
+		XSECnew(mp_partitionPool, XSECThreadPool(m_parallelThreads));
+
+	mp_partitionNext = firstChild;
+	m_partitioning = true;
+
+	return true;
+
+}
+
+void XSECC14n20010315::clearPartitions(void) {
+
+	XMLSize_t size = m_partitions.size();
+	for (XMLSize_t i = 0; i < size; ++i) {
+		if (m_partitions[i] != NULL)
+			delete m_partitions[i];
+	}
+
+	m_partitions.clear();
+	m_partitionIndex = 0;
+
+}
+
+void XSECC14n20010315::runPartitions(void) {
+
+	clearPartitions();
+
+	XMLSize_t batch = (m_parallelThreads * XSECC14N_PARTITIONS_PER_THREAD) / XSECC14N_PARTITION_WAVES;
+	if (batch < m_parallelThreads)
+		batch = m_parallelThreads;
+
+	for (XMLSize_t i = 0; i < batch && mp_partitionNext != NULL; ++i) {
+
+		XSECC14nPartitionTask * t;
+		XSECnew(t, XSECC14nPartitionTask(this, mp_partitionNext, m_partitionSize));
+		m_partitions.push_back(t);
+		mp_partitionPool->addTask(t);
+
+		for (XMLSize_t j = 0; j < m_partitionSize && mp_partitionNext != NULL; ++j)
+			mp_partitionNext = mp_partitionNext->getNextSibling();
+
+	}
+
+	mp_partitionPool->runAll();
+
+}
+
+XMLSize_t XSECC14n20010315::processNextPartition(void) {
+
+	m_bufferLength = m_bufferPoint = 0;
+
+	if (m_partitionIndex >= m_partitions.size()) {
+
+		if (mp_partitionNext == NULL) {
+
+			// All children done - mp_nextNode is still the document element, so
+			// the normal path will now close it off
+			clearPartitions();
+			m_partitioning = false;
+			return processNextNode();
+
+		}
+
+		runPartitions();
+
+	}
+
+	// Hand back the next piece in order, and free it as we go
+	XSECC14nPartitionTask * t = m_partitions[m_partitionIndex];
+	m_partitions[m_partitionIndex++] = NULL;
+
+	if (t->m_outputLength > 0) {
+		m_buffer.sbMemcpyIn(t->m_output.rawBuffer(), t->m_outputLength);
+		m_bufferLength = t->m_outputLength;
+	}
+
+	delete t;
+
+	return m_bufferLength;
+
+}
+
+void XSECC14n20010315::canonicalisePartition(DOMNode * first,
+											 XMLSize_t count,
+											 safeBuffer & output,
+											 XMLSize_t & outputLength) {
+
+	// Runs in a worker thread - we only read from this object
+
+	XSECC14n20010315 c(mp_doc, first);
+
+	c.mp_firstElementNode = mp_firstElementNode;
+	c.m_firstElementProcessed = false;
+	c.m_processComments = m_processComments;
+	c.m_XPathSelection = m_XPathSelection;
+	c.mp_XPathMap = mp_XPathMap;
+	c.m_exclusive = m_exclusive;
+	c.m_exclusiveDefault = m_exclusiveDefault;
+	c.m_incl11 = m_incl11;
+	c.m_useNamespaceStack = m_useNamespaceStack;
+	c.m_virtualNamespaceNodes = m_virtualNamespaceNodes;
+
+	XMLSize_t size = m_exclNSList.size();
+	for (XMLSize_t i = 0; i < size; ++i)
+		c.m_exclNSList.push_back(XMLString::replicate(m_exclNSList[i]));
+
+	outputLength = 0;
+	DOMNode * n = first;
+
+	for (XMLSize_t i = 0; i < count && n != NULL; ++i) {
+
+		c.setStartNode(n);
+		c.m_returnedFromChild = false;
+
+		while (!c.m_allNodesDone) {
+
+			c.processNextNode();
+			if (c.m_bufferLength > 0) {
+				// safeBuffer only grows linearly, so do it ourselves
+				if (outputLength + c.m_bufferLength + 2 >= output.sbRawBufferSize())
+					output.resize((outputLength + c.m_bufferLength) * 2);
+				output.sbMemcpyIn(outputLength, c.m_buffer.rawBuffer(), c.m_bufferLength);
+				outputLength += c.m_bufferLength;
+			}
+
+		}
+
+		n = n->getNextSibling();
+
+	}
+
+}
+
 // --------------------------------------------------------------------------------
 //           XSECC14n20010315 processNextNode method
 // --------------------------------------------------------------------------------
@@ -726,6 +940,19 @@ safeBuffer c14nCleanAttribute(safeBuffer &input) {
 
 }
 
+bool XSECC14n20010315::namespaceInNodeSet(DOMNode *e, DOMNode *a) const {
+
+	if (!m_XPathSelection)
+		return true;
+
+	// Virtual namespace nodes follow their element
+	if (m_virtualNamespaceNodes && m_useNamespaceStack)
+		return mp_XPathMap->hasNode(e);
+
+	return mp_XPathMap->hasNode(a);
+
+}
+
 bool XSECC14n20010315::checkRenderNameSpaceNode(DOMNode *e, DOMNode *a) {
 
 	DOMNode *parent;
@@ -733,11 +960,11 @@ bool XSECC14n20010315::checkRenderNameSpaceNode(DOMNode *e, DOMNode *a) {
 	DOMNamedNodeMap *atts;
 
 	// If XPath and node not selected, then never print
-	if (m_XPathSelection && ! m_XPathMap.hasNode(a))
+	if (!namespaceInNodeSet(e, a))
 		return false;
 
 	// BUGFIX: we need to skip xmlns:xml if the value is http://www.w3.org/XML/1998/namespace
-	if (strEquals(a->getLocalName(), "xml") && strEquals(a->getNodeValue(), "http://www.w3.org/XML/1998/namespace"))
+	if (strEquals(a->getLocalName(), XMLUni::fgXMLString) && strEquals(a->getNodeValue(), XMLUni::fgXMLURIName))
 		return false;
 
 	// First - are we exclusive?
@@ -747,12 +974,11 @@ bool XSECC14n20010315::checkRenderNameSpaceNode(DOMNode *e, DOMNode *a) {
 
 	if (m_exclusive) {
 
-		if (strEquals(a->getNodeName(), "xmlns")) {
+		if (strEquals(a->getNodeName(), XMLUni::fgXMLNSString)) {
 			processAsExclusive = m_exclusiveDefault;
 		}
 		else {
-			localName << (*mp_formatter << a->getLocalName());
-			processAsExclusive = !inNonExclNSList(localName);
+			processAsExclusive = !inNonExclNSList(a->getLocalName());
 		}
 
 	}
@@ -760,11 +986,11 @@ bool XSECC14n20010315::checkRenderNameSpaceNode(DOMNode *e, DOMNode *a) {
 	if (processAsExclusive) {
 
 		// Is the parent in the  node-set?
-		if (m_XPathSelection && !m_XPathMap.hasNode(e))
+		if (m_XPathSelection && !mp_XPathMap->hasNode(e))
 			return false;
 
 		// Is the name space visibly utilised?
-		localName << (*mp_formatter << a->getLocalName());
+		localName.sbUTF8In(a->getLocalName());
 
 		if (localName.sbStrcmp("xmlns") == 0)
 			localName[0] = '\0';			// Is this correct or should Xerces return "" for default?
@@ -781,7 +1007,7 @@ bool XSECC14n20010315::checkRenderNameSpaceNode(DOMNode *e, DOMNode *a) {
 
 		while (parent != NULL) {
 
-			if (!m_XPathSelection || m_XPathMap.hasNode(parent)) {
+			if (!m_XPathSelection || mp_XPathMap->hasNode(parent)) {
 
 				// An output ancestor
 				if (visiblyUtilises(parent, localName)) {
@@ -790,7 +1016,8 @@ bool XSECC14n20010315::checkRenderNameSpaceNode(DOMNode *e, DOMNode *a) {
 					while (parent != NULL) {
 						atts = parent->getAttributes();
 						att = (atts != NULL) ? atts->getNamedItem(a->getNodeName()) : NULL;
-						if (att != NULL && (!m_XPathSelection || m_XPathMap.hasNode(att))) {
+						if (att != NULL && (!m_XPathSelection ||
+							(m_virtualNamespaceNodes && m_useNamespaceStack) || mp_XPathMap->hasNode(att))) {
 
 							// Check URI is the same
 							if (strEquals(att->getNodeValue(), a->getNodeValue()))
@@ -831,13 +1058,13 @@ bool XSECC14n20010315::checkRenderNameSpaceNode(DOMNode *e, DOMNode *a) {
 	// Is to be treated as non-exclusive
 
 	// Never directly render a default
-	if (strEquals(a->getNodeName(), "xmlns") && strEquals(a->getNodeValue(), ""))
+	if (strEquals(a->getNodeName(), XMLUni::fgXMLNSString) && strEquals(a->getNodeValue(), ""))
 		return false;
 
 	// If using a namespace stack, then we need to check whether the current node is in the nodeset
 	// Only really necessary for envelope txfms in boundary conditions
 
-	if (m_useNamespaceStack && m_XPathSelection && !m_XPathMap.hasNode(e))
+	if (m_useNamespaceStack && m_XPathSelection && !mp_XPathMap->hasNode(e))
 		return false;
 
 	// Otherwise, of node is at base of selected document, then print
@@ -847,31 +1074,45 @@ bool XSECC14n20010315::checkRenderNameSpaceNode(DOMNode *e, DOMNode *a) {
 	if (m_useNamespaceStack) {
 
 		// In this case, we need to go up until we find the namespace definition
-		// in question
+		// in question.  The stack holds every ancestor's declarations of this
+		// name (nearest first), so there is no need to walk the DOM
 
-		parent = e->getParentNode();
-		while (parent != NULL) {
+		if (m_XPathSelection && m_virtualNamespaceNodes) {
 
-			if (!m_XPathSelection || m_XPathMap.hasNode(parent)) {
-				DOMNamedNodeMap *pmap = parent->getAttributes();
-				DOMNode *pns;
-				if (pmap)
-					pns = pmap->getNamedItem(a->getNodeName());
-				else
-					pns = NULL;
+			// Namespace nodes are implied by elements, so compare against
+			// whatever was in scope at the nearest output ancestor
 
-				if (pns != NULL) {
+			parent = e->getParentNode();
+			while (parent != NULL && !mp_XPathMap->hasNode(parent))
+				parent = parent->getParentNode();
 
-					// Note we don't check XPath inclusion, as we shouldn't be
-					// using the namespace stack for XPath expressions
+			if (parent == NULL)
+				return true;
 
-					if (strEquals(pns->getNodeValue(), a->getNodeValue()))
-						return false;
-					else
-						return true;		// Was defined but differently
-				}
+			DOMNode *pns = m_nsStack.getInScopeNamespace(a->getNodeName(), parent);
+			if (pns != NULL && strEquals(pns->getNodeValue(), a->getNodeValue()))
+				return false;
+
+			return true;
+
+		}
+
+		DOMNode *owner;
+		DOMNode *pns = m_nsStack.getFirstAncestorNamespace(a, e, &owner);
+		while (pns != NULL) {
+
+			// Note we don't check XPath inclusion, as we shouldn't be
+			// using the namespace stack for XPath expressions
+
+			if (!m_XPathSelection || mp_XPathMap->hasNode(owner)) {
+
+				if (strEquals(pns->getNodeValue(), a->getNodeValue()))
+					return false;
+				else
+					return true;		// Was defined but differently
 			}
-			parent = parent->getParentNode();
+
+			pns = m_nsStack.getNextAncestorNamespace(&owner);
 		}
 		// Obviously we haven't found it!
 		return true;
@@ -880,10 +1121,10 @@ bool XSECC14n20010315::checkRenderNameSpaceNode(DOMNode *e, DOMNode *a) {
 	// Find the parent and check if the node is already defined or if the node
 	// was out of scope
 	parent = e->getParentNode();
-//	if (m_XPathSelection && !m_XPathMap.hasNode(parent))
+//	if (m_XPathSelection && !mp_XPathMap->hasNode(parent))
 //		return true;
 
-	while (m_XPathSelection && parent != NULL && !m_XPathMap.hasNode(parent))
+	while (m_XPathSelection && parent != NULL && !mp_XPathMap->hasNode(parent))
 		parent = parent->getParentNode();
 
 	if (parent == NULL)
@@ -895,7 +1136,7 @@ bool XSECC14n20010315::checkRenderNameSpaceNode(DOMNode *e, DOMNode *a) {
 
 	if (pns != NULL) {
 
-		if (m_XPathSelection && !m_XPathMap.hasNode(pns))
+		if (m_XPathSelection && !mp_XPathMap->hasNode(pns))
 			return true;			// Not printed in previous node
 
 		if (strEquals(pns->getNodeValue(), a->getNodeValue()))
@@ -933,6 +1174,13 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 
 	}
 
+	// Are we handing back the output of parallel partitions?
+	if (m_partitioning) {
+
+		return processNextPartition();
+
+	}
+
 	// Always zeroise buffers to make work simpler
 	m_bufferLength = m_bufferPoint = 0;
 	m_buffer.sbStrcpyIn("");
@@ -951,7 +1199,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 	}
 	else {
 
-		processNode = ((!m_XPathSelection) || (m_XPathMap.hasNode(mp_nextNode)));
+		processNode = ((!m_XPathSelection) || (mp_XPathMap->hasNode(mp_nextNode)));
 		nodeT = mp_nextNode->getNodeType();
 
 	}
@@ -1006,10 +1254,10 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 			else
 				m_buffer.sbStrcpyIn("<?");
 
-			m_formatBuffer << (*mp_formatter << mp_nextNode->getNodeName());
+			m_formatBuffer.sbUTF8In(mp_nextNode->getNodeName());
 			m_buffer.sbStrcatIn(m_formatBuffer);
 
-			m_formatBuffer << (*mp_formatter << ((DOMProcessingInstruction *) mp_nextNode)->getData());
+			m_formatBuffer.sbUTF8In(((DOMProcessingInstruction *) mp_nextNode)->getData());
 			if (m_formatBuffer.sbStrlen() > 0) {
 				m_buffer.sbStrcatIn(" ");
 				m_buffer.sbStrcatIn(m_formatBuffer);
@@ -1043,7 +1291,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 			else
 				m_buffer.sbStrcpyIn("<!--");
 
-			m_formatBuffer << (*mp_formatter << mp_nextNode->getNodeValue());
+			m_formatBuffer.sbUTF8In(mp_nextNode->getNodeValue());
 
 			if (m_formatBuffer.sbStrlen() > 0) {
 				m_buffer.sbStrcatIn(m_formatBuffer);
@@ -1067,7 +1315,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 	case DOMNode::TEXT_NODE : // Straight copy for now
 
 		if (processNode) {
-			m_formatBuffer << (*mp_formatter << mp_nextNode->getNodeValue());
+			m_formatBuffer.sbUTF8In(mp_nextNode->getNodeValue());
 
 			// Do c14n cleaning on the text string
 
@@ -1086,7 +1334,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 		if (m_returnedFromChild) {
 			if (processNode) {
 				m_buffer.sbStrcpyIn ("</");
-				m_formatBuffer << (*mp_formatter << mp_nextNode->getNodeName());
+				m_formatBuffer.sbUTF8In(mp_nextNode->getNodeName());
 				m_buffer.sbStrcatIn(m_formatBuffer);
 				m_buffer.sbStrcatIn(">");
 			}
@@ -1100,7 +1348,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 		if (processNode) {
 
 			m_buffer.sbStrcpyIn("<");
-			m_formatBuffer << (*mp_formatter << mp_nextNode->getNodeName());
+			m_formatBuffer.sbUTF8In(mp_nextNode->getNodeName());
 			m_buffer.sbStrcatIn(m_formatBuffer);
 		}
 
@@ -1132,8 +1380,8 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 			for (i = 0; i < size; ++i) {
 
 				// Get the name and value of the attribute
-				currentName << (*mp_formatter << tmpAtts->item(i)->getNodeName());
-				currentValue << (*mp_formatter << tmpAtts->item(i)->getNodeValue());
+				currentName.sbUTF8In(tmpAtts->item(i)->getNodeName());
+				currentValue.sbUTF8In(tmpAtts->item(i)->getNodeValue());
 
 				// Build the string used to sort this node
 
@@ -1148,7 +1396,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 
 						// Is this the default?
 						if (currentName.sbStrcmp("xmlns") == 0 &&
-							(!m_XPathSelection || m_XPathMap.hasNode(tmpAtts->item(i))) &&
+							(!m_XPathSelection || mp_XPathMap->hasNode(tmpAtts->item(i))) &&
 							!currentValue.sbStrcmp("") == 0)
 							xmlnsFound = true;
 
@@ -1157,7 +1405,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 
 							// Add to the list
 
-							m_formatBuffer << (*mp_formatter << tmpAtts->item(i)->getNodeName());
+							m_formatBuffer.sbUTF8In(tmpAtts->item(i)->getNodeName());
 							if (m_formatBuffer[5] == ':')
 								currentName.sbStrcpyIn((char *) &m_formatBuffer[6]);
 							else
@@ -1192,7 +1440,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 					if (XMLElement) {
 
 						DOMNode *t = mp_nextNode->getParentNode();
-						if (m_XPathSelection && m_XPathMap.hasNode(t))
+						if (m_XPathSelection && mp_XPathMap->hasNode(t))
 							XMLElement = false;
 						else {
 
@@ -1232,7 +1480,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 
 
 
-					if ((!m_XPathSelection && next == mp_nextNode) || XMLElement || ((next == mp_nextNode) && m_XPathMap.hasNode(tmpAtts->item(i)))) {
+					if ((!m_XPathSelection && next == mp_nextNode) || XMLElement || ((next == mp_nextNode) && mp_XPathMap->hasNode(tmpAtts->item(i)))) {
 
 						toIns = new XSECNodeListElt;
 						toIns->element = tmpAtts->item(i);
@@ -1250,7 +1498,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 							toIns->sortString.sbStrcatIn(NOURI_PREFIX);
 						}
 						else {
-							m_formatBuffer << (*mp_formatter << nsURI);
+							m_formatBuffer.sbUTF8In(nsURI);
 							toIns->sortString.sbStrcatIn(HAVEURI_PREFIX);
 							toIns->sortString.sbStrcatIn(m_formatBuffer);
 						}
@@ -1260,7 +1508,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 						int index = XMLString::indexOf(ln, chColon);
 						if (index >= 0)
 							ln = &ln[index+1];
-						m_formatBuffer << (*mp_formatter << ln);
+						m_formatBuffer.sbUTF8In(ln);
 						toIns->sortString.sbStrcatIn(m_formatBuffer);
 
 						// Insert node
@@ -1292,12 +1540,12 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 			DOMNode * nsnode = m_nsStack.getFirstNamespace();
 			while (nsnode != NULL) {
 				// Get the name and value of the attribute
-				currentName << (*mp_formatter << nsnode->getNodeName());
-				currentValue << (*mp_formatter << nsnode->getNodeValue());
+				currentName.sbUTF8In(nsnode->getNodeName());
+				currentValue.sbUTF8In(nsnode->getNodeValue());
 
 				// Is this the default?
 				if (currentName.sbStrcmp("xmlns") == 0 &&
-					(!m_XPathSelection || m_XPathMap.hasNode(nsnode)) &&
+					namespaceInNodeSet(mp_nextNode, nsnode) &&
 					!currentValue.sbStrcmp("") == 0)
 					xmlnsFound = true;
 
@@ -1307,7 +1555,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 					// Add to the list
 					XSECNodeListElt *toIns;
 
-					m_formatBuffer << (*mp_formatter << nsnode->getNodeName());
+					m_formatBuffer.sbUTF8In(nsnode->getNodeName());
 					if (m_formatBuffer[5] == ':')
 						currentName.sbStrcpyIn((char *) &m_formatBuffer[6]);
 					else
@@ -1353,7 +1601,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 
 					while (next != NULL) {
 
-						if (!m_XPathSelection || m_useNamespaceStack || m_XPathMap.hasNode(next)) {
+						if (!m_XPathSelection || m_useNamespaceStack || mp_XPathMap->hasNode(next)) {
 
 							DOMNode *tmpAtt;
 
@@ -1366,7 +1614,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 									tmpAtts = nextAttParent->getAttributes();
 									if (tmpAtts != NULL)
 										tmpAtt = tmpAtts->getNamedItem(DSIGConstants::s_unicodeStrXmlns);
-									if (tmpAtts != NULL && tmpAtt != NULL && (!m_XPathSelection || m_useNamespaceStack || m_XPathMap.hasNode(tmpAtt))) {
+									if (tmpAtts != NULL && tmpAtt != NULL && (!m_XPathSelection || m_useNamespaceStack || mp_XPathMap->hasNode(tmpAtt))) {
 
 										// Check URI is the same
 										if (!strEquals(tmpAtt->getNodeValue(), "")) {
@@ -1405,7 +1653,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 
 				next = mp_nextNode->getParentNode();
 				while (!xmlnsFound && next != NULL) {
-					while (next != NULL && !m_useNamespaceStack && (m_XPathSelection && !m_XPathMap.hasNode(next)))
+					while (next != NULL && !m_useNamespaceStack && (m_XPathSelection && !mp_XPathMap->hasNode(next)))
 						next = next->getParentNode();
 
 					XMLSize_t size;
@@ -1419,11 +1667,11 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 
 					for (XMLSize_t i = 0; i < size; ++i) {
 
-						currentName << (*mp_formatter << tmpAtts->item(i)->getNodeName());
-						currentValue << (*mp_formatter << tmpAtts->item(i)->getNodeValue());
+						currentName.sbUTF8In(tmpAtts->item(i)->getNodeName());
+						currentValue.sbUTF8In(tmpAtts->item(i)->getNodeValue());
 
 						if ((currentName.sbStrcmp("xmlns") == 0) &&
-							(m_useNamespaceStack || !m_XPathSelection || m_XPathMap.hasNode(tmpAtts->item(i)))) {
+							(m_useNamespaceStack || !m_XPathSelection || mp_XPathMap->hasNode(tmpAtts->item(i)))) {
 							if (currentValue.sbStrcmp("") != 0) {
 								xmlnsFound = true;
 							}
@@ -1491,12 +1739,12 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 
 		if (mp_nextNode != 0) {
 
-			m_formatBuffer << (*mp_formatter << mp_nextNode->getNodeName());
+			m_formatBuffer.sbUTF8In(mp_nextNode->getNodeName());
 			m_buffer.sbStrcatIn(m_formatBuffer);
 
 			m_buffer.sbStrcatIn("=\"");
 
-			m_formatBuffer << (*mp_formatter << mp_nextNode->getNodeValue());
+			m_formatBuffer.sbUTF8In(mp_nextNode->getNodeValue());
 			sbWork = c14nCleanAttribute(m_formatBuffer);
 			m_buffer.sbStrcatIn(sbWork);
 
@@ -1538,7 +1786,7 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 		mp_nextNode = mp_attributeParent;
 
 		// End the element definition
-		if (!m_XPathSelection || (m_XPathMap.hasNode(mp_nextNode)))
+		if (!m_XPathSelection || (mp_XPathMap->hasNode(mp_nextNode)))
 			m_buffer.sbStrcatIn(">");
 
 		m_returnedFromChild = false;
@@ -1583,6 +1831,17 @@ XMLSize_t XSECC14n20010315::processNextNode() {
 		// Going down - so check for children nodes
 		next = mp_nextNode->getFirstChild();
 
+		// The children of the document element can be done in parallel.  Once
+		// the partitions have all been handed back we come back up to this
+		// node to close it off.
+		if (next != NULL && m_parallelThreads > 1 && mp_nextNode == mp_firstElementNode &&
+			mp_nextNode->getParentNode() == mp_doc && startPartitions(next)) {
+
+			m_returnedFromChild = true;
+			return m_bufferLength;
+
+		}
+
 		if (next != NULL)
 
 			mp_nextNode = next;
@@ -34,6 +34,7 @@
 
 //XSEC includes
 #include <xsec/framework/XSECDefs.hpp>
+#include <xsec/framework/XSECMemory.hpp>
 #include <xsec/utils/XSECSafeBuffer.hpp>
 #include <xsec/utils/XSECXPathNodeList.hpp>
 #include <xsec/canon/XSECCanon.hpp>
@@ -48,7 +49,8 @@
 XSEC_USING_XERCES(XMLFormatter);
 XSEC_USING_XERCES(XMLFormatTarget);
 
-class XSECSafeBufferFormatter;
+class XSECC14nPartitionTask;
+class XSECThreadPool;
 
 // --------------------------------------------------------------------------------
 //           Simple structure for holding a list of nodes
@@ -59,7 +61,7 @@ class XSECSafeBufferFormatter;
 // of Xerces (and use the "...impl" classes).  Such an approach might not be supported
 // in the future.
 
-struct XSECNodeListElt {
+struct XSECNodeListElt : public XSECMemory {
 
 	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode	*element;	// Element referred to
 	safeBuffer						sortString;	// The string that is used to sort the nodes
@@ -77,6 +79,12 @@ struct XSECNodeListElt {
 #define NOURI_PREFIX         "a"
 #define HAVEURI_PREFIX       "b"
 
+// Parallel processing of the document element's children
+
+#define XSECC14N_PARALLEL_MIN_CHILDREN		4	/* Don't bother below this */
+#define XSECC14N_PARTITIONS_PER_THREAD		8	/* Total partitions = threads * this */
+#define XSECC14N_PARTITION_WAVES			4	/* Partitions are run in this many batches */
+
 // --------------------------------------------------------------------------------
 //           XSECC14n20010315 Object definition
 // --------------------------------------------------------------------------------
@@ -84,9 +92,11 @@ struct XSECNodeListElt {
 class XSEC_EXPORT XSECC14n20010315 : public XSECCanon {
 
 #if defined(XALAN_NO_NAMESPACES)
-	typedef vector<char *>				CharListVectorType;
+	typedef vector<XMLCh *>				XMLChListVectorType;
+	typedef vector<XSECC14nPartitionTask *>	PartitionVectorType;
 #else
-	typedef std::vector<char *>			CharListVectorType;
+	typedef std::vector<XMLCh *>		XMLChListVectorType;
+	typedef std::vector<XSECC14nPartitionTask *>	PartitionVectorType;
 #endif
 
 #if defined(XALAN_SIZE_T_IN_NAMESPACE_STD)
@@ -123,6 +133,18 @@ public:
 
 	// Namespace processing
 	void setUseNamespaceStack(bool flag) {m_useNamespaceStack = flag;}
+	// When set (and the namespace stack is in use), a namespace node is taken
+	// to be in the XPath node-set whenever its element is.  This lets a node-set
+	// be canonicalised without first expanding namespaces into the DOM.
+	void setVirtualNamespaceNodes(bool flag) {m_virtualNamespaceNodes = flag;}
+
+	// Parallel processing
+	// When threads > 1, the children of the document element are split into
+	// partitions that are canonicalised concurrently and then handed back
+	// in document order.  Output is identical to the serial case.  The
+	// document must not be modified while the canonicaliser is running.
+	void setParallelProcessing(unsigned int threads) {m_parallelThreads = threads;}
+	unsigned int getParallelProcessing(void) const {return m_parallelThreads;}
 
 protected:
 
@@ -130,7 +152,7 @@ protected:
 	XMLSize_t processNextNode();
 
 	// Test whether a name space is in the non-exclusive list
-	bool inNonExclNSList(safeBuffer &ns);
+	bool inNonExclNSList(const XMLCh * prefix);
 
 private:
 
@@ -138,9 +160,21 @@ private:
 	bool checkRenderNameSpaceNode(XERCES_CPP_NAMESPACE_QUALIFIER DOMNode *e,
 								  XERCES_CPP_NAMESPACE_QUALIFIER DOMNode *a);
 	void stackInit(XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * n);
+	bool namespaceInNodeSet(XERCES_CPP_NAMESPACE_QUALIFIER DOMNode *e,
+							XERCES_CPP_NAMESPACE_QUALIFIER DOMNode *a) const;
+
+	// Parallel partition handling
+	friend class XSECC14nPartitionTask;
+	bool startPartitions(XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * firstChild);
+	void runPartitions(void);
+	XMLSize_t processNextPartition(void);
+	void clearPartitions(void);
+	void canonicalisePartition(XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * first,
+							   XMLSize_t count,
+							   safeBuffer & output,
+							   XMLSize_t & outputLength);
 
 	// For formatting the buffers
-	XSECSafeBufferFormatter		* mp_formatter;
 	safeBuffer					m_formatBuffer;
 
 	// For holding state whilst walking the DOM tree
@@ -155,12 +189,13 @@ private:
 	// For XPath evaluation
 	bool			  m_XPathSelection;				// Are we doing an XPath?
 	XSECXPathNodeList m_XPathMap;					// The elements in the XPath
+	const XSECXPathNodeList * mp_XPathMap;			// Map in use (may be shared by a partition)
 
 	// For comment processing
 	bool			m_processComments;				// Whether comments are in or out (in by default)
 
 	// For exclusive canonicalisation
-	CharListVectorType		m_exclNSList;
+	XMLChListVectorType		m_exclNSList;
 	bool					m_exclusive;
 	bool					m_exclusiveDefault;
 
@@ -173,8 +208,17 @@ private:
 	// has been run to select the input nodeset.  Otherwise we should be fine.
 
 	bool					m_useNamespaceStack;
+	bool					m_virtualNamespaceNodes;
 	XSECXMLNSStack			m_nsStack;
 
+	// Parallel processing of the document element's children
+	unsigned int			m_parallelThreads;
+	bool					m_partitioning;			// Currently handing back partitions?
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * mp_partitionNext;	// First child not yet partitioned
+	XMLSize_t				m_partitionSize;		// Children per partition
+	PartitionVectorType		m_partitions;			// Current batch of partitions
+	XMLSize_t				m_partitionIndex;		// Next partition to hand back
+	XSECThreadPool			* mp_partitionPool;		// Shared by every wave of this canonicalisation
 
 
 };
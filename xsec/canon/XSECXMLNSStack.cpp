@@ -34,7 +34,9 @@
 
 #include "../utils/XSECDOMUtils.hpp"
 
-// Xerces
+#include <xercesc/util/XMLString.hpp>
+
+#include <string.h>
 
 XERCES_CPP_NAMESPACE_USE
 
@@ -42,16 +44,31 @@ XERCES_CPP_NAMESPACE_USE
 //           Holder structures
 // --------------------------------------------------------------------------------
 
+typedef struct XSECNSPrefixStruct {
+
+	XMLCh									* mp_name;		// Attribute name (xmlns:foo)
+	unsigned int							m_hash;			// Hash of the name
+	struct XSECNSHolderStruct				* mp_binding;	// Declaration in scope
+	struct XSECNSPrefixStruct				* mp_next;		// Next in hash bucket
+
+} XSECNSPrefix;
+
 typedef struct XSECNSHolderStruct {
 
 	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode	* mp_ns;		// Actual NS attribute
 	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode	* mp_owner;		// Owner Element
+	struct XSECNSPrefixStruct				* mp_prefix;	// Interned name
 
 	struct XSECNSHolderStruct				* mp_hides;		// WHat does this NS hide?
 	struct XSECNSHolderStruct				* mp_next;		// Next in list
 
+	struct XSECNSHolderStruct				* mp_prevVisible;	// Visible list
+	struct XSECNSHolderStruct				* mp_nextVisible;
+
 	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode	* mp_printed;	// Node at which it was printed
+	struct XSECNSHolderStruct				* mp_nextPrinted;	// Next printed at same node
 
+	unsigned int							m_depth;		// Depth of owner on the stack
 	bool									m_isDefault;	// Is this a default NS?
 
 } XSECNSHolder;
@@ -59,96 +76,260 @@ typedef struct XSECNSHolderStruct {
 typedef struct XSECNSElementStruct {
 
 	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode	* mp_elt;		// Element
-	struct XSECNSHolderStruct				* mp_firstNS;	// WHat does this NS hide?
+	struct XSECNSHolderStruct				* mp_firstNS;	// NS declared by this element
+	struct XSECNSHolderStruct				* mp_firstPrinted;	// NS printed at this element
+	struct XSECNSElementStruct				* mp_parent;	// Next element down the stack
+	unsigned int							m_depth;		// Number of elements below this one
 
 } XSECNSElement;
 
+// --------------------------------------------------------------------------------
+//           Arena
+// --------------------------------------------------------------------------------
+
+// Size of each block handed out by the arena
+#define XSECNS_ARENA_BLOCK		4096
+
+class XSECNSArena {
+
+public:
+
+	XSECNSArena() : mp_blocks(NULL), mp_current(NULL), m_left(0) {}
+
+	~XSECNSArena() {
+
+		while (mp_blocks != NULL) {
+			Block * b = mp_blocks;
+			mp_blocks = b->mp_next;
+			delete[] (unsigned char *) b;
+		}
+
+	}
+
+	void * allocate(XMLSize_t size) {
+
+		// Keep everything pointer aligned
+		size = (size + sizeof(Block) - 1) & ~(sizeof(Block) - 1);
+
+		if (size > m_left) {
+
+			XMLSize_t blockSize = (size > XSECNS_ARENA_BLOCK ? size : XSECNS_ARENA_BLOCK);
+			unsigned char * raw;
+			XSECnew(raw, unsigned char[sizeof(Block) + blockSize]);
+
+			Block * b = (Block *) raw;
+			b->mp_next = mp_blocks;
+			mp_blocks = b;
+
+			mp_current = raw + sizeof(Block);
+			m_left = blockSize;
+
+		}
+
+		void * ret = mp_current;
+		mp_current += size;
+		m_left -= size;
+
+		return ret;
+
+	}
+
+private:
+
+	union Block {
+		Block		* mp_next;
+		double		m_align;
+	};
+
+	Block			* mp_blocks;
+	unsigned char	* mp_current;
+	XMLSize_t		m_left;
+
+};
+
 // --------------------------------------------------------------------------------
 //           Construct/Destruct
 // --------------------------------------------------------------------------------
 
 
-XSECXMLNSStack::XSECXMLNSStack() {
+XSECXMLNSStack::XSECXMLNSStack() :
+	mp_arena(NULL),
+	mp_elements(NULL),
+	mp_firstVisible(NULL),
+	mp_lastVisible(NULL),
+	mp_currentNS(NULL),
+	mp_ancestorNS(NULL),
+	mp_ancestorElt(NULL),
+	mp_freeHolders(NULL),
+	mp_freeElements(NULL) {
+
+	for (int i = 0; i < XSECNS_PREFIX_BUCKETS; ++i)
+		mp_prefixes[i] = NULL;
+
+	XSECnew(mp_arena, XSECNSArena);
 
 }
 
 XSECXMLNSStack::~XSECXMLNSStack() {
 
-	// Need to iterate through the Stack to 
-	XSECNSElement * t;
-	XSECNSHolder * u, *v;
-	
-	while (m_elements.size() > 0) {
-		t = m_elements.top();
-		u = t->mp_firstNS;
-		while (u != NULL) {
-			v = u->mp_next;
-			delete u;
-			u = v;
-		}
-		delete t;
-		m_elements.pop();
+	// Everything lives in the arena
+	delete mp_arena;
+
+}
+
+// --------------------------------------------------------------------------------
+//           Internal helpers
+// --------------------------------------------------------------------------------
+
+XSECNSPrefix * XSECXMLNSStack::findPrefix(const XMLCh * name, bool create) {
+
+	// FNV-1a over the UTF-16 code units
+	unsigned int hash = 2166136261U;
+	const XMLCh * c = name;
+	while (*c != 0) {
+		hash = (hash ^ (unsigned int) *c++) * 16777619U;
 	}
+
+	XSECNSPrefix * p = mp_prefixes[hash % XSECNS_PREFIX_BUCKETS];
+	while (p != NULL) {
+		if (p->m_hash == hash && XMLString::equals(p->mp_name, name))
+			return p;
+		p = p->mp_next;
+	}
+
+	if (!create)
+		return NULL;
+
+	XMLSize_t len = (XMLSize_t) (c - name) + 1;
+
+	p = (XSECNSPrefix *) mp_arena->allocate(sizeof(XSECNSPrefix));
+	p->mp_name = (XMLCh *) mp_arena->allocate(len * sizeof(XMLCh));
+	memcpy(p->mp_name, name, len * sizeof(XMLCh));
+	p->m_hash = hash;
+	p->mp_binding = NULL;
+	p->mp_next = mp_prefixes[hash % XSECNS_PREFIX_BUCKETS];
+	mp_prefixes[hash % XSECNS_PREFIX_BUCKETS] = p;
+
+	return p;
+
+}
+
+XSECNSHolder * XSECXMLNSStack::newHolder(void) {
+
+	XSECNSHolder * h = mp_freeHolders;
+
+	if (h != NULL)
+		mp_freeHolders = h->mp_next;
+	else
+		h = (XSECNSHolder *) mp_arena->allocate(sizeof(XSECNSHolder));
+
+	return h;
+
+}
+
+XSECNSElement * XSECXMLNSStack::newElement(void) {
+
+	XSECNSElement * e = mp_freeElements;
+
+	if (e != NULL)
+		mp_freeElements = e->mp_parent;
+	else
+		e = (XSECNSElement *) mp_arena->allocate(sizeof(XSECNSElement));
+
+	return e;
+
+}
+
+void XSECXMLNSStack::linkVisible(XSECNSHolder * h) {
+
+	h->mp_nextVisible = NULL;
+	h->mp_prevVisible = mp_lastVisible;
+
+	if (mp_lastVisible != NULL)
+		mp_lastVisible->mp_nextVisible = h;
+	else
+		mp_firstVisible = h;
+
+	mp_lastVisible = h;
+
 }
 
+void XSECXMLNSStack::unlinkVisible(XSECNSHolder * h) {
+
+	if (h->mp_prevVisible != NULL)
+		h->mp_prevVisible->mp_nextVisible = h->mp_nextVisible;
+	else
+		mp_firstVisible = h->mp_nextVisible;
+
+	if (h->mp_nextVisible != NULL)
+		h->mp_nextVisible->mp_prevVisible = h->mp_prevVisible;
+	else
+		mp_lastVisible = h->mp_prevVisible;
+
+	h->mp_prevVisible = h->mp_nextVisible = NULL;
+
+}
 
 // --------------------------------------------------------------------------------
 //           Stack Functions
 // --------------------------------------------------------------------------------
 void XSECXMLNSStack::pushElement(XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * elt) {
 
-	XSECNSElement * t;
-	XSECnew(t, XSECNSElement);
+	XSECNSElement * t = newElement();
 
 	t->mp_elt = elt;
 	t->mp_firstNS = NULL;
+	t->mp_firstPrinted = NULL;
+	t->mp_parent = mp_elements;
+	t->m_depth = (mp_elements != NULL ? mp_elements->m_depth + 1 : 0);
 
-	m_elements.push(t);
+	mp_elements = t;
 
 }
 
 void XSECXMLNSStack::popElement() {
 
-	// First - are there any namespaces to remove from the currently visible list?
+	XSECNSElement * e = mp_elements;
 	XSECNSHolder * t, *u;
-	XSECNSElement * e = m_elements.top();
 
-	// Iterate through the current namespaces vector
-	XSECNSHolderVectorType::iterator it = m_currentNS.begin();
-
-	while (it != m_currentNS.end()) {
-
-		t = *it;
-		if (t->mp_owner == e->mp_elt) {
-
-			// Need to delete this
-			m_currentNS.erase(it);
-			if (t->mp_hides != NULL) {
-				m_currentNS.push_back(t->mp_hides);
-			}
-			// TODO - Fix this, it is naieve and slow
-			it = m_currentNS.begin();
-
-		}
-		else {
-			if (t->mp_printed == e->mp_elt)
-				t->mp_printed = NULL;
-			it++;
-		}
+	if (e == NULL)
+		return;
 
+	// Anything printed at this element is no longer printed
+	t = e->mp_firstPrinted;
+	while (t != NULL) {
+		u = t->mp_nextPrinted;
+		if (t->mp_printed == e->mp_elt)
+			t->mp_printed = NULL;
+		t->mp_nextPrinted = NULL;
+		t = u;
 	}
 
-	// OK - Now we delete the NS nodes
+	// Remove this element's namespaces and re-expose what they hid
 	t = e->mp_firstNS;
 	while (t != NULL) {
+
 		u = t->mp_next;
-		delete t;
+
+		unlinkVisible(t);
+		t->mp_prefix->mp_binding = t->mp_hides;
+		if (t->mp_hides != NULL)
+			linkVisible(t->mp_hides);
+
+		t->mp_next = mp_freeHolders;
+		mp_freeHolders = t;
+
 		t = u;
+
 	}
 
-	// Now delete the element holder itself
-	m_elements.pop();
-	delete e;
+	// Make sure no cursor is left pointing at a recycled holder
+	mp_currentNS = NULL;
+	mp_ancestorNS = NULL;
+
+	mp_elements = e->mp_parent;
+	e->mp_parent = mp_freeElements;
+	mp_freeElements = e;
 
 }
 
@@ -159,59 +340,63 @@ void XSECXMLNSStack::popElement() {
 
 void XSECXMLNSStack::addNamespace(XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * ns) {
 
+	if (mp_elements == NULL) {
+		throw XSECException(XSECException::InternalError,
+			"XSECXMLNSStack::addNamespace - no element on the stack");
+	}
+
 	// Create the new entry for this node
-	XSECNSHolder * t, *u;
-	XSECnew(t, XSECNSHolder);
+	XSECNSPrefix * p = findPrefix(ns->getNodeName(), true);
+	XSECNSHolder * t = newHolder();
 
-	t->mp_hides = NULL;
-	t->mp_next = NULL;
 	t->mp_ns = ns;
-	t->mp_owner = (m_elements.top())->mp_elt;
+	t->mp_owner = mp_elements->mp_elt;
+	t->mp_prefix = p;
 	t->mp_printed = NULL;
-
+	t->mp_nextPrinted = NULL;
+	t->m_depth = mp_elements->m_depth;
 	t->m_isDefault = strEquals(ns->getNodeName(), DSIGConstants::s_unicodeStrXmlns);
 
 	// Does this hide something in the current namespace list?
-	XSECNSHolderVectorType::iterator it = m_currentNS.begin();
-
-	while (it != m_currentNS.end()) {
-		u = (*it);
-		if (strEquals(u->mp_ns->getNodeName(), ns->getNodeName())) {
+	t->mp_hides = p->mp_binding;
+	if (t->mp_hides != NULL)
+		unlinkVisible(t->mp_hides);
 
-			// This hides a current NS entry
-			t->mp_hides = u;
-			m_currentNS.erase(it);
-			it = m_currentNS.end();
-		}
-		else
-			it++;
-	}
-
-	// Now push it onto the namespace vector
-	m_currentNS.push_back(t);
+	// Now make it the visible binding for this name
+	p->mp_binding = t;
+	linkVisible(t);
 
 	// Add me to the current element's namespaces
-	XSECNSElement * e = m_elements.top();
-	
-	t->mp_next = e->mp_firstNS;
-	e->mp_firstNS = t;
+	t->mp_next = mp_elements->mp_firstNS;
+	mp_elements->mp_firstNS = t;
 
 }
 
 void XSECXMLNSStack::printNamespace(DOMNode * ns, DOMNode * elt) {
 
-	XSECNSHolder * t;
-	XSECNSHolderVectorType::iterator it = m_currentNS.begin();
+	XSECNSPrefix * p = findPrefix(ns->getNodeName(), false);
 
-	while (it != m_currentNS.end()) {
-		t = (*it);
-		// Fix for bug#47353, go ahead and track printing of default namespaces.
-		if (t->mp_ns == ns) { //  && t->m_isDefault == false) {
-			t->mp_printed = elt;
-			break;
-		}
-		it++;
+	// Fix for bug#47353, go ahead and track printing of default namespaces.
+	if (p == NULL || p->mp_binding == NULL || p->mp_binding->mp_ns != ns)
+		return;
+
+	// Already printed by an output ancestor (or this element)
+	XSECNSHolder * t = p->mp_binding;
+	if (t->mp_printed != NULL)
+		return;
+
+	t->mp_printed = elt;
+
+	// Remember it against the element so it can be cleared on pop
+	XSECNSElement * e = mp_elements;
+	while (e != NULL && e->mp_elt != elt)
+		e = e->mp_parent;
+
+	if (e != NULL) {
+		t->mp_nextPrinted = e->mp_firstPrinted;
+		e->mp_firstPrinted = t;
 	}
+
 }
 
 // --------------------------------------------------------------------------------
@@ -220,42 +405,105 @@ void XSECXMLNSStack::printNamespace(DOMNode * ns, DOMNode * elt) {
 
 DOMNode * XSECXMLNSStack::getFirstNamespace(void) {
 
-	m_currentNSIterator = m_currentNS.begin();
+	mp_currentNS = mp_firstVisible;
 
-	while (m_currentNSIterator != m_currentNS.end() && 
-		(*m_currentNSIterator)->mp_printed != NULL)
-		m_currentNSIterator++;
+	while (mp_currentNS != NULL && mp_currentNS->mp_printed != NULL)
+		mp_currentNS = mp_currentNS->mp_nextVisible;
 
-	if (m_currentNSIterator != m_currentNS.end())
-		return (*m_currentNSIterator)->mp_ns;
+	if (mp_currentNS != NULL)
+		return mp_currentNS->mp_ns;
 
 	return NULL;
 
 }
 
 DOMNode * XSECXMLNSStack::getNextNamespace(void) {
-	if (m_currentNSIterator == m_currentNS.end()) 
+
+	if (mp_currentNS == NULL) 
 		return NULL;
-	m_currentNSIterator++;
-	while (m_currentNSIterator != m_currentNS.end() && 
-		(*m_currentNSIterator)->mp_printed != NULL)
-		m_currentNSIterator++;
 
-	if (m_currentNSIterator == m_currentNS.end()) 
+	mp_currentNS = mp_currentNS->mp_nextVisible;
+	while (mp_currentNS != NULL && mp_currentNS->mp_printed != NULL)
+		mp_currentNS = mp_currentNS->mp_nextVisible;
+
+	if (mp_currentNS == NULL) 
 		return NULL;
 
-	return (*m_currentNSIterator)->mp_ns;
+	return mp_currentNS->mp_ns;
 
 }
 
 // Fix for bug#47353, explicit check for non-empty default NS decl.
 bool XSECXMLNSStack::isNonEmptyDefaultNS(void) {
-    for (XSECNSHolderVectorType::iterator it = m_currentNS.begin(); it != m_currentNS.end(); ++it) {
-        if ((*it)->m_isDefault) {
-            const XMLCh* val = (*it)->mp_ns->getNodeValue();
-            if (val && *val)
-                return true;
-        }
-    }
-    return false;
+
+	XSECNSPrefix * p = findPrefix(DSIGConstants::s_unicodeStrXmlns, false);
+
+	if (p != NULL && p->mp_binding != NULL) {
+		const XMLCh* val = p->mp_binding->mp_ns->getNodeValue();
+		if (val && *val)
+			return true;
+	}
+
+	return false;
+
+}
+
+DOMNode * XSECXMLNSStack::getInScopeNamespace(const XMLCh * name, DOMNode * elt) {
+
+	// Find how far down the stack the element is
+	XSECNSElement * e = mp_elements;
+	while (e != NULL && e->mp_elt != elt)
+		e = e->mp_parent;
+
+	if (e == NULL)
+		return NULL;
+
+	// Skip anything declared by descendants of the element
+	XSECNSPrefix * p = findPrefix(name, false);
+	XSECNSHolder * h = (p != NULL ? p->mp_binding : NULL);
+	while (h != NULL && h->m_depth > e->m_depth)
+		h = h->mp_hides;
+
+	return (h != NULL ? h->mp_ns : NULL);
+
+}
+
+DOMNode * XSECXMLNSStack::getFirstAncestorNamespace(DOMNode * ns, DOMNode * elt, DOMNode ** owner) {
+
+	XSECNSPrefix * p = findPrefix(ns->getNodeName(), false);
+
+	mp_ancestorNS = (p != NULL ? p->mp_binding : NULL);
+	mp_ancestorElt = elt;
+
+	// Skip anything declared on the element itself
+	while (mp_ancestorNS != NULL && mp_ancestorNS->mp_owner == elt)
+		mp_ancestorNS = mp_ancestorNS->mp_hides;
+
+	if (mp_ancestorNS == NULL)
+		return NULL;
+
+	if (owner != NULL)
+		*owner = mp_ancestorNS->mp_owner;
+
+	return mp_ancestorNS->mp_ns;
+
+}
+
+DOMNode * XSECXMLNSStack::getNextAncestorNamespace(DOMNode ** owner) {
+
+	if (mp_ancestorNS == NULL)
+		return NULL;
+
+	mp_ancestorNS = mp_ancestorNS->mp_hides;
+	while (mp_ancestorNS != NULL && mp_ancestorNS->mp_owner == mp_ancestorElt)
+		mp_ancestorNS = mp_ancestorNS->mp_hides;
+
+	if (mp_ancestorNS == NULL)
+		return NULL;
+
+	if (owner != NULL)
+		*owner = mp_ancestorNS->mp_owner;
+
+	return mp_ancestorNS->mp_ns;
+
 }
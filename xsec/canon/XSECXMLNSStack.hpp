@@ -36,34 +36,39 @@
 
 XSEC_DECLARE_XERCES_CLASS(DOMNode)
 
-// General
-
-#include <vector>
-#include <stack>
-
 // --------------------------------------------------------------------------------
 //           Holder structures
 // --------------------------------------------------------------------------------
 
 struct XSECNSHolderStruct;
 struct XSECNSElementStruct;
+struct XSECNSPrefixStruct;
 
 typedef struct XSECNSHolderStruct XSECNSHolder;
 typedef struct XSECNSElementStruct XSECNSElement;
+typedef struct XSECNSPrefixStruct XSECNSPrefix;
+
+class XSECNSArena;
 
-#if defined(XSEC_NO_NAMESPACES)
-	typedef vector<XSECNSHolder *>				XSECNSHolderVectorType;
-	typedef stack<XSECNSElement *>              XSECNSElementStackType;
-#else
-	typedef std::vector<XSECNSHolder *>			XSECNSHolderVectorType;
-	typedef std::stack<XSECNSElement *>         XSECNSElementStackType;
-#endif
+// Number of hash buckets used to intern namespace attribute names
+#define XSECNS_PREFIX_BUCKETS	64
 
 
 // --------------------------------------------------------------------------------
 //           The stack
 // --------------------------------------------------------------------------------
 
+/*
+ * Each distinct namespace attribute name ("xmlns", "xmlns:foo") is interned
+ * once, and the interned entry points at the declaration currently in scope.
+ * A new declaration simply links to the one it hides, so pushing and popping
+ * an element never copies the visible set, and finding the in-scope binding
+ * for a prefix is a single hash lookup.
+ *
+ * All holders, element records and interned names are carved out of an arena
+ * owned by the stack and recycled as elements are popped, so a full
+ * canonicalisation does no per-element heap allocation once warmed up.
+ */
 
 class XSECXMLNSStack {
 
@@ -88,15 +93,51 @@ public:
 	// Return whether the stack includes xmlns="something"
 	bool isNonEmptyDefaultNS(void);
 
+	// Return the declaration of a name that was in scope at an element still
+	// on the stack
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode *
+		getInScopeNamespace(const XMLCh * name,
+			XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * elt);
+
+	// Walk the declarations of the same name as ns made by ancestors of elt,
+	// nearest first.  owner is set to the declaring element
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode *
+		getFirstAncestorNamespace(XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * ns,
+			XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * elt,
+			XERCES_CPP_NAMESPACE_QUALIFIER DOMNode ** owner);
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode *
+		getNextAncestorNamespace(XERCES_CPP_NAMESPACE_QUALIFIER DOMNode ** owner);
+
 private:
 
-	// The stack holds all the elements, with a linked list of NS nodes
-	// THat were pushed in for each element
-	XSECNSElementStackType m_elements;
-	// The vector holds all the "currently visible" namespaces for this element
-	XSECNSHolderVectorType m_currentNS;
-	// Hold a pointer into the visible namespace list for the current element
-	XSECNSHolderVectorType::iterator m_currentNSIterator;
+	XSECNSPrefix * findPrefix(const XMLCh * name, bool create);
+	XSECNSHolder * newHolder(void);
+	XSECNSElement * newElement(void);
+	void linkVisible(XSECNSHolder * h);
+	void unlinkVisible(XSECNSHolder * h);
+
+	// Backing store for everything below
+	XSECNSArena				* mp_arena;
+
+	// Top of the element stack (each element links to its parent)
+	XSECNSElement			* mp_elements;
+	// Interned namespace attribute names
+	XSECNSPrefix			* mp_prefixes[XSECNS_PREFIX_BUCKETS];
+	// The "currently visible" namespaces, as a list in declaration order
+	XSECNSHolder			* mp_firstVisible;
+	XSECNSHolder			* mp_lastVisible;
+	// Iteration cursors
+	XSECNSHolder			* mp_currentNS;
+	XSECNSHolder			* mp_ancestorNS;
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode
+							* mp_ancestorElt;
+	// Recycled records
+	XSECNSHolder			* mp_freeHolders;
+	XSECNSElement			* mp_freeElements;
+
+	// Unimplemented
+	XSECXMLNSStack(const XSECXMLNSStack &);
+	XSECXMLNSStack & operator = (const XSECXMLNSStack &);
 
 };
 
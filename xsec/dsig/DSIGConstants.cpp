@@ -124,6 +124,8 @@ const XMLCh * DSIGConstants::s_unicodeStrURIKW_AES256_PAD;
 const XMLCh * DSIGConstants::s_unicodeStrURIRSA_1_5;
 const XMLCh * DSIGConstants::s_unicodeStrURIRSA_OAEP_MGFP1;
 const XMLCh * DSIGConstants::s_unicodeStrURIRSA_OAEP;
+const XMLCh * DSIGConstants::s_unicodeStrURIECDH_ES;
+const XMLCh * DSIGConstants::s_unicodeStrURICONCAT_KDF;
 
 const XMLCh * DSIGConstants::s_unicodeStrURIMGF1_BASE;
 const XMLCh * DSIGConstants::s_unicodeStrURIMGF1_SHA1;
@@ -225,6 +227,8 @@ void DSIGConstants::create() {
 	s_unicodeStrURIRSA_1_5 = XMLString::transcode(URI_ID_RSA_1_5);
 	s_unicodeStrURIRSA_OAEP_MGFP1 = XMLString::transcode(URI_ID_RSA_OAEP_MGFP1);
 	s_unicodeStrURIRSA_OAEP = XMLString::transcode(URI_ID_RSA_OAEP);
+	s_unicodeStrURIECDH_ES = XMLString::transcode(URI_ID_ECDH_ES);
+	s_unicodeStrURICONCAT_KDF = XMLString::transcode(URI_ID_CONCAT_KDF);
 
 	s_unicodeStrURIMGF1_BASE = XMLString::transcode(URI_ID_MGF1_BASE);
 	s_unicodeStrURIMGF1_SHA1 = XMLString::transcode(URI_ID_MGF1_SHA1);
@@ -318,6 +322,8 @@ void DSIGConstants::destroy() {
 	XSEC_RELEASE_XMLCH(s_unicodeStrURIRSA_1_5);
 	XSEC_RELEASE_XMLCH(s_unicodeStrURIRSA_OAEP_MGFP1);
 	XSEC_RELEASE_XMLCH(s_unicodeStrURIRSA_OAEP);
+	XSEC_RELEASE_XMLCH(s_unicodeStrURIECDH_ES);
+	XSEC_RELEASE_XMLCH(s_unicodeStrURICONCAT_KDF);
 
 	XSEC_RELEASE_XMLCH(s_unicodeStrURIMGF1_BASE);
 	XSEC_RELEASE_XMLCH(s_unicodeStrURIMGF1_SHA1);
@@ -82,6 +82,10 @@ XSEC_USING_XERCES(XMLString);
 #define URI_ID_RSA_OAEP_MGFP1    "http://www.w3.org/2001/04/xmlenc#rsa-oaep-mgf1p"
 #define URI_ID_RSA_OAEP          "http://www.w3.org/2009/xmlenc11#rsa-oaep"
 
+// Key Agreement and Key Derivation algorithms
+#define URI_ID_ECDH_ES           "http://www.w3.org/2009/xmlenc11#ECDH-ES"
+#define URI_ID_CONCAT_KDF        "http://www.w3.org/2009/xmlenc11#ConcatKDF"
+
 // OAEP MGFs
 #define URI_ID_MGF1_BASE        "http://www.w3.org/2009/xmlenc11#mgf1"
 #define URI_ID_MGF1_SHA1        "http://www.w3.org/2009/xmlenc11#mgf1sha1"
@@ -249,6 +253,8 @@ public:
     static const XMLCh * s_unicodeStrURIRSA_1_5;
     static const XMLCh * s_unicodeStrURIRSA_OAEP_MGFP1;
     static const XMLCh * s_unicodeStrURIRSA_OAEP;
+    static const XMLCh * s_unicodeStrURIECDH_ES;
+    static const XMLCh * s_unicodeStrURICONCAT_KDF;
 
     static const XMLCh * s_unicodeStrURIMGF1_BASE;
     static const XMLCh * s_unicodeStrURIMGF1_SHA1;
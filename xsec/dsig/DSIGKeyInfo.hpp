@@ -84,7 +84,8 @@ public:
 		KEYINFO_MGMTDATA		= 8,			// Management data
 		KEYINFO_ENCRYPTEDKEY	= 9, 			// XML Encryption - Encrypted Key
         KEYINFO_VALUE_EC        = 10,           // ECC Key
-        KEYINFO_DERENCODED      = 11            // DER-Encoded Key
+        KEYINFO_DERENCODED      = 11,           // DER-Encoded Key
+        KEYINFO_AGREEMENTMETHOD = 12            // XML Encryption - Key Agreement
 	};
 
 public:
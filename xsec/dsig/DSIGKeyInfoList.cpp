@@ -48,8 +48,10 @@
 
 #include "../utils/XSECDOMUtils.hpp"
 #include "../xenc/impl/XENCEncryptedKeyImpl.hpp"
+#include "../xenc/impl/XENCAgreementMethodImpl.hpp"
 
 #include <xercesc/util/Janitor.hpp>
+#include <xercesc/util/XMLUniDefs.hpp>
 
 XERCES_CPP_NAMESPACE_USE
 
@@ -114,6 +116,7 @@ void DSIGKeyInfoList::empty() {
 		delete m_keyInfoList[i];
 
 	m_keyInfoList.clear();
+	mp_keyInfoNode = NULL;
 
 }
 
@@ -135,54 +138,81 @@ bool DSIGKeyInfoList::addXMLKeyInfo(DOMNode *ki) {
 	if (ki == 0)
 		return false;
 
-	DSIGKeyInfo * k;
+	DSIGKeyInfo * k = NULL;
 
-	if (strEquals(getDSIGLocalName(ki), "X509Data")) {
+	// Classify the namespace once, then dispatch on the local name
 
-		// Have a certificate!
-		XSECnew(k, DSIGKeyInfoX509(mp_env, ki));
-	}
+	const XMLCh * name = ki->getLocalName();
 
-	else if (strEquals(getDSIGLocalName(ki), "KeyName")) {
+	switch (mp_env->getNamespaceType(ki)) {
 
-		XSECnew(k, DSIGKeyInfoName(mp_env, ki));
-	}
+	case XSEC_NS_DSIG :
 
-	else if (strEquals(getDSIGLocalName(ki), "KeyValue")) {
+		if (name == NULL)
+			break;
 
-		XSECnew(k, DSIGKeyInfoValue(mp_env, ki));
-	}
+		switch (name[0]) {
 
-	else if (strEquals(getDSIGLocalName(ki), "PGPData")) {
+		case chLatin_X :
+			if (strEquals(name, "X509Data")) {
+				XSECnew(k, DSIGKeyInfoX509(mp_env, ki));
+			}
+			break;
 
-		XSECnew(k, DSIGKeyInfoPGPData(mp_env, ki));
-	}
+		case chLatin_K :
+			if (strEquals(name, "KeyName")) {
+				XSECnew(k, DSIGKeyInfoName(mp_env, ki));
+			} else if (strEquals(name, "KeyValue")) {
+				XSECnew(k, DSIGKeyInfoValue(mp_env, ki));
+			}
+			break;
 
-	else if (strEquals(getDSIGLocalName(ki), "SPKIData")) {
+		case chLatin_P :
+			if (strEquals(name, "PGPData")) {
+				XSECnew(k, DSIGKeyInfoPGPData(mp_env, ki));
+			}
+			break;
 
-		XSECnew(k, DSIGKeyInfoSPKIData(mp_env, ki));
+		case chLatin_S :
+			if (strEquals(name, "SPKIData")) {
+				XSECnew(k, DSIGKeyInfoSPKIData(mp_env, ki));
+			}
+			break;
 
-	}
+		case chLatin_M :
+			if (strEquals(name, "MgmtData")) {
+				XSECnew(k, DSIGKeyInfoMgmtData(mp_env, ki));
+			}
+			break;
 
-	else if (strEquals(getDSIGLocalName(ki), "MgmtData")) {
+		default :
+			break;
 
-		XSECnew(k, DSIGKeyInfoMgmtData(mp_env, ki));
+		}
+		break;
 
-	}
-    
-    else if (strEquals(getDSIG11LocalName(ki), "DEREncodedKeyValue")) {
+	case XSEC_NS_DSIG11 :
 
-		XSECnew(k, DSIGKeyInfoDEREncoded(mp_env, ki));
+		if (strEquals(name, "DEREncodedKeyValue")) {
+			XSECnew(k, DSIGKeyInfoDEREncoded(mp_env, ki));
+		}
+		break;
 
-	}
+	case XSEC_NS_XENC :
 
-	else if (strEquals(getXENCLocalName(ki), "EncryptedKey")) {
+		if (strEquals(name, "EncryptedKey")) {
+			XSECnew(k, XENCEncryptedKeyImpl(mp_env, (DOMElement *) ki));
+		} else if (strEquals(name, "AgreementMethod")) {
+			XSECnew(k, XENCAgreementMethodImpl(mp_env, (DOMElement *) ki));
+		}
+		break;
 
-		XSECnew(k, XENCEncryptedKeyImpl(mp_env, (DOMElement *) ki));
+	default :
+		break;
 
 	}
 
-	else {
+	if (k == NULL) {
 
 	    XSECnew(k, DSIGKeyInfoExt(mp_env, ki));
 
@@ -212,7 +242,7 @@ bool DSIGKeyInfoList::addXMLKeyInfo(DOMNode *ki) {
 
 bool DSIGKeyInfoList::loadListFromXML(DOMNode * node) {
 
-	if (node == NULL || !strEquals(getDSIGLocalName(node), "KeyInfo")) {
+	if (node == NULL || !strEquals(mp_env->getLocalName(node, XSEC_NS_DSIG), "KeyInfo")) {
 		throw XSECException(XSECException::ExpectedDSIGChildNotFound,
 			"DSIGKeyInfoList::loadListFromXML - expected KeyInfo node");
 	}
@@ -223,7 +253,7 @@ bool DSIGKeyInfoList::loadListFromXML(DOMNode * node) {
 
 		// Find out what kind of KeyInfo child it is
 
-		if (tmpKI != 0 && strEquals(getDSIGLocalName(tmpKI), "RetrievalMethod")) {
+		if (tmpKI != 0 && strEquals(mp_env->getLocalName(tmpKI, XSEC_NS_DSIG), "RetrievalMethod")) {
 
 			// A reference to key information held elsewhere
 
@@ -306,7 +336,7 @@ bool DSIGKeyInfoList::loadListFromXML(DOMNode * node) {
 					// Skip text and comments
 				    tmpTran = tmpTran->getNextSibling();
 
-				if (tmpTran != 0 && strEquals(getDSIGLocalName(tmpTran), "Transforms")) {
+				if (tmpTran != 0 && strEquals(mp_env->getLocalName(tmpTran, XSEC_NS_DSIG), "Transforms")) {
 
 
 					// Process the transforms using the static function.
@@ -315,7 +345,7 @@ bool DSIGKeyInfoList::loadListFromXML(DOMNode * node) {
 
 					DSIGTransformList * l = DSIGReference::loadTransforms(
 					    tmpTran,
-						mp_env->getSBFormatter(),
+						NULL,
 						mp_env);
 
 					DSIGTransformList::TransformListVectorType::size_type size, i;
@@ -54,6 +54,8 @@
 #include <xsec/framework/XSECEnv.hpp>
 #include <xsec/framework/XSECAlgorithmHandler.hpp>
 #include <xsec/framework/XSECAlgorithmMapper.hpp>
+#include <xsec/framework/XSECMetrics.hpp>
+#include <xsec/framework/XSECTrace.hpp>
 #include <xsec/utils/XSECPlatformUtils.hpp>
 #include <xsec/utils/XSECBinTXFMInputStream.hpp>
 
@@ -109,7 +111,6 @@ static const XMLCh s_unicodeStrRootNode[] =
 
 
 DSIGReference::DSIGReference(const XSECEnv * env, DOMNode *dom) :
-    mp_formatter(NULL),
     mp_referenceNode(dom),
     mp_preHash(NULL),
     mp_manifestList(NULL),
@@ -120,16 +121,16 @@ DSIGReference::DSIGReference(const XSECEnv * env, DOMNode *dom) :
     mp_env(env),
     mp_transformList(NULL),
     mp_algorithmURI(NULL),
-    m_loaded(false) {
+    m_loaded(false),
+    m_hashSequence(0),
+    mp_hashedTarget(NULL),
+    m_transformsFingerprint(0) {
 
     // Should throw an exception if the node is not a REFERENCE element
 
-    XSECnew(mp_formatter, XSECSafeBufferFormatter("UTF-8",XMLFormatter::NoEscapes,
-                                                XMLFormatter::UnRep_CharRef));
 }
 
 DSIGReference::DSIGReference(const XSECEnv * env) :
-    mp_formatter(NULL),
     mp_referenceNode(NULL),
     mp_preHash(NULL),
     mp_manifestList(NULL),
@@ -140,10 +141,11 @@ DSIGReference::DSIGReference(const XSECEnv * env) :
     mp_env(env),
     mp_transformList(NULL),
     mp_algorithmURI(NULL),
-    m_loaded(false) {
+    m_loaded(false),
+    m_hashSequence(0),
+    mp_hashedTarget(NULL),
+    m_transformsFingerprint(0) {
 
-    XSECnew(mp_formatter, XSECSafeBufferFormatter("UTF-8",XMLFormatter::NoEscapes,
-                                            XMLFormatter::UnRep_CharRef));
 };
 
 DSIGReference::~DSIGReference() {
@@ -157,9 +159,6 @@ DSIGReference::~DSIGReference() {
 
     }
 
-    if (mp_formatter != NULL)
-        delete mp_formatter;
-
     if (mp_manifestList != NULL)
         delete mp_manifestList;
 
@@ -203,6 +202,9 @@ void DSIGReference::addTransform(DSIGTransform * txfm, DOMElement * txfmElt) {
     mp_env->doPrettyPrint(mp_transformsNode);
 
     mp_transformList->addTransform(txfm);
+
+    // The digest no longer matches the transforms
+    m_hashSequence = 0;
 }
 
 
@@ -423,6 +425,10 @@ const XMLCh * DSIGReference::getURI() const {
 
 DSIGReferenceList * DSIGReference::getManifestReferenceList() const {
 
+    // Deferred by load()
+    if (m_isManifest && m_loaded && mp_manifestList == NULL)
+        loadManifest();
+
     return mp_manifestList;
 
 }
@@ -558,7 +564,7 @@ void DSIGReference::load(void) {
         for (XMLSize_t i = 0; i < size; ++i) {
 
             name = atts->item(i)->getNodeName();
-            sbName << (*mp_formatter << atts->item(i)->getNodeName());
+            sbName.sbUTF8In(atts->item(i)->getNodeName());
 
             if (strEquals(name, s_unicodeStrURI)) {
                 mp_URI = atts->item(i)->getNodeValue();
@@ -619,13 +625,13 @@ void DSIGReference::load(void) {
 
     }
 
-    if (strEquals(getDSIGLocalName(tmpElt), "Transforms")) {
+    if (strEquals(mp_env->getLocalName(tmpElt, XSEC_NS_DSIG), "Transforms")) {
 
         // Store node for later use
         mp_transformsNode = tmpElt;
 
         // Load the transforms
-        mp_transformList = loadTransforms(tmpElt, mp_formatter, mp_env);
+        mp_transformList = loadTransforms(tmpElt, NULL, mp_env);
 
         // Find next node
         tmpElt = tmpElt->getNextSibling();
@@ -644,7 +650,7 @@ void DSIGReference::load(void) {
     }
 
 
-    if (tmpElt == NULL || !strEquals(getDSIGLocalName(tmpElt), "DigestMethod")) {
+    if (tmpElt == NULL || !strEquals(mp_env->getLocalName(tmpElt, XSEC_NS_DSIG), "DigestMethod")) {
 
         throw XSECException(XSECException::ExpectedDSIGChildNotFound,
                             "Expected <DigestMethod> element");
@@ -674,7 +680,7 @@ void DSIGReference::load(void) {
     tmpElt = tmpElt->getNextSibling();
 
     while (tmpElt != 0 &&
-        (tmpElt->getNodeType() != DOMNode::ELEMENT_NODE || !strEquals(getDSIGLocalName(tmpElt), "DigestValue"))) {
+        (tmpElt->getNodeType() != DOMNode::ELEMENT_NODE || !strEquals(mp_env->getLocalName(tmpElt, XSEC_NS_DSIG), "DigestValue"))) {
         if (tmpElt->getNodeType() == DOMNode::ENTITY_REFERENCE_NODE) {
             throw XSECException(XSECException::ExpectedDSIGChildNotFound,
                 "EntityReference nodes in <Reference> are unsupported.");
@@ -693,67 +699,105 @@ void DSIGReference::load(void) {
 
     // If we are a manifest, then we need to load the manifest references
 
-    if (m_isManifest) {
+    if (m_isManifest && !mp_env->getLazyLoadFlag())
+        loadManifest();
 
-        // Find the manifest node - we cheat and use a transform
-        TXFMBase                * docObject;
-        DOMNode                    * manifestNode, * referenceNode;
+    m_loaded = true;
 
-        docObject = getURIBaseTXFM(mp_referenceNode->getOwnerDocument(), mp_URI,
-            mp_env);
+}
 
-        manifestNode = docObject->getFragmentNode();
-        delete docObject;
+// --------------------------------------------------------------------------------
+//           loadManifest
+// --------------------------------------------------------------------------------
 
-        // Now search downwards to find a <Manifest>
-        if (manifestNode == 0 || manifestNode->getNodeType() != DOMNode::ELEMENT_NODE ||
-            (!strEquals(getDSIGLocalName(manifestNode), "Object") && !strEquals(getDSIGLocalName(manifestNode), "Manifest"))) {
+DOMNode * DSIGReference::findManifestReference(void) const {
 
-            throw XSECException(XSECException::ExpectedDSIGChildNotFound,
-                "Expected <Manifest> or <Object> URI for Manifest Type <Reference>");
+    // Find the manifest node - we cheat and use a transform
+    TXFMBase                * docObject;
+    DOMNode                    * manifestNode, * referenceNode;
 
-        }
+    docObject = getURIBaseTXFM(mp_referenceNode->getOwnerDocument(), mp_URI,
+        mp_env);
 
-        if (strEquals(getDSIGLocalName(manifestNode), "Object")) {
+    manifestNode = docObject->getFragmentNode();
+    delete docObject;
 
-            // Find Manifest child
-            manifestNode = manifestNode->getFirstChild();
-            while (manifestNode != 0 && manifestNode->getNodeType() != DOMNode::ELEMENT_NODE) {
-                if (manifestNode->getNodeType() == DOMNode::ENTITY_REFERENCE_NODE) {
-                    throw XSECException(XSECException::ExpectedDSIGChildNotFound,
-                        "EntityReference nodes in <Reference> are unsupported.");
-                }
-                manifestNode = manifestNode->getNextSibling();
-            }
+    // Now search downwards to find a <Manifest>
+    if (manifestNode == 0 || manifestNode->getNodeType() != DOMNode::ELEMENT_NODE ||
+        (!strEquals(mp_env->getLocalName(manifestNode, XSEC_NS_DSIG), "Object") && !strEquals(mp_env->getLocalName(manifestNode, XSEC_NS_DSIG), "Manifest"))) {
 
-            if (manifestNode == 0 || !strEquals(getDSIGLocalName(manifestNode), "Manifest"))
-                throw XSECException(XSECException::ExpectedDSIGChildNotFound,
-                "Expected <Manifest> as child of <Object> for Manifest Type <Reference>");
+        throw XSECException(XSECException::ExpectedDSIGChildNotFound,
+            "Expected <Manifest> or <Object> URI for Manifest Type <Reference>");
 
-        }
+    }
 
-        // Now have the manifest node, find the first reference and load!
-        referenceNode = manifestNode->getFirstChild();
+    if (strEquals(mp_env->getLocalName(manifestNode, XSEC_NS_DSIG), "Object")) {
 
-        while (referenceNode != 0 &&
-            (referenceNode->getNodeType() != DOMNode::ELEMENT_NODE || !strEquals(getDSIGLocalName(referenceNode), "Reference"))) {
-            if (referenceNode->getNodeType() == DOMNode::ENTITY_REFERENCE_NODE) {
+        // Find Manifest child
+        manifestNode = manifestNode->getFirstChild();
+        while (manifestNode != 0 && manifestNode->getNodeType() != DOMNode::ELEMENT_NODE) {
+            if (manifestNode->getNodeType() == DOMNode::ENTITY_REFERENCE_NODE) {
                 throw XSECException(XSECException::ExpectedDSIGChildNotFound,
                     "EntityReference nodes in <Reference> are unsupported.");
             }
-            referenceNode = referenceNode->getNextSibling();
+            manifestNode = manifestNode->getNextSibling();
         }
 
-        if (referenceNode == 0)
+        if (manifestNode == 0 || !strEquals(mp_env->getLocalName(manifestNode, XSEC_NS_DSIG), "Manifest"))
             throw XSECException(XSECException::ExpectedDSIGChildNotFound,
-            "Expected <Reference> as child of <Manifest>");
+            "Expected <Manifest> as child of <Object> for Manifest Type <Reference>");
 
-        // Have reference node, so lets create a list!
-        mp_manifestList = DSIGReference::loadReferenceListFromXML(mp_env, referenceNode);
+    }
 
-    } /* m_isManifest */
+    // Now have the manifest node, find the first reference and load!
+    referenceNode = manifestNode->getFirstChild();
 
-    m_loaded = true;
+    while (referenceNode != 0 &&
+        (referenceNode->getNodeType() != DOMNode::ELEMENT_NODE || !strEquals(mp_env->getLocalName(referenceNode, XSEC_NS_DSIG), "Reference"))) {
+        if (referenceNode->getNodeType() == DOMNode::ENTITY_REFERENCE_NODE) {
+            throw XSECException(XSECException::ExpectedDSIGChildNotFound,
+                "EntityReference nodes in <Reference> are unsupported.");
+        }
+        referenceNode = referenceNode->getNextSibling();
+    }
+
+    if (referenceNode == 0)
+        throw XSECException(XSECException::ExpectedDSIGChildNotFound,
+        "Expected <Reference> as child of <Manifest>");
+
+    return referenceNode;
+
+}
+
+void DSIGReference::loadManifest(void) const {
+
+    // Have reference node, so lets create a list!
+    mp_manifestList = DSIGReference::loadReferenceListFromXML(mp_env, findManifestReference());
+
+}
+
+XMLSize_t DSIGReference::getManifestReferenceCount(XMLSize_t max) const {
+
+    if (!m_isManifest)
+        return 0;
+
+    if (mp_manifestList != NULL)
+        return mp_manifestList->getSize();
+
+    // Walk the elements of the Manifest without loading anything.  Anything
+    // other than a Reference fails when the Manifest is loaded, so it may
+    // as well be counted
+
+    XMLSize_t count = 0;
+    const DOMNode * n = findManifestReference();
+
+    while (n != NULL && count <= max) {
+        if (n->getNodeType() == DOMNode::ELEMENT_NODE)
+            ++count;
+        n = n->getNextSibling();
+    }
+
+    return count;
 
 }
 
@@ -778,7 +822,7 @@ DSIGReferenceList *DSIGReference::loadReferenceListFromXML(const XSECEnv * env,
         // Must be an element node
 
         if (tmpRef->getNodeType() != DOMNode::ELEMENT_NODE ||
-            !strEquals(getDSIGLocalName(tmpRef), "Reference")) {
+            !strEquals(env->getLocalName(tmpRef, XSEC_NS_DSIG), "Reference")) {
 
             throw XSECException(XSECException::ExpectedDSIGChildNotFound,
                 "Expected <Reference> as child of <SignedInfo>");
@@ -863,7 +907,13 @@ XSECBinTXFMInputStream * DSIGReference::makeBinInputStream(void) const {
 // --------------------------------------------------------------------------------
 
 
-void DSIGReference::hashReferenceList(const DSIGReferenceList *lst, bool interlocking) {
+void DSIGReference::hashReferenceList(const DSIGReferenceList *lst, bool interlocking,
+                                      DSIGChangeTracker * changes) {
+
+    if (changes != NULL) {
+        hashChangedReferences(lst, interlocking, *changes);
+        return;
+    }
 
 // Run through a list of hashes and checkHash for each one
 
@@ -900,11 +950,227 @@ void DSIGReference::hashReferenceList(const DSIGReferenceList *lst, bool interlo
     } while (interlocking && !DSIGReference::verifyReferenceList(lst, errStr) && i-- >= 0);
 }
 
+// Only hash the references that a change may have affected.  A new DigestValue
+// is itself a change, so a reference (or manifest) covering it is picked up
+// on the next pass.  Returns true if any DigestValue was rewritten.
+
+bool DSIGReference::hashChangedReferences(const DSIGReferenceList *lst, bool interlocking,
+                                          DSIGChangeTracker & changes) {
+
+    DSIGReference * r;
+    int sz = (int) lst->getSize();
+    int i = sz;
+    bool changed, anyChanged = false;
+
+    do {
+
+        changed = false;
+
+        for (int j = 0; j < sz; ++j) {
+
+            r = lst->item(j);
+
+            if (r->isManifest() &&
+                hashChangedReferences(r->getManifestReferenceList(), interlocking, changes))
+                changed = true;
+
+            if (!r->isHashCurrent(changes) && r->updateHash(&changes))
+                changed = true;
+
+        }
+
+        anyChanged = anyChanged || changed;
+
+    } while (interlocking && changed && i-- >= 0);
+
+    return anyChanged;
+
+}
+
+// --------------------------------------------------------------------------------
+//           Change tracking
+// --------------------------------------------------------------------------------
+
+// Attributes have no parent, so are tracked through their element
+
+static const DOMNode * getTrackedNode(const DOMNode * n) {
+
+    if (n != NULL && n->getNodeType() == DOMNode::ATTRIBUTE_NODE)
+        return static_cast<const DOMAttr *>(n)->getOwnerElement();
+
+    return n;
+
+}
+
+static bool isAncestorOrSelf(const DOMNode * ancestor, const DOMNode * n) {
+
+    while (n != NULL) {
+        if (n == ancestor)
+            return true;
+        n = n->getParentNode();
+    }
+
+    return false;
+
+}
+
+void DSIGChangeTracker::markDirty(const DOMNode * node) {
+
+    Change c;
+    c.mp_node = getTrackedNode(node);
+    c.m_sequence = next();
+
+    if (c.mp_node != NULL)
+        m_changes.push_back(c);
+
+}
+
+bool DSIGChangeTracker::hasChanged(const DOMNode * target, unsigned int sequence) const {
+
+    // A change above the target can alter it too (e.g. in-scope namespaces)
+
+    for (ChangeVectorType::size_type i = 0; i < m_changes.size(); ++i) {
+
+        if (m_changes[i].m_sequence > sequence &&
+            (isAncestorOrSelf(target, m_changes[i].mp_node) ||
+             isAncestorOrSelf(m_changes[i].mp_node, target)))
+            return true;
+
+    }
+
+    return false;
+
+}
+
+const DOMNode * DSIGReference::getHashTarget(void) const {
+
+    // The node whose subtree is the whole input to the digest, or NULL if
+    // that cannot be known without running the transforms
+
+    if (!m_loaded || mp_preHash != NULL || mp_URI == NULL ||
+        (mp_URI[0] != 0 && mp_URI[0] != chPound))
+        return NULL;
+
+    // Transforms that can reach outside the subtree (XPath, XSLT, ...) or
+    // that we know nothing about rule it out
+
+    if (mp_transformList != NULL) {
+
+        DSIGTransformList::size_type sz = mp_transformList->getSize();
+        for (DSIGTransformList::size_type i = 0; i < sz; ++i) {
+
+            const XMLCh * uri = mp_transformList->item(i)->getAlgorithmURI();
+            if (!(strEquals(uri, DSIGConstants::s_unicodeStrURIENVELOPE) ||
+                  strEquals(uri, DSIGConstants::s_unicodeStrURIBASE64) ||
+                  strEquals(uri, DSIGConstants::s_unicodeStrURIC14N_NOC) ||
+                  strEquals(uri, DSIGConstants::s_unicodeStrURIC14N_COM) ||
+                  strEquals(uri, DSIGConstants::s_unicodeStrURIC14N11_NOC) ||
+                  strEquals(uri, DSIGConstants::s_unicodeStrURIC14N11_COM) ||
+                  strEquals(uri, DSIGConstants::s_unicodeStrURIEXC_C14N_NOC) ||
+                  strEquals(uri, DSIGConstants::s_unicodeStrURIEXC_C14N_COM)))
+                return NULL;
+
+        }
+
+    }
+
+    // Resolve the URI exactly as calculateHash() would
+
+    const DOMNode * target = NULL;
+
+    try {
+
+        TXFMBase * base = getURIBaseTXFM(mp_referenceNode->getOwnerDocument(), mp_URI, mp_env);
+        Janitor<TXFMBase> j_base(base);
+
+        if (base->getNodeType() == TXFMBase::DOM_NODE_DOCUMENT)
+            target = base->getDocument();
+        else
+            target = base->getFragmentNode();
+
+    }
+    catch (const XSECException &) {
+        return NULL;
+    }
+
+    return target;
+
+}
+
+// FNV-1a over the node types, names and values in the Transforms element,
+// so that a transform changed through the API (a new c14n method or
+// inclusive namespace list, say) is noticed without a DOM change record
+
+static void fingerprintString(XMLUInt64 & h, const XMLCh * str) {
+
+    if (str != NULL) {
+        for (; *str != 0; ++str) {
+            h ^= (XMLUInt64) *str;
+            h *= 1099511628211ULL;
+        }
+    }
+
+    // Separator, so "ab" + "c" differs from "a" + "bc"
+    h ^= 0xFFFFu;
+    h *= 1099511628211ULL;
+
+}
+
+static void fingerprintNode(XMLUInt64 & h, const DOMNode * n) {
+
+    h ^= (XMLUInt64) n->getNodeType();
+    h *= 1099511628211ULL;
+
+    fingerprintString(h, n->getNamespaceURI());
+    fingerprintString(h, n->getNodeName());
+    fingerprintString(h, n->getNodeValue());
+
+    const DOMNamedNodeMap * atts = n->getAttributes();
+    if (atts != NULL) {
+        XMLSize_t sz = atts->getLength();
+        for (XMLSize_t i = 0; i < sz; ++i)
+            fingerprintNode(h, atts->item(i));
+    }
+
+    for (const DOMNode * c = n->getFirstChild(); c != NULL; c = c->getNextSibling())
+        fingerprintNode(h, c);
+
+    // End of children
+    h ^= 0xFFFEu;
+    h *= 1099511628211ULL;
+
+}
+
+XMLUInt64 DSIGReference::getTransformsFingerprint(void) const {
+
+    XMLUInt64 h = 14695981039346656037ULL;
+
+    if (mp_transformsNode != NULL)
+        fingerprintNode(h, mp_transformsNode);
+
+    return h;
+
+}
+
+bool DSIGReference::isHashCurrent(const DSIGChangeTracker & changes) const {
+
+    if (!changes.isCached(m_hashSequence))
+        return false;
+
+    const DOMNode * target = getHashTarget();
+
+    return (target != NULL && target == mp_hashedTarget &&
+        !changes.hasChanged(target, m_hashSequence) &&
+        getTransformsFingerprint() == m_transformsFingerprint);
+
+}
+
 // --------------------------------------------------------------------------------
 //           Verify reference list
 // --------------------------------------------------------------------------------
 
-bool DSIGReference::verifyReferenceList(const DSIGReferenceList * lst, safeBuffer &errStr) {
+bool DSIGReference::verifyReferenceList(const DSIGReferenceList * lst, safeBuffer &errStr,
+                                        bool stopOnFailure) {
 
     // Run through a list of hashes and checkHash for each one
 
@@ -953,9 +1219,15 @@ bool DSIGReference::verifyReferenceList(const DSIGReferenceList * lst, safeBuffe
 
         }
 
+        if (!res && stopOnFailure)
+            return false;
+
         // if a manifest, check the manifest list
         if (r->isManifest())
-            res = res & verifyReferenceList(r->getManifestReferenceList(), errStr);
+            res = res & verifyReferenceList(r->getManifestReferenceList(), errStr, stopOnFailure);
+
+        if (!res && stopOnFailure)
+            return false;
 
     }
 
@@ -977,7 +1249,7 @@ TXFMChain * DSIGReference::createTXFMChainFromList(TXFMBase * input,
 
     Janitor<TXFMChain> j_ret(ret);
 
-    DSIGTransformList::TransformListVectorType::size_type size, i;
+    DSIGTransformList::size_type size, i;
 
     size = lst->getSize();
 
@@ -987,6 +1259,8 @@ TXFMChain * DSIGReference::createTXFMChainFromList(TXFMBase * input,
 
         for (i = 0; i < size; ++i) {
 
+            XSECTraceScope trace("transform",
+                XSECTrace::isEnabled() ? lst->item(i)->getAlgorithmURI() : NULL);
             lst->item(i)->appendTransformer(ret);
 
         }
@@ -1010,8 +1284,8 @@ DSIGTransformList * DSIGReference::loadTransforms(
     // This is defined as a static function, not because it makes use of any static variables
     // in the DSIGReference class, but to neatly link it to the other users
 
-    if (transformsNode == 0 || (!strEquals(getDSIGLocalName(transformsNode), "Transforms") &&
-        !strEquals(getXENCLocalName(transformsNode), "Transforms"))) {
+    if (transformsNode == 0 || (!strEquals(env->getLocalName(transformsNode, XSEC_NS_DSIG), "Transforms") &&
+        !strEquals(env->getLocalName(transformsNode, XSEC_NS_XENC), "Transforms"))) {
 
             throw XSECException(XSECException::ExpectedDSIGChildNotFound,
                     "Expected <Transforms> in function DSIGReference::processTransforms");
@@ -1032,12 +1306,12 @@ DSIGTransformList * DSIGReference::loadTransforms(
     while (transforms != NULL) {
 
         // Process each transform in turn
-        if (!strEquals(getDSIGLocalName(transforms), "Transform")) {
+        if (!strEquals(env->getLocalName(transforms, XSEC_NS_DSIG), "Transform")) {
 
             // Not what we expected to see!
             safeBuffer tmp, error;
 
-            error << (*formatter << getDSIGLocalName(transforms));
+            error.sbUTF8In(env->getLocalName(transforms, XSEC_NS_DSIG));
             tmp.sbStrcpyIn("Unknown attribute in <Transforms> - Expected <Transform> found ");
             tmp.sbStrcatIn(error);
             tmp.sbStrcatIn(">.");
@@ -1061,7 +1335,7 @@ DSIGTransformList * DSIGReference::loadTransforms(
         }
 
         safeBuffer algorithm;
-        algorithm << (*formatter << transformAtts->item(i)->getNodeValue());
+        algorithm.sbUTF8In(transformAtts->item(i)->getNodeValue());
 
         // Determine what the transform is
 
@@ -1153,6 +1427,12 @@ DSIGTransformList * DSIGReference::loadTransforms(
 
 void DSIGReference::setHash() {
 
+    updateHash(NULL);
+
+}
+
+bool DSIGReference::updateHash(DSIGChangeTracker * changes) {
+
     // Set up
 
     if (mp_hashValueNode == 0) {
@@ -1209,17 +1489,42 @@ void DSIGReference::setHash() {
     while (tmpElt != NULL && tmpElt->getNodeType() != DOMNode::TEXT_NODE)
         tmpElt = tmpElt->getNextSibling();
 
+    XMLT newHash((char *) base64Hash);
+    delete[] base64Hash;
+
+    bool changed = true;
+
     if (tmpElt == NULL) {
         // Need to create the underlying TEXT_NODE
         DOMDocument *doc = mp_referenceNode->getOwnerDocument();
-        tmpElt = doc->createTextNode(MAKE_UNICODE_STRING((char *) base64Hash));
+        tmpElt = doc->createTextNode(newHash.getUnicodeStr());
         mp_hashValueNode->appendChild(tmpElt);
     }
+    else if (strEquals(tmpElt->getNodeValue(), newHash.getUnicodeStr())) {
+        changed = false;
+    }
     else {
-        tmpElt->setNodeValue(MAKE_UNICODE_STRING((char *) base64Hash));
+        tmpElt->setNodeValue(newHash.getUnicodeStr());
     }
 
-    delete[] base64Hash;
+    if (changes == NULL) {
+        // Nothing to tell us whether the DOM changes after this
+        m_hashSequence = 0;
+        return changed;
+    }
+
+    // Anything covering the DigestValue has to be hashed again - but not
+    // this reference, so the change comes before its own sequence number
+
+    if (changed)
+        changes->markDirty(mp_hashValueNode);
+
+    m_hashSequence = changes->next();
+    mp_hashedTarget = getHashTarget();
+    m_transformsFingerprint = getTransformsFingerprint();
+
+    return changed;
+
 }
 
 
@@ -1247,15 +1552,22 @@ unsigned int DSIGReference::calculateHash(XMLByte *toFill, unsigned int maxToFil
 
     }
 
-    // Find base transform
-    currentTxfm = getURIBaseTXFM(mp_referenceNode->getOwnerDocument(), mp_URI,
-        mp_env);
+    // Everything traced from here on is attributed to this Reference
+    XSECTraceScope trace("reference", mp_URI, true);
+
+    {
+        XSECMetricTimer timer(XSEC_METRIC_TRANSFORM_CHAIN);
+
+        // Find base transform
+        currentTxfm = getURIBaseTXFM(mp_referenceNode->getOwnerDocument(), mp_URI,
+            mp_env);
 
-    // Now build the transforms list
-    // Note this passes ownership of currentTxfm to the function, so it is the
-    // responsibility of createTXFMChain to ensure it gets deleted if this throws.
+        // Now build the transforms list
+        // Note this passes ownership of currentTxfm to the function, so it is the
+        // responsibility of createTXFMChain to ensure it gets deleted if this throws.
 
-    chain = createTXFMChainFromList(currentTxfm, mp_transformList);
+        chain = createTXFMChainFromList(currentTxfm, mp_transformList);
+    }
     Janitor<TXFMChain> j_chain(chain);
 
     DOMDocument *d = mp_referenceNode->getOwnerDocument();
@@ -1295,9 +1607,15 @@ unsigned int DSIGReference::calculateHash(XMLByte *toFill, unsigned int maxToFil
             "Hash method unknown in DSIGReference::calculateHash()");
     }
 
-    if (!handler->appendHashTxfm(chain, mp_algorithmURI)) {
-        throw XSECException(XSECException::SigVfyError,
-            "Unexpected error in handler whilst appending Hash transform");
+    {
+        // The hash transform pulls the data through the whole chain as
+        // soon as it is appended
+        XSECTraceScope hashTrace("hash", mp_algorithmURI);
+
+        if (!handler->appendHashTxfm(chain, mp_algorithmURI)) {
+            throw XSECException(XSECException::SigVfyError,
+                "Unexpected error in handler whilst appending Hash transform");
+        }
     }
 
     // Now we have the hashing transform, run it.
@@ -1335,7 +1653,7 @@ unsigned int DSIGReference::readHash(XMLByte *toFill, unsigned int maxToFill) co
 
     tmpElt = mp_referenceNode->getFirstChild();
 
-    while (tmpElt != 0 && !strEquals(getDSIGLocalName(tmpElt), "DigestValue"))
+    while (tmpElt != 0 && !strEquals(mp_env->getLocalName(tmpElt, XSEC_NS_DSIG), "DigestValue"))
         tmpElt = tmpElt->getNextSibling();
 
     if (tmpElt == NULL)
@@ -1352,7 +1670,7 @@ unsigned int DSIGReference::readHash(XMLByte *toFill, unsigned int maxToFill) co
         // Something wrong with the underlying XML if no text was found
         throw XSECException(XSECException::NoHashFoundInDigestValue);
 
-    b64HashVal << (*mp_formatter << tmpElt->getNodeValue());
+    b64HashVal.sbUTF8In(tmpElt->getNodeValue());
 
     // Now have the value of the string - create a transform around it
 
@@ -26,6 +26,9 @@
  *					 
  */
 
+#ifndef DSIGREFERENCE_INCLUDE
+#define DSIGREFERENCE_INCLUDE
+
 // High level include
 #include <xsec/framework/XSECDefs.hpp>
 
@@ -40,6 +43,8 @@
 #include <xsec/dsig/DSIGReferenceList.hpp>
 #include <xsec/dsig/DSIGConstants.hpp>
 
+#include <vector>
+
 class DSIGTransformList;
 class DSIGTransformBase64;
 class DSIGTransformC14n;
@@ -56,6 +61,78 @@ class XSECBinTXFMInputStream;
 class XSECURIResolver;
 class XSECEnv;
 
+/**
+ * @ingroup internal
+ */
+
+/**
+ * @brief Records the parts of a document changed since References were hashed
+ *
+ * Used by DSIGSignature for incremental signing.  Each change and each
+ * digest calculation is given an increasing sequence number, so a
+ * Reference only needs to be hashed again if a change made after its
+ * digest lies within (or contains) the node it dereferences.
+ */
+
+class XSEC_EXPORT DSIGChangeTracker {
+
+public:
+
+	DSIGChangeTracker() : m_sequence(0), m_validFrom(0) {}
+
+	/**
+	 * \brief Record that a node, or something beneath it, has changed
+	 */
+
+	void markDirty(const XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * node);
+
+	/**
+	 * \brief Has anything within or above target changed since sequence?
+	 */
+
+	bool hasChanged(const XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * target,
+					unsigned int sequence) const;
+
+	/**
+	 * \brief Is a digest calculated at sequence still usable at all?
+	 */
+
+	bool isCached(unsigned int sequence) const {return sequence > m_validFrom;}
+
+	/**
+	 * \brief Sequence number for a digest calculated now
+	 */
+
+	unsigned int next(void) {return ++m_sequence;}
+
+	/**
+	 * \brief Forget the changes once every Reference has been brought up to date
+	 */
+
+	void clear(void) {m_changes.clear();}
+
+	/**
+	 * \brief Forget the changes and treat every digest as out of date
+	 */
+
+	void invalidate(void) {m_changes.clear(); m_validFrom = ++m_sequence;}
+
+private:
+
+	struct Change {
+		const XERCES_CPP_NAMESPACE_QUALIFIER DOMNode
+								* mp_node;
+		unsigned int			m_sequence;
+	};
+
+	typedef std::vector<Change> ChangeVectorType;
+
+	ChangeVectorType			m_changes;
+	unsigned int				m_sequence;
+	unsigned int				m_validFrom;	// Digests up to here are stale
+
+};
+
 /**
  * @ingroup pubsig
  */
@@ -131,6 +208,9 @@ public:
 	 * <p>This function will load a Reference structure from the owner
 	 * document.</p>
 	 *
+	 * <p>If lazy loading is set in the environment, the References of a
+	 * Manifest are not loaded until getManifestReferenceList() is first
+	 * called.</p>
 	 */
 	
 	void load();
@@ -324,12 +404,30 @@ public:
 	/**
 	 * \brief Get the Manifest
 	 *
+	 * If the Manifest has not yet been loaded (see XSECEnv::setLazyLoadFlag)
+	 * it is loaded now, so this may throw the exceptions load() would have.
+	 *
 	 * @returns The ReferenceList containing the references in the Manifest
 	 * list of this reference element.
 	 */
 
 	DSIGReferenceList * getManifestReferenceList() const;		// Return list of references for a manifest object
 
+	/**
+	 * \brief Count the References in the Manifest
+	 *
+	 * Counts the \<Reference\> elements of the Manifest without loading
+	 * it, so that a caller can refuse an over-large Manifest before paying
+	 * to parse it.  If the Manifest is already loaded, the size of the
+	 * loaded list is returned.
+	 *
+	 * @param max Stop counting once more than this many are found
+	 * @returns The number of References (at most max + 1), or 0 if this
+	 * is not a Manifest reference
+	 */
+
+	XMLSize_t getManifestReferenceCount(XMLSize_t max) const;
+
 
 	//@}
 	
@@ -420,7 +518,8 @@ public:
 	 * the associated DSIGTrasnformList.
 	 *
 	 * @param transformsNode Starting node in the DOM
-	 * @param formatter The formatter to be used to move from XMLCh to strings
+	 * @param formatter Unused (strings are converted with safeBuffer::sbUTF8In)
+	 * and may be NULL.  Retained for compatibility.
 	 * @param env Environment in which to operate
 	 * @returns A pointer to the created list.
 	 */
@@ -470,10 +569,13 @@ public:
 	 *
 	 * @param lst The list to verify
 	 * @param errorStr The string to append any errors found to
+	 * @param stopOnFailure If true, return as soon as one reference fails
+	 * rather than checking (and reporting) the rest
 	 * @returns true iff all the references validate successfully.
 	 */
 
-	static bool verifyReferenceList(const DSIGReferenceList * lst, safeBuffer &errorStr);
+	static bool verifyReferenceList(const DSIGReferenceList * lst, safeBuffer &errorStr,
+									bool stopOnFailure = false);
 	
 	/**
 	 * \brief Hash a reference list
@@ -489,8 +591,11 @@ public:
 	 * are no inter-related references.  The algorithm for determining this
 	 * internally is very primitive and CPU intensive, so this is a method to 
 	 * bypass the checks.
+	 * @param changes If not NULL, only references that may have been affected
+	 * by the changes recorded since they were last hashed are hashed again
 	 */
-	static void hashReferenceList(const DSIGReferenceList * list, bool interlocking = true);
+	static void hashReferenceList(const DSIGReferenceList * list, bool interlocking = true,
+								  DSIGChangeTracker * changes = NULL);
 
 	//@}
 
@@ -498,17 +603,24 @@ private:
 
 	// Internal functions
 	void createTransformList(void);
+	void loadManifest(void) const;
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * findManifestReference(void) const;
+	bool updateHash(DSIGChangeTracker * changes);
+	const XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * getHashTarget(void) const;
+	bool isHashCurrent(const DSIGChangeTracker & changes) const;
+	XMLUInt64 getTransformsFingerprint(void) const;
+	static bool hashChangedReferences(const DSIGReferenceList * lst, bool interlocking,
+									  DSIGChangeTracker & changes);
 	void addTransform(
 		DSIGTransform * txfm, 
 		XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * txfmElt
 	);
 
 
-	XSECSafeBufferFormatter		* mp_formatter;
 	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode						
 								* mp_referenceNode;		// Points to start of document where reference node is
 	mutable TXFMBase				* mp_preHash;			// To be used pre-hash
-	DSIGReferenceList			* mp_manifestList;		// The list of references in a manifest
+	mutable DSIGReferenceList	* mp_manifestList;		// The list of references in a manifest
 	const XMLCh					* mp_URI;				// The URI String
 	bool						m_isManifest;			// Does this reference a manifest?
 	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode						
@@ -521,6 +633,12 @@ private:
 	
 	bool                        m_loaded;
 
+	// Incremental signing
+	unsigned int				m_hashSequence;			// When the DigestValue was last calculated
+	const XERCES_CPP_NAMESPACE_QUALIFIER DOMNode
+								* mp_hashedTarget;		// What the URI pointed to at the time
+	XMLUInt64					m_transformsFingerprint;	// Hash of the Transforms element at the time
+
 	DSIGReference();
 
 	/*\@}*/
@@ -528,6 +646,4 @@ private:
 	friend class DSIGSignedInfo;
 };
 
-
-
-
+#endif /* DSIGREFERENCE_INCLUDE */
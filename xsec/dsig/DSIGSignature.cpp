@@ -44,17 +44,21 @@
 #include <xsec/dsig/DSIGAlgorithmHandlerDefault.hpp>
 #include <xsec/enc/XSECCryptoKeyDSA.hpp>
 #include <xsec/enc/XSECCryptoKeyRSA.hpp>
+#include <xsec/enc/XSECCryptoException.hpp>
 #include <xsec/enc/XSECKeyInfoResolver.hpp>
+#include <xsec/framework/XSECAsyncQueue.hpp>
 #include <xsec/framework/XSECError.hpp>
 #include <xsec/framework/XSECAlgorithmHandler.hpp>
 #include <xsec/framework/XSECAlgorithmMapper.hpp>
 #include <xsec/framework/XSECEnv.hpp>
 #include <xsec/framework/XSECURIResolver.hpp>
+#include <xsec/framework/XSECMetrics.hpp>
 #include <xsec/transformers/TXFMDocObject.hpp>
 #include <xsec/transformers/TXFMOutputFile.hpp>
 #include <xsec/transformers/TXFMBase64.hpp>
 #include <xsec/transformers/TXFMC14n.hpp>
 #include <xsec/transformers/TXFMChain.hpp>
+#include <xsec/transformers/TXFMSB.hpp>
 #include <xsec/utils/XSECBinTXFMInputStream.hpp>
 #include <xsec/utils/XSECPlatformUtils.hpp>
 
@@ -214,6 +218,10 @@ XSECKeyInfoResolver* DSIGSignature::getKeyInfoResolver() const {
 
 DSIGObject* DSIGSignature::appendObject() {
 
+    // Keep the list in document order
+    if (mp_pendingObjectNode != NULL)
+        loadObjects();
+
     DSIGObject* ret;
     XSECnew(ret, DSIGObject(mp_env));
     DOMElement* elt = ret->createBlankObject();
@@ -228,11 +236,18 @@ DSIGObject* DSIGSignature::appendObject() {
 }
 
 int DSIGSignature::getObjectLength() const {
+
+    if (mp_pendingObjectNode != NULL)
+        const_cast<DSIGSignature*>(this)->loadObjects();
+
     return (unsigned int) m_objects.size();
 }
 
 DSIGObject* DSIGSignature::getObjectItem(int i) {
 
+    if (mp_pendingObjectNode != NULL)
+        loadObjects();
+
     if ( i < 0 || i >= ((int) m_objects.size())) {
         throw XSECException(XSECException::ObjectError,
             "DSIGSignature::getObjectItem - index out of range");
@@ -243,6 +258,9 @@ DSIGObject* DSIGSignature::getObjectItem(int i) {
 
 const DSIGObject* DSIGSignature::getObjectItem(int i) const {
 
+    if (mp_pendingObjectNode != NULL)
+        const_cast<DSIGSignature*>(this)->loadObjects();
+
     if ( i < 0 || i >= ((int) m_objects.size())) {
         throw XSECException(XSECException::ObjectError,
             "DSIGSignature::getObjectItem - index out of range");
@@ -265,10 +283,16 @@ DSIGSignature::DSIGSignature(DOMDocument* doc, DOMNode* sigNode) :
         mp_signatureValueNode(NULL),
         m_keyInfoList(NULL),
         mp_KeyInfoNode(NULL),
+        m_keyInfoPending(false),
         m_errStr(""),
         mp_signingKey(NULL),
         mp_KeyInfoResolver(NULL),
-        m_interlockingReferences(false) {
+        mp_pendingObjectNode(NULL),
+        m_interlockingReferences(false),
+        m_verificationPolicy(VERIFY_FULL),
+        m_maxReferences(0),
+        m_maxTransforms(0),
+        m_incrementalSign(false) {
 
     // Set up our formatter
     XSECnew(mp_formatter, XSECSafeBufferFormatter("UTF-8",XMLFormatter::NoEscapes,
@@ -288,10 +312,16 @@ DSIGSignature::DSIGSignature() :
         mp_signatureValueNode(NULL),
         m_keyInfoList(NULL),
         mp_KeyInfoNode(NULL),
+        m_keyInfoPending(false),
         m_errStr(""),
         mp_signingKey(NULL),
         mp_KeyInfoResolver(NULL),
-        m_interlockingReferences(false) {
+        mp_pendingObjectNode(NULL),
+        m_interlockingReferences(false),
+        m_verificationPolicy(VERIFY_FULL),
+        m_maxReferences(0),
+        m_maxTransforms(0),
+        m_incrementalSign(false) {
 
     // Set up our formatter
     XSECnew(mp_formatter, XSECSafeBufferFormatter("UTF-8",XMLFormatter::NoEscapes,
@@ -338,6 +368,46 @@ DSIGSignature::~DSIGSignature() {
     }
 }
 
+void DSIGSignature::reset(DOMDocument* doc, DOMNode* sigNode) {
+
+    // Drop everything that belongs to the old document, but keep the
+    // formatter, environment settings, resolvers and buffers
+
+    if (mp_signingKey != NULL) {
+        delete mp_signingKey;
+        mp_signingKey = NULL;
+    }
+
+    if (mp_signedInfo != NULL) {
+        delete mp_signedInfo;
+        mp_signedInfo = NULL;
+    }
+
+    for (int i = 0; i < ((int) m_objects.size()); ++i) {
+        delete (m_objects[i]);
+    }
+    m_objects.clear();
+
+    m_keyInfoList.empty();
+
+    mp_doc = doc;
+    mp_sigNode = sigNode;
+    mp_signatureValueNode = NULL;
+    mp_KeyInfoNode = NULL;
+    m_keyInfoPending = false;
+    mp_pendingObjectNode = NULL;
+    m_loaded = false;
+    m_interlockingReferences = false;
+    m_verificationPolicy = VERIFY_FULL;
+    m_maxReferences = 0;
+    m_maxTransforms = 0;
+    m_incrementalSign = false;
+    m_changes.invalidate();
+    m_errStr.sbXMLChIn(DSIGConstants::s_unicodeStrEmpty);
+
+    mp_env->setParentDocument(doc);
+}
+
 // Actions
 
 const XMLCh* DSIGSignature::getErrMsgs() const {
@@ -357,6 +427,14 @@ bool DSIGSignature::getPrettyPrint() const {
     return mp_env->getPrettyPrintFlag();
 }
 
+void DSIGSignature::setLazyLoad(bool flag) {
+    mp_env->setLazyLoadFlag(flag);
+}
+
+bool DSIGSignature::getLazyLoad() const {
+    return mp_env->getLazyLoadFlag();
+}
+
 // --------------------------------------------------------------------------------
 //           Creating signatures from blank
 // --------------------------------------------------------------------------------
@@ -486,11 +564,16 @@ void DSIGSignature::clearKeyInfo() {
 
     // Clear out the list
     m_keyInfoList.empty();
+    m_keyInfoPending = false;
 
 }
 
 void DSIGSignature::createKeyInfoElement() {
 
+    // Anything appended must follow what is already there
+    if (m_keyInfoPending)
+        loadKeyInfo();
+
     if (mp_KeyInfoNode != NULL)
         return;
 
@@ -575,6 +658,8 @@ void DSIGSignature::load() {
     // Load all the information from the source document into local variables for easier
     // manipulation by the other functions in the class
 
+    XSECMetricTimer timer(XSEC_METRIC_LOAD);
+
     if (mp_sigNode == NULL) {
 
         // Attempt to load an empty signature element
@@ -582,7 +667,7 @@ void DSIGSignature::load() {
 
     }
 
-    if (!strEquals(getDSIGLocalName(mp_sigNode), "Signature")) {
+    if (!strEquals(mp_env->getLocalName(mp_sigNode, XSEC_NS_DSIG), "Signature")) {
 
         throw XSECException(XSECException::LoadNonSignature);
 
@@ -600,7 +685,7 @@ void DSIGSignature::load() {
         // Skip text and comments
         tmpElt = tmpElt->getNextSibling();
 
-    if (tmpElt == 0 || !strEquals(getDSIGLocalName(tmpElt), "SignedInfo")) {
+    if (tmpElt == 0 || !strEquals(mp_env->getLocalName(tmpElt, XSEC_NS_DSIG), "SignedInfo")) {
 
             throw XSECException(XSECException::ExpectedDSIGChildNotFound,
                     "Expected <SignedInfo> as first child of <Signature>");
@@ -614,7 +699,7 @@ void DSIGSignature::load() {
 
     // Look at Signature Value
     tmpElt = findNextElementChild(tmpElt);
-    if (tmpElt == 0 || !strEquals(getDSIGLocalName(tmpElt), "SignatureValue")) {
+    if (tmpElt == 0 || !strEquals(mp_env->getLocalName(tmpElt, XSEC_NS_DSIG), "SignatureValue")) {
 
         throw XSECException(XSECException::ExpectedDSIGChildNotFound,
             "Expected <SignatureValue> node");
@@ -640,26 +725,26 @@ void DSIGSignature::load() {
     // Now look at KeyInfo
     tmpElt = findNextElementChild(tmpElt);
 
-    if (tmpElt != 0 && strEquals(getDSIGLocalName(tmpElt), "KeyInfo")) {
+    if (tmpElt != 0 && strEquals(mp_env->getLocalName(tmpElt, XSEC_NS_DSIG), "KeyInfo")) {
 
         // Have a keyInfo
 
         mp_KeyInfoNode = tmpElt;        // In case we later want to manipulate it
 
-        m_keyInfoList.loadListFromXML(tmpElt);
+        if (mp_env->getLazyLoadFlag())
+            m_keyInfoPending = true;
+        else
+            m_keyInfoList.loadListFromXML(tmpElt);
 
         tmpElt = findNextElementChild(tmpElt);
     }
 
-    while (tmpElt != 0 && strEquals(getDSIGLocalName(tmpElt), "Object")) {
+    if (tmpElt != 0 && strEquals(mp_env->getLocalName(tmpElt, XSEC_NS_DSIG), "Object")) {
 
-        DSIGObject* obj;
-        XSECnew(obj, DSIGObject(mp_env, tmpElt));
-        obj->load();
+        mp_pendingObjectNode = tmpElt;
 
-        m_objects.push_back(obj);
-
-        tmpElt = findNextElementChild(tmpElt);
+        if (!mp_env->getLazyLoadFlag())
+            loadObjects();
 
     }
 /*
@@ -673,6 +758,61 @@ void DSIGSignature::load() {
 */
 }
 
+// Read the parts of the signature that load() deferred.  On failure the
+// part is left unread, so the next attempt reports the same error.
+
+void DSIGSignature::loadKeyInfo() {
+
+    XSECMetricTimer timer(XSEC_METRIC_LOAD);
+
+    try {
+        m_keyInfoList.loadListFromXML(mp_KeyInfoNode);
+    }
+    catch (...) {
+        m_keyInfoList.empty();
+        throw;
+    }
+
+    m_keyInfoPending = false;
+
+}
+
+void DSIGSignature::loadObjects() {
+
+    XSECMetricTimer timer(XSEC_METRIC_LOAD);
+
+    DOMNode* tmpElt = mp_pendingObjectNode;
+    ObjectVectorType::size_type loaded = m_objects.size();
+
+    try {
+
+        while (tmpElt != 0 && strEquals(mp_env->getLocalName(tmpElt, XSEC_NS_DSIG), "Object")) {
+
+            DSIGObject* obj;
+            XSECnew(obj, DSIGObject(mp_env, tmpElt));
+            m_objects.push_back(obj);
+
+            obj->load();
+
+            tmpElt = findNextElementChild(tmpElt);
+
+        }
+
+    }
+    catch (...) {
+
+        while (m_objects.size() > loaded) {
+            delete m_objects.back();
+            m_objects.pop_back();
+        }
+        throw;
+
+    }
+
+    mp_pendingObjectNode = NULL;
+
+}
+
 TXFMChain* DSIGSignature::getSignedInfoInput() const {
 
     TXFMBase* txfm;
@@ -753,7 +893,7 @@ unsigned int DSIGSignature::calculateSignedInfoAndReferenceHash(unsigned char* h
                                                     unsigned int hashBufLen) const {
 
     // Set up the reference list hashes - including any manifests
-    mp_signedInfo->hash(m_interlockingReferences);
+    mp_signedInfo->hash(m_interlockingReferences, m_incrementalSign ? &m_changes : NULL);
     // calculaet signed InfoHash
     return calculateSignedInfoHash(hashBuf,hashBufLen);
 }
@@ -762,9 +902,9 @@ unsigned int DSIGSignature::calculateSignedInfoAndReferenceHash(unsigned char* h
 //           Verify a signature
 // --------------------------------------------------------------------------------
 
-bool DSIGSignature::verifySignatureOnlyInternal() const {
+// Checks common to all verification paths, and finds the key
 
-    unsigned char hash[4096];
+void DSIGSignature::prepareVerify() const {
 
     if (!m_loaded) {
 
@@ -798,6 +938,11 @@ bool DSIGSignature::verifySignatureOnlyInternal() const {
 
         }
 
+        if (m_keyInfoPending)
+            const_cast<DSIGSignature*>(this)->loadKeyInfo();
+
+        XSECMetricTimer timer(XSEC_METRIC_KEY_RESOLUTION);
+
         if ((mp_signingKey = mp_KeyInfoResolver->resolveKey(&m_keyInfoList)) == NULL) {
 
             throw XSECException(XSECException::SigVfyError,
@@ -805,6 +950,71 @@ bool DSIGSignature::verifySignatureOnlyInternal() const {
         }
 
     }
+}
+
+// Count the references (and their transforms) against the limits set,
+// stopping as soon as one is exceeded.  A Manifest that is not loaded yet
+// (lazy loading) is counted in the DOM first, so an over-large one is
+// refused without being parsed
+
+static bool withinReferenceLimits(const DSIGReferenceList* lst,
+                                  unsigned int maxReferences,
+                                  unsigned int maxTransforms,
+                                  unsigned int& count,
+                                  safeBuffer& errStr) {
+
+    DSIGReferenceList::size_type size = (lst ? lst->getSize() : 0);
+
+    for (DSIGReferenceList::size_type i = 0; i < size; ++i) {
+
+        const DSIGReference* r = lst->item(i);
+
+        if (maxReferences != 0 && ++count > maxReferences) {
+            errStr.sbXMLChCat("Signature has more References than allowed\n");
+            return false;
+        }
+
+        if (maxTransforms != 0 && r->getTransforms() != NULL &&
+                r->getTransforms()->getSize() > maxTransforms) {
+            errStr.sbXMLChCat("Reference URI=\"");
+            errStr.sbXMLChCat(r->getURI());
+            errStr.sbXMLChCat("\" has more Transforms than allowed\n");
+            return false;
+        }
+
+        if (!r->isManifest())
+            continue;
+
+        if (maxReferences != 0 &&
+                r->getManifestReferenceCount(maxReferences - count) > maxReferences - count) {
+            errStr.sbXMLChCat("Signature has more References than allowed\n");
+            return false;
+        }
+
+        if (!withinReferenceLimits(r->getManifestReferenceList(),
+                maxReferences, maxTransforms, count, errStr))
+            return false;
+
+    }
+
+    return true;
+}
+
+bool DSIGSignature::checkReferenceLimits() const {
+
+    if (m_maxReferences == 0 && m_maxTransforms == 0)
+        return true;
+
+    unsigned int count = 0;
+    return withinReferenceLimits(mp_signedInfo->getReferenceList(),
+        m_maxReferences, m_maxTransforms, count, m_errStr);
+}
+
+bool DSIGSignature::verifySignatureOnlyInternal() const {
+
+    unsigned char hash[4096];
+
+    prepareVerify();
 
     // Get the SignedInfo input bytes
     TXFMChain* chain = getSignedInfoInput();
@@ -823,6 +1033,8 @@ bool DSIGSignature::verifySignatureOnlyInternal() const {
             "Hash method unknown in DSIGSignature::verifySignatureOnlyInternal()");
     }
 
+    XSECMetricTimer timer(XSEC_METRIC_VERIFY, mp_signedInfo->getAlgorithmURI());
+
     bool sigVfyRet = handler->verifyBase64Signature(chain,
         mp_signedInfo->getAlgorithmURI(),
         m_signatureValueSB.rawCharBuffer(),
@@ -858,6 +1070,23 @@ bool DSIGSignature::verify() const {
     // Reset
     m_errStr.sbXMLChIn(DSIGConstants::s_unicodeStrEmpty);
 
+    // Nothing is digested for a signature that asks for too much
+
+    if (!checkReferenceLimits())
+        return false;
+
+    if (m_verificationPolicy == VERIFY_FAIL_FAST) {
+
+        // The SignatureValue is cheap to check compared to the references,
+        // so a forged or corrupt signature is rejected before any of them
+
+        if (!verifySignatureOnlyInternal())
+            return false;
+
+        return mp_signedInfo->verify(m_errStr, true);
+
+    }
+
     // First thing to do is check the references
 
     referenceCheckResult = mp_signedInfo->verify(m_errStr);
@@ -899,7 +1128,7 @@ void DSIGSignature::sign() {
     m_errStr.sbXMLChIn(DSIGConstants::s_unicodeStrEmpty);
 
     // Set up the reference list hashes - including any manifests
-    mp_signedInfo->hash(m_interlockingReferences);
+    mp_signedInfo->hash(m_interlockingReferences, m_incrementalSign ? &m_changes : NULL);
 
     // Get the SignedInfo input bytes
     TXFMChain* chain = getSignedInfoInput();
@@ -918,14 +1147,23 @@ void DSIGSignature::sign() {
             "Hash method unknown in DSIGSignature::sign()");
     }
 
-    if (!handler->signToSafeBuffer(chain, mp_signedInfo->getAlgorithmURI(),
-                                   mp_signingKey, mp_signedInfo->getHMACOutputLength(), b64Buf)) {
+    {
+        XSECMetricTimer timer(XSEC_METRIC_SIGN, mp_signedInfo->getAlgorithmURI());
 
-        throw XSECException(XSECException::SigVfyError,
-            "Unexpected error in handler whilst appending Signature Hash transform");
+        if (!handler->signToSafeBuffer(chain, mp_signedInfo->getAlgorithmURI(),
+                                       mp_signingKey, mp_signedInfo->getHMACOutputLength(), b64Buf)) {
+
+            throw XSECException(XSECException::SigVfyError,
+                "Unexpected error in handler whilst appending Signature Hash transform");
 
+        }
     }
 
+    setSignatureValue(b64Buf);
+}
+
+void DSIGSignature::setSignatureValue(const safeBuffer& b64Buf) {
+
     // Now we have the signature - place it in the DOM structures
 
     DOMNode*tmpElt = mp_signatureValueNode->getFirstChild();
@@ -947,6 +1185,199 @@ void DSIGSignature::sign() {
     m_signatureValueSB = b64Buf;
 }
 
+// --------------------------------------------------------------------------------
+//           Deferred sign and verify
+// --------------------------------------------------------------------------------
+
+// The key operation of a signAsync/verifyAsync.  run() works from a copy
+// of the canonicalised SignedInfo so that it never touches the DOM.
+
+class DSIGSignatureAsyncOp : public XSECAsyncOperation {
+
+public:
+
+    DSIGSignatureAsyncOp(const DSIGSignature* signature,
+                         DSIGSignature* signer,
+                         XSECAsyncCallback* callback,
+                         const XSECAlgorithmHandler* handler,
+                         bool referencesOK) :
+        mp_signature(signature),
+        mp_signer(signer),
+        mp_callback(callback),
+        mp_handler(handler),
+        m_referencesOK(referencesOK),
+        m_result(false),
+        m_failed(false) {
+
+        m_signedInfoLen = signature->readSignedInfoInput(m_signedInfo);
+        if (mp_signer == NULL)
+            m_signatureValue = signature->m_signatureValueSB;
+    }
+
+    virtual void run() {
+
+        try {
+
+            TXFMSB* sb;
+            XSECnew(sb, TXFMSB(mp_signature->mp_doc));
+            TXFMChain chain(sb);
+            sb->setInput(m_signedInfo, m_signedInfoLen);
+
+            const DSIGSignedInfo* si = mp_signature->mp_signedInfo;
+
+            XSECMetricTimer timer(mp_signer != NULL ? XSEC_METRIC_SIGN : XSEC_METRIC_VERIFY,
+                si->getAlgorithmURI());
+
+            if (mp_signer != NULL) {
+
+                m_result = mp_handler->signToSafeBuffer(&chain, si->getAlgorithmURI(),
+                    mp_signature->mp_signingKey, si->getHMACOutputLength(), m_signatureValue) != 0;
+
+                if (!m_result) {
+                    m_failed = true;
+                    m_cryptoError.sbStrcpyIn("Unexpected error in handler whilst signing");
+                }
+
+            }
+            else {
+
+                m_result = mp_handler->verifyBase64Signature(&chain, si->getAlgorithmURI(),
+                    m_signatureValue.rawCharBuffer(), si->getHMACOutputLength(),
+                    mp_signature->mp_signingKey);
+
+            }
+
+        }
+        catch (const XSECException& e) {
+            m_result = false;
+            m_failed = true;
+            m_error.sbXMLChIn(e.getMsg());
+        }
+        catch (const XSECCryptoException& e) {
+            m_result = false;
+            m_failed = true;
+            m_cryptoError.sbStrcpyIn(e.getMsg());
+        }
+    }
+
+    virtual void complete() {
+
+        // Transcoding is left to this (the caller's) thread
+        if (m_failed && m_cryptoError.sbStrlen() > 0)
+            m_error.sbTranscodeIn(m_cryptoError.rawCharBuffer());
+
+        if (mp_signer != NULL) {
+            if (m_result)
+                mp_signer->setSignatureValue(m_signatureValue);
+        }
+        else if (!m_result && !m_failed) {
+            mp_signature->m_errStr.sbXMLChCat("Validation of <SignedInfo> failed");
+        }
+
+        if (mp_callback != NULL) {
+            mp_callback->signatureComplete(mp_signature, m_result && m_referencesOK,
+                m_failed ? m_error.rawXMLChBuffer() : NULL);
+        }
+    }
+
+private:
+
+    const DSIGSignature*        mp_signature;
+    DSIGSignature*              mp_signer;      // Only set for a sign
+    XSECAsyncCallback*          mp_callback;
+    const XSECAlgorithmHandler* mp_handler;
+    bool                        m_referencesOK;
+
+    safeBuffer                  m_signedInfo;
+    unsigned int                m_signedInfoLen;
+    safeBuffer                  m_signatureValue;
+
+    bool                        m_result;
+    bool                        m_failed;
+    safeBuffer                  m_error;
+    safeBuffer                  m_cryptoError;
+};
+
+unsigned int DSIGSignature::readSignedInfoInput(safeBuffer& sb) const {
+
+    TXFMChain* chain = getSignedInfoInput();
+    Janitor<TXFMChain> j_chain(chain);
+
+    XMLByte buf[2048];
+    unsigned int total = 0;
+    unsigned int bytes;
+
+    while ((bytes = chain->getLastTxfm()->readBytes(buf, 2048)) > 0) {
+        sb.sbMemcpyIn(total, buf, bytes);
+        total += bytes;
+    }
+
+    return total;
+}
+
+void DSIGSignature::verifyAsync(XSECAsyncQueue& queue, XSECAsyncCallback* callback) const {
+
+    if (!m_loaded) {
+        throw XSECException(XSECException::SigVfyError,
+                    "DSIGSignature::verifyAsync() called prior to DSIGSignature::load()");
+    }
+
+    m_errStr.sbXMLChIn(DSIGConstants::s_unicodeStrEmpty);
+
+    // References are checked now, while we know the DOM is stable.  The
+    // key operation is always deferred, so the fail fast policy can only
+    // stop at the first bad reference.
+
+    bool referenceCheckResult = checkReferenceLimits() &&
+        mp_signedInfo->verify(m_errStr, m_verificationPolicy == VERIFY_FAIL_FAST);
+
+    prepareVerify();
+
+    const XSECAlgorithmHandler* handler =
+        XSECPlatformUtils::g_algorithmMapper->mapURIToHandler(
+                    mp_signedInfo->getAlgorithmURI());
+
+    if (handler == NULL) {
+        throw XSECException(XSECException::SigVfyError,
+            "Hash method unknown in DSIGSignature::verifyAsync()");
+    }
+
+    DSIGSignatureAsyncOp* op;
+    XSECnew(op, DSIGSignatureAsyncOp(this, NULL, callback, handler, referenceCheckResult));
+    queue.addOperation(op);
+}
+
+void DSIGSignature::signAsync(XSECAsyncQueue& queue, XSECAsyncCallback* callback) {
+
+    if (!m_loaded) {
+        throw XSECException(XSECException::SigVfyError,
+                    "DSIGSignature::signAsync() called prior to DSIGSignature::load()");
+    }
+
+    if (mp_signingKey == NULL) {
+        throw XSECException(XSECException::SigVfyError,
+            "DSIGSignature::signAsync() - no signing key loaded");
+    }
+
+    m_errStr.sbXMLChIn(DSIGConstants::s_unicodeStrEmpty);
+
+    // Set up the reference list hashes - including any manifests
+    mp_signedInfo->hash(m_interlockingReferences, m_incrementalSign ? &m_changes : NULL);
+
+    const XSECAlgorithmHandler* handler =
+        XSECPlatformUtils::g_algorithmMapper->mapURIToHandler(
+                    mp_signedInfo->getAlgorithmURI());
+
+    if (handler == NULL) {
+        throw XSECException(XSECException::SigVfyError,
+            "Hash method unknown in DSIGSignature::signAsync()");
+    }
+
+    DSIGSignatureAsyncOp* op;
+    XSECnew(op, DSIGSignatureAsyncOp(this, this, callback, handler, true));
+    queue.addOperation(op);
+}
+
 // --------------------------------------------------------------------------------
 //           Key Management
 // --------------------------------------------------------------------------------
@@ -37,6 +37,7 @@
 #include <xsec/dsig/DSIGKeyInfoList.hpp>
 #include <xsec/dsig/DSIGConstants.hpp>
 #include <xsec/dsig/DSIGSignedInfo.hpp>
+#include <xsec/dsig/DSIGReference.hpp>
 
 // Xerces Includes
 
@@ -53,6 +54,8 @@ class DSIGKeyInfoPGPData;
 class DSIGKeyInfoSPKIData;
 class DSIGKeyInfoMgmtData;
 class DSIGObject;
+class XSECAsyncQueue;
+class XSECAsyncCallback;
 
 /**
  * @ingroup pubsig
@@ -109,10 +112,43 @@ public:
       * into local structures.  Will throw various exceptions if it finds that
       * the DOM structure is not in line with the XML Signature standard.
       *
+      * If lazy loading is enabled, the KeyInfo list, Objects and Manifest
+      * References are not read until first used.
+      *
+      * @see #setLazyLoad
       */
 
     void load();
 
+    /**
+      * \brief Defer loading of parts of the signature until they are used
+      *
+      * When set prior to load(), only the SignedInfo (with its References
+      * and their Transforms) and the SignatureValue are read by load().
+      * The KeyInfo list is read when getKeyInfoList() is called or a key
+      * has to be resolved, the Objects when they are accessed, and the
+      * References in a Manifest when getManifestReferenceList() is called
+      * or the Manifest is hashed.  A signature checked with a key set via
+      * setSigningKey() using verifySignatureOnly() never reads them.
+      *
+      * Errors in a deferred part are thrown from the call that first
+      * needs it, and again on each later attempt.
+      *
+      * By default everything is read by load() (flag is false)
+      *
+      * @param flag true to defer loading
+      */
+
+    void setLazyLoad(bool flag);
+
+    /**
+      * \brief Tell caller whether lazy loading is active
+      *
+      * @returns True if parts of the signature are read on first use
+      */
+
+    bool getLazyLoad() const;
+
     /**
       * \brief Externally set the signing/verification key
       *
@@ -128,6 +164,29 @@ public:
 
     void setSigningKey(XSECCryptoKey* k);
 
+    /**
+      * \brief Re-target the object at a new signature
+      *
+      * Discards everything loaded from or created in the current document
+      * (the SignedInfo, references, KeyInfo list, Objects) along with the
+      * signing key, and binds the object to a new signature node.  load()
+      * must then be called as for a new object, and a key set or resolved
+      * again.  Cached namespace classifications are always dropped, even
+      * if the new document has the address of one already released.
+      *
+      * The formatter, environment and buffers are kept, as are settings
+      * such as namespace prefixes, Id attribute names and the KeyInfo and
+      * URI resolvers, so re-using an object is cheaper than releasing it
+      * and creating a new one.
+      *
+      * @param doc The DOM document holding the new signature (or NULL
+      * if createBlankSignature will be called)
+      * @param sigNode The Signature node within doc (or NULL)
+      */
+
+    void reset(XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument* doc = NULL,
+               XERCES_CPP_NAMESPACE_QUALIFIER DOMNode* sigNode = NULL);
+
     //@}
 
     /** @name Signature Operations */
@@ -147,6 +206,11 @@ public:
       *        <li>Validate the signature of the hash previously calculated.
       * </ul>
       *
+      * <p>With the VERIFY_FAIL_FAST policy the signature is checked first,
+      * and the references only if it is valid, stopping at the first that
+      * fails.  Under either policy, any limits set with
+      * setReferenceLimits() are checked before anything is digested.</p>
+      *
       * @returns true/false
       *        <ul>
       *        <li><b>true</b> = Signature (and all references) validated correctly.
@@ -171,6 +235,114 @@ public:
 
     bool verifySignatureOnly() const;
 
+    /**
+      * \brief The order and extent of the checks made by verify()
+      */
+
+    enum VerificationPolicy {
+
+        VERIFY_FULL = 0,            // References then SignatureValue, reporting
+                                    // every failure (the default)
+        VERIFY_FAIL_FAST = 1        // SignatureValue first, then references up
+                                    // to the first failure
+
+    };
+
+    /**
+      * \brief Set how verify() checks the signature
+      *
+      * <p>VERIFY_FULL digests every reference, so that #getErrMsgs lists
+      * all of the problems with a signature.  VERIFY_FAIL_FAST avoids
+      * digesting anything for a signature whose SignatureValue is wrong,
+      * and stops at the first bad reference, so the error messages only
+      * describe the first failure.</p>
+      *
+      * <p>The result of a successful verification is the same either way.</p>
+      *
+      * @param policy The policy to use
+      */
+
+    void setVerificationPolicy(VerificationPolicy policy) {m_verificationPolicy = policy;}
+
+    /**
+      * \brief Get the current verification policy
+      */
+
+    VerificationPolicy getVerificationPolicy() const {return m_verificationPolicy;}
+
+    /**
+      * \brief Limit the work a signature can ask for
+      *
+      * <p>When set, verify() and verifyAsync() count the references
+      * (including those in Manifests) and the transforms on each before
+      * digesting anything, and fail the signature if either is over the
+      * limit.</p>
+      *
+      * <p>With lazy loading (see XSECEnv::setLazyLoadFlag) the elements of
+      * each Manifest are counted before it is loaded, and Manifests are
+      * loaded one at a time, so checking stops at the first Manifest that
+      * takes the total over the limit without parsing it or any that
+      * follow.</p>
+      *
+      * @param maxReferences Most References allowed in total, or 0 for no limit
+      * @param maxTransforms Most Transforms allowed on one Reference, or 0
+      * for no limit
+      */
+
+    void setReferenceLimits(unsigned int maxReferences, unsigned int maxTransforms) {
+        m_maxReferences = maxReferences;
+        m_maxTransforms = maxTransforms;
+    }
+
+    /**
+     * \brief Only re-digest References whose content has changed
+     *
+     * <p>Where a document is edited and re-signed many times, most of the
+     * References are usually unaffected by each edit.  With incremental
+     * signing on, #sign keeps the DigestValue calculated for a Reference
+     * the last time round unless a node passed to #markDirty since then
+     * lies within, or contains, the node the Reference points to.  A
+     * Reference whose digest changes is itself a change, so Manifests and
+     * interlocking References that cover it are also brought up to date.</p>
+     *
+     * <p>Only same document References ("", "#id" and the equivalent
+     * xpointers) whose Transforms are enveloped signature, canonicalisation
+     * or base64 can be kept.  Everything else, and any Reference not
+     * yet hashed by this object, is always digested.</p>
+     *
+     * <p>The library cannot see edits made to the DOM, so the caller
+     * <em>must</em> mark everything it changes.  Turning this on or off
+     * discards the digests kept so far.</p>
+     *
+     * @param flag true to sign incrementally
+     */
+
+    void setIncrementalSign(bool flag) {
+        m_incrementalSign = flag;
+        m_changes.invalidate();
+    }
+
+    /**
+     * \brief Are References only re-digested when changed?
+     */
+
+    bool getIncrementalSign(void) const {return m_incrementalSign;}
+
+    /**
+     * \brief Record a change to the document
+     *
+     * Tell the signature that node, or something beneath it, has been
+     * changed since the last call to #sign.  For a removed node, mark its
+     * old parent.  Ignored unless #setIncrementalSign is on.
+     *
+     * @param node The node changed
+     */
+
+    void markDirty(const XERCES_CPP_NAMESPACE_QUALIFIER DOMNode* node) {
+        if (m_incrementalSign)
+            m_changes.markDirty(node);
+    }
+
     /**
       * \brief Sign a DSIGSignature DOM structure.
       *
@@ -197,6 +369,60 @@ public:
       */
 
     void sign();
+
+    /**
+      * \brief Verify a signature, deferring the key operation.
+      *
+      * <p>Does the same work as #verify, except that the final public key
+      * operation is left in the queue.  The reference digests are checked
+      * and the \<SignedInfo\> canonicalised before this returns, so the
+      * document may be modified (or other signatures in it verified)
+      * straight away.</p>
+      *
+      * <p>The result is passed to the callback during
+      * XSECAsyncQueue::wait(), at which point #getErrMsgs is also
+      * up to date.  The verification key and this object must remain
+      * valid until then.</p>
+      *
+      * <p>Reference limits apply as for #verify.  As the key operation
+      * always comes last, VERIFY_FAIL_FAST only stops the reference
+      * checks at the first failure.</p>
+      *
+      * <p>The deferred key operation is a normal, blocking call on the
+      * key, made from one of the queue's threads.  There is no
+      * asynchronous key interface (or OpenSSL ASYNC_JOB support), so the
+      * benefit is only that wait() runs many verifications in
+      * parallel.</p>
+      *
+      * @param queue The queue to add the key operation to
+      * @param callback Told the result, may be NULL
+      * @throws XSECException if the signature cannot be verified at all
+      * (as for #verify)
+      * @see XSECAsyncQueue
+      */
+
+    void verifyAsync(XSECAsyncQueue& queue, XSECAsyncCallback* callback) const;
+
+    /**
+      * \brief Sign a signature, deferring the key operation.
+      *
+      * <p>Does the same work as #sign, except that the final private key
+      * operation is left in the queue.  The reference digests are set
+      * before this returns.  The SignatureValue is only set during
+      * XSECAsyncQueue::wait(), so the \<SignedInfo\> (and the
+      * signing key) must not be changed until then.</p>
+      *
+      * <p>As for #verifyAsync, the key operation is a normal, blocking
+      * call made from one of the queue's threads.  It is not an
+      * asynchronous key or engine operation.</p>
+      *
+      * @param queue The queue to add the key operation to
+      * @param callback Told the result, may be NULL
+      * @throws XSECException (for errors found before the key operation)
+      * @see XSECAsyncQueue
+      */
+
+    void signAsync(XSECAsyncQueue& queue, XSECAsyncCallback* callback);
     //@}
 
     /** @name Functions to create and manipulate signature elements. */
@@ -627,7 +853,13 @@ public:
      * @returns A pointer to the DSIGKeyInfoList object held by the DSIGSignature
      */
 
-    DSIGKeyInfoList* getKeyInfoList() {return &m_keyInfoList;}
+    DSIGKeyInfoList* getKeyInfoList() {
+
+        if (m_keyInfoPending)
+            loadKeyInfo();
+        return &m_keyInfoList;
+
+    }
 
     /**
      * \brief Get the list of \<KeyInfo\> elements.
@@ -644,7 +876,13 @@ public:
      * @returns A pointer to the DSIGKeyInfoList object held by the DSIGSignature
      */
 
-    const DSIGKeyInfoList* getKeyInfoList() const {return &m_keyInfoList;}
+    const DSIGKeyInfoList* getKeyInfoList() const {
+
+        if (m_keyInfoPending)
+            const_cast<DSIGSignature*>(this)->loadKeyInfo();
+        return &m_keyInfoList;
+
+    }
 
     /**
      * \brief Clear out all KeyInfo elements in the signature.
@@ -889,6 +1127,7 @@ public:
     //@}
 
     friend class XSECProvider;
+    friend class DSIGSignatureAsyncOp;
 
 private:
 
@@ -902,8 +1141,14 @@ private:
 
     // Internal functions
     void createKeyInfoElement();
+    void loadKeyInfo();
+    void loadObjects();
     bool verifySignatureOnlyInternal() const;
+    void prepareVerify() const;
+    bool checkReferenceLimits() const;
     TXFMChain* getSignedInfoInput() const;
+    unsigned int readSignedInfoInput(safeBuffer& sb) const;
+    void setSignatureValue(const safeBuffer& b64Buf);
 
     // Initialisation
     static void Initialise();
@@ -917,6 +1162,7 @@ private:
     safeBuffer m_signatureValueSB;
     DSIGKeyInfoList m_keyInfoList;
     XERCES_CPP_NAMESPACE_QUALIFIER DOMNode* mp_KeyInfoNode;
+    bool m_keyInfoPending;        // KeyInfo not yet read (lazy loading)
     mutable safeBuffer m_errStr;
 
     // Environment
@@ -930,10 +1176,20 @@ private:
 
     // Objects
     ObjectVectorType m_objects;
+    XERCES_CPP_NAMESPACE_QUALIFIER DOMNode* mp_pendingObjectNode;    // First Object not yet read
 
     // Interlocking references
     bool m_interlockingReferences;
 
+    // Verification
+    VerificationPolicy m_verificationPolicy;
+    unsigned int m_maxReferences;
+    unsigned int m_maxTransforms;
+
+    // Incremental signing
+    bool m_incrementalSign;
+    mutable DSIGChangeTracker m_changes;
+
     // Not implemented constructors
 
     DSIGSignature();
@@ -86,16 +86,20 @@ DSIGSignedInfo::~DSIGSignedInfo() {
 //           Verify each reference element
 // --------------------------------------------------------------------------------
 
-bool DSIGSignedInfo::verify(safeBuffer& errStr) const {
-	return DSIGReference::verifyReferenceList(mp_referenceList, errStr);
+bool DSIGSignedInfo::verify(safeBuffer& errStr, bool stopOnFailure) const {
+	return DSIGReference::verifyReferenceList(mp_referenceList, errStr, stopOnFailure);
 }
 
 // --------------------------------------------------------------------------------
 //           Calculate and set hash values for each reference element
 // --------------------------------------------------------------------------------
 
-void DSIGSignedInfo::hash(bool interlockingReferences) const {
-	DSIGReference::hashReferenceList(mp_referenceList, interlockingReferences);
+void DSIGSignedInfo::hash(bool interlockingReferences, DSIGChangeTracker* changes) const {
+	DSIGReference::hashReferenceList(mp_referenceList, interlockingReferences, changes);
+
+	// Every reference has now caught up with the changes
+	if (changes != NULL)
+		changes->clear();
 }
 
 // --------------------------------------------------------------------------------
@@ -204,7 +208,7 @@ void DSIGSignedInfo::load() {
 		throw XSECException(XSECException::LoadEmptySignedInfo);
 	}
 
-	if (!strEquals(getDSIGLocalName(mp_signedInfoNode), "SignedInfo")) {
+	if (!strEquals(mp_env->getLocalName(mp_signedInfoNode, XSEC_NS_DSIG), "SignedInfo")) {
 		throw XSECException(XSECException::LoadNonSignedInfo);
 	}
 
@@ -221,7 +225,7 @@ void DSIGSignedInfo::load() {
 		tmpSI = tmpSI->getNextSibling();
 	}
 
-	if (tmpSI == 0 || !strEquals(getDSIGLocalName(tmpSI), "CanonicalizationMethod")) {
+	if (tmpSI == 0 || !strEquals(mp_env->getLocalName(tmpSI, XSEC_NS_DSIG), "CanonicalizationMethod")) {
 		throw XSECException(XSECException::ExpectedDSIGChildNotFound, 
 				"Expected <CanonicalizationMethod> as first child of <SignedInfo>");
 	}
@@ -252,7 +256,7 @@ void DSIGSignedInfo::load() {
 		tmpSI = tmpSI->getNextSibling();
 	}
 
-	if (tmpSI == 0 || !strEquals(getDSIGLocalName(tmpSI), "SignatureMethod")) {
+	if (tmpSI == 0 || !strEquals(mp_env->getLocalName(tmpSI, XSEC_NS_DSIG), "SignatureMethod")) {
 		throw XSECException(XSECException::ExpectedDSIGChildNotFound, 
 				"Expected <SignatureMethod> as child of <SignedInfo>");
 	}
@@ -282,7 +286,7 @@ void DSIGSignedInfo::load() {
 
 	DOMNode *tmpSOV = tmpSI->getFirstChild();
 	while (tmpSOV != NULL &&
-		(tmpSOV->getNodeType() != DOMNode::ELEMENT_NODE || !strEquals(getDSIGLocalName(tmpSOV), "HMACOutputLength"))) {
+		(tmpSOV->getNodeType() != DOMNode::ELEMENT_NODE || !strEquals(mp_env->getLocalName(tmpSOV, XSEC_NS_DSIG), "HMACOutputLength"))) {
 		if (tmpSOV->getNodeType() == DOMNode::ENTITY_REFERENCE_NODE) {
 			throw XSECException(XSECException::ExpectedDSIGChildNotFound,
 				"EntityReference nodes in <SignedInfo> are unsupported.");
@@ -300,7 +304,7 @@ void DSIGSignedInfo::load() {
 		if (tmpSOV != NULL) {
 
 			safeBuffer val;
-			val << (*mp_formatter << tmpSOV->getNodeValue());
+			val.sbUTF8In(tmpSOV->getNodeValue());
 			m_HMACOutputLength = atoi((char *) val.rawBuffer());
 
 		}
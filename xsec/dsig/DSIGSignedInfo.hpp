@@ -48,6 +48,7 @@ XSEC_DECLARE_XERCES_CLASS(DOMElement);
 #include <vector>
 
 class XSECEnv;
+class DSIGChangeTracker;
 
 /**
  * @ingroup pubsig
@@ -136,9 +137,10 @@ public:
      * validate the signature itself - this is done by DSIGSignature
      *
      * @param errStr The safeBuffer that error messages should be written to.
+     * @param stopOnFailure If true, stop at the first reference that fails
      */
 
-    bool verify(safeBuffer& errStr) const;
+    bool verify(safeBuffer& errStr, bool stopOnFailure = false) const;
 
     /**
      * \brief Hash the reference list
@@ -149,9 +151,11 @@ public:
      *
      * @param interlockingReferences Set to true if any references depend on other
      * references
+     * @param changes If not NULL, only hash the references affected by the
+     * changes it records (which are then cleared)
      */
 
-    void hash(bool interlockingReferences) const;
+    void hash(bool interlockingReferences, DSIGChangeTracker* changes = NULL) const;
 
     /**
      * \brief Create an empty SignedInfo
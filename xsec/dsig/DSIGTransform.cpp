@@ -52,3 +52,12 @@ DOMElement * DSIGTransform::createTransformNode() {
 	return ret;
 
 }
+
+const XMLCh * DSIGTransform::getAlgorithmURI(void) const {
+
+	if (mp_txfmNode == NULL || mp_txfmNode->getNodeType() != DOMNode::ELEMENT_NODE)
+		return NULL;
+
+	return static_cast<DOMElement *>(mp_txfmNode)->getAttributeNS(NULL, DSIGConstants::s_unicodeStrAlgorithm);
+
+}
@@ -147,6 +147,15 @@ public:
 
 	virtual void load(void) = 0;
 
+	/**
+	 * \brief Get the Algorithm URI of the transform
+	 *
+	 * @returns The Algorithm attribute of the \<Transform\> element, or
+	 * NULL if the element has not yet been created
+	 */
+
+	const XMLCh * getAlgorithmURI(void) const;
+
 	//@}
 
 protected:
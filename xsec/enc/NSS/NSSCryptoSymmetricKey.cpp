@@ -53,7 +53,7 @@ m_initialised(false),
 mp_k(NULL)
 {
 
-	
+	mp_wrapCtx[0] = mp_wrapCtx[1] = NULL;
 
 }
 
@@ -63,6 +63,8 @@ mp_k(NULL)
 
 NSSCryptoSymmetricKey::~NSSCryptoSymmetricKey() {
 
+  clearKeyWrapCtx();
+
   if (mp_k != 0)
 	  PK11_FreeSymKey(mp_k);
 
@@ -116,6 +118,8 @@ XSECCryptoKey * NSSCryptoSymmetricKey::clone() const {
 
 void NSSCryptoSymmetricKey::setKey(const unsigned char * key, unsigned int keyLen) {
 
+  clearKeyWrapCtx();
+
   if (mp_k != 0) {
 		PK11_FreeSymKey(mp_k);
     mp_k = 0;
@@ -164,6 +168,65 @@ void NSSCryptoSymmetricKey::setKey(const unsigned char * key, unsigned int keyLe
 
 }
 
+// --------------------------------------------------------------------------------
+//           Key wrap block operations
+// --------------------------------------------------------------------------------
+
+void NSSCryptoSymmetricKey::clearKeyWrapCtx(void) {
+
+	for (int i = 0; i < 2; ++i) {
+		if (mp_wrapCtx[i] != NULL) {
+			PK11_DestroyContext(mp_wrapCtx[i], PR_TRUE);
+			mp_wrapCtx[i] = NULL;
+		}
+	}
+
+}
+
+void NSSCryptoSymmetricKey::keyWrapBlock(bool forEncrypt,
+										 const unsigned char * inBlock,
+										 unsigned char * outBlock) {
+
+	PK11Context * ctx = mp_wrapCtx[forEncrypt ? 1 : 0];
+
+	if (ctx == NULL) {
+
+		if (mp_k == NULL) {
+			throw XSECCryptoException(XSECCryptoException::SymmetricError,
+				"NSS:SymmetricKey - Cannot wrap or unwrap without key");
+		}
+
+		// ECB keeps no state between blocks, so one context does for
+		// every block of every wrap with this key
+		SECItem * secParam = PK11_ParamFromIV(CKM_AES_ECB, NULL);
+		ctx = PK11_CreateContextBySymKey(CKM_AES_ECB,
+			forEncrypt ? CKA_ENCRYPT : CKA_DECRYPT, mp_k, secParam);
+		if (secParam)
+			SECITEM_FreeItem(secParam, PR_TRUE);
+
+		if (ctx == NULL) {
+			throw XSECCryptoException(XSECCryptoException::SymmetricError,
+				"NSS:SymmetricKey - Error creating key wrap context");
+		}
+
+		mp_wrapCtx[forEncrypt ? 1 : 0] = ctx;
+
+	}
+
+	unsigned char buf[16];
+	int outl = 0;
+
+	SECStatus s = PK11_CipherOp(ctx, buf, &outl, 16, (unsigned char *) inBlock, 16);
+
+	if (s != SECSuccess || outl != 16) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"NSS:SymmetricKey - Error processing block in AES key wrap");
+	}
+
+	memcpy(outBlock, buf, 16);
+
+}
+
 // --------------------------------------------------------------------------------
 //           Decrypt context initialisation
 // --------------------------------------------------------------------------------
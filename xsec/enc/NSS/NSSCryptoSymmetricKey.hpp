@@ -50,6 +50,9 @@
  *
  * This is the implementation for a wrapper of NSS symmetric
  * crypto functions.
+ *
+ * @note A key object is not thread safe.  The ECB contexts used for key
+ * wrap are kept with the key, so use a clone() per thread.
  */
 
 class XSEC_EXPORT NSSCryptoSymmetricKey : public XSECCryptoSymmetricKey {
@@ -274,6 +277,19 @@ public :
 
 	//@}
 
+protected:
+
+	/**
+	 * \brief Single block operation for key wrap
+	 *
+	 * Keeps an ECB context per direction for the life of the key, so
+	 * the key schedule is not rebuilt for every block of a key wrap.
+	 */
+
+	virtual void keyWrapBlock(bool forEncrypt,
+							  const unsigned char * inBlock,
+							  unsigned char * outBlock);
+
 private:
 
 	// Unimplemented constructors
@@ -283,6 +299,7 @@ private:
 	NSSCryptoSymmetricKey & operator= (const NSSCryptoSymmetricKey &);
 
 	int decryptCtxInit(const unsigned char * iv);
+	void clearKeyWrapCtx(void);
 
 	SymmetricKeyType				m_keyType;
 	SymmetricKeyMode				m_keyMode;		// ECB or CBC
@@ -296,6 +313,7 @@ private:
 
 	PK11Context *				mp_ctx;
 	PK11SymKey *					mp_k;
+	PK11Context *				mp_wrapCtx[2];	// Key wrap ECB contexts (decrypt, encrypt)
 
 };
 
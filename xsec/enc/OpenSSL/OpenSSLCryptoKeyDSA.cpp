@@ -35,6 +35,7 @@
 #include <xsec/enc/OpenSSL/OpenSSLCryptoBase64.hpp>
 #include <xsec/enc/XSECCryptoException.hpp>
 #include <xsec/enc/XSECCryptoUtils.hpp>
+#include <xsec/enc/XSCrypt/XSCryptCryptoBase64.hpp>
 #include <xsec/framework/XSECError.hpp>
 
 #include <xercesc/util/Janitor.hpp>
@@ -262,42 +263,27 @@ bool OpenSSLCryptoKeyDSA::verifyBase64Signature(unsigned char * hashBuf,
             "OpenSSL:DSA - Attempt to validate signature with empty key");
     }
 
-    char* cleanedBase64Signature;
-    unsigned int cleanedBase64SignatureLen = 0;
+    // Signature values are decoded strictly - anything other than base64
+    // and whitespace, or badly placed padding, is an error
 
-    cleanedBase64Signature =
-        XSECCryptoBase64::cleanBuffer(base64Signature, sigLen, cleanedBase64SignatureLen);
-    ArrayJanitor<char> j_cleanedBase64Signature(cleanedBase64Signature);
+    // DSA signatures (r and s, up to 256 bits each) fit on the stack
 
-    int sigValLen;
-    unsigned char* sigVal = new unsigned char[sigLen + 1];
-    ArrayJanitor<unsigned char> j_sigVal(sigVal);
+    unsigned char sigBuf[256];
+    unsigned char* sigVal = sigBuf;
+    if (sigLen + 1 > sizeof(sigBuf))
+        sigVal = new unsigned char[sigLen + 1];
+    ArrayJanitor<unsigned char> j_sigVal(sigVal == sigBuf ? NULL : sigVal);
 
-    EvpEncodeCtxRAII dctx;
+    int sigValLen;
 
-    if (!dctx.of()) {
-        throw XSECCryptoException(XSECCryptoException::ECError,
-            "OpenSSL:DSA - allocation fail during Context Creation");
+    try {
+        sigValLen = (int) XSCryptCryptoBase64::decodeStrict(
+            (const unsigned char *) base64Signature, sigLen, sigVal, sigLen + 1);
     }
-
-    EVP_DecodeInit(dctx.of());
-
-    int rc = EVP_DecodeUpdate(dctx.of(),
-                          sigVal,
-                          &sigValLen,
-                          (unsigned char *) cleanedBase64Signature,
-                          cleanedBase64SignatureLen);
-
-    if (rc < 0) {
-
+    catch (const XSECCryptoException &) {
         throw XSECCryptoException(XSECCryptoException::DSAError,
             "OpenSSL:DSA - Error during Base64 Decode");
     }
-    int t = 0;
-
-    EVP_DecodeFinal(dctx.of(), &sigVal[sigValLen], &t);
-
-    sigValLen += t;
 
     // Translate to BNs and thence to DSA_SIG
     BIGNUM * R;
@@ -42,12 +42,15 @@
 #include <xsec/utils/XSECPlatformUtils.hpp>
 
 #include <xercesc/util/Janitor.hpp>
+#include <xercesc/util/XMLString.hpp>
 
 XSEC_USING_XERCES(Janitor);
 XSEC_USING_XERCES(ArrayJanitor);
+XSEC_USING_XERCES(XMLString);
 
 
 #include <openssl/ecdsa.h>
+#include <openssl/ecdh.h>
 
 OpenSSLCryptoKeyEC::OpenSSLCryptoKeyEC() : mp_ecKey(NULL) {
 };
@@ -157,41 +160,27 @@ bool OpenSSLCryptoKeyEC::verifyBase64SignatureDSA(unsigned char * hashBuf,
             "OpenSSL:EC - Attempt to validate signature with empty key");
     }
 
-    char * cleanedBase64Signature;
-    unsigned int cleanedBase64SignatureLen = 0;
+    // Signature values are decoded strictly - anything other than base64
+    // and whitespace, or badly placed padding, is an error
 
-    cleanedBase64Signature =
-        XSECCryptoBase64::cleanBuffer(base64Signature, sigLen, cleanedBase64SignatureLen);
-    ArrayJanitor<char> j_cleanedBase64Signature(cleanedBase64Signature);
+    // Signatures on the usual curves (up to P-521) fit on the stack
 
-    int sigValLen;
-    unsigned char* sigVal = new unsigned char[sigLen + 1];
-    ArrayJanitor<unsigned char> j_sigVal(sigVal);
+    unsigned char sigBuf[256];
+    unsigned char* sigVal = sigBuf;
+    if (sigLen + 1 > sizeof(sigBuf))
+        sigVal = new unsigned char[sigLen + 1];
+    ArrayJanitor<unsigned char> j_sigVal(sigVal == sigBuf ? NULL : sigVal);
 
-    EvpEncodeCtxRAII dctx;
+    int sigValLen;
 
-    if (!dctx.of()) {
-        throw XSECCryptoException(XSECCryptoException::ECError,
-            "OpenSSL:EC - allocation fail during Context Creation");
+    try {
+        sigValLen = (int) XSCryptCryptoBase64::decodeStrict(
+            (const unsigned char *) base64Signature, sigLen, sigVal, sigLen + 1);
     }
-
-    EVP_DecodeInit(dctx.of());
-    int rc = EVP_DecodeUpdate(dctx.of(),
-                          sigVal,
-                          &sigValLen,
-                          (unsigned char *) cleanedBase64Signature,
-                          cleanedBase64SignatureLen);
-
-    if (rc < 0) {
-
+    catch (const XSECCryptoException &) {
         throw XSECCryptoException(XSECCryptoException::ECError,
             "OpenSSL:EC - Error during Base64 Decode");
     }
-    int t = 0;
-
-    EVP_DecodeFinal(dctx.of(), &sigVal[sigValLen], &t);
-
-    sigValLen += t;
 
     if (sigValLen <= 0 || sigValLen % 2 != 0) {
         throw XSECCryptoException(XSECCryptoException::ECError,
@@ -256,6 +245,12 @@ unsigned int OpenSSLCryptoKeyEC::signBase64SignatureDSA(unsigned char * hashBuf,
 
     unsigned int keyLen = 0;
     const EC_GROUP* group = EC_KEY_get0_group(mp_ecKey);
+#if (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+    // The group caches its order, so there is no need to copy it out
+    if (group) {
+        keyLen = (EC_GROUP_order_bits(group) + 7) / 8;
+    }
+#else
     if (group) {
         BIGNUM* order = BN_new();
         if (order) {
@@ -265,6 +260,7 @@ unsigned int OpenSSLCryptoKeyEC::signBase64SignatureDSA(unsigned char * hashBuf,
             BN_clear_free(order);
         }
     }
+#endif
 
     if (keyLen == 0) {
         throw XSECCryptoException(XSECCryptoException::ECError,
@@ -318,6 +314,128 @@ unsigned int OpenSSLCryptoKeyEC::signBase64SignatureDSA(unsigned char * hashBuf,
 
 
 
+// --------------------------------------------------------------------------------
+//           Key agreement
+// --------------------------------------------------------------------------------
+
+unsigned int OpenSSLCryptoKeyEC::deriveSharedSecret(const XSECCryptoKeyEC * publicKey,
+        unsigned char * secret,
+        unsigned int maxSecretLen) const {
+
+    if (mp_ecKey == NULL || EC_KEY_get0_private_key(mp_ecKey) == NULL) {
+        throw XSECCryptoException(XSECCryptoException::ECError,
+            "OpenSSL:EC - Key agreement requires a private key");
+    }
+
+    if (publicKey == NULL || !XMLString::equals(publicKey->getProviderName(), DSIGConstants::s_unicodeStrPROVOpenSSL)) {
+        throw XSECCryptoException(XSECCryptoException::ECError,
+            "OpenSSL:EC - Key agreement requires an OpenSSL public key");
+    }
+
+    const EC_KEY * peer = ((const OpenSSLCryptoKeyEC *) publicKey)->getOpenSSLEC();
+
+    if (peer == NULL || EC_KEY_get0_public_key(peer) == NULL ||
+        EC_GROUP_cmp(EC_KEY_get0_group(mp_ecKey), EC_KEY_get0_group(peer), NULL) != 0) {
+        throw XSECCryptoException(XSECCryptoException::ECError,
+            "OpenSSL:EC - Key agreement requires a public key on the same curve");
+    }
+
+    // Reject points that are not on the curve before using them
+    if (EC_KEY_check_key(peer) != 1) {
+        throw XSECCryptoException(XSECCryptoException::ECError,
+            "OpenSSL:EC - Peer public key is not valid");
+    }
+
+    unsigned int fieldLen = (EC_GROUP_get_degree(EC_KEY_get0_group(mp_ecKey)) + 7) / 8;
+    if (maxSecretLen < fieldLen) {
+        throw XSECCryptoException(XSECCryptoException::ECError,
+            "OpenSSL:EC - Buffer too small for shared secret");
+    }
+
+    int len = ECDH_compute_key(secret, fieldLen, EC_KEY_get0_public_key(peer), mp_ecKey, NULL);
+
+    if (len <= 0) {
+        throw XSECCryptoException(XSECCryptoException::ECError,
+            "OpenSSL:EC - Error calculating shared secret");
+    }
+
+    return (unsigned int) len;
+
+}
+
+XSECCryptoKeyEC * OpenSSLCryptoKeyEC::generateKeyPair(void) const {
+
+    if (mp_ecKey == NULL) {
+        throw XSECCryptoException(XSECCryptoException::ECError,
+            "OpenSSL:EC - Cannot generate a key pair without a curve");
+    }
+
+    EC_KEY * k = EC_KEY_new();
+    if (k == NULL || EC_KEY_set_group(k, EC_KEY_get0_group(mp_ecKey)) != 1 ||
+        EC_KEY_generate_key(k) != 1) {
+
+        if (k != NULL)
+            EC_KEY_free(k);
+
+        throw XSECCryptoException(XSECCryptoException::ECError,
+            "OpenSSL:EC - Error generating key pair");
+    }
+
+    OpenSSLCryptoKeyEC * ret;
+    XSECnew(ret, OpenSSLCryptoKeyEC);
+    ret->mp_ecKey = k;
+
+    return ret;
+
+}
+
+const char * OpenSSLCryptoKeyEC::getCurveName(void) const {
+
+    if (mp_ecKey == NULL)
+        return NULL;
+
+    int nid = EC_GROUP_get_curve_name(EC_KEY_get0_group(mp_ecKey));
+
+    return static_cast<OpenSSLCryptoProvider*>(XSECPlatformUtils::g_cryptoProvider)->NIDToCurveName(nid);
+
+}
+
+unsigned int OpenSSLCryptoKeyEC::getPublicKeyBase64(char * b64, unsigned int maxLen) const {
+
+    if (mp_ecKey == NULL || EC_KEY_get0_public_key(mp_ecKey) == NULL) {
+        throw XSECCryptoException(XSECCryptoException::ECError,
+            "OpenSSL:EC - No public key to export");
+    }
+
+    int octLen = i2o_ECPublicKey(mp_ecKey, NULL);
+    if (octLen <= 0) {
+        throw XSECCryptoException(XSECCryptoException::ECError,
+            "OpenSSL:EC - Error encoding public key");
+    }
+
+    unsigned char * oct;
+    XSECnew(oct, unsigned char[octLen]);
+    ArrayJanitor<unsigned char> j_oct(oct);
+
+    unsigned char * p = oct;
+    i2o_ECPublicKey(mp_ecKey, &p);
+
+    // Base64 output is 4/3 the size, plus line breaks and the terminator
+    if (maxLen < (unsigned int) (((octLen + 2) / 3) * 4 + (octLen / 48) + 4)) {
+        throw XSECCryptoException(XSECCryptoException::ECError,
+            "OpenSSL:EC - Buffer too small for encoded public key");
+    }
+
+    XSCryptCryptoBase64 enc;
+    enc.encodeInit();
+    unsigned int outLen = enc.encode(oct, octLen, (unsigned char *) b64, maxLen - 1);
+    outLen += enc.encodeFinish((unsigned char *) &b64[outLen], maxLen - 1 - outLen);
+    b64[outLen] = '\0';
+
+    return outLen;
+
+}
+
 XSECCryptoKey * OpenSSLCryptoKeyEC::clone() const {
 
     OpenSSLCryptoKeyEC * ret;
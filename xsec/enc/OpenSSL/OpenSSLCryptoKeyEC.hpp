@@ -150,6 +150,22 @@ public :
 
 	//@}
 
+	/** @name Key agreement methods */
+	//@{
+
+	virtual unsigned int deriveSharedSecret(const XSECCryptoKeyEC * publicKey,
+		unsigned char * secret,
+		unsigned int maxSecretLen) const;
+
+	virtual XSECCryptoKeyEC * generateKeyPair(void) const;
+
+	virtual const char * getCurveName(void) const;
+
+	virtual unsigned int getPublicKeyBase64(char * b64,
+		unsigned int maxLen) const;
+
+	//@}
+
 	/** @name OpenSSL Specific functions */
 	//@{
 
@@ -36,6 +36,7 @@
 #include <xsec/enc/OpenSSL/OpenSSLSupport.hpp>
 #include <xsec/enc/XSECCryptoException.hpp>
 #include <xsec/enc/XSECCryptoUtils.hpp>
+#include <xsec/enc/XSCrypt/XSCryptCryptoBase64.hpp>
 #include <xsec/framework/XSECError.hpp>
 
 #include "../../utils/XSECAlgorithmSupport.hpp"
@@ -290,14 +291,33 @@ const EVP_MD* getDigestFromHashType(XSECCryptoHash::HashType type) {
 }
 
 
+// Signatures only use the SHA family and MD5
+
+static const EVP_MD* getSignatureDigest(XSECCryptoHash::HashType type) {
+
+    if (type == XSECCryptoHash::HASH_MD5)
+        return EVP_get_digestbyname("MD5");
+
+    return getDigestFromHashType(type);
+}
+
+
 OpenSSLCryptoKeyRSA::OpenSSLCryptoKeyRSA() :
     mp_rsaKey(NULL),
     mp_accumE(NULL),
-    mp_accumN(NULL)
+    mp_accumN(NULL),
+    mp_evpKey(NULL)
 {
+    for (int i = 0; i <= XSECCryptoHash::HASH_SHA512; ++i) {
+        m_verifyContexts[i].prototype = NULL;
+        m_signContexts[i].prototype = NULL;
+    }
 };
 
 OpenSSLCryptoKeyRSA::~OpenSSLCryptoKeyRSA() {
+
+    releaseContexts();
+
     // If we have a RSA, delete it (OpenSSL will clear the memory)
 
     if (mp_rsaKey)
@@ -344,6 +364,8 @@ void OpenSSLCryptoKeyRSA::loadPublicModulusBase64BigNums(const char* b64, unsign
 
 void OpenSSLCryptoKeyRSA::setNBase(BIGNUM *nBase) {
 
+    releaseContexts();
+
     if (mp_rsaKey == NULL)
         mp_rsaKey = RSA_new();
 
@@ -369,6 +391,8 @@ void OpenSSLCryptoKeyRSA::loadPublicExponentBase64BigNums(const char* b64, unsig
 
 void OpenSSLCryptoKeyRSA::setEBase(BIGNUM *eBase) {
 
+    releaseContexts();
+
     if (mp_rsaKey == NULL)
         mp_rsaKey = RSA_new();
 
@@ -403,8 +427,13 @@ void OpenSSLCryptoKeyRSA::commitEN() {
 OpenSSLCryptoKeyRSA::OpenSSLCryptoKeyRSA(EVP_PKEY *k) :
     mp_rsaKey(NULL),
     mp_accumE(NULL),
-    mp_accumN(NULL)
+    mp_accumN(NULL),
+    mp_evpKey(NULL)
 {
+    for (int i = 0; i <= XSECCryptoHash::HASH_SHA512; ++i) {
+        m_verifyContexts[i].prototype = NULL;
+        m_signContexts[i].prototype = NULL;
+    }
 
     // Create a new key to be loaded as we go
 
@@ -431,6 +460,107 @@ OpenSSLCryptoKeyRSA::OpenSSLCryptoKeyRSA(EVP_PKEY *k) :
         RSA_set0_crt_params(mp_rsaKey, DUP_NON_NULL(dmp1), DUP_NON_NULL(dmq1), DUP_NON_NULL(iqmp));
 }
 
+// --------------------------------------------------------------------------------
+//           Signature contexts
+// --------------------------------------------------------------------------------
+
+EVP_PKEY_CTX* OpenSSLCryptoKeyRSA::acquireContext(bool sign, XSECCryptoHash::HashType type) const {
+
+    const EVP_MD* md = getSignatureDigest(type);
+    if (md == NULL) {
+        throw XSECCryptoException(XSECCryptoException::RSAError,
+            "OpenSSL:RSA - Unsupported HASH algorithm for RSA");
+    }
+
+    XERCES_CPP_NAMESPACE_QUALIFIER XMLMutexLock lock(&m_contextMutex);
+
+    ContextPool& pool = (sign ? m_signContexts[type] : m_verifyContexts[type]);
+
+    if (!pool.idle.empty()) {
+        EVP_PKEY_CTX* ctx = pool.idle.back();
+        pool.idle.pop_back();
+        return ctx;
+    }
+
+    // Another thread has the prototype (or none has been made yet), so
+    // start from a copy of the prototype with padding and digest in place
+
+    if (pool.prototype != NULL) {
+        EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_dup(pool.prototype);
+        if (ctx != NULL)
+            return ctx;
+    }
+
+    if (mp_evpKey == NULL) {
+        mp_evpKey = EVP_PKEY_new();
+        if (mp_evpKey == NULL || EVP_PKEY_set1_RSA(mp_evpKey, mp_rsaKey) != 1) {
+            throw XSECCryptoException(XSECCryptoException::RSAError,
+                "OpenSSL:RSA - Error creating EVP key");
+        }
+    }
+
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new(mp_evpKey, NULL);
+
+    if (ctx == NULL ||
+        (sign ? EVP_PKEY_sign_init(ctx) : EVP_PKEY_verify_init(ctx)) <= 0 ||
+        EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) <= 0 ||
+        EVP_PKEY_CTX_set_signature_md(ctx, md) <= 0) {
+
+        if (ctx != NULL)
+            EVP_PKEY_CTX_free(ctx);
+
+        throw XSECCryptoException(XSECCryptoException::RSAError,
+            "OpenSSL:RSA - Error initialising signature context");
+    }
+
+    if (pool.prototype == NULL) {
+        pool.prototype = EVP_PKEY_CTX_dup(ctx);
+    }
+
+    return ctx;
+}
+
+void OpenSSLCryptoKeyRSA::returnContext(EVP_PKEY_CTX* ctx, bool sign, XSECCryptoHash::HashType type) const {
+
+    XERCES_CPP_NAMESPACE_QUALIFIER XMLMutexLock lock(&m_contextMutex);
+
+    // The key was changed while this context was in use
+    if (mp_evpKey == NULL || EVP_PKEY_CTX_get0_pkey(ctx) != mp_evpKey) {
+        EVP_PKEY_CTX_free(ctx);
+        return;
+    }
+
+    ContextPool& pool = (sign ? m_signContexts[type] : m_verifyContexts[type]);
+    pool.idle.push_back(ctx);
+}
+
+void OpenSSLCryptoKeyRSA::releaseContexts() {
+
+    XERCES_CPP_NAMESPACE_QUALIFIER XMLMutexLock lock(&m_contextMutex);
+
+    for (int i = 0; i <= XSECCryptoHash::HASH_SHA512; ++i) {
+
+        ContextPool* pools[2] = {&m_verifyContexts[i], &m_signContexts[i]};
+
+        for (int j = 0; j < 2; ++j) {
+
+            if (pools[j]->prototype != NULL) {
+                EVP_PKEY_CTX_free(pools[j]->prototype);
+                pools[j]->prototype = NULL;
+            }
+
+            for (std::vector<EVP_PKEY_CTX*>::size_type k = 0; k < pools[j]->idle.size(); ++k)
+                EVP_PKEY_CTX_free(pools[j]->idle[k]);
+            pools[j]->idle.clear();
+        }
+    }
+
+    if (mp_evpKey != NULL) {
+        EVP_PKEY_free(mp_evpKey);
+        mp_evpKey = NULL;
+    }
+}
+
 // --------------------------------------------------------------------------------
 //           Verify a signature encoded as a Base64 string
 // --------------------------------------------------------------------------------
@@ -449,100 +579,56 @@ bool OpenSSLCryptoKeyRSA::verifySHA1PKCS1Base64Signature(
             "OpenSSL:RSA - Attempt to validate signature with empty key");
     }
 
-    char* cleanedBase64Signature;
-    unsigned int cleanedBase64SignatureLen = 0;
+    // Signature values are decoded strictly - anything other than base64
+    // and whitespace, or badly placed padding, is an error
 
-    cleanedBase64Signature =
-        XSECCryptoBase64::cleanBuffer(base64Signature, sigLen, cleanedBase64SignatureLen);
-    ArrayJanitor<char> j_cleanedBase64Signature(cleanedBase64Signature);
+    // Signatures for common key sizes fit on the stack
 
-    int sigValLen;
-    unsigned char* sigVal = new unsigned char[sigLen + 1];
-    ArrayJanitor<unsigned char> j_sigVal(sigVal);
+    int keySize = RSA_size(mp_rsaKey);
 
-    EvpEncodeCtxRAII dctx;
+    unsigned char sigBuf[1025];
+    unsigned char* sigVal = sigBuf;
+    if (sigLen + 1 > sizeof(sigBuf))
+        sigVal = new unsigned char[sigLen + 1];
+    ArrayJanitor<unsigned char> j_sigVal(sigVal == sigBuf ? NULL : sigVal);
 
-    if (!dctx.of()) {
-        throw XSECCryptoException(XSECCryptoException::RSAError,
-            "OpenSSL:RSA - allocation fail during Context Creation");
-    }
-
-    EVP_DecodeInit(dctx.of());
-    int rc = EVP_DecodeUpdate(dctx.of(),
-                          sigVal,
-                          &sigValLen,
-                          (unsigned char *) cleanedBase64Signature,
-                          cleanedBase64SignatureLen);
+    int sigValLen;
 
-    if (rc < 0) {
+    try {
+        sigValLen = (int) XSCryptCryptoBase64::decodeStrict(
+            (const unsigned char *) base64Signature, sigLen, sigVal, sigLen + 1);
+    }
+    catch (const XSECCryptoException &) {
         throw XSECCryptoException(XSECCryptoException::RSAError,
             "OpenSSL:RSA - Error during Base64 Decode");
     }
-    int t = 0;
-
-    EVP_DecodeFinal(dctx.of(), &sigVal[sigValLen], &t);
 
-    sigValLen += t;
+    unsigned int decodedLen = (unsigned int) sigValLen;
 
     // OpenSSL allows the signature size to be less than the key size.
     // Java does not and the spec requires that this fail, so we have to
     // perform this check.
 
-    int keySize = RSA_size(mp_rsaKey);
-    if (keySize != sigValLen) {
+    if (keySize != (int) decodedLen) {
             throw XSECCryptoException(XSECCryptoException::RSAError,
                 "OpenSSL:RSA - Signature size does not match key size");
     }
 
-    // Now decrypt
-
-    unsigned char* decryptBuf;
-
-    // Decrypt will always be longer than (RSA_len(key) - 11)
-    decryptBuf = new unsigned char[RSA_size(mp_rsaKey)];
-    ArrayJanitor<unsigned char> j_decryptBuf(decryptBuf);
-
     // Note at this time only supports PKCS1 padding
     // As that is what is defined in the standard.
-    // If this ever changes we will need to pass some paramaters
-    // into this function to allow it to determine what the
-    // padding should be and what the message digest OID should
-    // be.
-
-    int decryptSize = RSA_public_decrypt(sigValLen,
-                                             sigVal,
-                                             decryptBuf,
-                                             mp_rsaKey,
-                                             RSA_PKCS1_PADDING);
-
-    if (decryptSize < 0) {
-        // Really - this is a failed signature check, not an exception!
-        return false;
-    }
+    // The context has the padding and digest (and so the DigestInfo
+    // that wraps the hash) set up already.
 
-    /* Check the OID */
-    int oidLen = 0;
-    unsigned char * oid = getRSASigOID(type, oidLen);
+    EVP_PKEY_CTX* ctx = acquireContext(false, type);
 
-    if (oid == NULL) {
-        throw XSECCryptoException(XSECCryptoException::RSAError,
-            "OpenSSL:RSA::verify() - Unsupported HASH algorithm for RSA");
-    }
+    int res = EVP_PKEY_verify(ctx, sigVal, decodedLen, hashBuf, hashLen);
 
-    if (decryptSize != (int) (oidLen + hashLen) || hashLen != oid[oidLen-1]) {
-        return false;
-    }
-
-    for (t = 0; t < oidLen; ++t) {
-        if (oid[t] != decryptBuf[t]) {
-            return false;
-        }
-    }
+    returnContext(ctx, false, type);
 
-    for (;t < decryptSize; ++t) {
-        if (hashBuf[t-oidLen] != decryptBuf[t]) {
-            return false;
-        }
+    if (res <= 0) {
+        // Really - this is a failed signature check, not an exception!
+        ERR_clear_error();
+        return false;
     }
 
     // All OK
@@ -568,45 +654,30 @@ unsigned int OpenSSLCryptoKeyRSA::signSHA1PKCS1Base64Signature(
             "OpenSSL:RSA - Attempt to sign data with empty key");
     }
 
-    // Build the buffer to be encrypted by prepending the SHA1 OID to the hash
+    // The context adds the DigestInfo for the hash type and the padding
 
-    unsigned char* encryptBuf;
-    unsigned char* preEncryptBuf;
-    unsigned char* oid;
-    int oidLen;
-    int encryptLen;
-    int preEncryptLen;
+    const EVP_MD* md = getSignatureDigest(type);
 
-    oid = getRSASigOID(type, oidLen);
-
-    if (oid == NULL) {
+    if (md == NULL) {
         throw XSECCryptoException(XSECCryptoException::RSAError,
             "OpenSSL:RSA::sign() - Unsupported HASH algorithm for RSA");
     }
 
-    if (hashLen != oid[oidLen-1]) {
+    if (hashLen != (unsigned int) EVP_MD_size(md)) {
         throw XSECCryptoException(XSECCryptoException::RSAError,
             "OpenSSL:RSA::sign() - hashLen incorrect for hash type");
     }
 
-    preEncryptLen = hashLen + oidLen;
-    preEncryptBuf = new unsigned char[preEncryptLen];
-    encryptBuf = new unsigned char[RSA_size(mp_rsaKey)];
-
-    memcpy(preEncryptBuf, oid, oidLen);
-    memcpy(&preEncryptBuf[oidLen], hashBuf, hashLen);
+    unsigned char* encryptBuf = new unsigned char[RSA_size(mp_rsaKey)];
+    size_t encryptLen = RSA_size(mp_rsaKey);
 
-    // Now encrypt
+    EVP_PKEY_CTX* ctx = acquireContext(true, type);
 
-    encryptLen = RSA_private_encrypt(preEncryptLen,
-                                     preEncryptBuf,
-                                     encryptBuf,
-                                     mp_rsaKey,
-                                     RSA_PKCS1_PADDING);
+    int res = EVP_PKEY_sign(ctx, encryptBuf, &encryptLen, hashBuf, hashLen);
 
-    delete[] preEncryptBuf;
+    returnContext(ctx, true, type);
 
-    if (encryptLen < 0) {
+    if (res <= 0) {
         delete[] encryptBuf;
         throw XSECCryptoException(XSECCryptoException::RSAError,
             "OpenSSL:RSA::sign() - Error encrypting hash");
@@ -622,7 +693,7 @@ unsigned int OpenSSLCryptoKeyRSA::signSHA1PKCS1Base64Signature(
 
     // Translate signature to Base64
 
-    BIO_write(b64, encryptBuf, encryptLen);
+    BIO_write(b64, encryptBuf, (int) encryptLen);
     BIO_flush(b64);
 
     unsigned int sigValLen = BIO_read(bmem, base64SignatureBuf, base64SignatureBufLen);
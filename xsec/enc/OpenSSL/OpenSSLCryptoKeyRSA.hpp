@@ -36,6 +36,10 @@
 #if defined (XSEC_HAVE_OPENSSL)
 #include <openssl/evp.h>
 
+#include <xercesc/util/Mutexes.hpp>
+
+#include <vector>
+
 /**
  * \ingroup opensslcrypto
  */
@@ -44,6 +48,11 @@
  * \brief Implementation of the interface class for RSA keys.
  *
  * The library uses classes derived from this to process RSA keys.
+ *
+ * Signature operations run through EVP_PKEY_CTX objects that are set up
+ * once per hash algorithm (padding and digest already selected) and then
+ * re-used.  Each thread using the key takes its own context from a
+ * small pool, so a single key can be shared between threads.
  */
 
 class XSEC_EXPORT OpenSSLCryptoKeyRSA : public XSECCryptoKeyRSA {
@@ -247,6 +256,11 @@ public :
 
     /**
      * \brief Get OpenSSL RSA Object
+     *
+     * @note Signature contexts already set up for this key are not
+     * rebuilt if the returned object is changed directly.  Make any
+     * changes before the key is first used, or use the load methods,
+     * which discard the cached contexts.
      */
 
     RSA* getOpenSSLRSA() {return mp_rsaKey;}
@@ -261,9 +275,24 @@ public :
 
 private:
 
+    // Contexts set up for one operation and hash type
+    struct ContextPool {
+        EVP_PKEY_CTX* prototype;
+        std::vector<EVP_PKEY_CTX*> idle;
+    };
+
+    EVP_PKEY_CTX* acquireContext(bool sign, XSECCryptoHash::HashType type) const;
+    void returnContext(EVP_PKEY_CTX* ctx, bool sign, XSECCryptoHash::HashType type) const;
+    void releaseContexts();
+
     RSA* mp_rsaKey;
 
     BIGNUM *mp_accumE, *mp_accumN;
+
+    mutable EVP_PKEY* mp_evpKey;
+    mutable ContextPool m_verifyContexts[XSECCryptoHash::HASH_SHA512 + 1];
+    mutable ContextPool m_signContexts[XSECCryptoHash::HASH_SHA512 + 1];
+    mutable XERCES_CPP_NAMESPACE_QUALIFIER XMLMutex m_contextMutex;
     void setEBase(BIGNUM *eBase);
     void setNBase(BIGNUM *nBase);
 #if (OPENSSL_VERSION_NUMBER >= 0x10100000L)
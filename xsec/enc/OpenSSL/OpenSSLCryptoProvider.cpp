@@ -165,6 +165,17 @@ int OpenSSLCryptoProvider::curveNameToNID(const char* curveName) const {
             "OpenSSLCryptoProvider::curveNameToNID - curve name not recognized");
     return i->second;
 
+}
+
+const char* OpenSSLCryptoProvider::NIDToCurveName(int nid) const {
+
+    for (std::map<std::string,int>::const_iterator i = m_namedCurveMap.begin(); i != m_namedCurveMap.end(); ++i) {
+        if (i->second == nid)
+            return i->first.c_str();
+    }
+
+    return NULL;
+
 }
 #endif
 
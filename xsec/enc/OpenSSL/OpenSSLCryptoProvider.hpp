@@ -251,6 +251,16 @@ public :
      * @returns the corresponding NID
      */
     int curveNameToNID(const char* curveName) const;
+
+    /**
+     * \brief Map a curve NID to a curve name (in URI form).
+     *
+     * The reverse of curveNameToNID.
+     *
+     * @param nid the library identifier of the curve
+     * @returns the URI identifying the curve, or NULL if it is not known
+     */
+    const char* NIDToCurveName(int nid) const;
 #endif
 
     //@}
@@ -34,6 +34,9 @@
 #include <xsec/enc/OpenSSL/OpenSSLCryptoSymmetricKey.hpp>
 #include <xsec/framework/XSECError.hpp>
 #include <xsec/enc/XSECCryptoException.hpp>
+#include <xsec/utils/XSECPlatformUtils.hpp>
+#include <xsec/framework/XSECMetrics.hpp>
+#include "../../utils/XSECThreadPool.hpp"
 
 #include <xercesc/util/Janitor.hpp>
 XERCES_CPP_NAMESPACE_USE;
@@ -41,6 +44,7 @@ XERCES_CPP_NAMESPACE_USE;
 #if defined (XSEC_HAVE_OPENSSL)
 
 #include <string.h>
+#include <vector>
 
 #include <openssl/rand.h>
 
@@ -64,19 +68,29 @@ m_blockSize(0),
 m_ivSize(0),
 m_bytesInLastBlock(0),
 m_ivSent(false),
-m_doPad(false) {
+m_doPad(false),
+m_chainBytes(0),
+mp_decryptPool(NULL) {
     if (!mp_ctx)
         throw XSECCryptoException(XSECCryptoException::ECError, "OpenSSL::CryptoSymmetricKey - cannot allocate contexts");
 
 	EVP_CIPHER_CTX_init(mp_ctx);
 	m_keyBuf.isSensitive();
 
+	for (int i = 0; i < 4; ++i)
+		mp_wrapCtx[i] = NULL;
+
 }
 
 OpenSSLCryptoSymmetricKey::~OpenSSLCryptoSymmetricKey() {
 
 	// Clean up the context
 
+	clearKeyWrapCtx();
+
+	if (mp_decryptPool != NULL)
+		delete mp_decryptPool;
+
 	EVP_CIPHER_CTX_cleanup(mp_ctx);
 #if (OPENSSL_VERSION_NUMBER >= 0x10100000L)
     EVP_CIPHER_CTX_free(mp_ctx);
@@ -121,6 +135,9 @@ void OpenSSLCryptoSymmetricKey::setKey(const unsigned char * key, unsigned int k
 	m_keyBuf.sbMemcpyIn(key, keyLen);
 	m_keyLen = keyLen;
 
+	// Any key wrap schedule is now stale
+	clearKeyWrapCtx();
+
 }
 
 // --------------------------------------------------------------------------------
@@ -383,6 +400,12 @@ int OpenSSLCryptoSymmetricKey::decryptCtxInit(const unsigned char* iv, const uns
 	m_initialised = true;
 	m_bytesInLastBlock = 0;
 
+	// CBC chains from the IV
+	if (m_keyMode == MODE_CBC) {
+		memcpy(m_chainBlock, iv, m_blockSize);
+		m_chainBytes = 0;
+	}
+
 	// Disable OpenSSL padding - The interop samples have broken PKCS padding - AARGHH
 
 #if defined (XSEC_OPENSSL_CANSET_PADDING)
@@ -453,16 +476,22 @@ unsigned int OpenSSLCryptoSymmetricKey::decrypt(const unsigned char * inBuf,
 			"OpenSSLSymmetricKey::decrypt - Not enough space in output buffer");
 	}
 
+	if (decryptParallel(&inBuf[offset], &plainBuf[m_bytesInLastBlock], inLength - offset, outl)) {
+		// Done
+	}
 #if defined (XSEC_OPENSSL_CONST_BUFFERS)
-	if (EVP_DecryptUpdate(mp_ctx, &plainBuf[m_bytesInLastBlock], &outl, &inBuf[offset], inLength - offset) == 0) {
+	else if (EVP_DecryptUpdate(mp_ctx, &plainBuf[m_bytesInLastBlock], &outl, &inBuf[offset], inLength - offset) == 0) {
 #else
-	if (EVP_DecryptUpdate(mp_ctx, &plainBuf[m_bytesInLastBlock], &outl, (unsigned char *) &inBuf[offset], inLength - offset) == 0) {
+	else if (EVP_DecryptUpdate(mp_ctx, &plainBuf[m_bytesInLastBlock], &outl, (unsigned char *) &inBuf[offset], inLength - offset) == 0) {
 #endif
 		throw XSECCryptoException(XSECCryptoException::SymmetricError,
 			"OpenSSL:SymmetricKey - Error during OpenSSL decrypt"); 
 
 	}
 
+	if (m_keyMode == MODE_CBC)
+		trackCipherText(&inBuf[offset], inLength - offset);
+
 	// Store the last block if we are padding
 	if (m_doPad && m_blockSize > 0 && outl >= m_blockSize) {
 
@@ -483,6 +512,166 @@ unsigned int OpenSSLCryptoSymmetricKey::decrypt(const unsigned char * inBuf,
 
 }
 
+// --------------------------------------------------------------------------------
+//           Parallel CBC decrypt
+// --------------------------------------------------------------------------------
+
+// Decrypts one run of whole CBC blocks with its own context.  The IV is
+// the cipher text block preceding the run.
+
+class OpenSSLCBCDecryptTask : public XSECThreadTask {
+
+public:
+
+	OpenSSLCBCDecryptTask(const EVP_CIPHER * cipher,
+						  const unsigned char * key,
+						  const unsigned char * iv,
+						  const unsigned char * inBuf,
+						  unsigned char * plainBuf,
+						  unsigned int inLength) :
+		mp_cipher(cipher), mp_key(key), mp_iv(iv),
+		mp_inBuf(inBuf), mp_plainBuf(plainBuf), m_inLength(inLength) {}
+
+	virtual void run(void) {
+
+		EVP_CIPHER_CTX * ctx = EVP_CIPHER_CTX_new();
+		if (ctx == NULL) {
+			throw XSECCryptoException(XSECCryptoException::SymmetricError,
+				"OpenSSL:SymmetricKey - Cannot allocate context for parallel decrypt");
+		}
+
+		int outl = 0;
+		bool ok = (EVP_DecryptInit_ex(ctx, mp_cipher, NULL, mp_key, mp_iv) == 1);
+
+		if (ok) {
+			EVP_CIPHER_CTX_set_padding(ctx, 0);
+			ok = (EVP_DecryptUpdate(ctx, mp_plainBuf, &outl, mp_inBuf, (int) m_inLength) == 1 &&
+				(unsigned int) outl == m_inLength);
+		}
+
+		EVP_CIPHER_CTX_free(ctx);
+
+		if (!ok) {
+			throw XSECCryptoException(XSECCryptoException::SymmetricError,
+				"OpenSSL:SymmetricKey - Error during parallel OpenSSL decrypt");
+		}
+
+	}
+
+private:
+
+	const EVP_CIPHER		* mp_cipher;
+	const unsigned char		* mp_key;
+	const unsigned char		* mp_iv;
+	const unsigned char		* mp_inBuf;
+	unsigned char			* mp_plainBuf;
+	unsigned int			m_inLength;
+
+};
+
+void OpenSSLCryptoSymmetricKey::trackCipherText(const unsigned char * inBuf, unsigned int inLength) {
+
+	// Keep the last block of cipher text seen - when on a block boundary
+	// this is the IV for whatever comes next
+
+	if (inLength >= (unsigned int) m_blockSize) {
+		memcpy(m_chainBlock, &inBuf[inLength - m_blockSize], m_blockSize);
+	}
+	else if (inLength > 0) {
+		memmove(m_chainBlock, &m_chainBlock[inLength], m_blockSize - inLength);
+		memcpy(&m_chainBlock[m_blockSize - inLength], inBuf, inLength);
+	}
+
+	m_chainBytes = (int) ((m_chainBytes + inLength) % m_blockSize);
+
+}
+
+bool OpenSSLCryptoSymmetricKey::decryptParallel(const unsigned char * inBuf,
+												unsigned char * plainBuf,
+												unsigned int inLength,
+												int & outl) {
+
+#if defined (XSEC_OPENSSL_CANSET_PADDING)
+
+	unsigned int threads = XSECPlatformUtils::GetParallelDecryptionThreads();
+
+	// Only worth it (or possible) for big, block aligned CBC inputs
+	if (threads <= 1 || m_keyMode != MODE_CBC || m_chainBytes != 0 ||
+		inLength < XSECPlatformUtils::GetParallelDecryptionThreshold())
+		return false;
+
+	unsigned int bs = (unsigned int) m_blockSize;
+	unsigned int whole = inLength - (inLength % bs);
+	unsigned int per = ((whole / bs) / threads) * bs;
+
+	if (per == 0)
+		return false;
+
+	const EVP_CIPHER * cipher = EVP_CIPHER_CTX_cipher(mp_ctx);
+	const unsigned char * key = m_keyBuf.rawBuffer();
+
+	std::vector<OpenSSLCBCDecryptTask> tasks;
+	tasks.reserve(threads);
+
+	for (unsigned int i = 0; i < threads; ++i) {
+
+		unsigned int start = i * per;
+		unsigned int len = (i == threads - 1 ? whole - start : per);
+
+		tasks.push_back(OpenSSLCBCDecryptTask(cipher, key,
+			(i == 0 ? m_chainBlock : &inBuf[start - bs]),
+			&inBuf[start], &plainBuf[start], len));
+
+	}
+
+	// The pool is kept with the key, so a stream decrypted a chunk at a
+	// time only sets it up once
+	if (mp_decryptPool != NULL && mp_decryptPool->getThreadCount() != threads) {
+		delete mp_decryptPool;
+		mp_decryptPool = NULL;
+	}
+	if (mp_decryptPool == NULL)
+		XSECnew(mp_decryptPool, XSECThreadPool(threads));
+
+	for (unsigned int i = 0; i < threads; ++i)
+		mp_decryptPool->addTask(&tasks[i]);
+
+	{
+		XSECMetricTimer timer(XSEC_METRIC_PARALLEL_DECRYPT);
+		timer.setBytes(whole);
+		mp_decryptPool->runAll();
+	}
+
+	// Move the main context on to the end of the run, and hand it any
+	// partial block that is left over
+	int tail = 0;
+
+	if (EVP_DecryptInit_ex(mp_ctx, NULL, NULL, NULL, &inBuf[whole - bs]) == 0) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"OpenSSL:SymmetricKey - Error resetting IV after parallel decrypt");
+	}
+	EVP_CIPHER_CTX_set_padding(mp_ctx, 0);
+
+	if (whole < inLength &&
+		EVP_DecryptUpdate(mp_ctx, &plainBuf[whole], &tail, (unsigned char *) &inBuf[whole], inLength - whole) == 0) {
+
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"OpenSSL:SymmetricKey - Error during OpenSSL decrypt");
+
+	}
+
+	outl = (int) whole + tail;
+	return true;
+
+#else
+
+	// Without control of padding the context always holds back a block
+	return false;
+
+#endif
+
+}
+
 unsigned int OpenSSLCryptoSymmetricKey::decryptFinish(unsigned char * plainBuf,
 													  unsigned int maxOutLength) {
 
@@ -994,4 +1183,146 @@ unsigned int OpenSSLCryptoSymmetricKey::encryptFinish(unsigned char * cipherBuf,
 
 }
 
+// --------------------------------------------------------------------------------
+//           Key wrap
+// --------------------------------------------------------------------------------
+
+void OpenSSLCryptoSymmetricKey::clearKeyWrapCtx(void) {
+
+#if defined (XSEC_OPENSSL_HAVE_AES_WRAP)
+	for (int i = 0; i < 4; ++i) {
+		if (mp_wrapCtx[i] != NULL) {
+			EVP_CIPHER_CTX_free(mp_wrapCtx[i]);
+			mp_wrapCtx[i] = NULL;
+		}
+	}
+#endif
+
+}
+
+#if defined (XSEC_OPENSSL_HAVE_AES_WRAP)
+
+EVP_CIPHER_CTX * OpenSSLCryptoSymmetricKey::getKeyWrapCtx(bool encrypt, bool doPad) {
+
+	int idx = (encrypt ? 1 : 0) + (doPad ? 2 : 0);
+
+	if (mp_wrapCtx[idx] != NULL)
+		return mp_wrapCtx[idx];
+
+	if (m_keyLen == 0) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"OpenSSL:SymmetricKey - Cannot wrap or unwrap without key");
+	}
+
+	const EVP_CIPHER * cipher;
+
+	switch (m_keyType) {
+
+	case (KEY_AES_128) :
+		cipher = (doPad ? EVP_aes_128_wrap_pad() : EVP_aes_128_wrap());
+		break;
+
+	case (KEY_AES_192) :
+		cipher = (doPad ? EVP_aes_192_wrap_pad() : EVP_aes_192_wrap());
+		break;
+
+	case (KEY_AES_256) :
+		cipher = (doPad ? EVP_aes_256_wrap_pad() : EVP_aes_256_wrap());
+		break;
+
+	default :
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"OpenSSL:SymmetricKey - Key wrap requires an AES key");
+
+	}
+
+	EVP_CIPHER_CTX * ctx = EVP_CIPHER_CTX_new();
+
+	if (ctx == NULL) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"OpenSSL:SymmetricKey - Cannot allocate key wrap context");
+	}
+
+	EVP_CIPHER_CTX_set_flags(ctx, EVP_CIPHER_CTX_FLAG_WRAP_ALLOW);
+
+	if (EVP_CipherInit_ex(ctx, cipher, NULL, m_keyBuf.rawBuffer(), NULL, encrypt ? 1 : 0) != 1) {
+		EVP_CIPHER_CTX_free(ctx);
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"OpenSSL:SymmetricKey - Error initialising key wrap context");
+	}
+
+	mp_wrapCtx[idx] = ctx;
+	return ctx;
+
+}
+
+unsigned int OpenSSLCryptoSymmetricKey::wrapKey(const unsigned char * inBuf,
+												unsigned int inLength,
+												unsigned char * outBuf,
+												unsigned int maxOutLength,
+												bool doPad) {
+
+	if (inLength == 0 || (!doPad && inLength % 8 != 0)) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"OpenSSL:SymmetricKey - Key to wrap must be a multiple of 64 bits");
+	}
+
+	// RFC 3394 needs at least two blocks - fall back to the generic code
+	// for the (non-standard) single block case
+	if (!doPad && inLength < 16)
+		return XSECCryptoSymmetricKey::wrapKey(inBuf, inLength, outBuf, maxOutLength, doPad);
+
+	if (maxOutLength < ((inLength + 7) & ~7U) + 8) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"OpenSSL:SymmetricKey - Output buffer too small for wrapped key");
+	}
+
+	// The wrap ciphers keep no state between calls, so the context can be
+	// reused as is
+	EVP_CIPHER_CTX * ctx = getKeyWrapCtx(true, doPad);
+
+	int outl = 0;
+	if (EVP_CipherUpdate(ctx, outBuf, &outl, inBuf, inLength) != 1 || outl <= 0) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"OpenSSL:SymmetricKey - Error during key wrap");
+	}
+
+	return (unsigned int) outl;
+
+}
+
+unsigned int OpenSSLCryptoSymmetricKey::unwrapKey(const unsigned char * inBuf,
+												  unsigned int inLength,
+												  unsigned char * outBuf,
+												  unsigned int maxOutLength,
+												  bool doPad) {
+
+	if (inLength < 16 || inLength % 8 != 0) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"OpenSSL:SymmetricKey - Wrapped key not a multiple of 64 bits");
+	}
+
+	if (!doPad && inLength < 24)
+		return XSECCryptoSymmetricKey::unwrapKey(inBuf, inLength, outBuf, maxOutLength, doPad);
+
+	if (maxOutLength < inLength - 8) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"OpenSSL:SymmetricKey - Output buffer too small for unwrapped key");
+	}
+
+	EVP_CIPHER_CTX * ctx = getKeyWrapCtx(false, doPad);
+
+	int outl = 0;
+	if (EVP_CipherUpdate(ctx, outBuf, &outl, inBuf, inLength) != 1 || outl <= 0) {
+		memset(outBuf, 0, inLength - 8);
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"OpenSSL:SymmetricKey - Key unwrap failed integrity check");
+	}
+
+	return (unsigned int) outl;
+
+}
+
+#endif /* XSEC_OPENSSL_HAVE_AES_WRAP */
+
 #endif /* XSEC_HAVE_OPENSSL */
@@ -45,6 +45,8 @@
 
 #define MAX_BLOCK_SIZE      32
 
+class XSECThreadPool;
+
 /**
  * \ingroup opensslcrypto
  */
@@ -54,6 +56,11 @@
  *
  * This is the implementation for a wrapper of OpenSSL symmetric
  * crypto functions.
+ *
+ * @note A key object is not thread safe.  As well as the encrypt and
+ * decrypt state, it caches the EVP contexts used by wrapKey() and
+ * unwrapKey(), so even wrapping with one KEK from several threads at
+ * once needs a clone() of the key per thread.
  */
 
 class XSEC_EXPORT OpenSSLCryptoSymmetricKey : public XSECCryptoSymmetricKey {
@@ -276,6 +283,43 @@ public :
 
     //@}
 
+#if defined (XSEC_OPENSSL_HAVE_AES_WRAP)
+
+    /** @name Key wrap interface methods */
+    //@{
+
+    /**
+     * \brief Wrap a key using this (AES) key as the KEK
+     *
+     * Uses the OpenSSL AES key wrap ciphers.  A context is initialised
+     * the first time it is needed and then kept for the life of the key,
+     * so the key schedule is only built once per KEK.
+     *
+     * @see XSECCryptoSymmetricKey::wrapKey
+     */
+
+    virtual unsigned int wrapKey(const unsigned char * inBuf,
+                                 unsigned int inLength,
+                                 unsigned char * outBuf,
+                                 unsigned int maxOutLength,
+                                 bool doPad = false);
+
+    /**
+     * \brief Unwrap a key using this (AES) key as the KEK
+     *
+     * @see XSECCryptoSymmetricKey::unwrapKey
+     */
+
+    virtual unsigned int unwrapKey(const unsigned char * inBuf,
+                                   unsigned int inLength,
+                                   unsigned char * outBuf,
+                                   unsigned int maxOutLength,
+                                   bool doPad = false);
+
+    //@}
+
+#endif
+
     /** @name OpenSSL Library Specific functions */
     //@{
 
@@ -303,6 +347,15 @@ private:
 
     // Private functions
     int decryptCtxInit(const unsigned char* iv, const unsigned char* tag, unsigned int taglen);
+    bool decryptParallel(const unsigned char * inBuf,
+                         unsigned char * plainBuf,
+                         unsigned int inLength,
+                         int & outl);
+    void trackCipherText(const unsigned char * inBuf, unsigned int inLength);
+#if defined (XSEC_OPENSSL_HAVE_AES_WRAP)
+    EVP_CIPHER_CTX * getKeyWrapCtx(bool encrypt, bool doPad);
+#endif
+    void clearKeyWrapCtx(void);
 
     // Private variables
     SymmetricKeyType                m_keyType;
@@ -321,6 +374,17 @@ private:
     int                             m_bytesInLastBlock;
     bool                            m_ivSent;       // Has the IV been put in the stream
     bool                            m_doPad;        // Do we pad last block?
+
+    // CBC chaining state, so a large decrypt can be split across threads.
+    // The last cipher text block seen, and bytes since a block boundary
+    unsigned char                   m_chainBlock[MAX_BLOCK_SIZE];
+    int                             m_chainBytes;
+    XSECThreadPool                  *mp_decryptPool;    // Created on first parallel decrypt
+
+    // Key wrap contexts, indexed by direction and padding.  Created on
+    // first use and kept until the key changes.  Not locked - see the
+    // class note
+    EVP_CIPHER_CTX                  *mp_wrapCtx[4];
 };
 
 #endif /* XSEC_HAVE_OPENSSL */
@@ -20,7 +20,7 @@
 /*
  * XSEC
  *
- * XSCryptCryptoBase64 := Internal implementation of a base64 
+ * XSCryptCryptoBase64 := Internal implementation of a base64
  * encoder/decoder
  *
  * Author(s): Berin Lautenbach
@@ -32,11 +32,31 @@
 #include <xsec/enc/XSCrypt/XSCryptCryptoBase64.hpp>
 #include <xsec/enc/XSECCryptoException.hpp>
 
+#include <string.h>
+
+// The vector decoders are built on any x86 compiler that can target SSSE3
+// and AVX2 per function, and chosen at run time from what the CPU supports,
+// so a generic build still gets them.  Elsewhere only the table is used.
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#	include <intrin.h>
+#	include <immintrin.h>
+#	define XSCRYPT_BASE64_X86
+#	define XSCRYPT_TARGET_SSSE3
+#	define XSCRYPT_TARGET_AVX2
+#elif (defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#	include <immintrin.h>
+#	define XSCRYPT_BASE64_X86
+#	define XSCRYPT_TARGET_SSSE3 __attribute__((target("ssse3")))
+#	define XSCRYPT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
 // --------------------------------------------------------------------------------
 //           Lookup tables and macros
 // --------------------------------------------------------------------------------
 
-char Base64LookupTable[] = {
+static const char Base64LookupTable[] = {
 	'A','B','C','D','E','F','G','H','I','J','K','L','M',
 	'N','O','P','Q','R','S','T','U','V','W','X','Y','Z',
 	'a','b','c','d','e','f','g','h','i','j','k','l','m',
@@ -44,82 +64,311 @@ char Base64LookupTable[] = {
 	'0','1','2','3','4','5','6','7','8','9','+','/',
 };
 
-#define IS_UPPER(c) (c >= 'A' && c <= 'Z')
-#define IS_LOWER(c) (c >= 'a' && c <= 'z')
-#define IS_NUMBR(c) (c >= '0' && c <= '9')
-#define IS_OTHER(c) (c == '+' || c == '/')
-#define IS_B64CH(c) (IS_LOWER(c) || IS_UPPER(c) || IS_NUMBR(c) || IS_OTHER(c))
-#define IS_B64OE(c) (IS_B64CH(c) || c == '=')
+// Decode table.  0-63 are sextet values, B64_PAD is '=' and B64_SKIP is
+// anything else (whitespace or otherwise), which is silently dropped.
+// Both special values have one of the top two bits set, so a single mask
+// tells whether a group of four is plain base64.
+
+#define B64_PAD		0x40
+#define B64_SKIP	0x80
+#define B64_SPECIAL	0xC0
+
+static const unsigned char Base64DecodeTable[256] = {
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x3e,0x80,0x80,0x80,0x3f,
+	0x34,0x35,0x36,0x37,0x38,0x39,0x3a,0x3b,0x3c,0x3d,0x80,0x80,0x80,0x40,0x80,0x80,
+	0x80,0x00,0x01,0x02,0x03,0x04,0x05,0x06,0x07,0x08,0x09,0x0a,0x0b,0x0c,0x0d,0x0e,
+	0x0f,0x10,0x11,0x12,0x13,0x14,0x15,0x16,0x17,0x18,0x19,0x80,0x80,0x80,0x80,0x80,
+	0x80,0x1a,0x1b,0x1c,0x1d,0x1e,0x1f,0x20,0x21,0x22,0x23,0x24,0x25,0x26,0x27,0x28,
+	0x29,0x2a,0x2b,0x2c,0x2d,0x2e,0x2f,0x30,0x31,0x32,0x33,0x80,0x80,0x80,0x80,0x80,
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+};
 
 // --------------------------------------------------------------------------------
-//           Decoding
+//           Vector decoding
 // --------------------------------------------------------------------------------
 
-unsigned char decodeCh(unsigned char c) {
+// Each routine decodes one block of pure base64 characters (no whitespace
+// or padding).  If anything else is found in the block nothing is written
+// and false is returned, so the caller can fall back to the byte at a time
+// code.  The full vector width is stored, so the output must have room for
+// the number of input bytes, not just the number of decoded bytes.
+//
+// See W. Mula and D. Lemire, "Faster Base64 Encoding and Decoding using
+// AVX2 Instructions" for how the classification and packing work.
+
+typedef bool (*Base64DecodeBlockFn)(const unsigned char * in, unsigned char * out);
+
+struct Base64BlockDecoder {
+	Base64DecodeBlockFn		decodeBlock;	// NULL if no vector unit is usable
+	unsigned int			blockIn;
+	unsigned int			blockOut;
+};
+
+#if defined(XSCRYPT_BASE64_X86)
+
+XSCRYPT_TARGET_AVX2
+static bool decodeBlockAVX2(const unsigned char * in, unsigned char * out) {
+
+	const __m256i lut_lo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m256i lut_hi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71,
+		0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i mask_2F = _mm256_set1_epi8(0x2f);
+
+	__m256i str = _mm256_loadu_si256((const __m256i *) in);
+
+	// Classify each character by its high and low nibble
+	const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask_2F);
+	const __m256i lo_nibbles = _mm256_and_si256(str, mask_2F);
+	const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+	const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+
+	if (!_mm256_testz_si256(lo, hi))
+		return false;
+
+	// Translate to sextets
+	const __m256i eq_2F = _mm256_cmpeq_epi8(str, mask_2F);
+	const __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2F, hi_nibbles));
+	str = _mm256_add_epi8(str, roll);
+
+	// Pack four sextets into three bytes
+	const __m256i merge_ab_and_bc = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+	__m256i packed = _mm256_madd_epi16(merge_ab_and_bc, _mm256_set1_epi32(0x00011000));
+	packed = _mm256_shuffle_epi8(packed, _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+	packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+
+	_mm256_storeu_si256((__m256i *) out, packed);
+	return true;
+
+}
+
+XSCRYPT_TARGET_SSSE3
+static bool decodeBlockSSSE3(const unsigned char * in, unsigned char * out) {
+
+	const __m128i lut_lo = _mm_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m128i lut_hi = _mm_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71,
+		0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2F = _mm_set1_epi8(0x2f);
+
+	__m128i str = _mm_loadu_si128((const __m128i *) in);
+
+	// Classify each character by its high and low nibble
+	const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2F);
+	const __m128i lo_nibbles = _mm_and_si128(str, mask_2F);
+	const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+	const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+
+	if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+		return false;
+
+	// Translate to sextets
+	const __m128i eq_2F = _mm_cmpeq_epi8(str, mask_2F);
+	const __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2F, hi_nibbles));
+	str = _mm_add_epi8(str, roll);
+
+	// Pack four sextets into three bytes
+	const __m128i merge_ab_and_bc = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+	__m128i packed = _mm_madd_epi16(merge_ab_and_bc, _mm_set1_epi32(0x00011000));
+	packed = _mm_shuffle_epi8(packed, _mm_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+	_mm_storeu_si128((__m128i *) out, packed);
+	return true;
+
+}
+
+#endif
+
+static Base64BlockDecoder selectBlockDecoder(void) {
+
+	Base64BlockDecoder d = {NULL, 0, 0};
+
+#if defined(XSCRYPT_BASE64_X86)
 
-	if (IS_UPPER(c))
-		return c - 'A';
+	bool ssse3, avx2;
 
-	if (IS_LOWER(c))
-		return (c - 'a') + 26;
+#	if defined(_MSC_VER)
+	int info[4];
 
-	if (IS_NUMBR(c))
-		return (c - '0') + 52;
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
 
-	if (c == '+')
-		return 62;
-	if (c == '/')
-		return 63;
+	__cpuid(info, 1);
+	ssse3 = (info[2] & (1 << 9)) != 0;
 
-	if (c == '=')
-		return 64;
+	// AVX2 also needs the OS to save the YMM registers
+	bool osYMM = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+		(_xgetbv(0) & 6) == 6;
 
-	return 65;		// error;
+	avx2 = false;
+	if (osYMM && maxLeaf >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#	else
+	__builtin_cpu_init();
+	ssse3 = __builtin_cpu_supports("ssse3") != 0;
+	avx2 = __builtin_cpu_supports("avx2") != 0;
+#	endif
+
+	if (avx2) {
+		d.decodeBlock = decodeBlockAVX2;
+		d.blockIn = 32;
+		d.blockOut = 24;
+	}
+	else if (ssse3) {
+		d.decodeBlock = decodeBlockSSSE3;
+		d.blockIn = 16;
+		d.blockOut = 12;
+	}
+
+#endif
+
+	return d;
 
 }
 
-void XSCryptCryptoBase64::canonicaliseInput(const unsigned char *inData, 
-											unsigned int inLength) {
+// Chosen once at load time.  Until then (or on other platforms) the
+// pointer is NULL and decode() uses the table alone
+static const Base64BlockDecoder s_blockDecoder = selectBlockDecoder();
 
-	// Canonicalise the input buffer into m_inputBuffer
+// --------------------------------------------------------------------------------
+//           Output handling
+// --------------------------------------------------------------------------------
 
-	unsigned char buf[400];			// Do 400 bytes at a time
+unsigned int XSCryptCryptoBase64::copyOutRemaining(unsigned char * outData,
+												   unsigned int outLength) {
 
-	unsigned int i, j;
-	j = 0;
+	// Copy anything carried over from a previous call
 
-	for (i = 0; i < inLength; ++i) {
+	unsigned int cpyOut = (m_remainingOutput < outLength ? m_remainingOutput : outLength);
 
-		if (IS_B64OE(inData[i])) {
+	if (cpyOut == 0)
+		return 0;
 
-			// Have a base64 or '=' char
-			buf[j++] = inData[i];
+	m_outputBuffer.sbMemcpyOut(outData, cpyOut);
 
-			if (j == 400) {
-				m_inputBuffer.sbMemcpyIn(m_remainingInput, buf, 400);
-				m_remainingInput += 400;
-				j = 0;
-			}
-		}
+	// Move the buffers down
+	if (cpyOut != m_remainingOutput) {
+		m_remainingOutput = m_remainingOutput - cpyOut;
+		m_outputBuffer.sbMemshift(0, cpyOut, m_remainingOutput);
+	}
+	else
+		m_remainingOutput = 0;
+
+	return cpyOut;
+
+}
+
+void XSCryptCryptoBase64::emit(const unsigned char * data, unsigned int len,
+							   unsigned char *& out, unsigned int & room) {
+
+	// Fill the caller's buffer first.  Whatever doesn't fit goes to the
+	// carry over buffer, and from then on everything goes there so
+	// ordering is kept
+
+	unsigned int direct = (len < room ? len : room);
+
+	if (direct > 0) {
+		memcpy(out, data, direct);
+		out += direct;
+		room -= direct;
 	}
 
-	if (j > 0) {
-		m_inputBuffer.sbMemcpyIn(m_remainingInput, buf, j);
-		m_remainingInput += j;
+	if (direct < len) {
+		m_outputBuffer.sbMemcpyIn(m_remainingOutput, &data[direct], len - direct);
+		m_remainingOutput += len - direct;
+		room = 0;
 	}
 
 }
 
+// --------------------------------------------------------------------------------
+//           Decoding
+// --------------------------------------------------------------------------------
 
 void XSCryptCryptoBase64::decodeInit(void) {
 
-	m_remainingInput = m_remainingOutput = 0;
+	m_remainingOutput = 0;
+	m_carryLen = 0;
 	m_allDone = false;
 	m_state = B64_DECODE;
 
 }
 
-unsigned int XSCryptCryptoBase64::decode(const unsigned char * inData, 
+void XSCryptCryptoBase64::decodeCarry(unsigned char *& out, unsigned int & room) {
+
+	// m_carry holds a complete group of four
+
+	unsigned char b[3];
+	unsigned int n;
+
+	m_carryLen = 0;
+
+	if (m_carry[0] > 63 || m_carry[1] > 63) {
+
+		throw XSECCryptoException(XSECCryptoException::Base64Error,
+			"XSCrypt:Base64 - Invalid character at start of base 64 block");
+
+	}
+
+	b[0] = (unsigned char) ((m_carry[0] << 2) | (m_carry[1] >> 4));
+
+	if (m_carry[2] == B64_PAD) {
+
+		// '=' character found
+		n = 1;
+		m_allDone = true;
+
+	}
+	else {
+
+		b[1] = (unsigned char) ((m_carry[1] << 4) | (m_carry[2] >> 2));
+
+		if (m_carry[3] == B64_PAD) {
+			n = 2;
+			m_allDone = true;
+		}
+		else {
+			b[2] = (unsigned char) ((m_carry[2] << 6) | m_carry[3]);
+			n = 3;
+		}
+
+	}
+
+	emit(b, n, out, room);
+
+}
+
+unsigned int XSCryptCryptoBase64::decode(const unsigned char * inData,
 						 	    unsigned int inLength,
 								unsigned char * outData,
 								unsigned int outLength) {
@@ -130,155 +379,224 @@ unsigned int XSCryptCryptoBase64::decode(const unsigned char * inData,
 
 		throw XSECCryptoException(XSECCryptoException::Base64Error,
 			"XSCrypt:Base64 - Attempt to decode when not in decode state");
-	
+
 	}
 
-	// Copy the data into our input buffer
-	canonicaliseInput(inData, inLength);
+	// Anything left from last time goes first
+	unsigned int done = copyOutRemaining(outData, outLength);
 
-	unsigned int i = 0;
-	unsigned char t;
+	unsigned char * out = outData + done;
+	unsigned int room = (m_remainingOutput > 0 ? 0 : outLength - done);
 
-	while (m_allDone != true && m_remainingInput - i >= 4) {
+	const unsigned char * in = inData;
+	const unsigned char * end = inData + inLength;
 
-		// BYTE 1
+	while (in < end && m_allDone != true) {
 
-		t = decodeCh(m_inputBuffer[i++]);
+		if (m_carryLen == 0) {
 
-		if (t > 63) {
+			// Runs of plain base64 (typically a full line)
+			if (s_blockDecoder.decodeBlock != NULL) {
 
-			throw XSECCryptoException(XSECCryptoException::Base64Error,
-			"XSCrypt:Base64 - Invalid character at start of base 64 block");
+				while ((unsigned int) (end - in) >= s_blockDecoder.blockIn &&
+					   room >= s_blockDecoder.blockIn &&
+					   s_blockDecoder.decodeBlock(in, out)) {
 
-		}
+					in += s_blockDecoder.blockIn;
+					out += s_blockDecoder.blockOut;
+					room -= s_blockDecoder.blockOut;
 
-		m_outputBuffer[m_remainingOutput] = (t << 2);
+				}
 
-		// BYTE 2
+			}
 
-		t = decodeCh(m_inputBuffer[i++]);
+			// Whole groups of four with no whitespace or padding
+			while (end - in >= 4 && room >= 3) {
 
-		if (t > 63) {
+				unsigned char t0 = Base64DecodeTable[in[0]];
+				unsigned char t1 = Base64DecodeTable[in[1]];
+				unsigned char t2 = Base64DecodeTable[in[2]];
+				unsigned char t3 = Base64DecodeTable[in[3]];
 
-			throw XSECCryptoException(XSECCryptoException::Base64Error,
-			"XSCrypt:Base64 - Invalid character at start of base 64 block");
+				if (((t0 | t1 | t2 | t3) & B64_SPECIAL) != 0)
+					break;
+
+				out[0] = (unsigned char) ((t0 << 2) | (t1 >> 4));
+				out[1] = (unsigned char) ((t1 << 4) | (t2 >> 2));
+				out[2] = (unsigned char) ((t2 << 6) | t3);
+
+				in += 4;
+				out += 3;
+				room -= 3;
+
+			}
+
+			if (in == end)
+				break;
 
 		}
 
-		// Take top two bits and place at end of current byte
-		m_outputBuffer[m_remainingOutput] = m_outputBuffer[m_remainingOutput] |
-			(t >> 4);
+		// Byte at a time until the next group boundary
+		unsigned char t = Base64DecodeTable[*in++];
 
-		m_remainingOutput++;		// Have a new complete byte
+		if (t == B64_SKIP)
+			continue;
 
-		// Take remaining 4 bits and add to outputBuffer
-		m_outputBuffer[m_remainingOutput] = ( t << 4);
+		m_carry[m_carryLen++] = t;
 
-		// BYTE 3
+		if (m_carryLen == 4)
+			decodeCarry(out, room);
 
-		t = decodeCh(m_inputBuffer[i++]);
+	}
 
-		if (t > 64) {
+	// Return however much we have decoded
+	return (unsigned int) (out - outData);
 
-			throw XSECCryptoException(XSECCryptoException::Base64Error,
-			"XSCrypt:Base64 - Invalid character at start of base 64 block");
+}
 
-		}
+unsigned int XSCryptCryptoBase64::decodeFinish(unsigned char * outData,
+							 	      unsigned int outLength) {
 
-		if (t == 64) {
+	if (m_state != B64_DECODE) {
 
-			// '=' character found
+		throw XSECCryptoException(XSECCryptoException::Base64Error,
+			"XSCrypt:Base64 - Attempt to complete a decode when not in decode state");
 
-			m_allDone = true;
-			break;
+	}
 
-		}
+	// An incomplete final group is dropped
+	m_allDone = true;
+	m_carryLen = 0;
 
-		// Take 4 bits and append to current buffer
+	return copyOutRemaining(outData, outLength);
 
-		m_outputBuffer[m_remainingOutput] = m_outputBuffer[m_remainingOutput] | (t >> 2);
-		m_remainingOutput++;
+}
 
-		// Take last 2 bits and append to buffer
+unsigned int XSCryptCryptoBase64::decodeStrict(const unsigned char * inData,
+								unsigned int inLength,
+								unsigned char * outData,
+								unsigned int outLength) {
 
-		m_outputBuffer[m_remainingOutput] = (t << 6);
+	if (outLength < inLength) {
 
-		// BYTE 4
+		throw XSECCryptoException(XSECCryptoException::Base64Error,
+			"XSCrypt:Base64 - Output buffer too small for strict decode");
 
-		t = decodeCh(m_inputBuffer[i++]);
+	}
 
-		if (t > 64) {
+	unsigned char * out = outData;
 
-			throw XSECCryptoException(XSECCryptoException::Base64Error,
-			"XSCrypt:Base64 - Invalid character at start of base 64 block");
+	const unsigned char * in = inData;
+	const unsigned char * end = inData + inLength;
+
+	unsigned char g[4];
+	unsigned int gLen = 0;
+	bool padded = false;
+
+	while (in < end) {
+
+		if (gLen == 0 && !padded) {
+
+			// The output is at least as long as the input, so there is
+			// always room for whatever is left
+
+			if (s_blockDecoder.decodeBlock != NULL) {
+
+				while ((unsigned int) (end - in) >= s_blockDecoder.blockIn &&
+					   s_blockDecoder.decodeBlock(in, out)) {
+
+					in += s_blockDecoder.blockIn;
+					out += s_blockDecoder.blockOut;
+
+				}
+
+			}
+
+			while (end - in >= 4) {
+
+				unsigned char t0 = Base64DecodeTable[in[0]];
+				unsigned char t1 = Base64DecodeTable[in[1]];
+				unsigned char t2 = Base64DecodeTable[in[2]];
+				unsigned char t3 = Base64DecodeTable[in[3]];
+
+				if (((t0 | t1 | t2 | t3) & B64_SPECIAL) != 0)
+					break;
+
+				out[0] = (unsigned char) ((t0 << 2) | (t1 >> 4));
+				out[1] = (unsigned char) ((t1 << 4) | (t2 >> 2));
+				out[2] = (unsigned char) ((t2 << 6) | t3);
+
+				in += 4;
+				out += 3;
+
+			}
+
+			if (in == end)
+				break;
 
 		}
 
-		if (t == 64) {
+		unsigned char c = *in++;
+		unsigned char t = Base64DecodeTable[c];
 
-			m_allDone = true;
-			break;
+		if (t == B64_SKIP) {
+
+			if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+				continue;
+
+			throw XSECCryptoException(XSECCryptoException::Base64Error,
+				"XSCrypt:Base64 - Invalid character in base64 data");
 
 		}
 
-		// Place all six bits and end of current byte
+		if (padded) {
 
-		m_outputBuffer[m_remainingOutput] = m_outputBuffer[m_remainingOutput] | t;
-		m_remainingOutput++;
+			throw XSECCryptoException(XSECCryptoException::Base64Error,
+				"XSCrypt:Base64 - Data found after base64 padding");
 
-	}
+		}
 
-	// Now whatever we've decoded can be placed in the output buffer
+		g[gLen++] = t;
 
-	unsigned int cpyOut = (m_remainingOutput < outLength ? m_remainingOutput : outLength);
+		if (gLen < 4)
+			continue;
 
-	m_outputBuffer.sbMemcpyOut(outData, cpyOut);
+		gLen = 0;
 
-	// Move the buffers down
-	if (cpyOut != m_remainingOutput) {
-		m_remainingOutput = m_remainingOutput - cpyOut;
-		m_outputBuffer.sbMemshift(0, cpyOut, m_remainingOutput);
-	}
-	else
-		m_remainingOutput = 0;
+		if (g[0] == B64_PAD || g[1] == B64_PAD || (g[2] == B64_PAD && g[3] != B64_PAD)) {
 
-	if (i != m_remainingInput) {
-		m_remainingInput -= i;
-		m_inputBuffer.sbMemshift(0, i, m_remainingInput);
-	}
-	else
-		m_remainingInput = 0;
+			throw XSECCryptoException(XSECCryptoException::Base64Error,
+				"XSCrypt:Base64 - Invalid base64 padding");
 
-	// Return however much we have decoded
-	return cpyOut;
+		}
 
-}
+		*out++ = (unsigned char) ((g[0] << 2) | (g[1] >> 4));
 
-unsigned int XSCryptCryptoBase64::decodeFinish(unsigned char * outData,
-							 	      unsigned int outLength) {
+		if (g[2] == B64_PAD) {
+			padded = true;
+			continue;
+		}
 
-	if (m_state != B64_DECODE) {
+		*out++ = (unsigned char) ((g[1] << 4) | (g[2] >> 2));
+
+		if (g[3] == B64_PAD) {
+			padded = true;
+			continue;
+		}
+
+		*out++ = (unsigned char) ((g[2] << 6) | g[3]);
 
-		throw XSECCryptoException(XSECCryptoException::Base64Error,
-			"XSCrypt:Base64 - Attempt to complete a decode when not in decode state");
-	
 	}
 
-	m_allDone = true;
-	unsigned int cpyOut = (m_remainingOutput < outLength ? m_remainingOutput : outLength);
+	if (gLen != 0) {
 
-	m_outputBuffer.sbMemcpyOut(outData, cpyOut);
+		throw XSECCryptoException(XSECCryptoException::Base64Error,
+			"XSCrypt:Base64 - Incomplete base64 data");
 
-	// Move the buffers down
-	if (cpyOut != m_remainingOutput) {
-		m_remainingOutput = m_remainingOutput - cpyOut;
-		m_outputBuffer.sbMemshift(0, cpyOut, m_remainingOutput);
-	}
-	else {
-		m_remainingOutput = 0;
 	}
 
-	return cpyOut;
+	return (unsigned int) (out - outData);
+
 }
 
 // --------------------------------------------------------------------------------
@@ -287,7 +605,8 @@ unsigned int XSCryptCryptoBase64::decodeFinish(unsigned char * outData,
 
 void XSCryptCryptoBase64::encodeInit(void) {
 
-	m_remainingInput = m_remainingOutput = 0;
+	m_remainingOutput = 0;
+	m_carryLen = 0;
 	m_allDone = false;
 	m_charCount = 0;
 	m_state = B64_ENCODE;
@@ -295,7 +614,7 @@ void XSCryptCryptoBase64::encodeInit(void) {
 }
 
 
-unsigned int XSCryptCryptoBase64::encode(const unsigned char * inData, 
+unsigned int XSCryptCryptoBase64::encode(const unsigned char * inData,
 						 	    unsigned int inLength,
 								unsigned char * outData,
 								unsigned int outLength) {
@@ -304,74 +623,78 @@ unsigned int XSCryptCryptoBase64::encode(const unsigned char * inData,
 
 		throw XSECCryptoException(XSECCryptoException::Base64Error,
 			"XSCrypt:Base64 - Attempt to encode when not in encoding state");
-	
+
 	}
 
-	// Copy input data into end of input buffer
-	m_inputBuffer.sbMemcpyIn(m_remainingInput, inData, inLength);
-	m_remainingInput += inLength;
+	unsigned int done = copyOutRemaining(outData, outLength);
 
-	unsigned int i = 0;
-	unsigned char t;
+	if (m_allDone == true)
+		return done;
 
-	while (m_allDone == false && m_remainingInput - i >= 3) {
+	unsigned char * out = outData + done;
+	unsigned int room = (m_remainingOutput > 0 ? 0 : outLength - done);
 
-		// Have a complete block of three bytes to encode
+	const unsigned char * in = inData;
+	const unsigned char * end = inData + inLength;
 
-		// First 6 bits;
-		t = (m_inputBuffer[i] >> 2);
-		m_outputBuffer[m_remainingOutput++] = Base64LookupTable[t];
+	unsigned char blk[3];
+	unsigned char chars[5];
 
-		// 2 bits from byte one and 4 from byte 2
-		t = ((m_inputBuffer[i++] << 4) & 0x30);
-		t |= (m_inputBuffer[i] >> 4);
-		m_outputBuffer[m_remainingOutput++] = Base64LookupTable[t];
+	while (m_carryLen + (end - in) >= 3) {
 
-		// 4 from byte 2 and 2 from byte 3
-		t = ((m_inputBuffer[i++] << 2) & 0x3C);
-		t |= (m_inputBuffer[i] >> 6);
-		m_outputBuffer[m_remainingOutput++] = Base64LookupTable[t];
+		// Have a complete block of three bytes to encode
+		const unsigned char * b;
 
-		// last 6 bits from byte 3
-		t = m_inputBuffer[i++] & 0x3F;
-		m_outputBuffer[m_remainingOutput++] = Base64LookupTable[t];
+		if (m_carryLen > 0) {
 
-		m_charCount += 4;
+			// Finish off the block carried from the last call
+			memcpy(blk, m_carry, m_carryLen);
+			memcpy(&blk[m_carryLen], in, 3 - m_carryLen);
+			in += 3 - m_carryLen;
+			m_carryLen = 0;
+			b = blk;
 
-		if (m_charCount >= 76) {
+		}
+		else {
+
+			b = in;
+			in += 3;
 
-			m_outputBuffer[m_remainingOutput++] = '\n';
-			m_charCount = 0;
-		
 		}
 
-	}
+		// Write straight out if there is room for a full group and newline
+		unsigned char * o = (room >= 5 ? out : chars);
 
-	// Now copy data out to output buffer
+		o[0] = Base64LookupTable[b[0] >> 2];
+		o[1] = Base64LookupTable[((b[0] << 4) & 0x30) | (b[1] >> 4)];
+		o[2] = Base64LookupTable[((b[1] << 2) & 0x3C) | (b[2] >> 6)];
+		o[3] = Base64LookupTable[b[2] & 0x3F];
 
-	unsigned int cpyOut = (m_remainingOutput < outLength ? m_remainingOutput : outLength);
+		unsigned int n = 4;
+		m_charCount += 4;
 
-	m_outputBuffer.sbMemcpyOut(outData, cpyOut);
+		if (m_charCount >= 76) {
 
-	// Move the buffers down
-	if (cpyOut != m_remainingOutput) {
-		m_remainingOutput = m_remainingOutput - cpyOut;
-		m_outputBuffer.sbMemshift(0, cpyOut, m_remainingOutput);
-	}
-	else
-		m_remainingOutput = 0;
+			o[n++] = '\n';
+			m_charCount = 0;
 
-	if (i != m_remainingInput) {
-		m_remainingInput -= i;
-		m_inputBuffer.sbMemshift(0, i, m_remainingInput);
-	}
+		}
 
-	else
+		if (o == out) {
+			out += n;
+			room -= n;
+		}
+		else
+			emit(chars, n, out, room);
 
-		m_remainingInput = 0;
+	}
 
-	// Return however much we have decoded
-	return cpyOut;
+	// Keep the tail for next time
+	while (in < end)
+		m_carry[m_carryLen++] = *in++;
+
+	// Return however much we have encoded
+	return (unsigned int) (out - outData);
 
 }
 
@@ -382,62 +705,53 @@ unsigned int XSCryptCryptoBase64::encodeFinish(unsigned char * outData,
 
 		throw XSECCryptoException(XSECCryptoException::Base64Error,
 			"XSCrypt:Base64 - Attempt to complete an encode when not in encoding state");
-	
+
 	}
 
-	if (m_allDone == false && m_remainingInput > 0) {
+	if (m_allDone == false && m_carryLen > 0) {
 
-		// Will always be < 3 characters remaining in inputBuffer
+		// Will always be < 3 characters remaining in the carry buffer
 		// If necessary - terminate the Base64 string
 
-		if (m_remainingInput >= 3) {
+		if (m_carryLen >= 3) {
 
 			throw XSECCryptoException(XSECCryptoException::Base64Error,
 				"XSCrypt:Base64 - Too much remaining input in input buffer");
 
 		}
 
+		unsigned char chars[4];
+
 		// First 6 bits;
-		unsigned int t = (m_inputBuffer[0] >> 2);
-		m_outputBuffer[m_remainingOutput++] = Base64LookupTable[t];
+		chars[0] = Base64LookupTable[m_carry[0] >> 2];
 
 		// 2 bits from byte one and 4 from byte 2
-		t = ((m_inputBuffer[0] << 4) & 0x30);
-		
-		if (m_remainingInput == 1) {
-			m_outputBuffer[m_remainingOutput++] = Base64LookupTable[t];
-			m_outputBuffer[m_remainingOutput++] = '=';
-			m_outputBuffer[m_remainingOutput++] = '=';
+		unsigned int t = ((m_carry[0] << 4) & 0x30);
+
+		if (m_carryLen == 1) {
+			chars[1] = Base64LookupTable[t];
+			chars[2] = '=';
+			chars[3] = '=';
 		}
 
 		else {
 
-			t |= (m_inputBuffer[1] >> 4);
-			m_outputBuffer[m_remainingOutput++] = Base64LookupTable[t];
+			t |= (m_carry[1] >> 4);
+			chars[1] = Base64LookupTable[t];
 
 			// 4 from byte 2
-			t = ((m_inputBuffer[1] << 2) & 0x3C);
-			m_outputBuffer[m_remainingOutput++] = Base64LookupTable[t];
-			m_outputBuffer[m_remainingOutput++] = '=';
+			chars[2] = Base64LookupTable[(m_carry[1] << 2) & 0x3C];
+			chars[3] = '=';
 		}
 
+		m_outputBuffer.sbMemcpyIn(m_remainingOutput, chars, 4);
+		m_remainingOutput += 4;
+		m_carryLen = 0;
+
 	}
 
 	m_allDone = true;
 
 	// Copy out
-	unsigned int cpyOut = (m_remainingOutput < outLength ? m_remainingOutput : outLength);
-
-	m_outputBuffer.sbMemcpyOut(outData, cpyOut);
-
-	// Move the buffers down
-	if (cpyOut != m_remainingOutput) {
-		m_remainingOutput = m_remainingOutput - cpyOut;
-		m_outputBuffer.sbMemshift(0, cpyOut, m_remainingOutput);
-	}
-	else {
-		m_remainingOutput = 0;
-	}
-
-	return cpyOut;
+	return copyOutRemaining(outData, outLength);
 }
@@ -46,6 +46,24 @@
  *
  */
 
+/**
+ * \brief Base64 encoder/decoder used by all the crypto providers.
+ *
+ * Decoding is table driven and works directly on the caller's buffers.
+ * Whitespace (and any other character outside the base64 alphabet) is
+ * skipped as it is read rather than in a separate pass, so XML text
+ * content can be passed in as is.  Partial blocks are carried between
+ * calls, so input may be split at any point.
+ *
+ * On x86, runs of base64 characters are decoded 16 (SSSE3) or 32 (AVX2)
+ * at a time when the CPU running the library supports it; this is checked
+ * once at load time, so no special compiler flags are needed.
+ *
+ * The streaming decoder is lenient by design.  Callers that must reject
+ * malformed input (signature values in the OpenSSL keys, for instance)
+ * use decodeStrict() instead, which uses the same tables and vector code.
+ */
+
 class XSEC_EXPORT XSCryptCryptoBase64 : public XSECCryptoBase64 {
 
 
@@ -53,7 +71,8 @@ public :
 
 	// Constructors/Destructors
 	
-	XSCryptCryptoBase64() : m_state(B64_UNINITIALISED) {};
+	XSCryptCryptoBase64() : m_remainingOutput(0), m_carryLen(0),
+		m_allDone(false), m_state(B64_UNINITIALISED), m_charCount(0) {};
 	virtual ~XSCryptCryptoBase64() {};
 
 	/** @name Decoding Functions */
@@ -101,6 +120,28 @@ public :
 	virtual unsigned int decodeFinish(unsigned char * outData,
 							 	      unsigned int outLength);
 
+	/**
+	 * \brief Decode a complete buffer, rejecting malformed input
+	 *
+	 * Decodes the whole of inData in one call, without allocating.  Only
+	 * base64 characters and XML whitespace may appear, padding must be
+	 * correctly placed and nothing but whitespace may follow it, and the
+	 * data must end on a group boundary.
+	 *
+	 * @param inData Pointer to the buffer holding encoded data.
+	 * @param inLength Length of the encoded data in the buffer
+	 * @param outData Buffer to place decoded data into.  Must be at
+	 *        least inLength bytes, as vector code writes full blocks.
+	 * @param outLength Size of the outData buffer
+	 * @returns The number of bytes placed in the outData buffer.
+	 * @throws XSECCryptoException if the input is not valid base64
+	 */
+
+	static unsigned int decodeStrict(const unsigned char * inData,
+								unsigned int inLength,
+								unsigned char * outData,
+								unsigned int outLength);
+
 	//@}
 
 	/** @name Encoding Functions */
@@ -157,12 +198,15 @@ private :
 		B64_DECODE
 	};
 
-	safeBuffer				m_inputBuffer;		// Carry over buffer
 	safeBuffer				m_outputBuffer;		// Carry over output
 
-	unsigned int			m_remainingInput;	// Number of bytes in carry input buffer
 	unsigned int			m_remainingOutput;	// Number of bytes in carry output buffer
 
+	// Partial block carried between calls.  When decoding this holds up
+	// to three decoded sextets, when encoding up to two input bytes
+	unsigned char			m_carry[4];
+	unsigned int			m_carryLen;
+
 	bool					m_allDone;			// End found (=)
 
 	b64state				m_state;			// What are we currently doing?
@@ -170,7 +214,10 @@ private :
 	unsigned int			m_charCount;		// How many characters in current line?
 
 	// Private functions
-	void canonicaliseInput(const unsigned char *inData, unsigned int inLength);
+	unsigned int copyOutRemaining(unsigned char * outData, unsigned int outLength);
+	void emit(const unsigned char * data, unsigned int len,
+		unsigned char *& out, unsigned int & room);
+	void decodeCarry(unsigned char *& out, unsigned int & room);
 
 };
 
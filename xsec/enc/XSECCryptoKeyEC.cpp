@@ -0,0 +1,65 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XSECCryptoKeyEC := Default implementations of the optional
+ *                    key agreement methods
+ *
+ * $Id$
+ *
+ */
+
+#include <xsec/framework/XSECDefs.hpp>
+#include <xsec/enc/XSECCryptoKeyEC.hpp>
+#include <xsec/enc/XSECCryptoException.hpp>
+
+// --------------------------------------------------------------------------------
+//           Key agreement - not supported unless the provider overrides
+// --------------------------------------------------------------------------------
+
+unsigned int XSECCryptoKeyEC::deriveSharedSecret(const XSECCryptoKeyEC * publicKey,
+												 unsigned char * secret,
+												 unsigned int maxSecretLen) const {
+
+	throw XSECCryptoException(XSECCryptoException::UnsupportedError,
+		"XSECCryptoKeyEC - Key agreement not supported by this provider");
+
+}
+
+XSECCryptoKeyEC * XSECCryptoKeyEC::generateKeyPair(void) const {
+
+	throw XSECCryptoException(XSECCryptoException::UnsupportedError,
+		"XSECCryptoKeyEC - Key generation not supported by this provider");
+
+}
+
+const char * XSECCryptoKeyEC::getCurveName(void) const {
+
+	return NULL;
+
+}
+
+unsigned int XSECCryptoKeyEC::getPublicKeyBase64(char * b64, unsigned int maxLen) const {
+
+	throw XSECCryptoException(XSECCryptoException::UnsupportedError,
+		"XSECCryptoKeyEC - Public key export not supported by this provider");
+
+}
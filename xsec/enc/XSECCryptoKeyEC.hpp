@@ -150,6 +150,68 @@ public :
 
 	//@}
 
+	/** @name Key agreement methods
+	 *
+	 * Used for XML Encryption 1.1 ECDH-ES key agreement.  The default
+	 * implementations throw an XSECCryptoException, so providers only
+	 * need to override them if they support key agreement.
+	 */
+
+	//@{
+
+	/**
+	 * \brief Calculate an ECDH shared secret
+	 *
+	 * Combines the private part of this key with the public part of
+	 * the peer key to produce the shared secret Z (the x co-ordinate
+	 * of the shared point, as an octet string the size of the field).
+	 *
+	 * @param publicKey The peer's public key.  Must be on the same curve
+	 * and from the same provider.
+	 * @param secret Buffer to place the shared secret in
+	 * @param maxSecretLen Size of the secret buffer
+	 * @returns Number of bytes placed in secret
+	 */
+
+	virtual unsigned int deriveSharedSecret(const XSECCryptoKeyEC * publicKey,
+		unsigned char * secret,
+		unsigned int maxSecretLen) const;
+
+	/**
+	 * \brief Generate a new key pair on the same curve as this key
+	 *
+	 * Used to create the ephemeral (originator) key for ECDH-ES.
+	 *
+	 * @returns A new key pair, owned by the caller
+	 */
+
+	virtual XSECCryptoKeyEC * generateKeyPair(void) const;
+
+	/**
+	 * \brief Get the URI naming the curve of this key
+	 *
+	 * @returns The curve URI (typically an OID URN) in the form used
+	 * by loadPublicKeyBase64, or NULL if the curve has no known name.
+	 */
+
+	virtual const char * getCurveName(void) const;
+
+	/**
+	 * \brief Get the public key as Base64 encoded octets
+	 *
+	 * The encoding is the uncompressed point, as used in the PublicKey
+	 * element of a dsig11:ECKeyValue and read by loadPublicKeyBase64.
+	 *
+	 * @param b64 Buffer to place the (NUL terminated) encoding in
+	 * @param maxLen Size of the buffer
+	 * @returns Number of characters placed in the buffer
+	 */
+
+	virtual unsigned int getPublicKeyBase64(char * b64,
+		unsigned int maxLen) const;
+
+	//@}
+
 };
 
 
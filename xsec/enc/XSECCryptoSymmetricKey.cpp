@@ -0,0 +1,271 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XSECCryptoSymmetricKey := Default (provider independent) implementation
+ *                           of RFC 3394/5649 AES key wrap
+ *
+ * $Id$
+ *
+ */
+
+#include <xsec/framework/XSECDefs.hpp>
+#include <xsec/enc/XSECCryptoSymmetricKey.hpp>
+#include <xsec/enc/XSECCryptoException.hpp>
+
+#include <string.h>
+
+// --------------------------------------------------------------------------------
+//           Constants and helpers
+// --------------------------------------------------------------------------------
+
+// RFC 3394 default IV
+static const unsigned char s_keyWrapIV[] = {
+	0xA6, 0xA6, 0xA6, 0xA6, 0xA6, 0xA6, 0xA6, 0xA6
+};
+
+// RFC 5649 alternative IV (first 32 bits - the rest is the message length)
+static const unsigned char s_keyWrapPadIV[] = {
+	0xA6, 0x59, 0x59, 0xA6
+};
+
+static void xorCounter(unsigned char * a, unsigned int t) {
+
+	// A ^= t, with t as a 64 bit big endian value
+	for (int k = 7; t != 0; --k) {
+		a[k] ^= (unsigned char) (t & 0xFF);
+		t >>= 8;
+	}
+
+}
+
+static bool isAESKey(XSECCryptoSymmetricKey::SymmetricKeyType t) {
+
+	return (t == XSECCryptoSymmetricKey::KEY_AES_128 ||
+			t == XSECCryptoSymmetricKey::KEY_AES_192 ||
+			t == XSECCryptoSymmetricKey::KEY_AES_256);
+
+}
+
+// --------------------------------------------------------------------------------
+//           Single block operation
+// --------------------------------------------------------------------------------
+
+void XSECCryptoSymmetricKey::keyWrapBlock(bool forEncrypt,
+										  const unsigned char * inBlock,
+										  unsigned char * outBlock) {
+
+	unsigned char buf[32];		// Give this an extra block for WinCAPI
+	unsigned int sz;
+
+	if (forEncrypt) {
+		encryptInit(false, MODE_ECB);
+		sz = encrypt(inBlock, buf, 16, 32);
+		sz += encryptFinish(&buf[sz], 32 - sz);
+	}
+	else {
+		decryptInit(false, MODE_ECB);		// No padding
+		sz = decrypt(inBlock, buf, 16, 32);
+		sz += decryptFinish(&buf[sz], 32 - sz);
+	}
+
+	if (sz != 16) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"XSECCryptoSymmetricKey - Error processing block in AES key wrap");
+	}
+
+	memcpy(outBlock, buf, 16);
+
+}
+
+// --------------------------------------------------------------------------------
+//           Wrap
+// --------------------------------------------------------------------------------
+
+unsigned int XSECCryptoSymmetricKey::wrapKey(const unsigned char * inBuf,
+											 unsigned int inLength,
+											 unsigned char * outBuf,
+											 unsigned int maxOutLength,
+											 bool doPad) {
+
+	if (!isAESKey(getSymmetricKeyType())) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"XSECCryptoSymmetricKey - Key wrap requires an AES key");
+	}
+
+	if (inLength == 0 || (!doPad && inLength % 8 != 0)) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"XSECCryptoSymmetricKey - Key to wrap must be a multiple of 64 bits");
+	}
+
+	unsigned int n = (inLength + 7) / 8;
+
+	if (maxOutLength < (n + 1) * 8) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"XSECCryptoSymmetricKey - Output buffer too small for wrapped key");
+	}
+
+	unsigned char a[8];
+	unsigned char block[16];
+
+	if (doPad) {
+		memcpy(a, s_keyWrapPadIV, 4);
+		a[4] = (unsigned char) (inLength >> 24);
+		a[5] = (unsigned char) (inLength >> 16);
+		a[6] = (unsigned char) (inLength >> 8);
+		a[7] = (unsigned char) inLength;
+	}
+	else
+		memcpy(a, s_keyWrapIV, 8);
+
+	// R[1..n] live in the output buffer, after the space for A
+	unsigned char * r = &outBuf[8];
+	memmove(r, inBuf, inLength);
+	memset(&r[inLength], 0, n * 8 - inLength);
+
+	if (doPad && n == 1) {
+
+		// A single padded block is simply encrypted with the IV
+		memcpy(block, a, 8);
+		memcpy(&block[8], r, 8);
+		keyWrapBlock(true, block, outBuf);
+		return 16;
+
+	}
+
+	for (unsigned int j = 0; j <= 5; ++j) {
+		for (unsigned int i = 1; i <= n; ++i) {
+
+			unsigned char * ri = &r[8 * (i - 1)];
+
+			memcpy(block, a, 8);
+			memcpy(&block[8], ri, 8);
+
+			keyWrapBlock(true, block, block);
+
+			memcpy(a, block, 8);
+			xorCounter(a, (n * j) + i);
+			memcpy(ri, &block[8], 8);
+
+		}
+	}
+
+	memcpy(outBuf, a, 8);
+
+	return (n + 1) * 8;
+
+}
+
+// --------------------------------------------------------------------------------
+//           Unwrap
+// --------------------------------------------------------------------------------
+
+unsigned int XSECCryptoSymmetricKey::unwrapKey(const unsigned char * inBuf,
+											   unsigned int inLength,
+											   unsigned char * outBuf,
+											   unsigned int maxOutLength,
+											   bool doPad) {
+
+	if (!isAESKey(getSymmetricKeyType())) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"XSECCryptoSymmetricKey - Key unwrap requires an AES key");
+	}
+
+	if (inLength < 16 || inLength % 8 != 0) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"XSECCryptoSymmetricKey - Wrapped key not a multiple of 64 bits");
+	}
+
+	unsigned int n = (inLength / 8) - 1;
+
+	if (maxOutLength < n * 8) {
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"XSECCryptoSymmetricKey - Output buffer too small for unwrapped key");
+	}
+
+	unsigned char a[8];
+	unsigned char block[16];
+
+	if (doPad && n == 1) {
+
+		keyWrapBlock(false, inBuf, block);
+		memcpy(a, block, 8);
+		memcpy(outBuf, &block[8], 8);
+
+	}
+	else {
+
+		memcpy(a, inBuf, 8);
+		unsigned char * r = outBuf;
+		memmove(r, &inBuf[8], n * 8);
+
+		for (int j = 5; j >= 0; --j) {
+			for (unsigned int i = n; i > 0; --i) {
+
+				unsigned char * ri = &r[8 * (i - 1)];
+
+				memcpy(block, a, 8);
+				xorCounter(block, (n * j) + i);
+				memcpy(&block[8], ri, 8);
+
+				keyWrapBlock(false, block, block);
+
+				memcpy(a, block, 8);
+				memcpy(ri, &block[8], 8);
+
+			}
+		}
+
+	}
+
+	// Integrity check
+	unsigned int len = n * 8;
+	bool ok;
+
+	if (doPad) {
+
+		unsigned int mli =
+			((unsigned int) a[4] << 24) | ((unsigned int) a[5] << 16) |
+			((unsigned int) a[6] << 8) | (unsigned int) a[7];
+
+		ok = (memcmp(a, s_keyWrapPadIV, 4) == 0 && mli > len - 8 && mli <= len);
+
+		if (ok) {
+			for (unsigned int k = mli; k < len; ++k)
+				ok = ok && (outBuf[k] == 0);
+			len = mli;
+		}
+
+	}
+	else
+		ok = (memcmp(a, s_keyWrapIV, 8) == 0);
+
+	if (!ok) {
+
+		memset(outBuf, 0, n * 8);
+		throw XSECCryptoException(XSECCryptoException::SymmetricError,
+			"XSECCryptoSymmetricKey - Key unwrap failed integrity check");
+
+	}
+
+	return len;
+
+}
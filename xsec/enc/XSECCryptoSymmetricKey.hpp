@@ -302,6 +302,81 @@ public :
 
 	//@}
 
+	/** @name Key wrap interface methods */
+	//@{
+
+	/**
+	 * \brief Wrap a key using this (AES) key as the KEK
+	 *
+	 * Performs an RFC 3394 AES key wrap of the passed in key, or an
+	 * RFC 5649 wrap with padding if doPad is set.  This is independent
+	 * of any encrypt or decrypt operation in progress.
+	 *
+	 * The default implementation runs the wrap over single block ECB
+	 * operations through keyWrapBlock().  Providers that have a native
+	 * key wrap should override this so that the key schedule is set up
+	 * once per KEK rather than once per block.
+	 *
+	 * Implementations may keep wrap state with the key, so as with
+	 * encrypt and decrypt, one key object must not be used from more than
+	 * one thread at a time.
+	 *
+	 * @param inBuf The key to be wrapped
+	 * @param inLength Length of the key.  Must be a multiple of 8 unless
+	 * doPad is set
+	 * @param outBuf Buffer to place the wrapped key in
+	 * @param maxOutLength Size of outBuf.  The wrapped key is 8 bytes
+	 * longer than the (padded) input
+	 * @param doPad Use RFC 5649 (key wrap with padding)
+	 * @returns Bytes placed in outBuf
+	 */
+
+	virtual unsigned int wrapKey(const unsigned char * inBuf,
+								 unsigned int inLength,
+								 unsigned char * outBuf,
+								 unsigned int maxOutLength,
+								 bool doPad = false);
+
+	/**
+	 * \brief Unwrap a key using this (AES) key as the KEK
+	 *
+	 * Reverses wrapKey().  Throws an XSECCryptoException if the wrapped
+	 * key fails the integrity check.
+	 *
+	 * @param inBuf The wrapped key
+	 * @param inLength Length of the wrapped key
+	 * @param outBuf Buffer to place the unwrapped key in
+	 * @param maxOutLength Size of outBuf.  Must be at least inLength - 8
+	 * @param doPad Use RFC 5649 (key wrap with padding)
+	 * @returns Bytes placed in outBuf
+	 */
+
+	virtual unsigned int unwrapKey(const unsigned char * inBuf,
+								   unsigned int inLength,
+								   unsigned char * outBuf,
+								   unsigned int maxOutLength,
+								   bool doPad = false);
+
+	//@}
+
+protected :
+
+	/**
+	 * \brief Encrypt or decrypt a single block for the default key wrap
+	 *
+	 * The default implementation initialises a fresh unpadded ECB
+	 * operation for each block.  Providers can override this to keep an
+	 * ECB context for the life of the key instead.
+	 *
+	 * @param forEncrypt true to encrypt, false to decrypt
+	 * @param inBlock 16 byte block to process
+	 * @param outBlock 16 byte buffer for the result
+	 */
+
+	virtual void keyWrapBlock(bool forEncrypt,
+							  const unsigned char * inBlock,
+							  unsigned char * outBlock);
+
 };
 
 
@@ -44,17 +44,11 @@ XERCES_CPP_NAMESPACE_USE
 // --------------------------------------------------------------------------------
 XSECKeyInfoResolverDefault::XSECKeyInfoResolverDefault() {
 
-	// Create a UTF-8 formatter
-	XSECnew(mp_formatter, XSECSafeBufferFormatter("UTF-8",XMLFormatter::NoEscapes, 
-												XMLFormatter::UnRep_CharRef));
 }
 
 
 XSECKeyInfoResolverDefault::~XSECKeyInfoResolverDefault() {
 
-	if (mp_formatter != NULL)
-		delete mp_formatter;
-
 }
 
 
@@ -90,7 +84,7 @@ XSECCryptoKey * XSECKeyInfoResolverDefault::resolveKey(const DSIGKeyInfoList * l
 				// The crypto interface classes work UTF-8
 				safeBuffer transX509;
 
-				transX509 << (*mp_formatter << x509Str);
+				transX509.sbUTF8In(x509Str);
 				x509->loadX509Base64Bin(transX509.rawCharBuffer(), (unsigned int) strlen(transX509.rawCharBuffer()));
 				ret = x509->clonePublicKey();
 			}
@@ -109,13 +103,13 @@ XSECCryptoKey * XSECKeyInfoResolverDefault::resolveKey(const DSIGKeyInfoList * l
 
 			safeBuffer value;
 
-			value << (*mp_formatter << ((DSIGKeyInfoValue *) lst->item(i))->getDSAP());
+			value.sbUTF8In(((DSIGKeyInfoValue *) lst->item(i))->getDSAP());
 			dsa->loadPBase64BigNums(value.rawCharBuffer(), (unsigned int) strlen(value.rawCharBuffer()));
-			value << (*mp_formatter << ((DSIGKeyInfoValue *) lst->item(i))->getDSAQ());
+			value.sbUTF8In(((DSIGKeyInfoValue *) lst->item(i))->getDSAQ());
 			dsa->loadQBase64BigNums(value.rawCharBuffer(), (unsigned int) strlen(value.rawCharBuffer()));
-			value << (*mp_formatter << ((DSIGKeyInfoValue *) lst->item(i))->getDSAG());
+			value.sbUTF8In(((DSIGKeyInfoValue *) lst->item(i))->getDSAG());
 			dsa->loadGBase64BigNums(value.rawCharBuffer(), (unsigned int) strlen(value.rawCharBuffer()));
-			value << (*mp_formatter << ((DSIGKeyInfoValue *) lst->item(i))->getDSAY());
+			value.sbUTF8In(((DSIGKeyInfoValue *) lst->item(i))->getDSAY());
 			dsa->loadYBase64BigNums(value.rawCharBuffer(), (unsigned int) strlen(value.rawCharBuffer()));
 
 			j_dsa.release();
@@ -131,9 +125,9 @@ XSECCryptoKey * XSECKeyInfoResolverDefault::resolveKey(const DSIGKeyInfoList * l
 
 			safeBuffer value;
 
-			value << (*mp_formatter << ((DSIGKeyInfoValue *) lst->item(i))->getRSAModulus());
+			value.sbUTF8In(((DSIGKeyInfoValue *) lst->item(i))->getRSAModulus());
 			rsa->loadPublicModulusBase64BigNums(value.rawCharBuffer(), (unsigned int) strlen(value.rawCharBuffer()));
-			value << (*mp_formatter << ((DSIGKeyInfoValue *) lst->item(i))->getRSAExponent());
+			value.sbUTF8In(((DSIGKeyInfoValue *) lst->item(i))->getRSAExponent());
 			rsa->loadPublicExponentBase64BigNums(value.rawCharBuffer(), (unsigned int) strlen(value.rawCharBuffer()));
 
 			j_rsa.release();
@@ -149,7 +143,7 @@ XSECCryptoKey * XSECKeyInfoResolverDefault::resolveKey(const DSIGKeyInfoList * l
             Janitor<XSECCryptoKeyEC> j_ec(ec);
 
             safeBuffer value;
-			value << (*mp_formatter << ((DSIGKeyInfoValue *) lst->item(i))->getECPublicKey());
+			value.sbUTF8In(((DSIGKeyInfoValue *) lst->item(i))->getECPublicKey());
             XSECAutoPtrChar curve(((DSIGKeyInfoValue *) lst->item(i))->getECNamedCurve());
             if (curve.get()) {
                 ec->loadPublicKeyBase64(curve.get(), value.rawCharBuffer(), (unsigned int) strlen(value.rawCharBuffer()));
@@ -162,7 +156,7 @@ XSECCryptoKey * XSECKeyInfoResolverDefault::resolveKey(const DSIGKeyInfoList * l
         case (DSIGKeyInfo::KEYINFO_DERENCODED) :
         {
             safeBuffer value;
-			value << (*mp_formatter << ((DSIGKeyInfoDEREncoded *) lst->item(i))->getData());
+			value.sbUTF8In(((DSIGKeyInfoDEREncoded *) lst->item(i))->getData());
             return XSECPlatformUtils::g_cryptoProvider->keyDER(value.rawCharBuffer(), (unsigned int)strlen(value.rawCharBuffer()), true);
         }
             break;
@@ -99,10 +99,6 @@ public :
 
 	//@}
 
-private:
-
-	XSECSafeBufferFormatter		* mp_formatter;
-
 	/*\@}*/
 };
 
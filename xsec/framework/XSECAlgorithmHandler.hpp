@@ -121,6 +121,31 @@ public:
 		safeBuffer & result
 	) const = 0;
 
+	/**
+	 * \brief Append an appropriate encrypt TXFMer to a plain text chain.
+	 *
+	 * Used for streamed encryption.  The appended transformer must
+	 * output the raw (not base64 encoded) cipher text, in the same
+	 * format as would be produced by encryptToSafeBuffer.
+	 *
+	 * The default implementation returns false, indicating that the
+	 * algorithm cannot be streamed.
+	 *
+	 * @param plainText Chain that will provide the plain bytes.  Ownership
+	 * remains with the caller - do not delete.
+	 * @param encryptionMethod Information about the algorithm to use.
+	 * @param key The key to use for the encryption
+	 * @param doc Document in which to operate
+	 * @returns true if a transformer was appended
+	 */
+
+	virtual bool appendEncryptCipherTXFM(
+		TXFMChain * plainText,
+		XENCEncryptionMethod * encryptionMethod,
+		const XSECCryptoKey * key,
+		XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument * doc
+	) const {return false;}
+
 	//@}
 
 	/** @name Decryption Methods */
@@ -0,0 +1,129 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XSECAsyncQueue := Queue of deferred signature operations whose
+ *                   key operations are run as a batch
+ *
+ * $Id$
+ *
+ */
+
+#include <xsec/framework/XSECAsyncQueue.hpp>
+#include <xsec/framework/XSECError.hpp>
+
+#include "../utils/XSECThreadPool.hpp"
+
+// --------------------------------------------------------------------------------
+//           Thread pool adapter
+// --------------------------------------------------------------------------------
+
+class XSECAsyncTask : public XSECThreadTask {
+
+public:
+
+	XSECAsyncTask(XSECAsyncOperation * op) : mp_op(op) {}
+
+	virtual void run(void) {mp_op->run();}
+
+private:
+
+	XSECAsyncOperation * mp_op;
+
+};
+
+// --------------------------------------------------------------------------------
+//           Construct/Destruct
+// --------------------------------------------------------------------------------
+
+XSECAsyncQueue::XSECAsyncQueue(unsigned int threads) :
+	m_threads(threads),
+	mp_pool(NULL) {
+
+}
+
+XSECAsyncQueue::~XSECAsyncQueue() {
+
+	for (OperationVectorType::size_type i = 0; i < m_operations.size(); ++i)
+		delete m_operations[i];
+
+	delete mp_pool;
+
+}
+
+// --------------------------------------------------------------------------------
+//           Queue and run
+// --------------------------------------------------------------------------------
+
+void XSECAsyncQueue::addOperation(XSECAsyncOperation * op) {
+
+	m_operations.push_back(op);
+
+}
+
+void XSECAsyncQueue::wait(void) {
+
+	// Take the operations out of the queue first, so whatever happens
+	// the queue is empty (and re-usable) on return
+
+	OperationVectorType ops;
+	ops.swap(m_operations);
+
+	// Index of the first operation not yet completed and deleted - anything
+	// from here on is freed if something throws
+	OperationVectorType::size_type i = 0;
+
+	try {
+
+		if (!ops.empty()) {
+
+			std::vector<XSECAsyncTask> tasks;
+			tasks.reserve(ops.size());
+
+			// The pool (and its threads) is kept for the next wait()
+			if (mp_pool == NULL)
+				XSECnew(mp_pool, XSECThreadPool(m_threads));
+
+			for (OperationVectorType::size_type j = 0; j < ops.size(); ++j) {
+				tasks.push_back(XSECAsyncTask(ops[j]));
+				mp_pool->addTask(&tasks.back());
+			}
+
+			mp_pool->runAll();
+
+		}
+
+		for (i = 0; i < ops.size(); ++i) {
+			ops[i]->complete();
+			delete ops[i];
+		}
+
+	}
+	catch (...) {
+
+		// Anything not completed is dropped
+		for (; i < ops.size(); ++i)
+			delete ops[i];
+		throw;
+
+	}
+
+}
@@ -0,0 +1,199 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XSECAsyncQueue := Queue of deferred signature operations whose
+ *                   key operations are run as a batch
+ *
+ * $Id$
+ */
+
+#ifndef XSECASYNCQUEUE_INCLUDE
+#define XSECASYNCQUEUE_INCLUDE
+
+#include <xsec/framework/XSECDefs.hpp>
+
+#include <vector>
+
+class DSIGSignature;
+class XSECThreadPool;
+
+/**
+ * @ingroup pubsig
+ */
+/*\@{*/
+
+/**
+ * @brief Completion interface for asynchronous signature operations
+ *
+ * Implemented by callers of DSIGSignature::signAsync and
+ * DSIGSignature::verifyAsync to be told the outcome of each operation.
+ */
+
+class XSEC_EXPORT XSECAsyncCallback {
+
+public:
+
+	XSECAsyncCallback() {}
+	virtual ~XSECAsyncCallback() {}
+
+	/**
+	 * \brief Called when a queued operation completes
+	 *
+	 * Called from the thread that calls XSECAsyncQueue::wait(), once for
+	 * each operation, in the order the operations were queued.
+	 *
+	 * @param signature The signature that was signed or verified
+	 * @param result For a verify, whether the signature (and its references)
+	 * validated.  For a sign, true if the SignatureValue was set.
+	 * @param errorMsg NULL, unless an exception prevented the operation from
+	 * completing, in which case the message of the exception (and result is
+	 * false)
+	 */
+
+	virtual void signatureComplete(const DSIGSignature * signature,
+								   bool result,
+								   const XMLCh * errorMsg) = 0;
+
+};
+
+/**
+ * @brief A deferred operation held by an XSECAsyncQueue
+ *
+ * The work is split in two.  run() may be called from any thread and
+ * must not touch the DOM.  complete() is called afterwards from the
+ * thread that waits on the queue, and is where results are written back
+ * and callbacks made.
+ *
+ * Operations are normally created by the library (see
+ * DSIGSignature::signAsync), but applications may queue their own.
+ */
+
+class XSEC_EXPORT XSECAsyncOperation {
+
+public:
+
+	XSECAsyncOperation() {}
+	virtual ~XSECAsyncOperation() {}
+
+	/**
+	 * \brief Do the (thread safe) work of the operation
+	 *
+	 * Exceptions should be caught and reported through complete().
+	 */
+
+	virtual void run(void) = 0;
+
+	/**
+	 * \brief Finish the operation in the waiting thread
+	 */
+
+	virtual void complete(void) = 0;
+
+};
+
+/**
+ * @brief Batch up signature operations
+ *
+ * Signing or verifying a signature is dominated by the public key
+ * operation at the end.  DSIGSignature::signAsync and
+ * DSIGSignature::verifyAsync do everything that needs the DOM straight
+ * away (reference digests and canonicalising the SignedInfo), and leave
+ * the key operation queued here.  Calling wait() then runs all of the
+ * queued key operations at once, spread over a set of threads, before
+ * completing each operation and making the callbacks.
+ *
+ * The keys used must be safe to share between threads for the duration
+ * of wait() (the OpenSSL keys are), and must stay valid until then.
+ *
+ * The key operations themselves are ordinary blocking calls through the
+ * existing XSECCryptoKey and algorithm handler interfaces.  There is no
+ * asynchronous key interface, and the OpenSSL provider does not use
+ * ASYNC_JOB or hardware engines that can pause a job.  The only gain
+ * from the queue is running many key operations in parallel.
+ *
+ * @note A queue is not itself thread safe - it should be filled and
+ * waited on by a single thread.
+ */
+
+class XSEC_EXPORT XSECAsyncQueue {
+
+public:
+
+	/**
+	 * \brief Create a queue
+	 *
+	 * @param threads Maximum number of threads to run key operations on,
+	 * or 0 for one per processor
+	 */
+
+	XSECAsyncQueue(unsigned int threads = 0);
+
+	/**
+	 * \brief Destructor
+	 *
+	 * Any operations still queued are discarded without being run, and
+	 * no callbacks are made for them.
+	 */
+
+	~XSECAsyncQueue();
+
+	/**
+	 * \brief Queue an operation
+	 *
+	 * @param op The operation.  The queue takes ownership.
+	 */
+
+	void addOperation(XSECAsyncOperation * op);
+
+	/**
+	 * \brief Number of operations waiting to be run
+	 */
+
+	XMLSize_t getPendingCount(void) const {return m_operations.size();}
+
+	/**
+	 * \brief Run and complete all queued operations
+	 *
+	 * Blocks until every queued key operation has run, then completes
+	 * them in the order they were queued.  On return the queue is empty
+	 * and can be re-used.
+	 */
+
+	void wait(void);
+
+private:
+
+	typedef std::vector<XSECAsyncOperation *> OperationVectorType;
+
+	unsigned int			m_threads;
+	OperationVectorType		m_operations;
+	XSECThreadPool			* mp_pool;		// Created by the first wait()
+
+	// Unimplemented
+	XSECAsyncQueue(const XSECAsyncQueue &);
+	XSECAsyncQueue & operator = (const XSECAsyncQueue &);
+
+};
+
+/*\@}*/
+
+#endif /* XSECASYNCQUEUE_INCLUDE */
@@ -152,6 +152,7 @@ XSECEnv::XSECEnv(DOMDocument *doc) {
 	mp_xkmsPrefixNS = XMLString::replicate(s_defaultXKMSPrefix);
 #endif
 	m_prettyPrintFlag = true;
+	m_lazyLoadFlag = false;
 
 	mp_URIResolver = NULL;
 
@@ -165,6 +166,9 @@ XSECEnv::XSECEnv(DOMDocument *doc) {
 	registerIdAttributeName(s_Id);
 	registerIdAttributeName(s_id);
 
+	for (int i = 0; i < XSEC_NS_COUNT; ++i)
+		mp_namespaceURIs[i] = NULL;
+
 }
 
 XSECEnv::XSECEnv(const XSECEnv & theOther) {
@@ -181,6 +185,7 @@ XSECEnv::XSECEnv(const XSECEnv & theOther) {
 	mp_xkmsPrefixNS = XMLString::replicate(theOther.mp_xkmsPrefixNS);
 #endif
 	m_prettyPrintFlag = theOther.m_prettyPrintFlag;
+	m_lazyLoadFlag = theOther.m_lazyLoadFlag;
 
 	if (theOther.mp_URIResolver != NULL)
 		mp_URIResolver = theOther.mp_URIResolver->clone();
@@ -198,6 +203,10 @@ XSECEnv::XSECEnv(const XSECEnv & theOther) {
 		registerIdAttributeName(theOther.getIdAttributeNameListItem(i));
 	}
 
+	// The namespace cache is not copied - the copy is normally re-parented
+	for (int j = 0; j < XSEC_NS_COUNT; ++j)
+		mp_namespaceURIs[j] = NULL;
+
 }
 
 XSECEnv::~XSECEnv() {
@@ -258,6 +267,46 @@ XSECEnv::~XSECEnv() {
 
 }
 
+// --------------------------------------------------------------------------------
+//           Parent document and namespace classification
+// --------------------------------------------------------------------------------
+
+void XSECEnv::setParentDocument(DOMDocument * doc) {
+
+	// Pooled strings belong to the old document.  Always drop them - a
+	// new document may well be allocated where a released one used to be,
+	// so the same pointer says nothing about the string pool behind it
+	for (int i = 0; i < XSEC_NS_COUNT; ++i)
+		mp_namespaceURIs[i] = NULL;
+
+	mp_doc = doc;
+
+}
+
+XSECNamespaceType XSECEnv::getNamespaceType(const DOMNode * node) const {
+
+	const XMLCh * uri = node->getNamespaceURI();
+
+	if (uri == NULL)
+		return XSEC_NS_OTHER;
+
+	for (int i = XSEC_NS_OTHER + 1; i < XSEC_NS_COUNT; ++i) {
+		if (uri == mp_namespaceURIs[i])
+			return (XSECNamespaceType) i;
+	}
+
+	XSECNamespaceType ret = getXSECNamespaceType(uri);
+
+	// Only pointers pooled by our own document are safe to remember - they
+	// live exactly as long as the document does
+
+	if (ret != XSEC_NS_OTHER && mp_doc != NULL && node->getOwnerDocument() == mp_doc)
+		mp_namespaceURIs[ret] = uri;
+
+	return ret;
+
+}
+
 // --------------------------------------------------------------------------------
 //           Set and Get Resolvers
 // --------------------------------------------------------------------------------
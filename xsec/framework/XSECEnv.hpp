@@ -42,6 +42,26 @@
 
 class XSECURIResolver;
 
+/**
+ * @brief Namespaces known to the library
+ *
+ * Used by XSECEnv::getNamespaceType to classify elements.
+ */
+
+enum XSECNamespaceType {
+
+	XSEC_NS_OTHER = 0,
+	XSEC_NS_DSIG,
+	XSEC_NS_DSIG11,
+	XSEC_NS_EC,
+	XSEC_NS_XPF,
+	XSEC_NS_XENC,
+	XSEC_NS_XENC11,
+	XSEC_NS_XKMS,
+	XSEC_NS_COUNT
+
+};
+
 /**
  * @ingroup internal
  */
@@ -290,6 +310,35 @@ public:
 
 	void doPrettyPrint(XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * node) const;
 
+	//@}
+
+	/** @name Loading Functions */
+	//@{
+
+	/**
+	 * \brief Set Lazy Load flag
+	 *
+	 * When set, loading a signature only reads what is needed to check
+	 * the SignedInfo.  The KeyInfo list, the Object elements and the
+	 * References within a Manifest are read when they are first used,
+	 * and any errors in them are reported at that point rather than from
+	 * load().
+	 *
+	 * By default everything is read by load() (flag is false)
+	 *
+	 * @param flag Value to set the flag (true = defer loading)
+	 */
+
+	void setLazyLoadFlag(bool flag) {m_lazyLoadFlag = flag;}
+
+	/**
+	 * \brief Return the current value of the Lazy Load flag
+	 *
+	 * @returns The value of the lazy load flag
+	 */
+
+	bool getLazyLoadFlag(void) const {return m_lazyLoadFlag;}
+
 	//@}
 	
 	/** @name General information functions */
@@ -312,14 +361,54 @@ public:
 	 * \brief
 	 *
 	 * Set the DOMDocument that the super class is operating within.
+	 * Any namespace pointers cached by getNamespaceType() are dropped,
+	 * even if doc is the same pointer as before, so this must be called
+	 * whenever the environment moves on to a newly parsed document.
 	 *
 	 * Mainly used by the library itself.
 	 *
 	 * @param doc The Document node.
 	 */
 
-	void setParentDocument(XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument * doc)
-		{mp_doc = doc;}
+	void setParentDocument(XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument * doc);
+
+	//@}
+
+	/** @name Namespace classification */
+	//@{
+
+	/**
+	 * \brief Find which known namespace a node is in
+	 *
+	 * Xerces pools the strings of a document, so every node in the parent
+	 * document that is in a given namespace returns the same pointer from
+	 * getNamespaceURI().  The first time a known namespace is seen, its
+	 * pooled pointer is remembered, and after that nodes in that namespace
+	 * are classified with a pointer compare rather than a string compare.
+	 *
+	 * Nodes from other documents are classified correctly, but are not
+	 * cached.
+	 *
+	 * @param node The node to classify
+	 * @returns The namespace of the node, or XSEC_NS_OTHER if it is not
+	 * one the library knows about
+	 */
+
+	XSECNamespaceType getNamespaceType(const XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * node) const;
+
+	/**
+	 * \brief Get the local name of a node in a given namespace
+	 *
+	 * @param node The node to look at
+	 * @param type The namespace the node should be in
+	 * @returns The local name of the node, or NULL if the node is not in
+	 * the namespace
+	 */
+
+	const XMLCh * getLocalName(const XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * node,
+		XSECNamespaceType type) const {
+		return (getNamespaceType(node) == type ? node->getLocalName() : NULL);
+	}
 
 	//@}
 
@@ -560,11 +649,15 @@ private:
 
 	// Flags
 	bool						m_prettyPrintFlag;
+	bool						m_lazyLoadFlag;
 	bool						m_idByAttributeNameFlag;
 
 	// Id handling
 	IdNameVectorType			m_idAttributeNameList;	
 
+	// Pooled namespace URIs of mp_doc, indexed by XSECNamespaceType
+	mutable const XMLCh			* mp_namespaceURIs[XSEC_NS_COUNT];
+
 	XSECEnv();
 
 	/*\@}*/
@@ -0,0 +1,349 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XSECMemory := Allocation of short lived internal objects, with
+ *               optional per-operation arenas
+ *
+ * $Id$
+ *
+ */
+
+#include <xsec/framework/XSECMemory.hpp>
+#include <xsec/framework/XSECError.hpp>
+#include <xsec/utils/XSECPlatformUtils.hpp>
+
+#include <xercesc/framework/MemoryManager.hpp>
+#include <xercesc/util/PlatformUtils.hpp>
+
+#include <new>
+
+#if defined(_WIN32)
+#	include <windows.h>
+#else
+#	include <pthread.h>
+#endif
+
+XERCES_CPP_NAMESPACE_USE
+
+// --------------------------------------------------------------------------------
+//           Block headers
+// --------------------------------------------------------------------------------
+
+// Every block handed out is preceded by a header recording where it came
+// from, so it can be freed correctly whatever has changed since
+
+struct XSECMemoryHeader {
+
+	XSECArenaImpl		* mp_arena;		// Owning arena (or NULL)
+	MemoryManager		* mp_manager;	// Heap it came from if not an arena
+
+};
+
+// Keep the objects that follow suitably aligned
+#define XSEC_ALIGN(x)			(((x) + 15) & ~((size_t) 15))
+#define XSEC_HEADER_SIZE		XSEC_ALIGN(sizeof(XSECMemoryHeader))
+
+static void * rawAllocate(MemoryManager * mm, size_t size) {
+
+	if (mm != NULL)
+		return mm->allocate(size);
+
+	return ::operator new(size);
+
+}
+
+static void rawDeallocate(MemoryManager * mm, void * p) {
+
+	if (mm != NULL)
+		mm->deallocate(p);
+	else
+		::operator delete(p);
+
+}
+
+// --------------------------------------------------------------------------------
+//           The arena itself
+// --------------------------------------------------------------------------------
+
+class XSECArenaImpl {
+
+public:
+
+	XSECArenaImpl(size_t chunkSize) :
+		m_refs(1),
+		m_chunkSize(XSEC_ALIGN(chunkSize)),
+		mp_next(NULL),
+		m_remaining(0),
+		mp_chunks(NULL),
+		m_allocations(0),
+		m_bytes(0),
+		m_chunkCount(0) {
+
+		// Chunks must come back to the heap they came from
+		mp_manager = XSECPlatformUtils::g_memoryManager;
+
+	}
+
+	~XSECArenaImpl() {
+
+		while (mp_chunks != NULL) {
+			Chunk * c = mp_chunks;
+			mp_chunks = c->mp_next;
+			rawDeallocate(mp_manager, c);
+		}
+
+	}
+
+	// Returns NULL if the block should come from the heap instead.  Only
+	// ever called from the thread the arena is active on.
+
+	void * allocate(size_t size) {
+
+		size = XSEC_ALIGN(size);
+
+		if (size > m_chunkSize / 4)
+			return NULL;
+
+		if (size > m_remaining) {
+
+			Chunk * c = (Chunk *) rawAllocate(mp_manager, XSEC_ALIGN(sizeof(Chunk)) + m_chunkSize);
+			c->mp_next = mp_chunks;
+			mp_chunks = c;
+
+			mp_next = ((char *) c) + XSEC_ALIGN(sizeof(Chunk));
+			m_remaining = m_chunkSize;
+			++m_chunkCount;
+
+		}
+
+		void * ret = mp_next;
+		mp_next += size;
+		m_remaining -= size;
+
+		++m_allocations;
+		m_bytes += size;
+
+		XMLPlatformUtils::atomicIncrement(m_refs);
+
+		return ret;
+
+	}
+
+	// One reference is held by the XSECArena and one by each live block.
+	// May be called from any thread.
+
+	void release(void) {
+
+		if (XMLPlatformUtils::atomicDecrement(m_refs) == 0)
+			delete this;
+
+	}
+
+	struct Chunk {
+		Chunk			* mp_next;
+	};
+
+	int					m_refs;
+	size_t				m_chunkSize;
+	char				* mp_next;
+	size_t				m_remaining;
+	Chunk				* mp_chunks;
+	MemoryManager		* mp_manager;
+
+	XMLSize_t			m_allocations;
+	XMLSize_t			m_bytes;
+	XMLSize_t			m_chunkCount;
+
+};
+
+// --------------------------------------------------------------------------------
+//           Thread local active arena
+// --------------------------------------------------------------------------------
+
+#if defined(_WIN32)
+
+static DWORD s_arenaKey = TLS_OUT_OF_INDEXES;
+
+static XSECArenaImpl * getActiveArena(void) {
+
+	if (s_arenaKey == TLS_OUT_OF_INDEXES)
+		return NULL;
+
+	return (XSECArenaImpl *) TlsGetValue(s_arenaKey);
+
+}
+
+static bool setActiveArena(XSECArenaImpl * arena) {
+
+	return (s_arenaKey != TLS_OUT_OF_INDEXES && TlsSetValue(s_arenaKey, arena) != 0);
+
+}
+
+void XSECMemory::initialise(void) {
+
+	if (s_arenaKey == TLS_OUT_OF_INDEXES)
+		s_arenaKey = TlsAlloc();
+
+}
+
+void XSECMemory::terminate(void) {
+
+	if (s_arenaKey != TLS_OUT_OF_INDEXES) {
+		TlsFree(s_arenaKey);
+		s_arenaKey = TLS_OUT_OF_INDEXES;
+	}
+
+}
+
+#else
+
+static pthread_key_t s_arenaKey;
+static bool s_arenaKeyValid = false;
+
+static XSECArenaImpl * getActiveArena(void) {
+
+	if (!s_arenaKeyValid)
+		return NULL;
+
+	return (XSECArenaImpl *) pthread_getspecific(s_arenaKey);
+
+}
+
+static bool setActiveArena(XSECArenaImpl * arena) {
+
+	return (s_arenaKeyValid && pthread_setspecific(s_arenaKey, arena) == 0);
+
+}
+
+void XSECMemory::initialise(void) {
+
+	if (!s_arenaKeyValid)
+		s_arenaKeyValid = (pthread_key_create(&s_arenaKey, NULL) == 0);
+
+}
+
+void XSECMemory::terminate(void) {
+
+	if (s_arenaKeyValid) {
+		pthread_key_delete(s_arenaKey);
+		s_arenaKeyValid = false;
+	}
+
+}
+
+#endif
+
+// --------------------------------------------------------------------------------
+//           XSECMemory
+// --------------------------------------------------------------------------------
+
+void * XSECMemory::allocate(size_t size) {
+
+	XSECMemoryHeader * h = NULL;
+	XSECArenaImpl * arena = getActiveArena();
+
+	if (arena != NULL) {
+
+		h = (XSECMemoryHeader *) arena->allocate(XSEC_HEADER_SIZE + size);
+		if (h != NULL) {
+			h->mp_arena = arena;
+			h->mp_manager = NULL;
+		}
+
+	}
+
+	if (h == NULL) {
+
+		MemoryManager * mm = XSECPlatformUtils::g_memoryManager;
+		h = (XSECMemoryHeader *) rawAllocate(mm, XSEC_HEADER_SIZE + size);
+		h->mp_arena = NULL;
+		h->mp_manager = mm;
+
+	}
+
+	return ((char *) h) + XSEC_HEADER_SIZE;
+
+}
+
+void XSECMemory::deallocate(void * p) {
+
+	if (p == NULL)
+		return;
+
+	XSECMemoryHeader * h = (XSECMemoryHeader *) (((char *) p) - XSEC_HEADER_SIZE);
+
+	if (h->mp_arena != NULL)
+		h->mp_arena->release();
+	else
+		rawDeallocate(h->mp_manager, h);
+
+}
+
+void * XSECMemory::operator new(size_t size) {
+
+	return allocate(size);
+
+}
+
+void XSECMemory::operator delete(void * p) {
+
+	deallocate(p);
+
+}
+
+// --------------------------------------------------------------------------------
+//           XSECArena
+// --------------------------------------------------------------------------------
+
+XSECArena::XSECArena(XMLSize_t chunkSize) {
+
+	XSECnew(mp_impl, XSECArenaImpl(chunkSize));
+
+	mp_previous = getActiveArena();
+	setActiveArena(mp_impl);
+
+}
+
+XSECArena::~XSECArena() {
+
+	setActiveArena(mp_previous);
+	mp_impl->release();
+
+}
+
+XMLSize_t XSECArena::getAllocationCount(void) const {
+
+	return mp_impl->m_allocations;
+
+}
+
+XMLSize_t XSECArena::getBytesAllocated(void) const {
+
+	return mp_impl->m_bytes;
+
+}
+
+XMLSize_t XSECArena::getChunkCount(void) const {
+
+	return mp_impl->m_chunkCount;
+
+}
@@ -0,0 +1,193 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XSECMemory := Allocation of short lived internal objects, with
+ *               optional per-operation arenas
+ *
+ * $Id$
+ */
+
+#ifndef XSECMEMORY_INCLUDE
+#define XSECMEMORY_INCLUDE
+
+#include <xsec/framework/XSECDefs.hpp>
+
+#include <stddef.h>
+
+class XSECArenaImpl;
+
+/**
+ * @ingroup internal
+ */
+/*\@{*/
+
+/**
+ * @brief Base class for short lived internal objects
+ *
+ * Much as Xerces' XMemory does, classes deriving from XSECMemory are
+ * allocated through a class level operator new.  Memory comes from the
+ * XSECArena active on the calling thread if there is one, and otherwise
+ * from the MemoryManager passed to XSECPlatformUtils::Initialise (or the
+ * global heap if none was given).
+ *
+ * Only objects that are created and destroyed within a single
+ * operation derive from this class - the transformers, transform chains
+ * and canonicalisation node lists.
+ */
+
+class XSEC_EXPORT XSECMemory {
+
+public:
+
+	static void * operator new(size_t size);
+	static void operator delete(void * p);
+
+	/**
+	 * \brief Allocate a block of memory
+	 *
+	 * @param size Number of bytes required
+	 * @returns The block, which must be freed with deallocate()
+	 */
+
+	static void * allocate(size_t size);
+
+	/**
+	 * \brief Free a block returned by allocate()
+	 *
+	 * May be called from any thread, and after the arena the block came
+	 * from has gone out of scope.
+	 */
+
+	static void deallocate(void * p);
+
+	/**
+	 * \brief Set up the thread local state (called by XSECPlatformUtils)
+	 */
+
+	static void initialise(void);
+
+	/**
+	 * \brief Free the thread local state (called by XSECPlatformUtils)
+	 */
+
+	static void terminate(void);
+
+protected:
+
+	XSECMemory() {}
+
+};
+
+/*\@}*/
+
+/**
+ * @ingroup pubsig
+ */
+/*\@{*/
+
+/**
+ * @brief A scoped monotonic arena for per-operation allocations
+ *
+ * Creating an XSECArena makes it the active arena for the calling thread
+ * until it is destroyed.  While it is active, the short lived objects the
+ * library creates (the transform chain built for each Reference, the
+ * canonicaliser's node lists etc.) are carved out of large chunks rather
+ * than each being a separate heap allocation, and the chunks are freed in
+ * one go.
+ *
+ * \code
+ *	{
+ *		XSECArena arena;
+ *		bool ok = sig->verify();
+ *		// arena.getAllocationCount() objects came from
+ *		// arena.getChunkCount() heap allocations
+ *	}
+ * \endcode
+ *
+ * Individual objects are never freed back to the arena.  If an object
+ * from the arena is still alive when the XSECArena is destroyed, the
+ * chunks are kept until that object is deleted, so going out of scope is
+ * always safe.
+ *
+ * Arenas nest - the most recently created one on a thread is the active
+ * one.  They must be destroyed in the reverse order of creation, which is
+ * natural when they are used as automatic variables.  An arena created
+ * before XSECPlatformUtils::Initialise() is called has no effect.
+ */
+
+class XSEC_EXPORT XSECArena {
+
+public:
+
+	/**
+	 * \brief Create and activate an arena
+	 *
+	 * @param chunkSize Size of each chunk requested from the heap.
+	 * Objects larger than a quarter of this are not allocated from
+	 * the arena.
+	 */
+
+	XSECArena(XMLSize_t chunkSize = 16384);
+
+	/**
+	 * \brief Deactivate the arena, and free it once it is no longer used
+	 */
+
+	~XSECArena();
+
+	/** @name Counters */
+	//@{
+
+	/**
+	 * \brief Number of objects allocated from the arena
+	 */
+
+	XMLSize_t getAllocationCount(void) const;
+
+	/**
+	 * \brief Number of bytes handed out by the arena
+	 */
+
+	XMLSize_t getBytesAllocated(void) const;
+
+	/**
+	 * \brief Number of chunks (and so heap allocations) used
+	 */
+
+	XMLSize_t getChunkCount(void) const;
+
+	//@}
+
+private:
+
+	XSECArenaImpl		* mp_impl;
+	XSECArenaImpl		* mp_previous;
+
+	// Unimplemented
+	XSECArena(const XSECArena &);
+	XSECArena & operator = (const XSECArena &);
+
+};
+
+/*\@}*/
+
+#endif /* XSECMEMORY_INCLUDE */
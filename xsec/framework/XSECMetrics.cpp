@@ -0,0 +1,281 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XSECMetrics := Timers and counters for the stages of signature and
+ *                encryption processing
+ *
+ * $Id$
+ *
+ */
+
+#include <xsec/framework/XSECMetrics.hpp>
+#include <xsec/framework/XSECError.hpp>
+
+#include <xercesc/util/XMLString.hpp>
+
+#include <new>
+#include <string.h>
+
+#if defined(_WIN32)
+#	include <windows.h>
+#else
+#	include <time.h>
+#endif
+
+XERCES_CPP_NAMESPACE_USE
+
+// --------------------------------------------------------------------------------
+//           Clock
+// --------------------------------------------------------------------------------
+
+#if defined(_WIN32)
+
+XMLUInt64 XSECMetricTimer::now(void) {
+
+	static LARGE_INTEGER frequency;
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	// Split to avoid overflowing with high frequency counters
+	XMLUInt64 c = (XMLUInt64) counter.QuadPart;
+	XMLUInt64 f = (XMLUInt64) frequency.QuadPart;
+	return (c / f) * 1000000000ULL + ((c % f) * 1000000000ULL) / f;
+
+}
+
+#else
+
+XMLUInt64 XSECMetricTimer::now(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (XMLUInt64) ts.tv_sec * 1000000000ULL + (XMLUInt64) ts.tv_nsec;
+
+}
+
+#endif
+
+// --------------------------------------------------------------------------------
+//           Construct/Destruct
+// --------------------------------------------------------------------------------
+
+XSECMetrics::XSECMetrics() {
+
+	memset(m_stages, 0, sizeof(m_stages));
+
+}
+
+XSECMetrics::~XSECMetrics() {
+
+	for (AlgorithmVectorType::size_type i = 0; i < m_algorithms.size(); ++i) {
+		XSEC_RELEASE_XMLCH(m_algorithms[i]->mp_algorithm);
+		delete m_algorithms[i];
+	}
+
+}
+
+// --------------------------------------------------------------------------------
+//           Recording
+// --------------------------------------------------------------------------------
+
+static void addMeasurement(XSECMetricStatistics & stats, XMLUInt64 nanoseconds, XMLSize_t bytes) {
+
+	unsigned int bucket = 0;
+	XMLUInt64 bound = 1000;
+
+	while (bucket < XSEC_METRIC_BUCKET_COUNT - 1 && nanoseconds > bound) {
+		++bucket;
+		bound <<= 1;
+	}
+
+	stats.count++;
+	stats.nanoseconds += nanoseconds;
+	stats.bytes += bytes;
+	stats.buckets[bucket]++;
+
+}
+
+void XSECMetrics::record(XSECMetricStage stage,
+						 const XMLCh * algorithm,
+						 XMLUInt64 nanoseconds,
+						 XMLSize_t bytes) {
+
+	if ((unsigned int) stage >= XSEC_METRIC_STAGE_COUNT)
+		return;
+
+	XMLMutexLock lock(&m_mutex);
+
+	addMeasurement(m_stages[stage], nanoseconds, bytes);
+
+	if (algorithm == NULL)
+		return;
+
+	AlgorithmVectorType::size_type i;
+	for (i = 0; i < m_algorithms.size(); ++i) {
+
+		if (m_algorithms[i]->m_stage == stage &&
+			XMLString::equals(m_algorithms[i]->mp_algorithm, algorithm))
+			break;
+
+	}
+
+	if (i == m_algorithms.size()) {
+
+		// First time this algorithm has been seen.  Measurements must not
+		// throw, so anything going wrong here only loses the breakdown.
+
+		AlgorithmStatistics * a = new (std::nothrow) AlgorithmStatistics;
+		if (a == NULL)
+			return;
+
+		a->m_stage = stage;
+		a->mp_algorithm = XMLString::replicate(algorithm);
+		memset(&a->m_stats, 0, sizeof(a->m_stats));
+
+		try {
+			m_algorithms.push_back(a);
+		}
+		catch (...) {
+			XSEC_RELEASE_XMLCH(a->mp_algorithm);
+			delete a;
+			return;
+		}
+
+	}
+
+	addMeasurement(m_algorithms[i]->m_stats, nanoseconds, bytes);
+
+}
+
+void XSECMetrics::reset(void) {
+
+	XMLMutexLock lock(&m_mutex);
+
+	memset(m_stages, 0, sizeof(m_stages));
+	for (AlgorithmVectorType::size_type i = 0; i < m_algorithms.size(); ++i)
+		memset(&m_algorithms[i]->m_stats, 0, sizeof(XSECMetricStatistics));
+
+}
+
+// --------------------------------------------------------------------------------
+//           Reading
+// --------------------------------------------------------------------------------
+
+void XSECMetrics::getStatistics(XSECMetricStage stage, XSECMetricStatistics & stats) const {
+
+	if ((unsigned int) stage >= XSEC_METRIC_STAGE_COUNT) {
+		throw XSECException(XSECException::InternalError,
+			"XSECMetrics::getStatistics - unknown stage");
+	}
+
+	XMLMutexLock lock(&m_mutex);
+	stats = m_stages[stage];
+
+}
+
+bool XSECMetrics::getStatistics(XSECMetricStage stage,
+								const XMLCh * algorithm,
+								XSECMetricStatistics & stats) const {
+
+	if (algorithm == NULL) {
+		getStatistics(stage, stats);
+		return true;
+	}
+
+	XMLMutexLock lock(&m_mutex);
+
+	for (AlgorithmVectorType::size_type i = 0; i < m_algorithms.size(); ++i) {
+
+		if (m_algorithms[i]->m_stage == stage &&
+			XMLString::equals(m_algorithms[i]->mp_algorithm, algorithm)) {
+
+			stats = m_algorithms[i]->m_stats;
+			return true;
+
+		}
+
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	return false;
+
+}
+
+void XSECMetrics::getAlgorithms(XSECMetricStage stage,
+								std::vector<const XMLCh *> & algorithms) const {
+
+	algorithms.clear();
+
+	XMLMutexLock lock(&m_mutex);
+
+	for (AlgorithmVectorType::size_type i = 0; i < m_algorithms.size(); ++i) {
+		if (m_algorithms[i]->m_stage == stage)
+			algorithms.push_back(m_algorithms[i]->mp_algorithm);
+	}
+
+}
+
+const char * XSECMetrics::getStageName(XSECMetricStage stage) {
+
+	switch (stage) {
+
+	case XSEC_METRIC_LOAD :
+		return "load";
+	case XSEC_METRIC_TRANSFORM_CHAIN :
+		return "transform_chain";
+	case XSEC_METRIC_C14N :
+		return "c14n";
+	case XSEC_METRIC_DIGEST :
+		return "digest";
+	case XSEC_METRIC_BASE64 :
+		return "base64";
+	case XSEC_METRIC_KEY_RESOLUTION :
+		return "key_resolution";
+	case XSEC_METRIC_SIGN :
+		return "sign";
+	case XSEC_METRIC_VERIFY :
+		return "verify";
+	case XSEC_METRIC_ENCRYPT :
+		return "encrypt";
+	case XSEC_METRIC_DECRYPT :
+		return "decrypt";
+	case XSEC_METRIC_PARALLEL_DECRYPT :
+		return "parallel_decrypt";
+	default :
+		return "unknown";
+
+	}
+
+}
+
+XMLUInt64 XSECMetrics::getBucketBound(unsigned int bucket) {
+
+	if (bucket >= XSEC_METRIC_BUCKET_COUNT - 1)
+		return ~((XMLUInt64) 0);
+
+	return ((XMLUInt64) 1000) << bucket;
+
+}
@@ -0,0 +1,364 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XSECMetrics := Timers and counters for the stages of signature and
+ *                encryption processing
+ *
+ * $Id$
+ */
+
+#ifndef XSECMETRICS_INCLUDE
+#define XSECMETRICS_INCLUDE
+
+#include <xsec/framework/XSECDefs.hpp>
+#include <xsec/utils/XSECPlatformUtils.hpp>
+#include <xsec/framework/XSECTrace.hpp>
+
+#include <xercesc/util/Mutexes.hpp>
+
+#include <vector>
+
+/**
+ * @ingroup pubsig
+ */
+/*\@{*/
+
+/**
+ * \brief The stages of processing that are measured
+ *
+ * Stages can nest - for example the time recorded for XSEC_METRIC_SIGN
+ * includes canonicalising and digesting the SignedInfo, which are also
+ * recorded under XSEC_METRIC_C14N and XSEC_METRIC_DIGEST.
+ */
+
+enum XSECMetricStage {
+
+	XSEC_METRIC_LOAD = 0,				// Loading signatures and encrypted
+										// structures, parsing decrypted XML
+	XSEC_METRIC_TRANSFORM_CHAIN,		// Building a Reference's transform chain
+	XSEC_METRIC_C14N,					// Canonicalisation (bytes output)
+	XSEC_METRIC_DIGEST,					// Digest and HMAC (bytes hashed)
+	XSEC_METRIC_BASE64,					// Base64 transform (bytes input)
+	XSEC_METRIC_KEY_RESOLUTION,			// Calls to a KeyInfo resolver
+	XSEC_METRIC_SIGN,					// Creating a SignatureValue
+	XSEC_METRIC_VERIFY,					// Checking a SignatureValue
+	XSEC_METRIC_ENCRYPT,				// Encrypting data or keys
+	XSEC_METRIC_DECRYPT,				// Decrypting data or keys
+	XSEC_METRIC_PARALLEL_DECRYPT,		// CBC decryption split across threads
+										// (bytes decrypted)
+	XSEC_METRIC_STAGE_COUNT
+
+};
+
+/**
+ * \brief Receives measurements from the library
+ *
+ * Register an implementation with XSECPlatformUtils::Initialise() or
+ * XSECPlatformUtils::SetMetricsSink().  When no sink is registered the
+ * library does not read the clock at all.
+ *
+ * record() is called from whichever thread did the work, so must be
+ * thread safe, and must not throw.
+ */
+
+class XSEC_EXPORT XSECMetricsSink {
+
+public:
+
+	XSECMetricsSink() {}
+	virtual ~XSECMetricsSink() {}
+
+	/**
+	 * \brief Record one measurement
+	 *
+	 * @param stage The stage of processing measured
+	 * @param algorithm URI of the algorithm used, or NULL where there is
+	 * none.  Only valid for the duration of the call.
+	 * @param nanoseconds Time taken, from a monotonic clock
+	 * @param bytes Amount of data processed, where meaningful (otherwise 0)
+	 */
+
+	virtual void record(XSECMetricStage stage,
+						const XMLCh * algorithm,
+						XMLUInt64 nanoseconds,
+						XMLSize_t bytes) = 0;
+
+};
+
+// Histogram buckets - see XSECMetrics::getBucketBound
+#define XSEC_METRIC_BUCKET_COUNT	24
+
+/**
+ * \brief Totals for a stage (or a stage and algorithm)
+ */
+
+struct XSECMetricStatistics {
+
+	XMLUInt64		count;			// Number of measurements
+	XMLUInt64		nanoseconds;	// Total time
+	XMLUInt64		bytes;			// Total bytes processed
+
+	// Number of measurements in each latency bucket.  These are not
+	// cumulative - buckets[i] counts durations above the bound of
+	// bucket i - 1 and no more than the bound of bucket i.
+	XMLUInt64		buckets[XSEC_METRIC_BUCKET_COUNT];
+
+};
+
+/**
+ * \brief A sink that keeps running totals
+ *
+ * XSECMetrics gathers counters and latency histograms for each stage,
+ * and for each algorithm seen within a stage, for an exporter (e.g. for
+ * Prometheus) to read at its leisure.  All of the counters only ever
+ * increase (unless reset() is called).
+ *
+ * \code
+ *	XSECMetrics metrics;
+ *	XSECPlatformUtils::Initialise(NULL, NULL, &metrics);
+ *	...
+ *	XSECMetricStatistics s;
+ *	metrics.getStatistics(XSEC_METRIC_C14N, s);
+ * \endcode
+ */
+
+class XSEC_EXPORT XSECMetrics : public XSECMetricsSink {
+
+public:
+
+	/** @name Constructors and Destructors */
+	//@{
+
+	XSECMetrics();
+	virtual ~XSECMetrics();
+
+	//@}
+
+	/** @name Recording */
+	//@{
+
+	virtual void record(XSECMetricStage stage,
+						const XMLCh * algorithm,
+						XMLUInt64 nanoseconds,
+						XMLSize_t bytes);
+
+	/**
+	 * \brief Set all counters back to zero
+	 *
+	 * Algorithms already seen are kept, so pointers returned by
+	 * getAlgorithms() remain valid.
+	 */
+
+	void reset(void);
+
+	//@}
+
+	/** @name Reading */
+	//@{
+
+	/**
+	 * \brief Get the totals for a stage, across all algorithms
+	 */
+
+	void getStatistics(XSECMetricStage stage, XSECMetricStatistics & stats) const;
+
+	/**
+	 * \brief Get the totals for one algorithm within a stage
+	 *
+	 * @returns false (and zeroed statistics) if the algorithm has not
+	 * been seen for this stage
+	 */
+
+	bool getStatistics(XSECMetricStage stage,
+					   const XMLCh * algorithm,
+					   XSECMetricStatistics & stats) const;
+
+	/**
+	 * \brief Get the algorithms seen for a stage
+	 *
+	 * @param stage The stage to look at
+	 * @param algorithms Filled with the algorithm URIs, which remain
+	 * owned by (and valid for the life of) this object
+	 */
+
+	void getAlgorithms(XSECMetricStage stage,
+					   std::vector<const XMLCh *> & algorithms) const;
+
+	/**
+	 * \brief A short name for a stage (e.g. "c14n"), suitable for a label
+	 */
+
+	static const char * getStageName(XSECMetricStage stage);
+
+	/**
+	 * \brief Upper bound of a histogram bucket, in nanoseconds
+	 *
+	 * Bucket 0 is up to one microsecond, and each bucket after that is
+	 * double the previous.  The last bucket has no upper bound, and
+	 * returns the largest XMLUInt64.
+	 */
+
+	static XMLUInt64 getBucketBound(unsigned int bucket);
+
+	//@}
+
+private:
+
+	struct AlgorithmStatistics {
+
+		XSECMetricStage			m_stage;
+		XMLCh					* mp_algorithm;
+		XSECMetricStatistics	m_stats;
+
+	};
+
+	typedef std::vector<AlgorithmStatistics *> AlgorithmVectorType;
+
+	mutable XERCES_CPP_NAMESPACE_QUALIFIER XMLMutex
+							m_mutex;
+	XSECMetricStatistics	m_stages[XSEC_METRIC_STAGE_COUNT];
+	AlgorithmVectorType		m_algorithms;
+
+	// Unimplemented
+	XSECMetrics(const XSECMetrics &);
+	XSECMetrics & operator = (const XSECMetrics &);
+
+};
+
+/*\@}*/
+
+/**
+ * @ingroup internal
+ */
+/*\@{*/
+
+/**
+ * \brief Times a scope and reports it to the registered sinks
+ *
+ * The measurement also goes to the trace sink, as an event named after
+ * the stage.  Does nothing (and does not read the clock) if neither sink
+ * is registered.
+ */
+
+class XSEC_EXPORT XSECMetricTimer {
+
+public:
+
+	XSECMetricTimer(XSECMetricStage stage, const XMLCh * algorithm = NULL) :
+		mp_sink(XSECPlatformUtils::g_metricsSink),
+		m_trace(XSECTrace::isEnabled()),
+		m_stage(stage),
+		mp_algorithm(algorithm),
+		m_bytes(0),
+		m_start(0) {
+
+		if (mp_sink != NULL || m_trace)
+			m_start = now();
+
+	}
+
+	~XSECMetricTimer() {
+
+		if (mp_sink != NULL)
+			mp_sink->record(m_stage, mp_algorithm, now() - m_start, m_bytes);
+		if (m_trace)
+			XSECTrace::event(XSECMetrics::getStageName(m_stage), mp_algorithm, m_start);
+
+	}
+
+	void setAlgorithm(const XMLCh * algorithm) {mp_algorithm = algorithm;}
+	void setBytes(XMLSize_t bytes) {m_bytes = bytes;}
+
+	static bool isEnabled(void) {return XSECPlatformUtils::g_metricsSink != NULL;}
+
+	// Monotonic clock, in nanoseconds
+	static XMLUInt64 now(void);
+
+private:
+
+	XSECMetricsSink			* mp_sink;
+	bool					m_trace;
+	XSECMetricStage			m_stage;
+	const XMLCh				* mp_algorithm;
+	XMLSize_t				m_bytes;
+	XMLUInt64				m_start;
+
+	// Unimplemented
+	XSECMetricTimer(const XSECMetricTimer &);
+	XSECMetricTimer & operator = (const XSECMetricTimer &);
+
+};
+
+/**
+ * \brief Adds up the time spent in many small steps
+ *
+ * Used by transforms that do their work a buffer at a time.  The total is
+ * reported as a single measurement when the accumulator is destroyed.
+ */
+
+class XSEC_EXPORT XSECMetricAccumulator {
+
+public:
+
+	XSECMetricAccumulator(XSECMetricStage stage, const XMLCh * algorithm = NULL) :
+		m_stage(stage),
+		mp_algorithm(algorithm),
+		m_nanoseconds(0),
+		m_bytes(0),
+		m_used(false) {}
+
+	~XSECMetricAccumulator() {
+
+		XSECMetricsSink * sink = XSECPlatformUtils::g_metricsSink;
+		if (m_used && sink != NULL)
+			sink->record(m_stage, mp_algorithm, m_nanoseconds, m_bytes);
+
+	}
+
+	void setAlgorithm(const XMLCh * algorithm) {mp_algorithm = algorithm;}
+
+	// Add a step that began at start (from XSECMetricTimer::now())
+	void add(XMLUInt64 start, XMLSize_t bytes) {
+
+		m_nanoseconds += XSECMetricTimer::now() - start;
+		m_bytes += bytes;
+		m_used = true;
+
+	}
+
+private:
+
+	XSECMetricStage			m_stage;
+	const XMLCh				* mp_algorithm;
+	XMLUInt64				m_nanoseconds;
+	XMLSize_t				m_bytes;
+	bool					m_used;
+
+	// Unimplemented
+	XSECMetricAccumulator(const XSECMetricAccumulator &);
+	XSECMetricAccumulator & operator = (const XSECMetricAccumulator &);
+
+};
+
+/*\@}*/
+
+#endif /* XSECMETRICS_INCLUDE */
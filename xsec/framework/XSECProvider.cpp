@@ -30,6 +30,7 @@
 #include <xsec/framework/XSECProvider.hpp>
 #include <xsec/framework/XSECError.hpp>
 #include <xsec/framework/XSECURIResolverXerces.hpp>
+#include <xsec/enc/XSECKeyInfoResolver.hpp>
 
 #include "../utils/XSECDOMUtils.hpp"
 #include "../xenc/impl/XENCCipherImpl.hpp"
@@ -45,7 +46,8 @@ XERCES_CPP_NAMESPACE_USE
 // --------------------------------------------------------------------------------
 
 
-XSECProvider::XSECProvider() {
+XSECProvider::XSECProvider() :
+        m_poolSize(0) {
 
     mp_URIResolver = new XSECURIResolverXerces();
 #ifdef XSEC_XKMS_ENABLED
@@ -55,6 +57,8 @@ XSECProvider::XSECProvider() {
 
 XSECProvider::~XSECProvider() {
 
+    setPoolSize(0);
+
     if (mp_URIResolver != NULL)
         delete mp_URIResolver;
 
@@ -71,9 +75,12 @@ XSECProvider::~XSECProvider() {
 
 DSIGSignature* XSECProvider::newSignatureFromDOM(DOMDocument* doc, DOMNode* sigNode) {
 
-    DSIGSignature* ret;
+    DSIGSignature* ret = takePooledSignature();
 
-    XSECnew(ret, DSIGSignature(doc, sigNode));
+    if (ret != NULL)
+        ret->reset(doc, sigNode);
+    else
+        XSECnew(ret, DSIGSignature(doc, sigNode));
 
     setup(ret);
 
@@ -93,7 +100,12 @@ DSIGSignature* XSECProvider::newSignatureFromDOM(DOMDocument* doc) {
 
     }
 
-    XSECnew(ret, DSIGSignature(doc, sigNode));
+    ret = takePooledSignature();
+
+    if (ret != NULL)
+        ret->reset(doc, sigNode);
+    else
+        XSECnew(ret, DSIGSignature(doc, sigNode));
 
     setup(ret);
 
@@ -102,9 +114,10 @@ DSIGSignature* XSECProvider::newSignatureFromDOM(DOMDocument* doc) {
 
 DSIGSignature* XSECProvider::newSignature() {
 
-    DSIGSignature* ret;
+    DSIGSignature* ret = takePooledSignature();
 
-    XSECnew(ret, DSIGSignature());
+    if (ret == NULL)
+        XSECnew(ret, DSIGSignature());
 
     setup(ret);
 
@@ -112,6 +125,24 @@ DSIGSignature* XSECProvider::newSignature() {
 }
 
 void XSECProvider::releaseSignature(DSIGSignature* toRelease) {
+
+    if (toRelease != NULL && getPoolSize() > 0) {
+
+        // Nothing that can find or trust a key survives into the pool
+        toRelease->reset();
+        if (toRelease->mp_KeyInfoResolver != NULL) {
+            delete toRelease->mp_KeyInfoResolver;
+            toRelease->mp_KeyInfoResolver = NULL;
+        }
+
+        XMLMutexLock lock(&m_poolMutex);
+        if (m_signaturePool.size() < m_poolSize) {
+            m_signaturePool.push_back(toRelease);
+            return;
+        }
+
+    }
+
     delete toRelease;
 }
 
@@ -121,9 +152,12 @@ void XSECProvider::releaseSignature(DSIGSignature* toRelease) {
 
 XENCCipher* XSECProvider::newCipher(DOMDocument* doc) {
 
-    XENCCipherImpl* ret;
+    XENCCipherImpl* ret = takePooledCipher();
 
-    XSECnew(ret, XENCCipherImpl(doc));
+    if (ret != NULL)
+        ret->reset(doc);
+    else
+        XSECnew(ret, XENCCipherImpl(doc));
 
     setup(ret);
 
@@ -131,6 +165,27 @@ XENCCipher* XSECProvider::newCipher(DOMDocument* doc) {
 }
 
 void XSECProvider::releaseCipher(XENCCipher* toRelease) {
+
+    if (toRelease != NULL && getPoolSize() > 0) {
+
+        // Ciphers are only ever created by the provider
+        XENCCipherImpl* impl = (XENCCipherImpl*) toRelease;
+
+        impl->reset(NULL);
+        impl->setKeyCache(NULL, NULL);
+        if (impl->mp_keyInfoResolver != NULL) {
+            delete impl->mp_keyInfoResolver;
+            impl->mp_keyInfoResolver = NULL;
+        }
+
+        XMLMutexLock lock(&m_poolMutex);
+        if (m_cipherPool.size() < m_poolSize) {
+            m_cipherPool.push_back(impl);
+            return;
+        }
+
+    }
+
     delete toRelease;
 }
 
@@ -157,6 +212,60 @@ void XSECProvider::setDefaultURIResolver(XSECURIResolver* resolver) {
     mp_URIResolver = resolver->clone();
 }
 
+// --------------------------------------------------------------------------------
+//           Object pooling
+// --------------------------------------------------------------------------------
+
+void XSECProvider::setPoolSize(unsigned int size) {
+
+    XMLMutexLock lock(&m_poolMutex);
+
+    m_poolSize = size;
+
+    while (m_signaturePool.size() > size) {
+        delete m_signaturePool.back();
+        m_signaturePool.pop_back();
+    }
+
+    while (m_cipherPool.size() > size) {
+        delete m_cipherPool.back();
+        m_cipherPool.pop_back();
+    }
+}
+
+unsigned int XSECProvider::getPoolSize(void) const {
+
+    XMLMutexLock lock(&m_poolMutex);
+
+    return m_poolSize;
+}
+
+DSIGSignature* XSECProvider::takePooledSignature() {
+
+    XMLMutexLock lock(&m_poolMutex);
+
+    if (m_poolSize == 0 || m_signaturePool.empty())
+        return NULL;
+
+    DSIGSignature* ret = m_signaturePool.back();
+    m_signaturePool.pop_back();
+
+    return ret;
+}
+
+XENCCipherImpl* XSECProvider::takePooledCipher() {
+
+    XMLMutexLock lock(&m_poolMutex);
+
+    if (m_poolSize == 0 || m_cipherPool.empty())
+        return NULL;
+
+    XENCCipherImpl* ret = m_cipherPool.back();
+    m_cipherPool.pop_back();
+
+    return ret;
+}
+
 // --------------------------------------------------------------------------------
 //           Internal functions
 // --------------------------------------------------------------------------------
@@ -34,8 +34,12 @@
 #include <xsec/xenc/XENCCipher.hpp>
 #include <xsec/xkms/XKMSMessageFactory.hpp>
 
+#include <xercesc/util/Mutexes.hpp>
+
 #include <vector>
 
+class XENCCipherImpl;
+
 /**
  * @addtogroup pubsig
  * @{
@@ -139,10 +143,10 @@ public:
      * it can be safely deleted once the signature operations have been completed without
      * impacting the underlying DOM structure.</p>
      *
+     * <p>If pooling is enabled (see setPoolSize) the object is reset and
+     * kept for re-use rather than deleted.</p>
+     *
      * @param toRelease The DSIGSignature object to be deleted.
-     * @todo The DSIGSignature objects are fairly bulky in terms of creation and deletion.
-     * There should be a capability to store "released" objects in a re-use stack.  At the
-     * moment the Provider class simply deletes the objects.
      * @see DSIGSignature#createBlankSignature
      */
 
@@ -176,6 +180,9 @@ public:
      * automatically be deleted when the provider goes out of scope (or is itself
      * deleted).
      *
+     * <p>If pooling is enabled (see setPoolSize) the object is reset and
+     * kept for re-use rather than deleted.</p>
+     *
      * @param toRelease The XENCCipher object to be deleted
      */
 
@@ -220,6 +227,43 @@ public:
 
     //@}
 
+    /** @name Object pooling */
+    //@{
+
+    /**
+     * \brief Keep released objects for re-use
+     *
+     * Creating a DSIGSignature or XENCCipher sets up an environment,
+     * formatter (and so a transcoder) and various buffers.  For small,
+     * frequent messages that can cost as much as the cryptography.
+     *
+     * With pooling enabled, releaseSignature and releaseCipher reset the
+     * object (see DSIGSignature::reset and XENCCipher::reset) and keep it,
+     * and the new... methods hand out a kept object in preference to
+     * creating one.  Up to size objects of each type are kept.  The pool
+     * is thread safe, so one provider can serve many threads.
+     *
+     * Keys, key caches and KeyInfo resolvers are always cleared when an
+     * object is returned to the pool, and the URI resolver is set back to
+     * the provider's default when it is handed out.  Other settings made
+     * on an object (namespace prefixes, Id attribute names, pretty
+     * printing) stay with it, so code sharing a pool should configure the
+     * objects it takes in the same way.
+     *
+     * @param size Maximum number of idle objects of each type to keep.
+     * 0 (the default) disables pooling, and frees any objects held.
+     */
+
+    void setPoolSize(unsigned int size);
+
+    /**
+     * \brief Get the maximum number of idle objects kept
+     */
+
+    unsigned int getPoolSize(void) const;
+
+    //@}
+
 private:
 
     // Copy constructor is disabled
@@ -230,6 +274,21 @@ private:
 
     void setup(DSIGSignature* sig);
     void setup(XENCCipher* cipher);
+    DSIGSignature* takePooledSignature();
+    XENCCipherImpl* takePooledCipher();
+
+#if defined(XSEC_NO_NAMESPACES)
+    typedef vector<DSIGSignature*> SignaturePoolType;
+    typedef vector<XENCCipherImpl*> CipherPoolType;
+#else
+    typedef std::vector<DSIGSignature*> SignaturePoolType;
+    typedef std::vector<XENCCipherImpl*> CipherPoolType;
+#endif
+
+    unsigned int m_poolSize;
+    SignaturePoolType m_signaturePool;
+    CipherPoolType m_cipherPool;
+    mutable XERCES_CPP_NAMESPACE_QUALIFIER XMLMutex m_poolMutex;
 
 #ifdef XSEC_XKMS_ENABLED
     XKMSMessageFactory* mp_xkmsMessageFactory;
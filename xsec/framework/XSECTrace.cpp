@@ -0,0 +1,345 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XSECTrace := Tracing of References, transforms and the other stages
+ *              of processing
+ *
+ * $Id$
+ *
+ */
+
+#include <xsec/framework/XSECTrace.hpp>
+#include <xsec/framework/XSECMetrics.hpp>
+#include <xsec/framework/XSECError.hpp>
+#include <xsec/utils/XSECSafeBuffer.hpp>
+
+#if defined(_WIN32)
+#	include <windows.h>
+#else
+#	include <pthread.h>
+#endif
+
+XERCES_CPP_NAMESPACE_USE
+
+// --------------------------------------------------------------------------------
+//           Thread local state
+// --------------------------------------------------------------------------------
+
+#if defined(_WIN32)
+
+static DWORD s_referenceKey = TLS_OUT_OF_INDEXES;
+
+static unsigned long currentThreadId(void) {
+
+	return (unsigned long) GetCurrentThreadId();
+
+}
+
+const XMLCh * XSECTrace::getReference(void) {
+
+	if (s_referenceKey == TLS_OUT_OF_INDEXES)
+		return NULL;
+
+	return (const XMLCh *) TlsGetValue(s_referenceKey);
+
+}
+
+void XSECTrace::setReference(const XMLCh * reference) {
+
+	if (s_referenceKey != TLS_OUT_OF_INDEXES)
+		TlsSetValue(s_referenceKey, (LPVOID) reference);
+
+}
+
+void XSECTrace::initialise(void) {
+
+	if (s_referenceKey == TLS_OUT_OF_INDEXES)
+		s_referenceKey = TlsAlloc();
+
+}
+
+void XSECTrace::terminate(void) {
+
+	if (s_referenceKey != TLS_OUT_OF_INDEXES) {
+		TlsFree(s_referenceKey);
+		s_referenceKey = TLS_OUT_OF_INDEXES;
+	}
+
+}
+
+#else
+
+static pthread_key_t s_referenceKey;
+static bool s_referenceKeyValid = false;
+
+static unsigned long currentThreadId(void) {
+
+	return (unsigned long) pthread_self();
+
+}
+
+const XMLCh * XSECTrace::getReference(void) {
+
+	if (!s_referenceKeyValid)
+		return NULL;
+
+	return (const XMLCh *) pthread_getspecific(s_referenceKey);
+
+}
+
+void XSECTrace::setReference(const XMLCh * reference) {
+
+	if (s_referenceKeyValid)
+		pthread_setspecific(s_referenceKey, (const void *) reference);
+
+}
+
+void XSECTrace::initialise(void) {
+
+	if (!s_referenceKeyValid)
+		s_referenceKeyValid = (pthread_key_create(&s_referenceKey, NULL) == 0);
+
+}
+
+void XSECTrace::terminate(void) {
+
+	if (s_referenceKeyValid) {
+		pthread_key_delete(s_referenceKey);
+		s_referenceKeyValid = false;
+	}
+
+}
+
+#endif
+
+// --------------------------------------------------------------------------------
+//           Events
+// --------------------------------------------------------------------------------
+
+void XSECTrace::event(const char * name, const XMLCh * detail, XMLUInt64 start) {
+
+	XSECTraceSink * sink = XSECPlatformUtils::g_traceSink;
+	if (sink != NULL)
+		sink->traceEvent(name, getReference(), detail, start, XSECMetricTimer::now() - start);
+
+}
+
+XSECTraceScope::XSECTraceScope(const char * name, const XMLCh * detail, bool isReference) :
+	mp_name(name),
+	mp_detail(detail),
+	mp_previousReference(NULL),
+	m_enabled(XSECTrace::isEnabled()),
+	m_isReference(isReference),
+	m_start(0) {
+
+	if (!m_enabled)
+		return;
+
+	if (m_isReference) {
+		mp_previousReference = XSECTrace::getReference();
+		XSECTrace::setReference(detail);
+	}
+
+	m_start = XSECMetricTimer::now();
+
+}
+
+XSECTraceScope::~XSECTraceScope() {
+
+	if (!m_enabled)
+		return;
+
+	XSECTrace::event(mp_name, mp_detail, m_start);
+
+	if (m_isReference)
+		XSECTrace::setReference(mp_previousReference);
+
+}
+
+// --------------------------------------------------------------------------------
+//           Chrome trace-event writer
+// --------------------------------------------------------------------------------
+
+// Append a string as a JSON string literal
+
+static void appendJSONString(safeBuffer & out, const char * str) {
+
+	out.sbStrcatIn("\"");
+
+	char esc[8];
+	for (const unsigned char * p = (const unsigned char *) str; *p != 0; ++p) {
+
+		switch (*p) {
+
+		case '"' :
+			out.sbStrcatIn("\\\"");
+			break;
+		case '\\' :
+			out.sbStrcatIn("\\\\");
+			break;
+		case '\n' :
+			out.sbStrcatIn("\\n");
+			break;
+		case '\r' :
+			out.sbStrcatIn("\\r");
+			break;
+		case '\t' :
+			out.sbStrcatIn("\\t");
+			break;
+		default :
+			if (*p < 0x20) {
+				sprintf(esc, "\\u%04x", (unsigned int) *p);
+				out.sbStrcatIn(esc);
+			}
+			else {
+				esc[0] = (char) *p;
+				esc[1] = '\0';
+				out.sbStrcatIn(esc);
+			}
+
+		}
+
+	}
+
+	out.sbStrcatIn("\"");
+
+}
+
+static void appendJSONString(safeBuffer & out, const XMLCh * str) {
+
+	safeBuffer utf8;
+	utf8.sbUTF8In(str);
+	appendJSONString(out, utf8.rawCharBuffer());
+
+}
+
+XSECTraceWriter::XSECTraceWriter(const char * fileName) :
+	mp_file(NULL),
+	m_origin(XSECMetricTimer::now()),
+	m_events(0) {
+
+	mp_file = fopen(fileName, "w");
+
+	if (mp_file == NULL) {
+		throw XSECException(XSECException::InternalError,
+			"XSECTraceWriter::XSECTraceWriter - Unable to open trace file");
+	}
+
+	fputs("[\n", mp_file);
+
+}
+
+XSECTraceWriter::~XSECTraceWriter() {
+
+	close();
+
+}
+
+void XSECTraceWriter::close(void) {
+
+	XMLMutexLock lock(&m_mutex);
+
+	if (mp_file != NULL) {
+		fputs("\n]\n", mp_file);
+		fclose(mp_file);
+		mp_file = NULL;
+	}
+
+}
+
+unsigned int XSECTraceWriter::getThreadNumber(void) {
+
+	// Viewers show tids as given, so map them to 1, 2, ...
+
+	unsigned long id = currentThreadId();
+
+	ThreadVectorType::size_type i;
+	for (i = 0; i < m_threads.size(); ++i) {
+		if (m_threads[i] == id)
+			return (unsigned int) i + 1;
+	}
+
+	m_threads.push_back(id);
+	return (unsigned int) i + 1;
+
+}
+
+void XSECTraceWriter::traceEvent(const char * name,
+								 const XMLCh * reference,
+								 const XMLCh * detail,
+								 XMLUInt64 start,
+								 XMLUInt64 duration) {
+
+	// Sinks must not throw - an event that cannot be written is dropped
+
+	try {
+
+		safeBuffer line;
+		char num[64];
+
+		line.sbStrcpyIn("{\"name\":");
+		appendJSONString(line, name);
+		line.sbStrcatIn(",\"cat\":\"xsec\",\"ph\":\"X\",\"ts\":");
+
+		XMLUInt64 ts = (start > m_origin ? start - m_origin : 0);
+		sprintf(num, "%llu.%03u,\"dur\":%llu.%03u,\"pid\":1,\"tid\":",
+			(unsigned long long) (ts / 1000), (unsigned int) (ts % 1000),
+			(unsigned long long) (duration / 1000), (unsigned int) (duration % 1000));
+		line.sbStrcatIn(num);
+
+		XMLMutexLock lock(&m_mutex);
+
+		if (mp_file == NULL)
+			return;
+
+		sprintf(num, "%u", getThreadNumber());
+		line.sbStrcatIn(num);
+
+		if (reference != NULL || detail != NULL) {
+
+			line.sbStrcatIn(",\"args\":{");
+			if (reference != NULL) {
+				line.sbStrcatIn("\"reference\":");
+				appendJSONString(line, reference);
+			}
+			if (detail != NULL) {
+				if (reference != NULL)
+					line.sbStrcatIn(",");
+				line.sbStrcatIn("\"detail\":");
+				appendJSONString(line, detail);
+			}
+			line.sbStrcatIn("}");
+
+		}
+
+		line.sbStrcatIn("}");
+
+		if (m_events > 0)
+			fputs(",\n", mp_file);
+		fputs(line.rawCharBuffer(), mp_file);
+		++m_events;
+
+	}
+	catch (...) {
+	}
+
+}
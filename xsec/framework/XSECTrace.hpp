@@ -0,0 +1,241 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XSECTrace := Tracing of References, transforms and the other stages
+ *              of processing
+ *
+ * $Id$
+ */
+
+#ifndef XSECTRACE_INCLUDE
+#define XSECTRACE_INCLUDE
+
+#include <xsec/framework/XSECDefs.hpp>
+#include <xsec/utils/XSECPlatformUtils.hpp>
+
+#include <xercesc/util/Mutexes.hpp>
+
+#include <stdio.h>
+#include <vector>
+
+/**
+ * @ingroup pubsig
+ */
+/*\@{*/
+
+/**
+ * @brief Receives trace events from the library
+ *
+ * Register an implementation with XSECPlatformUtils::SetTraceSink().
+ * An event is reported when each traced piece of work finishes, so
+ * events on a thread nest in the order they complete.  The events are:
+ *
+ *  - "reference" - calculating the digest of a Reference (detail is the URI)
+ *  - "transform" - adding a Reference transform to the chain, which is
+ *    where XPath and XSLT transforms do their work (detail is the
+ *    transform Algorithm)
+ *  - "hash" - reading the transform chain to its end and digesting it
+ *    (detail is the DigestMethod)
+ *  - "c14n" - the span over which a canonicaliser produced its output
+ *  - "c14n_partition" - one partition of a parallel canonicalisation
+ *  - The stages measured for XSECMetricsSink that are not already
+ *    covered above, such as "key_resolution" and "verify" (checking the
+ *    SignatureValue), named by XSECMetrics::getStageName() and with the
+ *    algorithm as detail
+ *
+ * traceEvent() is called from whichever thread did the work, so must be
+ * thread safe, and must not throw.
+ */
+
+class XSEC_EXPORT XSECTraceSink {
+
+public:
+
+	XSECTraceSink() {}
+	virtual ~XSECTraceSink() {}
+
+	/**
+	 * \brief Record an event
+	 *
+	 * @param name What was done (see above)
+	 * @param reference URI of the Reference being processed on this
+	 * thread, or NULL if there is none
+	 * @param detail Algorithm, URI etc. depending on the event, or NULL
+	 * @param start When the work started, in nanoseconds from a
+	 * monotonic clock
+	 * @param duration How long it took, in nanoseconds
+	 */
+
+	virtual void traceEvent(const char * name,
+							const XMLCh * reference,
+							const XMLCh * detail,
+							XMLUInt64 start,
+							XMLUInt64 duration) = 0;
+
+};
+
+/**
+ * @brief Write trace events to a file in Chrome trace-event format
+ *
+ * The file can be loaded into chrome://tracing or Perfetto.  Each event is
+ * written as a complete ("X") event with the Reference URI and detail as
+ * arguments.  The file is completed when the writer is closed or
+ * destroyed, which must be after it is removed from XSECPlatformUtils.
+ *
+ * \code
+ *	XSECTraceWriter trace("out.json");
+ *	XSECPlatformUtils::SetTraceSink(&trace);
+ *	sig->verify();
+ *	XSECPlatformUtils::SetTraceSink(NULL);
+ * \endcode
+ */
+
+class XSEC_EXPORT XSECTraceWriter : public XSECTraceSink {
+
+public:
+
+	/**
+	 * \brief Open the output file
+	 *
+	 * Throws an XSECException if the file cannot be created.
+	 */
+
+	XSECTraceWriter(const char * fileName);
+
+	virtual ~XSECTraceWriter();
+
+	virtual void traceEvent(const char * name,
+							const XMLCh * reference,
+							const XMLCh * detail,
+							XMLUInt64 start,
+							XMLUInt64 duration);
+
+	/**
+	 * \brief Finish and close the file
+	 *
+	 * Further events are ignored.
+	 */
+
+	void close(void);
+
+	/**
+	 * \brief Number of events written
+	 */
+
+	XMLSize_t getEventCount(void) const {return m_events;}
+
+private:
+
+	typedef std::vector<unsigned long> ThreadVectorType;
+
+	unsigned int getThreadNumber(void);
+
+	XERCES_CPP_NAMESPACE_QUALIFIER XMLMutex
+						m_mutex;
+	FILE				* mp_file;
+	XMLUInt64			m_origin;		// Time the writer was opened
+	XMLSize_t			m_events;
+	ThreadVectorType	m_threads;		// Maps threads to small numbers
+
+	// Unimplemented
+	XSECTraceWriter(const XSECTraceWriter &);
+	XSECTraceWriter & operator = (const XSECTraceWriter &);
+
+};
+
+/*\@}*/
+
+/**
+ * @ingroup internal
+ */
+/*\@{*/
+
+/**
+ * @brief Per-thread trace state
+ */
+
+class XSEC_EXPORT XSECTrace {
+
+public:
+
+	static bool isEnabled(void) {return XSECPlatformUtils::g_traceSink != NULL;}
+
+	/**
+	 * \brief The Reference being processed on this thread (or NULL)
+	 */
+
+	static const XMLCh * getReference(void);
+	static void setReference(const XMLCh * reference);
+
+	/**
+	 * \brief Report a finished event to the registered sink (if any)
+	 */
+
+	static void event(const char * name, const XMLCh * detail, XMLUInt64 start);
+
+	/**
+	 * \brief Set up the thread local state (called by XSECPlatformUtils)
+	 */
+
+	static void initialise(void);
+
+	/**
+	 * \brief Free the thread local state (called by XSECPlatformUtils)
+	 */
+
+	static void terminate(void);
+
+};
+
+/**
+ * @brief Traces a scope
+ *
+ * Does nothing (and does not read the clock) if no sink is registered.
+ * A scope created with isReference set makes detail the current
+ * Reference for everything traced inside it on this thread.
+ */
+
+class XSEC_EXPORT XSECTraceScope {
+
+public:
+
+	XSECTraceScope(const char * name, const XMLCh * detail = NULL, bool isReference = false);
+	~XSECTraceScope();
+
+private:
+
+	const char				* mp_name;
+	const XMLCh				* mp_detail;
+	const XMLCh				* mp_previousReference;
+	bool					m_enabled;
+	bool					m_isReference;
+	XMLUInt64				m_start;
+
+	// Unimplemented
+	XSECTraceScope(const XSECTraceScope &);
+	XSECTraceScope & operator = (const XSECTraceScope &);
+
+};
+
+/*\@}*/
+
+#endif /* XSECTRACE_INCLUDE */
@@ -82,6 +82,9 @@
 #	if (OPENSSL_VERSION_NUMBER >= 0x10001000)
 #		define XSEC_OPENSSL_HAVE_GCM
 #	endif
+#	if (OPENSSL_VERSION_NUMBER >= 0x10100000L)
+#		define XSEC_OPENSSL_HAVE_AES_WRAP
+#	endif
 
 #endif
 
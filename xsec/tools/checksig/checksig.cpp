@@ -28,6 +28,7 @@
 
 #include "AnonymousResolver.hpp"
 #include "InteropResolver.hpp"
+#include "../common/BatchUtils.hpp"
 
 // XSEC
 
@@ -38,15 +39,33 @@
 #include <xsec/framework/XSECException.hpp>
 #include <xsec/enc/XSECCryptoException.hpp>
 #include <xsec/enc/XSECKeyInfoResolverDefault.hpp>
+#include <xsec/framework/XSECTrace.hpp>
+#include <xsec/framework/XSECMetrics.hpp>
+#include <xsec/enc/XSECCryptoKeyHMAC.hpp>
 
 #include "../../utils/XSECDOMUtils.hpp"
+#include "../../utils/XSECThreadPool.hpp"
 
 // General
 
 #include <memory.h>
 #include <string.h>
 #include <iostream>
+#include <fstream>
 #include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+# include <windows.h>
+#else
+# include <dirent.h>
+#endif
 
 #if defined(HAVE_UNISTD_H)
 # include <unistd.h>
@@ -69,6 +88,7 @@
 #include <xercesc/util/XMLException.hpp>
 #include <xercesc/util/XMLUri.hpp>
 #include <xercesc/util/Janitor.hpp>
+#include <xercesc/util/Mutexes.hpp>
 
 XERCES_CPP_NAMESPACE_USE
 
@@ -128,10 +148,14 @@ std::ostream& operator<< (std::ostream& target, const XMLCh * s)
 //           Checksig
 // ----------------------------------------------------------------------------
 
+// Set by --trace, and closed once verification is complete
+XSECTraceWriter * traceWriter = NULL;
+
 
 void printUsage(void) {
 
-	cerr << "\nUsage: checksig [options] <input file name>\n\n";
+	cerr << "\nUsage: checksig [options] <input file name>\n";
+	cerr << "       checksig --batch [options] <directory|list file>\n\n";
 	cerr << "     Where options are :\n\n";
 	cerr << "     --skiprefs/-s\n";
 	cerr << "         Skip checking references - check signature only\n\n";
@@ -143,6 +167,19 @@ void printUsage(void) {
 	cerr << "         Define an attribute Id by name\n\n";
 	cerr << "     --idns/-d <ns uri> <name>\n";
 	cerr << "         Define an attribute Id by namespace URI and name\n\n";
+	cerr << "     --batch/-b\n";
+	cerr << "         Check every file below a directory, or each file named\n";
+	cerr << "         (one per line) in a list file, and write the results and\n";
+	cerr << "         throughput and latency totals to stdout as JSON\n\n";
+	cerr << "     --threads/-t <n>\n";
+	cerr << "         Number of files to check at once in batch mode\n";
+	cerr << "         (default is one per processor)\n\n";
+	cerr << "     --keycache/-k\n";
+	cerr << "         In batch mode, create the --hmackey key once and re-use\n";
+	cerr << "         keys read from identical KeyInfo elements\n\n";
+	cerr << "     --trace <file>\n";
+	cerr << "         Write a trace of the processing to <file> in Chrome\n";
+	cerr << "         trace-event (JSON) format\n\n";
 #if defined (XSEC_HAVE_OPENSSL)
 	cerr << "     --interop/-i\n";
 	cerr << "         Use the interop resolver for Baltimore interop examples\n\n";
@@ -160,6 +197,532 @@ void printUsage(void) {
 	cerr << "         0 = Signature OK\n";
 	cerr << "         1 = Signature Bad\n";
 	cerr << "         2 = Processing error\n";
+	cerr << "     In batch mode, the worst result of any file\n";
+
+}
+
+// Work out a file: base URI for the directory holding filename.  The
+// result is released with XSEC_RELEASE_XMLCH.
+
+XMLCh * makeBaseURI(const char * filename) {
+
+#if XSEC_HAVE_GETCWD_DYN
+	char *path = getcwd(NULL, 0);
+	char *baseURI = (char*)malloc(strlen(path) + 8 + 1 + strlen(filename) + 1);
+#else
+	char path[PATH_MAX];
+	char baseURI[(PATH_MAX * 2) + 10];
+	getcwd(path, PATH_MAX);
+#endif
+	strcpy(baseURI, "file:///");		
+
+	// Ugly and nasty but quick
+	if (filename[0] != '\\' && filename[0] != '/' && filename[1] != ':') {
+		strcat(baseURI, path);
+		strcat(baseURI, "/");
+	} else if (path[1] == ':') {
+		path[2] = '\0';
+		strcat(baseURI, path);
+	}
+
+	strcat(baseURI, filename);
+
+	// Find any ':' and "\" characters
+	int lastSlash = 0;
+	for (unsigned int i = 8; i < strlen(baseURI); ++i) {
+		if (baseURI[i] == '\\') {
+			lastSlash = i;
+			baseURI[i] = '/';
+		}
+		else if (baseURI[i] == '/')
+			lastSlash = i;
+	}
+
+	// The last "\\" must prefix the filename
+	baseURI[lastSlash + 1] = '\0';
+	XMLCh * baseURIXMLCh = XMLString::transcode(baseURI);
+
+#if XSEC_HAVE_GETCWD_DYN
+	free(path);
+	free(baseURI);
+#endif
+
+	return baseURIXMLCh;
+
+}
+
+// ----------------------------------------------------------------------------
+//           Batch mode
+// ----------------------------------------------------------------------------
+
+// Options that apply to every file in a batch
+
+struct BatchOptions {
+
+	const char				* hmacKeyStr;
+	const char				* idAttributeNS;
+	const char				* idAttributeName;
+	bool					skipRefs;
+	bool					useXSECURIResolver;
+	bool					useAnonymousResolver;
+	bool					keyCache;
+
+};
+
+// Keys resolved from KeyInfo, shared by all the workers.  A key is found
+// again by the canonical form of the KeyInfo it came from, which saves
+// parsing the same certificate (say) for every document from one signer.
+
+class KeyCache {
+
+public:
+
+	KeyCache() : m_hits(0), m_misses(0) {}
+
+	~KeyCache() {
+		for (KeyMapType::iterator i = m_keys.begin(); i != m_keys.end(); ++i)
+			delete i->second;
+	}
+
+	// Returns a copy of the cached key, or NULL
+	XSECCryptoKey * get(const std::string & id) {
+
+		XMLMutexLock lock(&m_mutex);
+
+		KeyMapType::iterator i = m_keys.find(id);
+		if (i == m_keys.end()) {
+			++m_misses;
+			return NULL;
+		}
+
+		++m_hits;
+		return i->second->clone();
+
+	}
+
+	// Takes ownership of key
+	void put(const std::string & id, XSECCryptoKey * key) {
+
+		XMLMutexLock lock(&m_mutex);
+
+		if (m_keys.find(id) == m_keys.end())
+			m_keys[id] = key;
+		else
+			delete key;
+
+	}
+
+	XMLSize_t getHits(void) const {return m_hits;}
+	XMLSize_t getMisses(void) const {return m_misses;}
+
+private:
+
+	typedef std::map<std::string, XSECCryptoKey *> KeyMapType;
+
+	XMLMutex				m_mutex;
+	KeyMapType				m_keys;
+	XMLSize_t				m_hits;
+	XMLSize_t				m_misses;
+
+};
+
+class CachingKeyInfoResolver : public XSECKeyInfoResolver {
+
+public:
+
+	CachingKeyInfoResolver(KeyCache * cache) : mp_cache(cache) {}
+	virtual ~CachingKeyInfoResolver() {}
+
+	virtual XSECCryptoKey * resolveKey(const DSIGKeyInfoList * lst) const {
+
+		// Identify the KeyInfo by the canonical form of its children, so
+		// attributes (NamedCurve@URI, RetrievalMethod@URI ...) count too
+
+		std::string id;
+		unsigned char buf[1024];
+		XMLSize_t len;
+
+		for (DSIGKeyInfoList::size_type i = 0; lst != NULL && i < lst->getSize(); ++i) {
+
+			DOMNode * n = lst->item(i)->getKeyInfoDOMNode();
+			if (n == NULL)
+				return m_resolver.resolveKey(lst);
+
+			XSECC14n20010315 c14n(n->getOwnerDocument(), n);
+			c14n.setCommentsProcessing(false);
+
+			while ((len = c14n.outputBuffer(buf, 1024)) > 0)
+				id.append((const char *) buf, len);
+
+		}
+
+		if (id.empty())
+			return m_resolver.resolveKey(lst);
+
+		XSECCryptoKey * key = mp_cache->get(id);
+		if (key != NULL)
+			return key;
+
+		key = m_resolver.resolveKey(lst);
+		if (key != NULL)
+			mp_cache->put(id, key->clone());
+
+		return key;
+
+	}
+
+	virtual XSECKeyInfoResolver * clone(void) const {
+		return new CachingKeyInfoResolver(mp_cache);
+	}
+
+private:
+
+	KeyCache				* mp_cache;
+	XSECKeyInfoResolverDefault
+							m_resolver;
+
+};
+
+// A worker keeps its own parser, provider and resolvers for every file it
+// checks
+
+class BatchWorker : public XSECThreadTask {
+
+public:
+
+	BatchWorker(BatchQueue & queue, const BatchOptions & options,
+				KeyCache * cache, const XSECCryptoKey * hmacKey) :
+		m_queue(queue),
+		m_options(options),
+		mp_hmacKey(hmacKey),
+		m_cachingResolver(cache),
+		mp_keyInfoResolver(NULL) {
+
+		if (cache != NULL)
+			mp_keyInfoResolver = &m_cachingResolver;
+		else
+			mp_keyInfoResolver = &m_defaultResolver;
+
+		m_parser.setDoNamespaces(true);
+		m_parser.setCreateEntityReferenceNodes(true);
+
+	}
+
+	virtual void run(void) {
+
+		XMLSize_t index;
+		while (m_queue.next(index)) {
+
+			BatchResult & r = m_queue.getResult(index);
+			const char * filename = m_queue.getFile(index);
+
+			XMLUInt64 start = XSECMetricTimer::now();
+
+			struct stat st;
+			r.bytes = (stat(filename, &st) == 0 ? (XMLUInt64) st.st_size : 0);
+
+			try {
+				r.result = check(filename, r.message);
+			}
+			catch (...) {
+				r.result = 2;
+				r.message = "Unknown error";
+			}
+
+			// Documents are not needed once checked
+			m_parser.resetDocumentPool();
+
+			r.nanoseconds = XSECMetricTimer::now() - start;
+
+		}
+
+	}
+
+private:
+
+	int check(const char * filename, std::string & message);
+
+	BatchQueue				& m_queue;
+	const BatchOptions		& m_options;
+	const XSECCryptoKey		* mp_hmacKey;	// Shared --hmackey key (if cached)
+	XercesDOMParser			m_parser;
+	XSECProvider			m_prov;
+	XSECKeyInfoResolverDefault
+							m_defaultResolver;
+	CachingKeyInfoResolver	m_cachingResolver;
+	XSECKeyInfoResolver		* mp_keyInfoResolver;
+	AnonymousResolver		m_anonymousResolver;
+
+};
+
+int BatchWorker::check(const char * filename, std::string & message) {
+
+	try {
+		m_parser.parse(filename);
+	}
+	catch (const XMLException & e) {
+		setMessage(message, e.getMessage());
+		return 2;
+	}
+	catch (const DOMException &) {
+		message = "A DOM error occurred during parsing";
+		return 2;
+	}
+
+	if (m_parser.getErrorCount() > 0) {
+		message = "Errors during parse";
+		return 2;
+	}
+
+	DOMDocument * theDOM = m_parser.getDocument();
+	DOMNode * sigNode = findDSIGNode(theDOM, "Signature");
+
+	if (sigNode == NULL) {
+		message = "Could not find <Signature> node";
+		return 2;
+	}
+
+	DSIGSignature * sig = m_prov.newSignatureFromDOM(theDOM, sigNode);
+
+	int ret;
+
+	try {
+
+		sig->setKeyInfoResolver(mp_keyInfoResolver);
+
+		if (m_options.idAttributeName != NULL) {
+			sig->setIdByAttributeName(true);
+			if (m_options.idAttributeNS != NULL) {
+				sig->registerIdAttributeNameNS(MAKE_UNICODE_STRING(m_options.idAttributeNS),
+											   MAKE_UNICODE_STRING(m_options.idAttributeName));
+			} else {
+				sig->registerIdAttributeName(MAKE_UNICODE_STRING(m_options.idAttributeName));
+			}
+		}
+
+		if (m_options.useXSECURIResolver || m_options.useAnonymousResolver) {
+
+			XMLCh * baseURIXMLCh = makeBaseURI(filename);
+
+			if (m_options.useAnonymousResolver)
+				sig->setURIResolver(&m_anonymousResolver);
+			sig->getURIResolver()->setBaseURI(baseURIXMLCh);
+
+			XSEC_RELEASE_XMLCH(baseURIXMLCh);
+
+		}
+
+		if (mp_hmacKey != NULL) {
+			sig->setSigningKey(mp_hmacKey->clone());
+		}
+		else if (m_options.hmacKeyStr != NULL) {
+			XSECCryptoKeyHMAC * hmacKey = XSECPlatformUtils::g_cryptoProvider->keyHMAC();
+			hmacKey->setKey((unsigned char *) m_options.hmacKeyStr,
+				(unsigned int) strlen(m_options.hmacKeyStr));
+			sig->setSigningKey(hmacKey);
+		}
+
+		sig->load();
+
+		bool result;
+		if (m_options.skipRefs)
+			result = sig->verifySignatureOnly();
+		else
+			result = sig->verify();
+
+		if (result) {
+			ret = 0;
+		}
+		else {
+			setMessage(message, sig->getErrMsgs());
+			ret = 1;
+		}
+
+	}
+	catch (const XSECException & e) {
+		setMessage(message, e.getMsg());
+		ret = 2;
+	}
+	catch (const XSECCryptoException & e) {
+		message = e.getMsg();
+		ret = 2;
+	}
+	catch (...) {
+		m_prov.releaseSignature(sig);
+		throw;
+	}
+
+	m_prov.releaseSignature(sig);
+	return ret;
+
+}
+
+// Gather the files to check - everything below a directory, or each line
+// of a list file
+
+#if defined(_WIN32)
+
+static void addDirectory(const std::string & dir, std::vector<std::string> & files) {
+
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &fd);
+
+	if (h == INVALID_HANDLE_VALUE)
+		return;
+
+	do {
+
+		if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0)
+			continue;
+
+		std::string path = dir + "\\" + fd.cFileName;
+		if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			addDirectory(path, files);
+		else
+			files.push_back(path);
+
+	} while (FindNextFileA(h, &fd));
+
+	FindClose(h);
+
+}
+
+#else
+
+static void addDirectory(const std::string & dir, std::vector<std::string> & files) {
+
+	DIR * d = opendir(dir.c_str());
+
+	if (d == NULL)
+		return;
+
+	struct dirent * e;
+	while ((e = readdir(d)) != NULL) {
+
+		if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+			continue;
+
+		std::string path = dir + "/" + e->d_name;
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0)
+			continue;
+
+		if (S_ISDIR(st.st_mode))
+			addDirectory(path, files);
+		else if (S_ISREG(st.st_mode))
+			files.push_back(path);
+
+	}
+
+	closedir(d);
+
+}
+
+#endif
+
+// Check every file, then write the results and totals to stdout as JSON
+
+int runBatch(const char * source, const BatchOptions & options, unsigned int threads) {
+
+	std::vector<std::string> files;
+
+	if (isDirectory(source)) {
+		addDirectory(source, files);
+		std::sort(files.begin(), files.end());
+	}
+	else if (!readFileList(source, files)) {
+		cerr << "Unable to read " << source << endl;
+		return 2;
+	}
+
+	KeyCache cache;
+	XSECCryptoKey * hmacKey = NULL;
+
+	if (options.keyCache && options.hmacKeyStr != NULL) {
+		XSECCryptoKeyHMAC * k = XSECPlatformUtils::g_cryptoProvider->keyHMAC();
+		k->setKey((unsigned char *) options.hmacKeyStr, (unsigned int) strlen(options.hmacKeyStr));
+		hmacKey = k;
+	}
+	Janitor<XSECCryptoKey> j_hmacKey(hmacKey);
+
+	BatchQueue queue(files);
+	XSECThreadPool pool(threads);
+
+	// No point in more workers than files
+	unsigned int workerCount = pool.getThreadCount();
+	if (workerCount > files.size())
+		workerCount = (unsigned int) files.size();
+
+	std::vector<BatchWorker *> workers;
+	for (unsigned int i = 0; i < workerCount; ++i) {
+		workers.push_back(new BatchWorker(queue, options,
+			options.keyCache ? &cache : NULL, hmacKey));
+		pool.addTask(workers.back());
+	}
+
+	XMLUInt64 start = XSECMetricTimer::now();
+	pool.runAll();
+	XMLUInt64 elapsed = XSECMetricTimer::now() - start;
+
+	for (unsigned int i = 0; i < workerCount; ++i)
+		delete workers[i];
+
+	// Per file results
+
+	XMLSize_t counts[3] = {0, 0, 0};
+	XMLUInt64 bytes = 0;
+	std::vector<XMLUInt64> latencies;
+	static const char * resultNames[3] = {"ok", "failed", "error"};
+
+	cout << "{\n  \"files\": [";
+
+	for (XMLSize_t i = 0; i < files.size(); ++i) {
+
+		const BatchResult & r = queue.getResult(i);
+
+		counts[r.result]++;
+		bytes += r.bytes;
+		latencies.push_back(r.nanoseconds);
+
+		cout << (i == 0 ? "\n" : ",\n") << "    {\"file\": ";
+		printJSONString(files[i]);
+		cout << ", \"result\": \"" << resultNames[r.result] << "\", \"ms\": "
+			 << toMilliseconds(r.nanoseconds);
+		if (!r.message.empty()) {
+			cout << ", \"message\": ";
+			printJSONString(r.message);
+		}
+		cout << "}";
+
+	}
+
+	// Totals
+
+	XMLSize_t n = latencies.size();
+	double seconds = (double) elapsed / 1000000000.0;
+
+	cout << "\n  ],\n  \"summary\": {\n";
+	cout << "    \"files\": " << n << ",\n";
+	cout << "    \"ok\": " << counts[0] << ",\n";
+	cout << "    \"failed\": " << counts[1] << ",\n";
+	cout << "    \"errors\": " << counts[2] << ",\n";
+	cout << "    \"threads\": " << workerCount << ",\n";
+	cout << "    \"seconds\": " << seconds << ",\n";
+	cout << "    \"files_per_second\": " << (seconds > 0 ? n / seconds : 0.0) << ",\n";
+	cout << "    \"bytes\": " << (unsigned long long) bytes << ",\n";
+	cout << "    \"bytes_per_second\": " << (seconds > 0 ? bytes / seconds : 0.0) << ",\n";
+	cout << "    ";
+	printLatencies(latencies);
+	if (options.keyCache) {
+		cout << ",\n    \"key_cache\": {\"hits\": " << cache.getHits()
+			 << ", \"misses\": " << cache.getMisses() << "}";
+	}
+	cout << "\n  }\n}" << endl;
+
+	if (counts[2] > 0)
+		return 2;
+
+	return (counts[1] > 0 ? 1 : 0);
 
 }
 
@@ -178,6 +741,9 @@ int evaluate(int argc, char ** argv) {
 #endif
 
 	bool skipRefs = false;
+	bool batch = false;
+	bool keyCache = false;
+	unsigned int threads = 0;
 
 	if (argc < 2) {
 
@@ -198,6 +764,22 @@ int evaluate(int argc, char ** argv) {
 			skipRefs = true;
 			paramCount++;
 		}
+		else if (_stricmp(argv[paramCount], "--batch") == 0 || _stricmp(argv[paramCount], "-b") == 0) {
+			batch = true;
+			paramCount++;
+		}
+		else if (_stricmp(argv[paramCount], "--threads") == 0 || _stricmp(argv[paramCount], "-t") == 0) {
+			if (paramCount +1 >= argc || atoi(argv[paramCount + 1]) < 0) {
+				printUsage();
+				return 2;
+			}
+			paramCount++;
+			threads = (unsigned int) atoi(argv[paramCount++]);
+		}
+		else if (_stricmp(argv[paramCount], "--keycache") == 0 || _stricmp(argv[paramCount], "-k") == 0) {
+			keyCache = true;
+			paramCount++;
+		}
 		else if (_stricmp(argv[paramCount], "--xsecresolver") == 0 || _stricmp(argv[paramCount], "-x") == 0) {
 			useXSECURIResolver = true;
 			paramCount++;
@@ -219,6 +801,22 @@ int evaluate(int argc, char ** argv) {
 			useIdAttributeNS = argv[paramCount++];
 			useIdAttributeName = argv[paramCount++];
 		}
+		else if (_stricmp(argv[paramCount], "--trace") == 0) {
+			if (paramCount +1 >= argc || traceWriter != NULL) {
+				printUsage();
+				return 2;
+			}
+			paramCount++;
+			try {
+				traceWriter = new XSECTraceWriter(argv[paramCount]);
+			}
+			catch (const XSECException &) {
+				cerr << "Unable to open trace file " << argv[paramCount] << endl;
+				return 2;
+			}
+			XSECPlatformUtils::SetTraceSink(traceWriter);
+			paramCount++;
+		}
 #if defined (XSEC_HAVE_OPENSSL)
 		else if (_stricmp(argv[paramCount], "--interop") == 0 || _stricmp(argv[paramCount], "-i") == 0) {
 			// Use the interop key resolver
@@ -327,6 +925,35 @@ int evaluate(int argc, char ** argv) {
 
 	filename = argv[paramCount];
 
+	if (batch) {
+
+		// Keys are made per document, and the interop resolver is only
+		// for single files
+		if (key != NULL || useInteropResolver) {
+			cerr << "--batch cannot be used with --interop or a Windows key" << endl;
+			return 2;
+		}
+
+		BatchOptions options;
+		options.hmacKeyStr = hmacKeyStr;
+		options.idAttributeNS = useIdAttributeNS;
+		options.idAttributeName = useIdAttributeName;
+		options.skipRefs = skipRefs;
+		options.useXSECURIResolver = useXSECURIResolver;
+		options.useAnonymousResolver = useAnonymousResolver;
+		options.keyCache = keyCache;
+
+		int ret = runBatch(filename, options, threads);
+
+#if defined (XSEC_HAVE_WINCAPI)
+		if (win32CSP != 0)
+			CryptReleaseContext(win32CSP, 0);
+#endif
+
+		return ret;
+
+	}
+
 	// Create and set up the parser
 
 	XercesDOMParser * parser = new XercesDOMParser;
@@ -421,49 +1048,7 @@ int evaluate(int argc, char ** argv) {
 		useInteropResolver == true) {
 
 		AnonymousResolver theAnonymousResolver;
-		     
-		// Map out base path of the file
-#if XSEC_HAVE_GETCWD_DYN
-		char *path = getcwd(NULL, 0);
-		char *baseURI = (char*)malloc(strlen(path) + 8 + 1 + strlen(filename) + 1);
-#else
-		char path[PATH_MAX];
-		char baseURI[(PATH_MAX * 2) + 10];
-		getcwd(path, PATH_MAX);
-#endif
-		strcpy(baseURI, "file:///");		
-
-		// Ugly and nasty but quick
-		if (filename[0] != '\\' && filename[0] != '/' && filename[1] != ':') {
-			strcat(baseURI, path);
-			strcat(baseURI, "/");
-		} else if (path[1] == ':') {
-			path[2] = '\0';
-			strcat(baseURI, path);
-		}
-
-		strcat(baseURI, filename);
-
-		// Find any ':' and "\" characters
-		int lastSlash = 0;
-		for (unsigned int i = 8; i < strlen(baseURI); ++i) {
-			if (baseURI[i] == '\\') {
-				lastSlash = i;
-				baseURI[i] = '/';
-			}
-			else if (baseURI[i] == '/')
-				lastSlash = i;
-		}
-
-		// The last "\\" must prefix the filename
-		baseURI[lastSlash + 1] = '\0';
-		XMLCh * baseURIXMLCh = XMLString::transcode(baseURI);
-
-		XMLUri uri(MAKE_UNICODE_STRING(baseURI));
-#if XSEC_HAVE_GETCWD_DYN
-		free(path);
-		free(baseURI);
-#endif
+		XMLCh * baseURIXMLCh = makeBaseURI(filename);
 
 		if (useAnonymousResolver == true) {
 			sig->setURIResolver(&theAnonymousResolver);
@@ -603,6 +1188,11 @@ int main(int argc, char **argv) {
 
 	retResult = evaluate(argc, argv);
 
+	if (traceWriter != NULL) {
+		XSECPlatformUtils::SetTraceSink(NULL);
+		delete traceWriter;
+	}
+
 	XSECPlatformUtils::Terminate();
 #ifdef XSEC_HAVE_XALAN
 	XalanTransformer::terminate();
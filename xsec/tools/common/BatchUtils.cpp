@@ -0,0 +1,173 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * BatchUtils := Helpers shared by the batch modes of the command line tools
+ *
+ * $Id$
+ *
+ */
+
+#include "BatchUtils.hpp"
+
+#include <xercesc/util/XMLString.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+# include <windows.h>
+#endif
+
+XERCES_CPP_NAMESPACE_USE
+
+using std::cout;
+
+// ----------------------------------------------------------------------------
+//           BatchQueue
+// ----------------------------------------------------------------------------
+
+bool BatchQueue::next(XMLSize_t & index) {
+
+	XMLMutexLock lock(&m_mutex);
+
+	if (m_next >= m_files.size())
+		return false;
+
+	index = m_next++;
+	return true;
+
+}
+
+// ----------------------------------------------------------------------------
+//           Helpers
+// ----------------------------------------------------------------------------
+
+void setMessage(std::string & message, const XMLCh * msg) {
+
+	char * m = XMLString::transcode(msg);
+	message = m;
+	XSEC_RELEASE_XMLCH(m);
+
+}
+
+#if defined(_WIN32)
+
+bool isDirectory(const char * path) {
+
+	DWORD attrs = GetFileAttributesA(path);
+	return (attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY) != 0);
+
+}
+
+#else
+
+bool isDirectory(const char * path) {
+
+	struct stat st;
+	return (stat(path, &st) == 0 && S_ISDIR(st.st_mode));
+
+}
+
+#endif
+
+bool readFileList(const char * listName, std::vector<std::string> & files) {
+
+	std::ifstream in(listName);
+	if (!in)
+		return false;
+
+	std::string line;
+	while (std::getline(in, line)) {
+
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		if (!line.empty())
+			files.push_back(line);
+
+	}
+
+	return true;
+
+}
+
+void printJSONString(const std::string & str) {
+
+	cout << '"';
+
+	char esc[8];
+	for (std::string::size_type i = 0; i < str.size(); ++i) {
+
+		unsigned char c = (unsigned char) str[i];
+
+		if (c == '"' || c == '\\')
+			cout << '\\' << (char) c;
+		else if (c == '\n')
+			cout << "\\n";
+		else if (c < 0x20) {
+			sprintf(esc, "\\u%04x", (unsigned int) c);
+			cout << esc;
+		}
+		else
+			cout << (char) c;
+
+	}
+
+	cout << '"';
+
+}
+
+double toMilliseconds(XMLUInt64 nanoseconds) {
+
+	return (double) nanoseconds / 1000000.0;
+
+}
+
+// Latency at percentile p of the sorted latencies
+
+static double percentile(const std::vector<XMLUInt64> & latencies, XMLSize_t p) {
+
+	XMLSize_t n = latencies.size();
+	return (n == 0 ? 0.0 : toMilliseconds(latencies[((n - 1) * p) / 100]));
+
+}
+
+void printLatencies(std::vector<XMLUInt64> & latencies) {
+
+	std::sort(latencies.begin(), latencies.end());
+
+	XMLUInt64 total = 0;
+	for (std::vector<XMLUInt64>::size_type i = 0; i < latencies.size(); ++i)
+		total += latencies[i];
+
+	XMLSize_t n = latencies.size();
+
+	cout << "\"latency_ms\": {\"min\": " << percentile(latencies, 0)
+		 << ", \"mean\": " << (n == 0 ? 0.0 : toMilliseconds(total / n))
+		 << ", \"p50\": " << percentile(latencies, 50)
+		 << ", \"p90\": " << percentile(latencies, 90)
+		 << ", \"p99\": " << percentile(latencies, 99)
+		 << ", \"max\": " << percentile(latencies, 100) << "}";
+
+}
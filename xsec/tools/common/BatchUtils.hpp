@@ -0,0 +1,106 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * BatchUtils := Helpers shared by the batch modes of the command line tools
+ *
+ * $Id$
+ *
+ */
+
+#ifndef BATCHUTILS_INCLUDE
+#define BATCHUTILS_INCLUDE
+
+// XSEC
+
+#include <xsec/framework/XSECDefs.hpp>
+
+#include <xercesc/util/Mutexes.hpp>
+
+#include <string>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+//           Results and work queue
+// ----------------------------------------------------------------------------
+
+// Outcome of one file
+
+struct BatchResult {
+
+	int						result;			// 0 on success, otherwise as for the exit code
+	std::string				message;
+	XMLUInt64				nanoseconds;
+	XMLUInt64				bytes;
+
+};
+
+// Hands out the files to the workers, and holds a result for each
+
+class BatchQueue {
+
+public:
+
+	BatchQueue(const std::vector<std::string> & files) :
+		m_files(files),
+		m_results(files.size()),
+		m_next(0) {}
+
+	// Returns false when there is nothing left
+	bool next(XMLSize_t & index);
+
+	const char * getFile(XMLSize_t index) const {return m_files[index].c_str();}
+	BatchResult & getResult(XMLSize_t index) {return m_results[index];}
+
+private:
+
+	XERCES_CPP_NAMESPACE_QUALIFIER XMLMutex
+							m_mutex;
+	const std::vector<std::string> &
+							m_files;
+	std::vector<BatchResult>
+							m_results;
+	XMLSize_t				m_next;
+
+};
+
+// ----------------------------------------------------------------------------
+//           Helpers
+// ----------------------------------------------------------------------------
+
+// Transcode an exception message
+void setMessage(std::string & message, const XMLCh * msg);
+
+bool isDirectory(const char * path);
+
+// Read one file name per line
+bool readFileList(const char * listName, std::vector<std::string> & files);
+
+// Write a string to stdout as a quoted JSON string
+void printJSONString(const std::string & str);
+
+double toMilliseconds(XMLUInt64 nanoseconds);
+
+// Write the "latency_ms" summary member (min, mean, percentiles, max) to
+// stdout.  Sorts the latencies.
+void printLatencies(std::vector<XMLUInt64> & latencies);
+
+#endif /* BATCHUTILS_INCLUDE */
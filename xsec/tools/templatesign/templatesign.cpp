@@ -39,6 +39,7 @@
 #include <xsec/framework/XSECException.hpp>
 #include <xsec/framework/XSECURIResolver.hpp>
 #include <xsec/enc/XSECCryptoException.hpp>
+#include <xsec/framework/XSECMetrics.hpp>
 
 #if defined (XSEC_HAVE_OPENSSL)
 #   include <xsec/enc/OpenSSL/OpenSSLCryptoKeyDSA.hpp>
@@ -64,11 +65,26 @@
 #endif
 
 #include "../../utils/XSECDOMUtils.hpp"
+#include "../../utils/XSECThreadPool.hpp"
+#include "../common/BatchUtils.hpp"
 
 #include <memory.h>
 #include <string.h>
 #include <iostream>
+#include <fstream>
 #include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+# include <windows.h>
+#else
+# include <dirent.h>
+#endif
 
 #if defined(HAVE_UNISTD_H)
 # include <unistd.h>
@@ -87,6 +103,8 @@
 #include <xercesc/util/XMLUniDefs.hpp>
 #include <xercesc/util/XMLNetAccessor.hpp>
 #include <xercesc/util/XMLUri.hpp>
+#include <xercesc/util/Mutexes.hpp>
+#include <xercesc/framework/LocalFileFormatTarget.hpp>
 
 #ifdef XSEC_HAVE_XALAN
 
@@ -491,9 +509,441 @@ DOMMemFormatTarget *MEMtarget;
 XMLFormatter *formatter, *MEMformatter;
 unsigned char *charBuffer;
 
+// --------------------------------------------------------------------------------
+//           Bulk signing
+// --------------------------------------------------------------------------------
+
+static const char * baseName(const char * path) {
+
+    const char * ret = path;
+    for (const char * p = path; *p != '\0'; ++p) {
+        if (*p == '/' || *p == '\\')
+            ret = p + 1;
+    }
+
+    return ret;
+
+}
+
+// importNode() only copies the namespace declarations made on the node
+// itself, so copy down any the template inherits from its ancestors.
+// The nearest declaration of a prefix wins.
+
+static void copyInScopeNamespaces(const DOMElement * from, DOMElement * to) {
+
+    for (DOMNode * n = from->getParentNode();
+         n != NULL && n->getNodeType() == DOMNode::ELEMENT_NODE;
+         n = n->getParentNode()) {
+
+        DOMNamedNodeMap * atts = n->getAttributes();
+
+        for (XMLSize_t i = 0; atts != NULL && i < atts->getLength(); ++i) {
+
+            DOMNode * a = atts->item(i);
+
+            if (strEquals(a->getNamespaceURI(), XMLUni::fgXMLNSURIName) &&
+                to->getAttributeNodeNS(XMLUni::fgXMLNSURIName, a->getLocalName()) == NULL) {
+
+                to->setAttributeNS(XMLUni::fgXMLNSURIName, a->getNodeName(), a->getNodeValue());
+
+            }
+
+        }
+
+    }
+
+}
+
+// A worker keeps its own copy of the prepared template, key, parser,
+// serializer and a DSIGSignature that is re-targeted at each document, so
+// nothing is shared once the workers are running.  Workers are created in
+// the main thread, which is the only one to read the template document.
+//
+// Only the template preparation (key, KeyInfo, --clearkeys) is done once.
+// Each document still gets its own copy of the Signature, which is loaded
+// and signed in full.
+
+class BulkWorker : public XSECThreadTask {
+
+public:
+
+    BulkWorker(BatchQueue & queue,
+               DOMElement * templateSig,
+               const XSECCryptoKey * key,
+               const XMLCh * baseURI,
+               const char * outDir) :
+        m_queue(queue),
+        m_outDir(outDir) {
+
+        DOMImplementation * impl =
+            DOMImplementationRegistry::getDOMImplementation(MAKE_UNICODE_STRING("Core"));
+
+        mp_template = impl->createDocument();
+        mp_templateSig = static_cast<DOMElement *>(mp_template->importNode(templateSig, true));
+        mp_template->appendChild(mp_templateSig);
+        copyInScopeNamespaces(templateSig, mp_templateSig);
+
+        mp_key = key->clone();
+
+        m_parser.setDoNamespaces(true);
+        m_parser.setCreateEntityReferenceNodes(true);
+
+        mp_serializer = ((DOMImplementationLS *) impl)->createLSSerializer();
+        mp_serializer->getDomConfig()->setParameter(XMLUni::fgDOMWRTFormatPrettyPrint, false);
+        mp_output = ((DOMImplementationLS *) impl)->createLSOutput();
+        mp_output->setEncoding(MAKE_UNICODE_STRING("UTF-8"));
+
+        mp_sig = m_prov.newSignature();
+        mp_sig->getURIResolver()->setBaseURI(baseURI);
+
+    }
+
+    virtual ~BulkWorker() {
+
+        m_prov.releaseSignature(mp_sig);
+        mp_output->release();
+        mp_serializer->release();
+        delete mp_key;
+        mp_template->release();
+
+    }
+
+    virtual void run(void) {
+
+        XMLSize_t index;
+        while (m_queue.next(index)) {
+
+            BatchResult & r = m_queue.getResult(index);
+            const char * filename = m_queue.getFile(index);
+
+            XMLUInt64 start = XSECMetricTimer::now();
+
+            struct stat st;
+            r.bytes = (stat(filename, &st) == 0 ? (XMLUInt64) st.st_size : 0);
+
+            try {
+                r.result = (sign(filename, r.message) ? 0 : 1);
+            }
+            catch (...) {
+                r.result = 1;
+                r.message = "Unknown error";
+            }
+
+            // Documents are not needed once written
+            m_parser.resetDocumentPool();
+
+            r.nanoseconds = XSECMetricTimer::now() - start;
+
+        }
+
+    }
+
+private:
+
+    bool sign(const char * filename, std::string & message);
+
+    BatchQueue               & m_queue;
+    std::string             m_outDir;
+    DOMDocument             * mp_template;
+    DOMElement              * mp_templateSig;
+    XSECCryptoKey           * mp_key;
+    XercesDOMParser         m_parser;
+    DOMLSSerializer         * mp_serializer;
+    DOMLSOutput             * mp_output;
+    XSECProvider            m_prov;
+    DSIGSignature           * mp_sig;
+
+};
+
+bool BulkWorker::sign(const char * filename, std::string & message) {
+
+    try {
+        m_parser.parse(filename);
+    }
+    catch (const XMLException & e) {
+        setMessage(message, e.getMessage());
+        return false;
+    }
+    catch (const DOMException &) {
+        message = "A DOM error occurred during parsing";
+        return false;
+    }
+
+    DOMDocument * doc = m_parser.getDocument();
+
+    if (m_parser.getErrorCount() > 0 || doc == NULL || doc->getDocumentElement() == NULL) {
+        message = "Errors during parse";
+        return false;
+    }
+
+    try {
+
+        // The signature goes at the end of the document element
+        DOMNode * sigNode = doc->importNode(mp_templateSig, true);
+        doc->getDocumentElement()->appendChild(sigNode);
+
+        mp_sig->reset(doc, sigNode);
+        mp_sig->load();
+        mp_sig->setSigningKey(mp_key->clone());
+        mp_sig->sign();
+
+        std::string outName = m_outDir + "/" + baseName(filename);
+        LocalFileFormatTarget target(outName.c_str());
+
+        mp_output->setByteStream(&target);
+        mp_serializer->write(doc, mp_output);
+        mp_output->setByteStream(NULL);
+
+    }
+    catch (const XSECException & e) {
+        setMessage(message, e.getMsg());
+        return false;
+    }
+    catch (const XSECCryptoException & e) {
+        message = e.getMsg();
+        return false;
+    }
+    catch (const XMLException & e) {
+        setMessage(message, e.getMessage());
+        return false;
+    }
+    catch (const DOMException &) {
+        message = "A DOM error occurred during signing";
+        return false;
+    }
+
+    return true;
+
+}
+
+// Gather the documents - each file in a directory, or each line of a list
+// file
+
+#if defined(_WIN32)
+
+static bool readDirectory(const char * dir, std::vector<std::string> & files) {
+
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileA((std::string(dir) + "\\*").c_str(), &fd);
+
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    do {
+        if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+            files.push_back(std::string(dir) + "\\" + fd.cFileName);
+    } while (FindNextFileA(h, &fd));
+
+    FindClose(h);
+    return true;
+
+}
+
+static bool sameFile(const char * a, const char * b) {
+
+    char fa[_MAX_PATH], fb[_MAX_PATH];
+
+    if (_fullpath(fa, a, _MAX_PATH) == NULL || _fullpath(fb, b, _MAX_PATH) == NULL)
+        return false;
+
+    // "dir" and "dir\" are the same directory
+    size_t la = strlen(fa), lb = strlen(fb);
+    if (la > 3 && (fa[la - 1] == '\\' || fa[la - 1] == '/'))
+        fa[la - 1] = '\0';
+    if (lb > 3 && (fb[lb - 1] == '\\' || fb[lb - 1] == '/'))
+        fb[lb - 1] = '\0';
+
+    return (_stricmp(fa, fb) == 0);
+
+}
+
+#else
+
+static bool readDirectory(const char * dir, std::vector<std::string> & files) {
+
+    DIR * d = opendir(dir);
+
+    if (d == NULL)
+        return false;
+
+    struct dirent * e;
+    while ((e = readdir(d)) != NULL) {
+
+        std::string path = std::string(dir) + "/" + e->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            files.push_back(path);
+
+    }
+
+    closedir(d);
+    return true;
+
+}
+
+static bool sameFile(const char * a, const char * b) {
+
+    struct stat sa, sb;
+    return (stat(a, &sa) == 0 && stat(b, &sb) == 0 &&
+            sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino);
+
+}
+
+#endif
+
+// Sign every document against the compiled template, then write any
+// failures and the totals to stdout as JSON
+
+int runBulk(const char * source,
+            const char * outDir,
+            unsigned int threads,
+            DOMElement * templateSig,
+            const XSECCryptoKey * key,
+            const XMLCh * baseURI) {
+
+    std::vector<std::string> files;
+
+    if (!(isDirectory(source) ? readDirectory(source, files) : readFileList(source, files))) {
+        cerr << "Unable to read " << source << endl;
+        return 1;
+    }
+
+    // Outputs are named after their inputs, so the names must be unique
+    std::sort(files.begin(), files.end());
+
+    std::vector<std::string> names;
+    for (XMLSize_t i = 0; i < files.size(); ++i)
+        names.push_back(baseName(files[i].c_str()));
+    std::sort(names.begin(), names.end());
+
+    for (XMLSize_t i = 1; i < names.size(); ++i) {
+        if (names[i] == names[i - 1]) {
+            cerr << "More than one input is named " << names[i] << endl;
+            return 1;
+        }
+    }
+
+    // Never write over an input
+    if (isDirectory(source) && sameFile(source, outDir)) {
+        cerr << "The output directory must not be the input directory" << endl;
+        return 1;
+    }
+
+    for (XMLSize_t i = 0; i < files.size(); ++i) {
+        std::string outName = std::string(outDir) + "/" + baseName(files[i].c_str());
+        if (sameFile(files[i].c_str(), outName.c_str())) {
+            cerr << "Signing " << files[i] << " would overwrite it" << endl;
+            return 1;
+        }
+    }
+
+    BatchQueue queue(files);
+    XSECThreadPool pool(threads);
+
+    // No point in more workers than documents
+    unsigned int workerCount = pool.getThreadCount();
+    if (workerCount > files.size())
+        workerCount = (unsigned int) files.size();
+
+    std::vector<BulkWorker *> workers;
+    for (unsigned int i = 0; i < workerCount; ++i) {
+        workers.push_back(new BulkWorker(queue, templateSig, key, baseURI, outDir));
+        pool.addTask(workers.back());
+    }
+
+    XMLUInt64 start = XSECMetricTimer::now();
+    pool.runAll();
+    XMLUInt64 elapsed = XSECMetricTimer::now() - start;
+
+    for (unsigned int i = 0; i < workerCount; ++i)
+        delete workers[i];
+
+    // Failures
+
+    XMLSize_t failed = 0;
+    XMLUInt64 bytes = 0;
+    std::vector<XMLUInt64> latencies;
+
+    cout << "{\n  \"failures\": [";
+
+    for (XMLSize_t i = 0; i < files.size(); ++i) {
+
+        const BatchResult & r = queue.getResult(i);
+
+        bytes += r.bytes;
+        latencies.push_back(r.nanoseconds);
+
+        if (r.result == 0)
+            continue;
+
+        cout << (failed++ == 0 ? "\n" : ",\n") << "    {\"file\": ";
+        printJSONString(files[i]);
+        cout << ", \"message\": ";
+        printJSONString(r.message);
+        cout << "}";
+
+    }
+
+    // Totals
+
+    XMLSize_t n = latencies.size();
+    double seconds = (double) elapsed / 1000000000.0;
+
+    cout << "\n  ],\n  \"summary\": {\n";
+    cout << "    \"documents\": " << n << ",\n";
+    cout << "    \"signed\": " << n - failed << ",\n";
+    cout << "    \"failed\": " << failed << ",\n";
+    cout << "    \"threads\": " << workerCount << ",\n";
+    cout << "    \"seconds\": " << seconds << ",\n";
+    cout << "    \"documents_per_second\": " << (seconds > 0 ? n / seconds : 0.0) << ",\n";
+    cout << "    \"bytes\": " << (unsigned long long) bytes << ",\n";
+    cout << "    \"bytes_per_second\": " << (seconds > 0 ? bytes / seconds : 0.0) << ",\n";
+    cout << "    ";
+    printLatencies(latencies);
+    cout << "\n  }\n}" << endl;
+
+    return (failed > 0 ? 1 : 0);
+
+}
+
+// Write a signed document to stdout
+
+void printDocument(DOMNode * doc) {
+
+    DOMPrintFormatTarget* formatTarget = new DOMPrintFormatTarget();
+    
+    const XMLCh* encNameStr = XMLString::transcode("UTF-8");
+    DOMNode *aNode = doc->getFirstChild();
+    if (aNode->getNodeType() == DOMNode::ENTITY_NODE)
+    {
+        const XMLCh* aStr = ((DOMEntity *)aNode)->getInputEncoding();
+        if (!strEquals(aStr, ""))
+        {
+            encNameStr = aStr;
+        }
+    }
+    XMLSize_t lent = XMLString::stringLen(encNameStr);
+    gEncodingName = new XMLCh[lent + 1];
+    XMLString::copyNString(gEncodingName, encNameStr, lent);
+    gEncodingName[lent] = 0;
+
+    gFormatter = new XMLFormatter("UTF-8", 0, formatTarget,
+                                          XMLFormatter::NoEscapes, gUnRepFlags);
+
+    cout << doc;
+
+    delete [] gEncodingName;
+    XMLCh * toRelease = (XMLCh *) encNameStr;
+    XSEC_RELEASE_XMLCH(toRelease);
+    delete gFormatter;
+    delete formatTarget;
+
+}
+
 void printUsage(void) {
 
-    cerr << "\nUsage: templatesign <key options> <file to sign>\n\n";
+    cerr << "\nUsage: templatesign <key options> <file to sign>\n";
+    cerr << "       templatesign <key options> --bulk <directory|list file> --outdir <directory> <template>\n\n";
 #if defined (XSEC_HAVE_OPENSSL)
     cerr << "    Where <key options> are one of :\n\n";
     cerr << "        --x509subjectname/-s <distinguished name>\n";
@@ -541,6 +991,18 @@ void printUsage(void) {
     cerr << "        --winrsakeyinfo/-wri\n";
     cerr << "                      Clear KeyInfo elements and insert RSA parameters from windows key\n";
 #endif
+    cerr << "\n    Bulk signing options :\n\n";
+    cerr << "        --bulk/-b <directory|list file>\n";
+    cerr << "                      Sign each file in <directory>, or named (one per line) in\n";
+    cerr << "                      <list file>, by adding the <Signature> from the template to\n";
+    cerr << "                      the end of its document element.  Throughput and latency\n";
+    cerr << "                      are reported on stdout as JSON\n";
+    cerr << "        --outdir/-o <directory>\n";
+    cerr << "                      Where bulk signed documents are written, under their\n";
+    cerr << "                      original file names\n";
+    cerr << "        --threads/-t <n>\n";
+    cerr << "                      Number of documents to sign at once (default is one per\n";
+    cerr << "                      processor)\n";
 
 
 }
@@ -556,6 +1018,9 @@ int main(int argc, char **argv) {
     int                         certCount = 0;
     int                         paramCount;
     bool                        clearKeyInfo = false;
+    const char                  * bulkSource = NULL;
+    const char                  * outDir = NULL;
+    unsigned int                threads = 0;
 #if defined(XSEC_HAVE_WINCAPI)
     HCRYPTPROV                  win32DSSCSP = 0;        // Crypto Provider
     HCRYPTPROV                  win32RSACSP = 0;        // Crypto Provider
@@ -789,6 +1254,42 @@ int main(int argc, char **argv) {
 
         }
 
+        else if (_stricmp(argv[paramCount], "--bulk") == 0 || _stricmp(argv[paramCount], "-b") == 0) {
+
+            if (paramCount + 2 >= argc) {
+                printUsage();
+                exit(1);
+            }
+
+            bulkSource = argv[paramCount + 1];
+            paramCount += 2;
+
+        }
+
+        else if (_stricmp(argv[paramCount], "--outdir") == 0 || _stricmp(argv[paramCount], "-o") == 0) {
+
+            if (paramCount + 2 >= argc) {
+                printUsage();
+                exit(1);
+            }
+
+            outDir = argv[paramCount + 1];
+            paramCount += 2;
+
+        }
+
+        else if (_stricmp(argv[paramCount], "--threads") == 0 || _stricmp(argv[paramCount], "-t") == 0) {
+
+            if (paramCount + 2 >= argc || atoi(argv[paramCount + 1]) < 0) {
+                printUsage();
+                exit(1);
+            }
+
+            threads = (unsigned int) atoi(argv[paramCount + 1]);
+            paramCount += 2;
+
+        }
+
 #if defined (XSEC_HAVE_WINCAPI)
         else if (_stricmp(argv[paramCount], "--windss") == 0 || _stricmp(argv[paramCount], "-wd") == 0) {
 
@@ -1040,6 +1541,21 @@ int main(int argc, char **argv) {
 
     }
 
+    if ((bulkSource == NULL) != (outDir == NULL)) {
+
+        printUsage();
+        exit(1);
+
+    }
+
+    if (bulkSource != NULL && key == NULL) {
+
+        // Each document gets a copy, so it must be given here
+        cerr << "Bulk signing needs a key" << endl;
+        exit(1);
+
+    }
+
     // Create and set up the parser
 
     XercesDOMParser * parser = new XercesDOMParser;
@@ -1145,7 +1661,8 @@ int main(int argc, char **argv) {
     // The last "\\" must prefix the filename
     baseURI[lastSlash + 1] = '\0';
 
-    sig->getURIResolver()->setBaseURI(MAKE_UNICODE_STRING(baseURI));
+    XMLCh * baseURIXMLCh = XMLString::transcode(baseURI);
+    sig->getURIResolver()->setBaseURI(baseURIXMLCh);
 #if XSEC_HAVE_GETCWD_DYN
     free(path);
     free(baseURI);
@@ -1155,9 +1672,13 @@ int main(int argc, char **argv) {
         sig->load();
         if (clearKeyInfo == true)
             sig->clearKeyInfo();
-        if (key != NULL)
-            sig->setSigningKey(key);
-        sig->sign();
+        // In bulk mode the template is only prepared (KeyInfo and so on),
+        // and each document is signed with a copy of the key
+        if (bulkSource == NULL) {
+            if (key != NULL)
+                sig->setSigningKey(key);
+            sig->sign();
+        }
 
         // Add any KeyInfo elements
 
@@ -1284,35 +1805,18 @@ int main(int argc, char **argv) {
         exit(1);
     }
 
-    // Print out the result
+    int retResult = 0;
 
-    DOMPrintFormatTarget* formatTarget = new DOMPrintFormatTarget();
-    
-    const XMLCh* encNameStr = XMLString::transcode("UTF-8");
-    DOMNode *aNode = doc->getFirstChild();
-    if (aNode->getNodeType() == DOMNode::ENTITY_NODE)
-    {
-        const XMLCh* aStr = ((DOMEntity *)aNode)->getInputEncoding();
-        if (!strEquals(aStr, ""))
-        {
-            encNameStr = aStr;
-        }
+    if (bulkSource != NULL) {
+        retResult = runBulk(bulkSource, outDir, threads, (DOMElement *) sigNode, key, baseURIXMLCh);
+        delete key;
+    }
+    else {
+        // Print out the result
+        printDocument(doc);
     }
-    XMLSize_t lent = XMLString::stringLen(encNameStr);
-    gEncodingName = new XMLCh[lent + 1];
-    XMLString::copyNString(gEncodingName, encNameStr, lent);
-    gEncodingName[lent] = 0;
-
-    gFormatter = new XMLFormatter("UTF-8", 0, formatTarget,
-                                          XMLFormatter::NoEscapes, gUnRepFlags);
-
-    cout << doc;
 
-    delete [] gEncodingName;
-    XMLCh * toRelease = (XMLCh *) encNameStr;
-    XSEC_RELEASE_XMLCH(toRelease);
-    delete gFormatter;
-    delete formatTarget;
+    XSEC_RELEASE_XMLCH(baseURIXMLCh);
 
 #if defined (_WIN32) && defined (XSEC_HAVE_WINCAPI)
     if (win32DSSCSP != 0)
@@ -1333,5 +1837,5 @@ int main(int argc, char **argv) {
     XMLPlatformUtils::Terminate();
 
     
-    return 0;
+    return retResult;
 }
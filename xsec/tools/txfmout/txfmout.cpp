@@ -40,6 +40,7 @@
 #include <xsec/framework/XSECURIResolver.hpp>
 #include <xsec/enc/XSECCryptoException.hpp>
 #include <xsec/utils/XSECBinTXFMInputStream.hpp>
+#include <xsec/framework/XSECTrace.hpp>
 
 #include "../../utils/XSECDOMUtils.hpp"
 
@@ -274,6 +275,9 @@ void printUsage(void) {
 	cerr << "         Output only references. [num] defines a single reference to output\n";
 	cerr << "     --newfiles/-n\n";
 	cerr << "         Create a new file for each reference/SignedInfo (append .#)\n";
+	cerr << "     --trace <file>\n";
+	cerr << "         Write a trace of the processing to <file> in Chrome\n";
+	cerr << "         trace-event (JSON) format\n";
 
 }
 
@@ -297,6 +301,10 @@ void outputReferenceList (DSIGReferenceList * lst, outputter & theOutputter, int
 
 		ref = lst->item(i);
 		if (refNum == -1 || theOutputter.getIndex() == refNum) {
+
+			// The transforms run as the output is read
+			XSECTraceScope trace("reference", ref->getURI(), true);
+
 			theOutputter.openSection();
 	
 			try {
@@ -355,6 +363,7 @@ int main(int argc, char **argv) {
 	bool					references = true;
 	outputter				theOutputter;
 	int						refNum = -1;
+	char					* traceFile = NULL;
 
 	if (argc < 2) {
 
@@ -385,6 +394,10 @@ int main(int argc, char **argv) {
 			paramCount++;
 			theOutputter.setNewFilePerOpen();
 		}
+		else if (_stricmp(argv[paramCount], "--trace") == 0) {
+			paramCount++;
+			traceFile = argv[paramCount++];
+		}
 		else {
 			printUsage();
 			exit(2);
@@ -418,6 +431,22 @@ int main(int argc, char **argv) {
 
 	}
 
+	XSECTraceWriter * traceWriter = NULL;
+
+	if (traceFile != NULL) {
+
+		try {
+			traceWriter = new XSECTraceWriter(traceFile);
+		}
+		catch (const XSECException &) {
+			cerr << "Unable to open trace file " << traceFile << endl;
+			exit (2);
+		}
+
+		XSECPlatformUtils::SetTraceSink(traceWriter);
+
+	}
+
 	// Create and set up the parser
 
 	XercesDOMParser * parser = new XercesDOMParser;
@@ -568,5 +597,10 @@ int main(int argc, char **argv) {
 
 	prov.releaseSignature(sig);
 
+	if (traceWriter != NULL) {
+		XSECPlatformUtils::SetTraceSink(NULL);
+		delete traceWriter;
+	}
+
 	return 0;
 }
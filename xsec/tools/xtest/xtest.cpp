@@ -49,6 +49,8 @@
 #include <xercesc/dom/DOM.hpp>
 #include <xercesc/util/XMLException.hpp>
 #include <xercesc/util/Janitor.hpp>
+#include <xercesc/util/BinMemInputStream.hpp>
+#include <xercesc/framework/MemoryManager.hpp>
 
 #include <xsec/transformers/TXFMOutputFile.hpp>
 #include <xsec/dsig/DSIGTransformXPath.hpp>
@@ -80,12 +82,18 @@ XALAN_USING_XALAN(XalanTransformer)
 #include <xsec/dsig/DSIGKeyInfoMgmtData.hpp>
 #include <xsec/enc/XSECCryptoException.hpp>
 #include <xsec/enc/XSECCryptoSymmetricKey.hpp>
+#include <xsec/enc/XSCrypt/XSCryptCryptoBase64.hpp>
 #include <xsec/framework/XSECError.hpp>
 #include <xsec/framework/XSECProvider.hpp>
+#include <xsec/framework/XSECAsyncQueue.hpp>
+#include <xsec/framework/XSECMemory.hpp>
+#include <xsec/framework/XSECMetrics.hpp>
+#include <xsec/framework/XSECTrace.hpp>
 #include <xsec/xenc/XENCCipher.hpp>
 #include <xsec/xenc/XENCEncryptedData.hpp>
 #include <xsec/xenc/XENCEncryptedKey.hpp>
 #include <xsec/xenc/XENCEncryptionMethod.hpp>
+#include <xsec/xenc/XENCKeyCache.hpp>
 #include <xsec/utils/XSECNameSpaceExpander.hpp>
 #include <xsec/utils/XSECBinTXFMInputStream.hpp>
 #include <xsec/utils/XSECPlatformUtils.hpp>
@@ -99,6 +107,7 @@ XALAN_USING_XALAN(XalanTransformer)
 #	include <openssl/rand.h>
 #	include <openssl/evp.h>
 #	include <openssl/pem.h>
+#	include "../../enc/OpenSSL/OpenSSLSupport.hpp"
 #endif
 #if defined (XSEC_HAVE_WINCAPI)
 #	include <xsec/enc/WinCAPI/WinCAPICryptoKeyHMAC.hpp>
@@ -971,6 +980,45 @@ void unitTestLongSHA(DOMImplementation * impl) {
 
 }
 
+bool rejectsCorruptSignatureValue(DOMDocument * doc, XSECCryptoKey * k) {
+
+	// Signature values are base64 decoded strictly, so a character outside
+	// the alphabet in the middle of an otherwise good value must fail
+
+	DOMNode * sv = findDSIGNode(doc->getDocumentElement(), "SignatureValue");
+	if (sv == NULL)
+		return false;
+
+	safeBuffer good;
+	gatherChildrenText(sv, good);
+
+	safeBuffer bad;
+	bad.sbStrcpyIn(good.rawCharBuffer());
+	bad[8] = '*';
+
+	sv->setTextContent(MAKE_UNICODE_STRING(bad.rawCharBuffer()));
+
+	bool rejected;
+
+	XSECProvider prov;
+	DSIGSignature * sig = prov.newSignatureFromDOM(doc);
+	sig->load();
+	sig->setSigningKey(k->clone());
+
+	try {
+		rejected = !sig->verify();
+	}
+	catch (const XSECCryptoException &) {
+		rejected = true;
+	}
+
+	prov.releaseSignature(sig);
+	sv->setTextContent(good.sbStrToXMLCh());
+
+	return rejected;
+
+}
+
 void unitTestSig(DOMImplementation * impl, XSECCryptoKey * k, const XMLCh * AlgURI) {
 
 	// Given a specific RSA/EC key and particular algorithm URI, sign and validate a document
@@ -1029,6 +1077,19 @@ void unitTestSig(DOMImplementation * impl, XSECCryptoKey * k, const XMLCh * AlgU
 
 		cerr << "OK";
 
+#if defined (XSEC_HAVE_OPENSSL)
+		if (!g_useWinCAPI && !g_useNSS) {
+
+			cerr << " ... corrupt SignatureValue ... ";
+			if (!rejectsCorruptSignatureValue(doc, k)) {
+				cerr << "accepted!" << endl;
+				exit(1);
+			}
+			cerr << "rejected";
+
+		}
+#endif
+
 		cerr << "\n";	
 
 		outputDoc(impl, doc);
@@ -1056,6 +1117,79 @@ void unitTestSig(DOMImplementation * impl, XSECCryptoKey * k, const XMLCh * AlgU
 }
 
 
+#if defined (XSEC_HAVE_OPENSSL)
+
+// Load a modulus and exponent into a key, as a KeyValue would
+
+void loadRSAPublicKey(OpenSSLCryptoKeyRSA * k, const BIGNUM * n, const char * e) {
+
+	unsigned char bin[1024];
+	unsigned char b64[2048];
+
+	int len = BN_bn2bin(n, bin);
+	len = EVP_EncodeBlock(b64, bin, len);
+
+	k->loadPublicModulusBase64BigNums((char *) b64, len);
+	k->loadPublicExponentBase64BigNums(e, (unsigned int) strlen(e));
+
+}
+
+void unitTestRSAKeyChange(void) {
+
+	cerr << "Checking RSA signature contexts follow key changes ... ";
+
+	BIO * bioMem = BIO_new(BIO_s_mem());
+	BIO_puts(bioMem, s_tstRSAPrivateKey);
+	EVP_PKEY * pk = PEM_read_bio_PrivateKey(bioMem, NULL, NULL, NULL);
+	BIO_free(bioMem);
+
+	OpenSSLCryptoKeyRSA * k = new OpenSSLCryptoKeyRSA(pk);
+	Janitor<OpenSSLCryptoKeyRSA> j_k(k);
+
+	const BIGNUM *n;
+	RSA_get0_key(EVP_PKEY_get0_RSA(pk), &n, NULL, NULL);
+
+	unsigned char hash[20];
+	for (int i = 0; i < 20; ++i)
+		hash[i] = (unsigned char) (i * 7);
+
+	char sig[1024];
+	unsigned int sigLen = k->signSHA1PKCS1Base64Signature(hash, 20, sig, 1024, XSECCryptoHash::HASH_SHA1);
+
+	if (sigLen == 0 || !k->verifySHA1PKCS1Base64Signature(hash, 20, sig, sigLen, XSECCryptoHash::HASH_SHA1)) {
+		cerr << "failed - could not sign and verify\n";
+		EVP_PKEY_free(pk);
+		exit(1);
+	}
+
+	// Swap the exponent - the cached contexts must not still verify
+
+	loadRSAPublicKey(k, n, "Aw==");
+
+	if (k->verifySHA1PKCS1Base64Signature(hash, 20, sig, sigLen, XSECCryptoHash::HASH_SHA1)) {
+		cerr << "failed - signature verified against the old key\n";
+		EVP_PKEY_free(pk);
+		exit(1);
+	}
+
+	// And back again
+
+	loadRSAPublicKey(k, n, "AQAB");
+
+	if (!k->verifySHA1PKCS1Base64Signature(hash, 20, sig, sigLen, XSECCryptoHash::HASH_SHA1)) {
+		cerr << "failed - signature did not verify after reloading the key\n";
+		EVP_PKEY_free(pk);
+		exit(1);
+	}
+
+	EVP_PKEY_free(pk);
+
+	cerr << "OK" << endl;
+
+}
+
+#endif
+
 void unitTestRSA(DOMImplementation * impl) {
 
 	/* First we load some keys to use! */
@@ -1149,6 +1283,11 @@ void unitTestRSA(DOMImplementation * impl) {
 
 	cerr << "Unit testing RSA-MD5 signature ... ";
 	unitTestSig(impl, rsaKey, DSIGConstants::s_unicodeStrURIRSA_MD5);
+
+#if defined (XSEC_HAVE_OPENSSL)
+	if (!g_useWinCAPI && !g_useNSS)
+		unitTestRSAKeyChange();
+#endif
 }
 
 void unitTestEC(DOMImplementation * impl) {
@@ -1193,520 +1332,2408 @@ void unitTestEC(DOMImplementation * impl) {
 #endif
 }
 
-void unitTestSignature(DOMImplementation * impl) {
-
-	// Test an enveloping signature
-	unitTestEnvelopingSignature(impl);
-#ifdef XSEC_HAVE_XALAN
-	unitTestBase64NodeSignature(impl);
-#else
-	cerr << "Skipping base64 node test (Requires XPath)" << endl;
-#endif
+void canonicaliseToBuffer(XSECC14n20010315 &c14n, safeBuffer &sb, XMLSize_t &len) {
 
-	// Test "long" sha hashes
-	if (XSECPlatformUtils::g_cryptoProvider->algorithmSupported(XSECCryptoHash::HASH_SHA512))
-		unitTestLongSHA(impl);
-	else
-		cerr << "Skipping long SHA hash tests as SHA512 not supported by crypto provider" << endl;
+	unsigned char buf[1024];
+	XMLSize_t sz;
 
-	// Test RSA Signatures
-	unitTestRSA(impl);
+	len = 0;
+	while ((sz = c14n.outputBuffer(buf, 1024)) > 0) {
+		sb.sbMemcpyIn(len, buf, sz);
+		len += sz;
+	}
 
-    // Test EC Signatures
-    unitTestEC(impl);
 }
 
-// --------------------------------------------------------------------------------
-//           Basic tests of signature function
-// --------------------------------------------------------------------------------
-
-void testSignature(DOMImplementation *impl) {
+void addSubtreeToNodeList(XSECXPathNodeList &list, DOMNode * n) {
 
-	cerr << "Creating a known doc and signing (HMAC-SHA1)" << endl;
-	
-	// Create a document
-    
-	DOMDocument * doc = createTestDoc(impl);
+	list.addNode(n);
 
-	// Check signature functions
+	DOMNamedNodeMap * atts = n->getAttributes();
+	if (atts != NULL) {
+		for (XMLSize_t i = 0; i < atts->getLength(); ++i)
+			list.addNode(atts->item(i));
+	}
 
-	XSECProvider prov;
-	DSIGSignature *sig;
-	DSIGReference *ref[10];
-	DOMElement *sigNode;
-	int refCount;
+	for (DOMNode * c = n->getFirstChild(); c != NULL; c = c->getNextSibling())
+		addSubtreeToNodeList(list, c);
 
-	try {
-		
-		/*
-		 * Now we have a document, create a signature for it.
-		 */
-		
-		sig = prov.newSignature();
-		sig->setDSIGNSPrefix(MAKE_UNICODE_STRING("ds"));
-		sig->setPrettyPrint(true);
+}
 
-		sigNode = sig->createBlankSignature(doc, 
-			DSIGConstants::s_unicodeStrURIC14N_COM,
-			DSIGConstants::s_unicodeStrURIHMAC_SHA1);
-		DOMElement * rootElem = doc->getDocumentElement();
-		DOMNode * prodElem = rootElem->getFirstChild();
+void unitTestParallelC14n(DOMImplementation * impl) {
 
-		rootElem->appendChild(doc->createTextNode(DSIGConstants::s_unicodeStrNL));
-		rootElem->insertBefore(doc->createComment(MAKE_UNICODE_STRING(" a comment ")), prodElem);
-		rootElem->appendChild(sigNode);
-		rootElem->insertBefore(doc->createTextNode(DSIGConstants::s_unicodeStrNL), prodElem);
+	// Canonicalise a document with many top level children serially and
+	// in parallel and make sure the output is identical.  Done for the
+	// whole document and for a node-set that drops every other child
 
-		/*
-		 * Add some test references
-		 */
+	cerr << "Comparing serial and parallel canonicalisation ... ";
 
-		ref[0] = sig->createReference(MAKE_UNICODE_STRING(""),
-			DSIGConstants::s_unicodeStrURISHA1);
-		ref[0]->appendEnvelopedSignatureTransform();
+	DOMDocument * doc = impl->createDocument();
+	DOMElement * root = doc->createElementNS(MAKE_UNICODE_STRING("urn:root"), MAKE_UNICODE_STRING("r:Root"));
+	root->setAttributeNS(DSIGConstants::s_unicodeStrURIXMLNS, MAKE_UNICODE_STRING("xmlns:r"), MAKE_UNICODE_STRING("urn:root"));
+	root->setAttributeNS(DSIGConstants::s_unicodeStrURIXMLNS, MAKE_UNICODE_STRING("xmlns:c"), MAKE_UNICODE_STRING("urn:child"));
+	doc->appendChild(root);
 
-		ref[1] = sig->createReference(MAKE_UNICODE_STRING("#xpointer(/)"),
-			DSIGConstants::s_unicodeStrURISHA1);
-		ref[1]->appendEnvelopedSignatureTransform();
-		ref[1]->appendCanonicalizationTransform(DSIGConstants::s_unicodeStrURIC14N_NOC);
+	for (int i = 0; i < 200; ++i) {
 
-		ref[2] = sig->createReference(MAKE_UNICODE_STRING("#xpointer(/)"),
-			DSIGConstants::s_unicodeStrURISHA1);
-		ref[2]->appendEnvelopedSignatureTransform();
-		ref[2]->appendCanonicalizationTransform(DSIGConstants::s_unicodeStrURIC14N_COM);
+		DOMElement * e = doc->createElementNS(MAKE_UNICODE_STRING("urn:child"), MAKE_UNICODE_STRING("c:Child"));
+		e->setAttributeNS(NULL, MAKE_UNICODE_STRING("b"), MAKE_UNICODE_STRING("2"));
+		e->setAttributeNS(NULL, MAKE_UNICODE_STRING("a"), MAKE_UNICODE_STRING("1 & <"));
+		if (i % 3 == 0)
+			e->setAttributeNS(DSIGConstants::s_unicodeStrURIXMLNS, MAKE_UNICODE_STRING("xmlns:r"), MAKE_UNICODE_STRING("urn:root"));
+		DOMElement * g = doc->createElementNS(MAKE_UNICODE_STRING("urn:root"), MAKE_UNICODE_STRING("r:Grand"));
+		g->appendChild(doc->createTextNode(MAKE_UNICODE_STRING("some text\r\n")));
+		e->appendChild(g);
+		e->appendChild(doc->createComment(MAKE_UNICODE_STRING("comment")));
+		root->appendChild(e);
+		root->appendChild(doc->createTextNode(MAKE_UNICODE_STRING("\n")));
 
-		ref[3] = sig->createReference(MAKE_UNICODE_STRING("#xpointer(/)"),
-			DSIGConstants::s_unicodeStrURISHA1);
-		ref[3]->appendEnvelopedSignatureTransform();
-		ref[3]->appendCanonicalizationTransform(DSIGConstants::s_unicodeStrURIEXC_C14N_NOC);
+	}
 
-		ref[4] = sig->createReference(MAKE_UNICODE_STRING("#xpointer(/)"),
-			DSIGConstants::s_unicodeStrURISHA1);
-		ref[4]->appendEnvelopedSignatureTransform();
-		ref[4]->appendCanonicalizationTransform(DSIGConstants::s_unicodeStrURIEXC_C14N_COM);
+	try {
 
-		ref[5] = sig->createReference(MAKE_UNICODE_STRING("#xpointer(/)"),
-			DSIGConstants::s_unicodeStrURISHA1);
-		ref[5]->appendEnvelopedSignatureTransform();
-		DSIGTransformC14n * ce = ref[5]->appendCanonicalizationTransform(
-			DSIGConstants::s_unicodeStrURIEXC_C14N_COM);
-		ce->addInclusiveNamespace("foo");
+		XSECXPathNodeList nodeSet;
+		nodeSet.addNode(root);
+		DOMNamedNodeMap * rootAtts = root->getAttributes();
+		for (XMLSize_t i = 0; i < rootAtts->getLength(); ++i)
+			nodeSet.addNode(rootAtts->item(i));
 
-		sig->setECNSPrefix(MAKE_UNICODE_STRING("ec"));
-		ref[6] = sig->createReference(MAKE_UNICODE_STRING("#xpointer(/)"),
-			DSIGConstants::s_unicodeStrURISHA1);
-		ref[6]->appendEnvelopedSignatureTransform();
-		ce = ref[6]->appendCanonicalizationTransform(
-			DSIGConstants::s_unicodeStrURIEXC_C14N_COM);
-		ce->addInclusiveNamespace("foo");
+		int child = 0;
+		for (DOMNode * c = root->getFirstChild(); c != NULL; c = c->getNextSibling()) {
+			if (c->getNodeType() != DOMNode::ELEMENT_NODE || (child++ % 2) == 0)
+				addSubtreeToNodeList(nodeSet, c);
+		}
 
-#ifndef XSEC_HAVE_XALAN
+		for (int mode = 0; mode < 4; ++mode) {
 
-		cerr << "WARNING : No testing of XPath being performed as Xalan not present" << endl;
-		refCount = 7;
+			safeBuffer serial, parallel;
+			XMLSize_t serialLen, parallelLen;
 
-#else
-		/*
-		 * Create some XPath/XPathFilter references
-		 */
+			XSECC14n20010315 c1(doc);
+			XSECC14n20010315 c2(doc);
+			if (mode & 1) {
+				c1.setExclusive();
+				c2.setExclusive();
+			}
+			if (mode & 2) {
+				c1.setXPathMap(nodeSet);
+				c2.setXPathMap(nodeSet);
+			}
+			c2.setParallelProcessing(4);
 
+			canonicaliseToBuffer(c1, serial, serialLen);
+			canonicaliseToBuffer(c2, parallel, parallelLen);
 
-		ref[7] = sig->createReference(MAKE_UNICODE_STRING(""),
-			DSIGConstants::s_unicodeStrURISHA1);
-		sig->setXPFNSPrefix(MAKE_UNICODE_STRING("xpf"));
-		DSIGTransformXPathFilter * xpf = ref[7]->appendXPathFilterTransform();
-		xpf->appendFilter(DSIGXPathFilterExpr::FILTER_INTERSECT, MAKE_UNICODE_STRING("//ADoc/category"));
+			if (serialLen == 0 || serialLen != parallelLen ||
+				memcmp(serial.rawBuffer(), parallel.rawBuffer(), serialLen) != 0) {
 
-		ref[8] = sig->createReference(MAKE_UNICODE_STRING(""),
-			DSIGConstants::s_unicodeStrURISHA1);
-		/*		ref[5]->appendXPathTransform("ancestor-or-self::dsig:Signature", 
-				"xmlns:dsig=http://www.w3.org/2000/09/xmldsig#"); */
+				cerr << "bad - output differs" << endl;
+				exit(1);
 
-		DSIGTransformXPath * x = ref[8]->appendXPathTransform("count(ancestor-or-self::dsig:Signature | \
-here()/ancestor::dsig:Signature[1]) > \
-count(ancestor-or-self::dsig:Signature)");
-		x->setNamespace("dsig", "http://www.w3.org/2000/09/xmldsig#");
+			}
 
-		refCount = 9;
+		}
 
-#endif
-	
-		/*
-		 * Sign the document, using an HMAC algorithm and the key "secret"
-		 */
+	}
+	catch (const XSECException &e)
+	{
+		cerr << "An error occurred during canonicalisation\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
+	}
 
+	doc->release();
+	cerr << "OK" << endl;
 
-		sig->appendKeyName(MAKE_UNICODE_STRING("The secret key is \"secret\""));
+}
 
-		// Append a test DNames
+class AsyncResultCounter : public XSECAsyncCallback {
 
-		DSIGKeyInfoX509 * x509 = sig->appendX509Data();
-		x509->setX509SubjectName(s_tstDName);
+public:
 
-		// Append a test PGPData element
-		sig->appendPGPData(s_tstPGPKeyID, s_tstPGPKeyPacket);
+	AsyncResultCounter() : m_good(0), m_bad(0), m_errors(0) {}
 
-		// Append an SPKIData element
-		DSIGKeyInfoSPKIData * spki = sig->appendSPKIData(s_tstSexp1);
-		spki->appendSexp(s_tstSexp2);
+	virtual void signatureComplete(const DSIGSignature *, bool result, const XMLCh * errorMsg) {
+		if (errorMsg != NULL)
+			++m_errors;
+		else if (result)
+			++m_good;
+		else
+			++m_bad;
+	}
 
-		// Append a MgmtData element
-		sig->appendMgmtData(s_tstMgmtData);
+	int m_good, m_bad, m_errors;
 
-		sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
-		sig->sign();
+};
 
-		// Output the document post signature if necessary
-		outputDoc(impl, doc);
+void unitTestAsyncSignature(DOMImplementation * impl) {
 
-		cerr << endl << "Doc signed OK - Checking values against Known Good" << endl;
+	// Sign and then verify a batch of signatures through a queue, with
+	// one of them broken before the verify
 
-		unsigned char buf[128];
-		XMLSize_t len;
+	cerr << "Signing and verifying a batch of signatures asynchronously ... ";
 
-		/*
-		 * Validate the reference hash values from known good
-		 */
+	const int count = 8;
+	DOMDocument * docs[count];
+	DSIGSignature * sigs[count];
+	DOMText * txts[count];
 
-		int i;
-		for (i = 0; i < refCount; ++i) {
+	XSECProvider prov;
 
-			cerr << "Calculating hash for reference " << i << " ... ";
+	try {
 
-			len = (int) ref[i]->calculateHash(buf, 128);
+		XSECAsyncQueue queue(4);
+		AsyncResultCounter signResults;
 
-			cerr << " Done\nChecking -> ";
+		for (int i = 0; i < count; ++i) {
 
-			if (len != 20) {
-				cerr << "Bad (Length = " << len << ")" << endl;
-				exit (1);
-			}
+			docs[i] = impl->createDocument();
 
-			for (int j = 0; j < 20; ++j) {
+			sigs[i] = prov.newSignature();
+			DOMElement * sigNode = sigs[i]->createBlankSignature(docs[i],
+				DSIGConstants::s_unicodeStrURIC14N_COM,
+				DSIGConstants::s_unicodeStrURIHMAC_SHA1);
+			docs[i]->appendChild(sigNode);
 
-				if (buf[j] != createdDocRefs[i][j]) {
-					cerr << "Bad at location " << j << endl;
-					exit (1);
-				}
-			
-			}
-			cerr << "Good.\n";
+			DSIGObject * obj = sigs[i]->appendObject();
+			obj->setId(MAKE_UNICODE_STRING("ObjectId"));
+			txts[i] = docs[i]->createTextNode(MAKE_UNICODE_STRING("A test string"));
+			obj->appendChild(txts[i]);
 
-		}
+			sigs[i]->createReference(MAKE_UNICODE_STRING("#ObjectId"),
+				DSIGConstants::s_unicodeStrURISHA1);
 
-		/*
-		 * Verify the signature check works
-		 */
+			sigs[i]->setSigningKey(createHMACKey((unsigned char *) "secret"));
+			sigs[i]->signAsync(queue, &signResults);
 
-		cerr << "Running \"verifySignatureOnly()\" on calculated signature ... ";
-		if (sig->verifySignatureOnly()) {
-			cerr << "OK" << endl;
 		}
-		else {
-			cerr << "Failed" << endl;
-			char * e = XMLString::transcode(sig->getErrMsgs());
-			cout << e << endl;
-			XSEC_RELEASE_XMLCH(e);
+
+		if (queue.getPendingCount() != count) {
+			cerr << "bad - operations not queued" << endl;
 			exit(1);
 		}
 
-		/*
+		queue.wait();
+
+		if (signResults.m_good != count || queue.getPendingCount() != 0) {
+			cerr << "bad - sign failed" << endl;
+			exit(1);
+		}
+
+		txts[count / 2]->setNodeValue(MAKE_UNICODE_STRING("A changed string"));
+
+		AsyncResultCounter verifyResults;
+		for (int i = 0; i < count; ++i)
+			sigs[i]->verifyAsync(queue, &verifyResults);
+
+		queue.wait();
+
+		if (verifyResults.m_good != count - 1 || verifyResults.m_bad != 1 ||
+			verifyResults.m_errors != 0) {
+
+			cerr << "bad - verify results wrong" << endl;
+			exit(1);
+
+		}
+
+		// The synchronous verify must agree with the queued one
+		for (int i = 0; i < count; ++i) {
+			if (sigs[i]->verify() != (i != count / 2)) {
+				cerr << "bad - async and sync verify disagree" << endl;
+				exit(1);
+			}
+		}
+
+	}
+	catch (const XSECException &e)
+	{
+		cerr << "An error occurred during signature processing\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
+	}
+	catch (const XSECCryptoException &e)
+	{
+		cerr << "A cryptographic error occurred during signature processing\n   Message: "
+		<< e.getMsg() << endl;
+		exit(1);
+	}
+
+	for (int i = 0; i < count; ++i) {
+		prov.releaseSignature(sigs[i]);
+		docs[i]->release();
+	}
+
+	cerr << "OK" << endl;
+
+}
+
+void unitTestArenaSignature(DOMImplementation * impl) {
+
+	// Sign and verify with the internal objects coming from an arena
+
+	cerr << "Signing and verifying with an arena ... ";
+
+	DOMDocument * doc = impl->createDocument();
+	XSECProvider prov;
+	DSIGSignature * sig = prov.newSignature();
+
+	try {
+
+		DOMElement * sigNode = sig->createBlankSignature(doc,
+			DSIGConstants::s_unicodeStrURIC14N_COM,
+			DSIGConstants::s_unicodeStrURIHMAC_SHA1);
+		doc->appendChild(sigNode);
+
+		DSIGObject * obj = sig->appendObject();
+		obj->setId(MAKE_UNICODE_STRING("ObjectId"));
+		obj->appendChild(doc->createTextNode(MAKE_UNICODE_STRING("A test string")));
+
+		sig->createReference(MAKE_UNICODE_STRING("#ObjectId"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+
+		XMLSize_t allocations, chunks;
+
+		{
+			XSECArena arena;
+			sig->sign();
+
+			allocations = arena.getAllocationCount();
+			chunks = arena.getChunkCount();
+		}
+
+		if (allocations == 0 || chunks == 0 || chunks >= allocations) {
+			cerr << "bad - arena not used" << endl;
+			exit(1);
+		}
+
+		bool result;
+		{
+			XSECArena arena;
+			result = sig->verify();
+		}
+
+		if (!result) {
+			cerr << "bad - verify failed" << endl;
+			exit(1);
+		}
+
+		cerr << allocations << " objects from " << chunks << " chunk(s) ... ";
+
+	}
+	catch (const XSECException &e)
+	{
+		cerr << "An error occurred during signature processing\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
+	}
+
+	prov.releaseSignature(sig);
+	doc->release();
+
+	cerr << "OK" << endl;
+
+}
+
+void unitTestPooledSignature(DOMImplementation * impl) {
+
+	// Sign a set of documents, then verify them with signature objects
+	// re-used from the provider's pool
+
+	cerr << "Re-using pooled signature objects ... ";
+
+	const int count = 4;
+	DOMDocument * docs[count];
+
+	XSECProvider prov;
+	prov.setPoolSize(1);
+
+	try {
+
+		DSIGSignature * first = NULL;
+
+		for (int i = 0; i < count; ++i) {
+
+			docs[i] = impl->createDocument();
+
+			DSIGSignature * sig = prov.newSignature();
+			if (i == 0)
+				first = sig;
+			else if (sig != first) {
+				cerr << "bad - pooled object not re-used" << endl;
+				exit(1);
+			}
+
+			DOMElement * sigNode = sig->createBlankSignature(docs[i],
+				DSIGConstants::s_unicodeStrURIC14N_COM,
+				DSIGConstants::s_unicodeStrURIHMAC_SHA1);
+			docs[i]->appendChild(sigNode);
+
+			DSIGObject * obj = sig->appendObject();
+			obj->setId(MAKE_UNICODE_STRING("ObjectId"));
+			obj->appendChild(docs[i]->createTextNode(MAKE_UNICODE_STRING("A test string")));
+
+			sig->createReference(MAKE_UNICODE_STRING("#ObjectId"),
+				DSIGConstants::s_unicodeStrURISHA1);
+			sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+			sig->sign();
+
+			prov.releaseSignature(sig);
+
+		}
+
+		for (int i = 0; i < count; ++i) {
+
+			DSIGSignature * sig = prov.newSignatureFromDOM(docs[i]);
+			if (sig != first) {
+				cerr << "bad - pooled object not re-used" << endl;
+				exit(1);
+			}
+
+			sig->load();
+
+			// The key must not survive a trip through the pool
+			bool haveKey = true;
+			try {
+				sig->verify();
+			}
+			catch (const XSECException &) {
+				haveKey = false;
+			}
+			if (haveKey) {
+				cerr << "bad - key kept by pooled object" << endl;
+				exit(1);
+			}
+
+			sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+			if (!sig->verify()) {
+				cerr << "bad - verify failed" << endl;
+				exit(1);
+			}
+
+			prov.releaseSignature(sig);
+
+		}
+
+	}
+	catch (const XSECException &e)
+	{
+		cerr << "An error occurred during signature processing\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
+	}
+
+	for (int i = 0; i < count; ++i)
+		docs[i]->release();
+
+	cerr << "OK" << endl;
+
+}
+
+void unitTestBase64(void) {
+
+	// Round trip every length either side of the vector block sizes, with
+	// and without whitespace and split input, then check bad padding and
+	// what the strict decoder rejects
+
+	cerr << "Base64 encoding and decoding ... ";
+
+	unsigned char raw[100];
+	unsigned char enc[200];
+	unsigned char spaced[400];
+	unsigned char dec[400];
+
+	for (unsigned int i = 0; i < 100; ++i)
+		raw[i] = (unsigned char) (i * 37 + 11);
+
+	try {
+
+		for (unsigned int len = 0; len < 100; ++len) {
+
+			XSCryptCryptoBase64 b64;
+
+			b64.encodeInit();
+			unsigned int encLen = b64.encode(raw, len, enc, 200);
+			encLen += b64.encodeFinish(&enc[encLen], 200 - encLen);
+
+			// Whitespace every seven characters, including inside what
+			// would otherwise be a full vector block
+			unsigned int spacedLen = 0;
+			for (unsigned int i = 0; i < encLen; ++i) {
+				if (i % 7 == 3) {
+					spaced[spacedLen++] = ' ';
+					spaced[spacedLen++] = '\t';
+					spaced[spacedLen++] = '\r';
+				}
+				spaced[spacedLen++] = enc[i];
+			}
+
+			for (int mode = 0; mode < 3; ++mode) {
+
+				const unsigned char * in = (mode == 0 ? enc : spaced);
+				unsigned int inLen = (mode == 0 ? encLen : spacedLen);
+				unsigned int decLen = 0;
+
+				b64.decodeInit();
+				if (mode == 2) {
+					for (unsigned int i = 0; i < inLen; ++i)
+						decLen += b64.decode(&in[i], 1, &dec[decLen], 400 - decLen);
+				}
+				else
+					decLen = b64.decode(in, inLen, dec, 400);
+				decLen += b64.decodeFinish(&dec[decLen], 400 - decLen);
+
+				if (decLen != len || memcmp(dec, raw, len) != 0) {
+					cerr << "bad - round trip failed at length " << len << endl;
+					exit(1);
+				}
+
+				if (mode != 2) {
+
+					decLen = XSCryptCryptoBase64::decodeStrict(in, inLen, dec, 400);
+
+					if (decLen != len || memcmp(dec, raw, len) != 0) {
+						cerr << "bad - strict decode failed at length " << len << endl;
+						exit(1);
+					}
+
+				}
+
+			}
+
+		}
+
+		if (XSCryptCryptoBase64::decodeStrict((const unsigned char *) "QUI=\n", 5, dec, 400) != 2 ||
+			memcmp(dec, "AB", 2) != 0) {
+			cerr << "bad - strict decode of padded group failed" << endl;
+			exit(1);
+		}
+
+	}
+	catch (const XSECCryptoException &e) {
+		cerr << "bad - " << e.getMsg() << endl;
+		exit(1);
+	}
+
+	static const char * badPadding[] = {"=AAA", "A===", "QUJD=AAA", NULL};
+
+	for (int i = 0; badPadding[i] != NULL; ++i) {
+
+		XSCryptCryptoBase64 b64;
+		bool thrown = false;
+
+		try {
+			b64.decodeInit();
+			unsigned int n = b64.decode((const unsigned char *) badPadding[i],
+				(unsigned int) strlen(badPadding[i]), dec, 400);
+			b64.decodeFinish(&dec[n], 400 - n);
+		}
+		catch (const XSECCryptoException &) {
+			thrown = true;
+		}
+
+		if (!thrown) {
+			cerr << "bad - accepted \"" << badPadding[i] << "\"" << endl;
+			exit(1);
+		}
+
+	}
+
+	static const char * badStrict[] = {"QUJD\x01", "QU*D", "QUJD=AAA", "QQ=A",
+		"A===", "QUI=QUI=", "QUJ", NULL};
+
+	for (int i = 0; badStrict[i] != NULL; ++i) {
+
+		bool thrown = false;
+
+		try {
+			XSCryptCryptoBase64::decodeStrict((const unsigned char *) badStrict[i],
+				(unsigned int) strlen(badStrict[i]), dec, 400);
+		}
+		catch (const XSECCryptoException &) {
+			thrown = true;
+		}
+
+		if (!thrown) {
+			cerr << "bad - strict decoder accepted \"" << badStrict[i] << "\"" << endl;
+			exit(1);
+		}
+
+	}
+
+	cerr << "OK" << endl;
+
+}
+
+void unitTestUTF8(void) {
+
+	// Check the UTF-16 to UTF-8 conversion used in place of a formatter
+
+	cerr << "Converting between UTF-16 and UTF-8 ... ";
+
+	// ASCII run, e-acute, euro, a surrogate pair (U+1F600) and more ASCII
+	static const XMLCh in[] = {
+		chLatin_S, chLatin_i, chLatin_g, chLatin_n, chLatin_e, chLatin_d, chSpace,
+		0x00E9, 0x20AC, 0xD83D, 0xDE00, chLatin_O, chLatin_K, chNull
+	};
+	static const unsigned char expected[] = {
+		'S', 'i', 'g', 'n', 'e', 'd', ' ',
+		0xC3, 0xA9, 0xE2, 0x82, 0xAC, 0xF0, 0x9F, 0x98, 0x80, 'O', 'K', 0
+	};
+
+	safeBuffer out;
+	out.sbUTF8In(in);
+
+	if (strcmp(out.rawCharBuffer(), (const char *) expected) != 0) {
+		cerr << "bad - incorrect UTF-8" << endl;
+		exit(1);
+	}
+
+	XSECSafeBufferFormatter formatter("UTF-8", XMLFormatter::NoEscapes, XMLFormatter::UnRep_CharRef);
+	safeBuffer formatted;
+	formatted << (formatter << in);
+
+	if (strcmp(formatted.rawCharBuffer(), (const char *) expected) != 0) {
+		cerr << "bad - formatter output differs" << endl;
+		exit(1);
+	}
+
+	safeBuffer back;
+	back.sbXMLChIn(DSIGConstants::s_unicodeStrEmpty);
+	back.sbXMLChCat8(out.rawCharBuffer());
+
+	if (!XMLString::equals(back.rawXMLChBuffer(), in)) {
+		cerr << "bad - round trip failed" << endl;
+		exit(1);
+	}
+
+	cerr << "OK" << endl;
+
+}
+
+void unitTestMetrics(DOMImplementation * impl) {
+
+	// Sign and verify with a metrics sink registered, and check the
+	// stages were recorded
+
+	cerr << "Collecting metrics for sign and verify ... ";
+
+	XSECMetrics metrics;
+	XSECPlatformUtils::SetMetricsSink(&metrics);
+
+	DOMDocument * doc = impl->createDocument();
+	XSECProvider prov;
+	DSIGSignature * sig = prov.newSignature();
+
+	try {
+
+		DOMElement * sigNode = sig->createBlankSignature(doc,
+			DSIGConstants::s_unicodeStrURIC14N_COM,
+			DSIGConstants::s_unicodeStrURIHMAC_SHA1);
+		doc->appendChild(sigNode);
+
+		DSIGObject * obj = sig->appendObject();
+		obj->setId(MAKE_UNICODE_STRING("ObjectId"));
+		obj->appendChild(doc->createTextNode(MAKE_UNICODE_STRING("A test string")));
+
+		sig->createReference(MAKE_UNICODE_STRING("#ObjectId"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+
+		sig->sign();
+		bool result = sig->verify();
+
+		XSECPlatformUtils::SetMetricsSink(NULL);
+
+		if (!result) {
+			cerr << "bad - verify failed" << endl;
+			exit(1);
+		}
+
+		XSECMetricStatistics s;
+		XSECMetricStage stages[] = {XSEC_METRIC_TRANSFORM_CHAIN, XSEC_METRIC_C14N,
+			XSEC_METRIC_DIGEST, XSEC_METRIC_SIGN, XSEC_METRIC_VERIFY};
+
+		for (unsigned int i = 0; i < sizeof(stages) / sizeof(XSECMetricStage); ++i) {
+
+			metrics.getStatistics(stages[i], s);
+			if (s.count == 0) {
+				cerr << "bad - nothing recorded for " << XSECMetrics::getStageName(stages[i]) << endl;
+				exit(1);
+			}
+
+		}
+
+		metrics.getStatistics(XSEC_METRIC_C14N, s);
+		if (s.bytes == 0) {
+			cerr << "bad - no canonicalised bytes counted" << endl;
+			exit(1);
+		}
+
+		XMLUInt64 inBuckets = 0;
+		for (unsigned int i = 0; i < XSEC_METRIC_BUCKET_COUNT; ++i)
+			inBuckets += s.buckets[i];
+
+		if (inBuckets != s.count) {
+			cerr << "bad - histogram does not match count" << endl;
+			exit(1);
+		}
+
+		if (!metrics.getStatistics(XSEC_METRIC_VERIFY, DSIGConstants::s_unicodeStrURIHMAC_SHA1, s) ||
+			s.count != 1) {
+			cerr << "bad - no per-algorithm breakdown" << endl;
+			exit(1);
+		}
+
+	}
+	catch (const XSECException &e)
+	{
+		XSECPlatformUtils::SetMetricsSink(NULL);
+		cerr << "An error occurred during signature processing\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
+	}
+
+	prov.releaseSignature(sig);
+	doc->release();
+
+	cerr << "OK" << endl;
+
+}
+
+// Counts allocations made through the Xerces memory manager while it
+// is installed
+
+class CountingMemoryManager : public MemoryManager {
+
+public:
+
+	CountingMemoryManager() :
+		mp_parent(XMLPlatformUtils::fgMemoryManager), m_count(0) {
+		XMLPlatformUtils::fgMemoryManager = this;
+	}
+
+	virtual ~CountingMemoryManager() {
+		XMLPlatformUtils::fgMemoryManager = mp_parent;
+	}
+
+	virtual MemoryManager * getExceptionMemoryManager() {
+		return mp_parent->getExceptionMemoryManager();
+	}
+
+	virtual void * allocate(XMLSize_t size) {
+		++m_count;
+		return mp_parent->allocate(size);
+	}
+
+	virtual void deallocate(void * p) {
+		mp_parent->deallocate(p);
+	}
+
+	unsigned int getCount(void) const {return m_count;}
+
+private:
+
+	MemoryManager	* mp_parent;
+	unsigned int	m_count;
+
+};
+
+void unitTestStrEquals(DOMImplementation * impl) {
+
+	cerr << "Comparing XMLCh strings with literals ... ";
+
+	XMLT signedInfo("SignedInfo");
+	XMLT signedInf("SignedInf");
+	XMLT empty("");
+
+	const XMLCh * nullStr = NULL;
+
+	bool ok =
+		strEquals(signedInfo.getUnicodeStr(), "SignedInfo") &&
+		strEquals("SignedInfo", signedInfo.getUnicodeStr()) &&
+		strEquals(empty.getUnicodeStr(), "") &&
+		strEquals(nullStr, "") &&
+		!strEquals(nullStr, "SignedInfo") &&
+		!strEquals(signedInfo.getUnicodeStr(), (const char *) NULL) &&
+		!strEquals(empty.getUnicodeStr(), "SignedInfo") &&
+		!strEquals(signedInfo.getUnicodeStr(), "") &&
+		// Same prefix, different lengths
+		!strEquals(signedInf.getUnicodeStr(), "SignedInfo") &&
+		!strEquals(signedInfo.getUnicodeStr(), "SignedInf") &&
+		!strEquals(signedInfo.getUnicodeStr(), "SignedInfoX");
+
+	if (!ok) {
+		cerr << "failed - ASCII comparison" << endl;
+		exit(1);
+	}
+
+	// Literals outside ASCII go through the transcoder.  Only check this
+	// where the local code page can round trip the literal.
+
+	const char * nonASCII = "Sign\xe9";
+	XMLCh * nonASCIIXMLCh = XMLString::transcode(nonASCII);
+	char * back = (nonASCIIXMLCh != NULL ? XMLString::transcode(nonASCIIXMLCh) : NULL);
+
+	if (back != NULL && strcmp(back, nonASCII) == 0) {
+
+		XMLT sign("Sign");
+		XMLT signe("Signe");
+
+		ok =
+			strEquals(nonASCIIXMLCh, nonASCII) &&
+			!strEquals(sign.getUnicodeStr(), nonASCII) &&
+			!strEquals(signe.getUnicodeStr(), nonASCII) &&
+			!strEquals(nonASCIIXMLCh, "Sign") &&
+			!strEquals(nonASCIIXMLCh, "Sign\xe9X");
+
+		if (!ok) {
+			cerr << "failed - non-ASCII comparison" << endl;
+			exit(1);
+		}
+
+	}
+
+	XSEC_RELEASE_XMLCH(back);
+	XSEC_RELEASE_XMLCH(nonASCIIXMLCh);
+
+	// The ASCII path must not allocate
+
+	{
+		CountingMemoryManager counter;
+		for (int i = 0; i < 1000; ++i) {
+			ok = strEquals(signedInfo.getUnicodeStr(), "SignedInfo") &&
+				!strEquals(signedInf.getUnicodeStr(), "SignedInfo");
+		}
+
+		if (!ok || counter.getCount() != 0) {
+			cerr << "failed - " << counter.getCount() << " allocations for ASCII comparisons" << endl;
+			exit(1);
+		}
+	}
+
+	// Report the allocations made loading a small signature
+
+	DOMDocument * doc = impl->createDocument();
+	XSECProvider prov;
+	DSIGSignature * sig = prov.newSignature();
+
+	try {
+
+		DOMElement * sigNode = sig->createBlankSignature(doc,
+			DSIGConstants::s_unicodeStrURIC14N_COM,
+			DSIGConstants::s_unicodeStrURIHMAC_SHA1);
+		doc->appendChild(sigNode);
+
+		DSIGObject * obj = sig->appendObject();
+		obj->setId(MAKE_UNICODE_STRING("ObjectId"));
+		obj->appendChild(doc->createTextNode(MAKE_UNICODE_STRING("A test string")));
+
+		sig->createReference(MAKE_UNICODE_STRING("#ObjectId"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		sig->appendKeyName(MAKE_UNICODE_STRING("secret"));
+		sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+		sig->sign();
+
+		prov.releaseSignature(sig);
+		sig = prov.newSignatureFromDOM(doc, sigNode);
+
+		unsigned int count;
+		{
+			CountingMemoryManager counter;
+			sig->load();
+			count = counter.getCount();
+		}
+
+		cerr << count << " allocations in DSIGSignature::load() ... ";
+
+	}
+	catch (const XSECException &e)
+	{
+		cerr << "An error occurred during signature processing\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
+	}
+
+	prov.releaseSignature(sig);
+	doc->release();
+
+	cerr << "OK" << endl;
+
+}
+
+void unitTestLazyLoad(DOMImplementation * impl) {
+
+	// Sign with a KeyInfo that cannot be loaded (it is not covered by the
+	// signature), and check that lazy loading only reports it on use
+
+	cerr << "Lazy loading of KeyInfo and Objects ... ";
+
+	DOMDocument * doc = impl->createDocument();
+	XSECProvider prov;
+	DSIGSignature * sig = prov.newSignature();
+
+	try {
+
+		DOMElement * sigNode = sig->createBlankSignature(doc,
+			DSIGConstants::s_unicodeStrURIC14N_COM,
+			DSIGConstants::s_unicodeStrURIHMAC_SHA1);
+		doc->appendChild(sigNode);
+
+		DSIGObject * obj = sig->appendObject();
+		obj->setId(MAKE_UNICODE_STRING("ObjectId"));
+		obj->appendChild(doc->createTextNode(MAKE_UNICODE_STRING("A test string")));
+
+		sig->createReference(MAKE_UNICODE_STRING("#ObjectId"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		sig->appendKeyName(MAKE_UNICODE_STRING("secret"));
+		sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+		sig->sign();
+
+		prov.releaseSignature(sig);
+		sig = NULL;
+
+		DOMElement * keyInfo = (DOMElement *) doc->getElementsByTagNameNS(
+			DSIGConstants::s_unicodeStrURIDSIG, MAKE_UNICODE_STRING("KeyInfo"))->item(0);
+		DOMElement * rm = doc->createElementNS(DSIGConstants::s_unicodeStrURIDSIG,
+			MAKE_UNICODE_STRING("RetrievalMethod"));
+		rm->setAttributeNS(NULL, MAKE_UNICODE_STRING("Bogus"), MAKE_UNICODE_STRING("1"));
+		keyInfo->appendChild(rm);
+
+		// Eager loading fails straight away
+		bool failed = false;
+		sig = prov.newSignatureFromDOM(doc, sigNode);
+		try {
+			sig->load();
+		}
+		catch (const XSECException &) {
+			failed = true;
+		}
+		prov.releaseSignature(sig);
+		sig = NULL;
+
+		if (!failed) {
+			cerr << "bad - bad KeyInfo not detected by load()" << endl;
+			exit(1);
+		}
+
+		// Lazy loading can check the signature with a known key
+		sig = prov.newSignatureFromDOM(doc, sigNode);
+		sig->setLazyLoad(true);
+		sig->load();
+		sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+
+		if (!sig->verifySignatureOnly()) {
+			cerr << "bad - lazily loaded signature failed to verify" << endl;
+			exit(1);
+		}
+
+		if (sig->getObjectLength() != 1) {
+			cerr << "bad - Object not loaded on use" << endl;
+			exit(1);
+		}
+
+		// ... and the error surfaces on use, every time
+		for (int i = 0; i < 2; ++i) {
+
+			failed = false;
+			try {
+				sig->getKeyInfoList();
+			}
+			catch (const XSECException &e) {
+				failed = (e.getType() == XSECException::UnknownDSIGAttribute);
+			}
+
+			if (!failed) {
+				cerr << "bad - KeyInfo error not reported on use" << endl;
+				exit(1);
+			}
+
+		}
+
+	}
+	catch (const XSECException &e)
+	{
+		cerr << "An error occurred during signature processing\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
+	}
+
+	if (sig != NULL)
+		prov.releaseSignature(sig);
+	doc->release();
+
+	cerr << "OK" << endl;
+
+}
+
+void unitTestFailFast(DOMImplementation * impl) {
+
+	cerr << "Fail fast verification ... ";
+
+	DOMDocument * doc = impl->createDocument();
+	XSECProvider prov;
+	DSIGSignature * sig = prov.newSignature();
+	XSECMetrics metrics;
+
+	try {
+
+		DOMElement * sigNode = sig->createBlankSignature(doc,
+			DSIGConstants::s_unicodeStrURIC14N_COM,
+			DSIGConstants::s_unicodeStrURIHMAC_SHA1);
+		doc->appendChild(sigNode);
+
+		DSIGObject * obj = sig->appendObject();
+		obj->setId(MAKE_UNICODE_STRING("ObjectId"));
+		obj->appendChild(doc->createTextNode(MAKE_UNICODE_STRING("A test string")));
+		obj = sig->appendObject();
+		obj->setId(MAKE_UNICODE_STRING("ObjectId2"));
+		obj->appendChild(doc->createTextNode(MAKE_UNICODE_STRING("Another test string")));
+
+		sig->createReference(MAKE_UNICODE_STRING("#ObjectId"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		sig->createReference(MAKE_UNICODE_STRING("#ObjectId2"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+		sig->sign();
+
+		prov.releaseSignature(sig);
+
+		sig = prov.newSignatureFromDOM(doc, sigNode);
+		sig->load();
+		sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+		sig->setVerificationPolicy(DSIGSignature::VERIFY_FAIL_FAST);
+
+		if (!sig->verify()) {
+			cerr << "bad - good signature failed to verify" << endl;
+			exit(1);
+		}
+
+		// Too many references fails before anything is digested
+		sig->setReferenceLimits(1, 0);
+		if (sig->verify()) {
+			cerr << "bad - reference limit ignored" << endl;
+			exit(1);
+		}
+		sig->setReferenceLimits(0, 0);
+
+		// A bad SignatureValue is found without digesting the references
+		prov.releaseSignature(sig);
+
+		doc->getElementsByTagNameNS(DSIGConstants::s_unicodeStrURIDSIG,
+			MAKE_UNICODE_STRING("SignatureValue"))->item(0)->getFirstChild()->setNodeValue(
+			MAKE_UNICODE_STRING("AAAAAAAAAAAAAAAAAAAAAAAAAAA="));
+
+		sig = prov.newSignatureFromDOM(doc, sigNode);
+		sig->load();
+		sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+		sig->setVerificationPolicy(DSIGSignature::VERIFY_FAIL_FAST);
+
+		XSECPlatformUtils::SetMetricsSink(&metrics);
+		bool result = sig->verify();
+		XSECPlatformUtils::SetMetricsSink(NULL);
+
+		XSECMetricStatistics s;
+		metrics.getStatistics(XSEC_METRIC_TRANSFORM_CHAIN, s);
+
+		if (result || s.count != 0) {
+			cerr << "bad - references checked after a bad SignatureValue" << endl;
+			exit(1);
+		}
+
+		// ... whereas the full policy still checks them
+		sig->setVerificationPolicy(DSIGSignature::VERIFY_FULL);
+
+		XSECPlatformUtils::SetMetricsSink(&metrics);
+		result = sig->verify();
+		XSECPlatformUtils::SetMetricsSink(NULL);
+
+		metrics.getStatistics(XSEC_METRIC_TRANSFORM_CHAIN, s);
+
+		if (result || s.count != 2) {
+			cerr << "bad - full verification did not check every reference" << endl;
+			exit(1);
+		}
+
+	}
+	catch (const XSECException &e)
+	{
+		XSECPlatformUtils::SetMetricsSink(NULL);
+		cerr << "An error occurred during signature processing\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
+	}
+
+	prov.releaseSignature(sig);
+	doc->release();
+
+	cerr << "OK" << endl;
+
+}
+
+// Sign, and return how many Reference transform chains were built doing so
+
+unsigned int signCountingReferences(DSIGSignature * sig) {
+
+	XSECMetrics metrics;
+	XSECMetricStatistics s;
+
+	XSECPlatformUtils::SetMetricsSink(&metrics);
+	try {
+		sig->sign();
+	}
+	catch (...) {
+		XSECPlatformUtils::SetMetricsSink(NULL);
+		throw;
+	}
+	XSECPlatformUtils::SetMetricsSink(NULL);
+
+	metrics.getStatistics(XSEC_METRIC_TRANSFORM_CHAIN, s);
+	return (unsigned int) s.count;
+
+}
+
+bool verifyFromDOM(XSECProvider & prov, DOMDocument * doc, DOMElement * sigNode) {
+
+	DSIGSignature * sig = prov.newSignatureFromDOM(doc, sigNode);
+	sig->load();
+	sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+	bool ret = sig->verify();
+	prov.releaseSignature(sig);
+
+	return ret;
+
+}
+
+void unitTestIncrementalSign(DOMImplementation * impl) {
+
+	cerr << "Incremental signing ... ";
+
+	DOMDocument * doc = impl->createDocument();
+	XSECProvider prov;
+	DSIGSignature * sig = prov.newSignature();
+
+	try {
+
+		DOMElement * sigNode = sig->createBlankSignature(doc,
+			DSIGConstants::s_unicodeStrURIC14N_COM,
+			DSIGConstants::s_unicodeStrURIHMAC_SHA1);
+		doc->appendChild(sigNode);
+
+		DSIGObject * obj = sig->appendObject();
+		obj->setId(MAKE_UNICODE_STRING("ObjectId"));
+		obj->appendChild(doc->createTextNode(MAKE_UNICODE_STRING("A test string")));
+		obj = sig->appendObject();
+		obj->setId(MAKE_UNICODE_STRING("ObjectId2"));
+		DOMText * text = doc->createTextNode(MAKE_UNICODE_STRING("Another test string"));
+		obj->appendChild(text);
+
+		sig->createReference(MAKE_UNICODE_STRING("#ObjectId"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		DSIGReference * ref = sig->createReference(MAKE_UNICODE_STRING("#ObjectId2"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		DSIGTransformC14n * c14n = ref->appendCanonicalizationTransform(
+			DSIGConstants::s_unicodeStrURIC14N_NOC);
+		sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+		sig->setIncrementalSign(true);
+
+		// Everything is hashed the first time round
+		if (signCountingReferences(sig) != 2) {
+			cerr << "bad - first signature did not hash every reference" << endl;
+			exit(1);
+		}
+
+		// ... and nothing when nothing has changed
+		if (signCountingReferences(sig) != 0 || !verifyFromDOM(prov, doc, sigNode)) {
+			cerr << "bad - unchanged references hashed again" << endl;
+			exit(1);
+		}
+
+		// Only the changed reference is hashed
+		text->setNodeValue(MAKE_UNICODE_STRING("A changed test string"));
+		sig->markDirty(text);
+
+		if (signCountingReferences(sig) != 1 || !verifyFromDOM(prov, doc, sigNode)) {
+			cerr << "bad - changed reference not re-signed correctly" << endl;
+			exit(1);
+		}
+
+		// Changing a transform through the API needs no markDirty()
+		c14n->setCanonicalizationMethod(DSIGConstants::s_unicodeStrURIEXC_C14N_NOC);
+
+		if (signCountingReferences(sig) != 1 || !verifyFromDOM(prov, doc, sigNode)) {
+			cerr << "bad - changed transform not re-signed correctly" << endl;
+			exit(1);
+		}
+
+		c14n->addInclusiveNamespace("ds");
+
+		if (signCountingReferences(sig) != 1 || !verifyFromDOM(prov, doc, sigNode)) {
+			cerr << "bad - changed inclusive namespaces not re-signed correctly" << endl;
+			exit(1);
+		}
+
+		// A change above both references affects both
+		sig->markDirty(sigNode);
+
+		if (signCountingReferences(sig) != 2) {
+			cerr << "bad - change to an ancestor ignored" << endl;
+			exit(1);
+		}
+
+		// Turning it off hashes everything as before
+		sig->setIncrementalSign(false);
+
+		if (signCountingReferences(sig) != 2 || !verifyFromDOM(prov, doc, sigNode)) {
+			cerr << "bad - full signature did not hash every reference" << endl;
+			exit(1);
+		}
+
+	}
+	catch (const XSECException &e)
+	{
+		cerr << "An error occurred during signature processing\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
+	}
+
+	prov.releaseSignature(sig);
+	doc->release();
+
+	cerr << "OK" << endl;
+
+}
+
+// Remembers which events were seen, and whether they were attributed to
+// the expected Reference
+
+class TraceCounter : public XSECTraceSink {
+
+public:
+
+	TraceCounter(const XMLCh * reference) :
+		mp_reference(reference), m_references(0), m_hashes(0), m_c14n(0),
+		m_verify(0), m_unattributed(0) {}
+
+	virtual void traceEvent(const char * name, const XMLCh * reference,
+		const XMLCh *, XMLUInt64, XMLUInt64) {
+
+		bool inReference = false;
+
+		if (strcmp(name, "reference") == 0) {
+			++m_references;
+			inReference = true;
+		}
+		else if (strcmp(name, "hash") == 0) {
+			++m_hashes;
+			inReference = true;
+		}
+		else if (strcmp(name, "c14n") == 0 && reference != NULL)
+			++m_c14n;
+		else if (strcmp(name, "verify") == 0)
+			++m_verify;
+
+		if (inReference && !XMLString::equals(reference, mp_reference))
+			++m_unattributed;
+
+	}
+
+	const XMLCh			* mp_reference;
+	int					m_references;
+	int					m_hashes;
+	int					m_c14n;
+	int					m_verify;
+	int					m_unattributed;
+
+};
+
+void unitTestTrace(DOMImplementation * impl) {
+
+	cerr << "Tracing sign and verify ... ";
+
+	TraceCounter trace(MAKE_UNICODE_STRING("#ObjectId"));
+	XSECPlatformUtils::SetTraceSink(&trace);
+
+	DOMDocument * doc = impl->createDocument();
+	XSECProvider prov;
+	DSIGSignature * sig = prov.newSignature();
+
+	try {
+
+		DOMElement * sigNode = sig->createBlankSignature(doc,
+			DSIGConstants::s_unicodeStrURIC14N_COM,
+			DSIGConstants::s_unicodeStrURIHMAC_SHA1);
+		doc->appendChild(sigNode);
+
+		DSIGObject * obj = sig->appendObject();
+		obj->setId(MAKE_UNICODE_STRING("ObjectId"));
+		obj->appendChild(doc->createTextNode(MAKE_UNICODE_STRING("A test string")));
+
+		sig->createReference(MAKE_UNICODE_STRING("#ObjectId"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+
+		sig->sign();
+		bool result = sig->verify();
+
+		XSECPlatformUtils::SetTraceSink(NULL);
+
+		if (!result) {
+			cerr << "bad - verify failed" << endl;
+			exit(1);
+		}
+
+		// One Reference digested on signing and again on verifying
+		if (trace.m_references != 2 || trace.m_hashes != 2 || trace.m_c14n == 0 ||
+			trace.m_verify != 1) {
+			cerr << "bad - expected events not seen" << endl;
+			exit(1);
+		}
+
+		if (trace.m_unattributed != 0) {
+			cerr << "bad - events not attributed to the Reference" << endl;
+			exit(1);
+		}
+
+	}
+	catch (const XSECException &e)
+	{
+		XSECPlatformUtils::SetTraceSink(NULL);
+		cerr << "An error occurred during signature processing\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
+	}
+
+	prov.releaseSignature(sig);
+	doc->release();
+
+	cerr << "OK" << endl;
+
+}
+
+void unitTestSignature(DOMImplementation * impl) {
+
+	// Check parallel canonicalisation matches the serial output
+	unitTestParallelC14n(impl);
+
+	// Test an enveloping signature
+	unitTestEnvelopingSignature(impl);
+
+	// Batch sign and verify through a queue
+	unitTestAsyncSignature(impl);
+
+	// Per-operation arena
+	unitTestArenaSignature(impl);
+
+	// Re-use of objects through the provider
+	unitTestPooledSignature(impl);
+
+	// String conversion used throughout
+	unitTestUTF8();
+
+	// Base64 codec
+	unitTestBase64();
+
+	// Timers and counters
+	unitTestMetrics(impl);
+
+	// Trace events
+	unitTestTrace(impl);
+
+	// String comparisons against literals
+	unitTestStrEquals(impl);
+
+	// Deferred loading of KeyInfo and Objects
+	unitTestLazyLoad(impl);
+
+	// Verification policies
+	unitTestFailFast(impl);
+
+	// Re-signing only what has changed
+	unitTestIncrementalSign(impl);
+
+#ifdef XSEC_HAVE_XALAN
+	unitTestBase64NodeSignature(impl);
+#else
+	cerr << "Skipping base64 node test (Requires XPath)" << endl;
+#endif
+
+	// Test "long" sha hashes
+	if (XSECPlatformUtils::g_cryptoProvider->algorithmSupported(XSECCryptoHash::HASH_SHA512))
+		unitTestLongSHA(impl);
+	else
+		cerr << "Skipping long SHA hash tests as SHA512 not supported by crypto provider" << endl;
+
+	// Test RSA Signatures
+	unitTestRSA(impl);
+
+    // Test EC Signatures
+    unitTestEC(impl);
+}
+
+// --------------------------------------------------------------------------------
+//           Basic tests of signature function
+// --------------------------------------------------------------------------------
+
+void serialiseToBuffer(DOMImplementation *impl, DOMNode * doc, safeBuffer &sb, XMLSize_t &len) {
+
+	MemBufFormatTarget formatTarget;
+
+	DOMLSSerializer   *theSerializer = ((DOMImplementationLS*)impl)->createLSSerializer();
+	Janitor<DOMLSSerializer> j_theSerializer(theSerializer);
+
+	theSerializer->getDomConfig()->setParameter(XMLUni::fgDOMWRTFormatPrettyPrint, false);
+
+	DOMLSOutput *theOutput = ((DOMImplementationLS*)impl)->createLSOutput();
+	Janitor<DOMLSOutput> j_theOutput(theOutput);
+
+	theOutput->setEncoding(MAKE_UNICODE_STRING("UTF-8"));
+	theOutput->setByteStream(&formatTarget);
+
+	theSerializer->write(doc, theOutput);
+
+	len = formatTarget.getLen();
+	sb.sbMemcpyIn(formatTarget.getRawBuffer(), len);
+
+}
+
+void testSignature(DOMImplementation *impl) {
+
+	cerr << "Creating a known doc and signing (HMAC-SHA1)" << endl;
+	
+	// Create a document
+    
+	DOMDocument * doc = createTestDoc(impl);
+
+	// Check signature functions
+
+	XSECProvider prov;
+	DSIGSignature *sig;
+	DSIGReference *ref[10];
+	DOMElement *sigNode;
+	int refCount;
+
+	try {
+		
+		/*
+		 * Now we have a document, create a signature for it.
+		 */
+		
+		sig = prov.newSignature();
+		sig->setDSIGNSPrefix(MAKE_UNICODE_STRING("ds"));
+		sig->setPrettyPrint(true);
+
+		sigNode = sig->createBlankSignature(doc, 
+			DSIGConstants::s_unicodeStrURIC14N_COM,
+			DSIGConstants::s_unicodeStrURIHMAC_SHA1);
+		DOMElement * rootElem = doc->getDocumentElement();
+		DOMNode * prodElem = rootElem->getFirstChild();
+
+		rootElem->appendChild(doc->createTextNode(DSIGConstants::s_unicodeStrNL));
+		rootElem->insertBefore(doc->createComment(MAKE_UNICODE_STRING(" a comment ")), prodElem);
+		rootElem->appendChild(sigNode);
+		rootElem->insertBefore(doc->createTextNode(DSIGConstants::s_unicodeStrNL), prodElem);
+
+		/*
+		 * Add some test references
+		 */
+
+		ref[0] = sig->createReference(MAKE_UNICODE_STRING(""),
+			DSIGConstants::s_unicodeStrURISHA1);
+		ref[0]->appendEnvelopedSignatureTransform();
+
+		ref[1] = sig->createReference(MAKE_UNICODE_STRING("#xpointer(/)"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		ref[1]->appendEnvelopedSignatureTransform();
+		ref[1]->appendCanonicalizationTransform(DSIGConstants::s_unicodeStrURIC14N_NOC);
+
+		ref[2] = sig->createReference(MAKE_UNICODE_STRING("#xpointer(/)"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		ref[2]->appendEnvelopedSignatureTransform();
+		ref[2]->appendCanonicalizationTransform(DSIGConstants::s_unicodeStrURIC14N_COM);
+
+		ref[3] = sig->createReference(MAKE_UNICODE_STRING("#xpointer(/)"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		ref[3]->appendEnvelopedSignatureTransform();
+		ref[3]->appendCanonicalizationTransform(DSIGConstants::s_unicodeStrURIEXC_C14N_NOC);
+
+		ref[4] = sig->createReference(MAKE_UNICODE_STRING("#xpointer(/)"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		ref[4]->appendEnvelopedSignatureTransform();
+		ref[4]->appendCanonicalizationTransform(DSIGConstants::s_unicodeStrURIEXC_C14N_COM);
+
+		ref[5] = sig->createReference(MAKE_UNICODE_STRING("#xpointer(/)"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		ref[5]->appendEnvelopedSignatureTransform();
+		DSIGTransformC14n * ce = ref[5]->appendCanonicalizationTransform(
+			DSIGConstants::s_unicodeStrURIEXC_C14N_COM);
+		ce->addInclusiveNamespace("foo");
+
+		sig->setECNSPrefix(MAKE_UNICODE_STRING("ec"));
+		ref[6] = sig->createReference(MAKE_UNICODE_STRING("#xpointer(/)"),
+			DSIGConstants::s_unicodeStrURISHA1);
+		ref[6]->appendEnvelopedSignatureTransform();
+		ce = ref[6]->appendCanonicalizationTransform(
+			DSIGConstants::s_unicodeStrURIEXC_C14N_COM);
+		ce->addInclusiveNamespace("foo");
+
+#ifndef XSEC_HAVE_XALAN
+
+		cerr << "WARNING : No testing of XPath being performed as Xalan not present" << endl;
+		refCount = 7;
+
+#else
+		/*
+		 * Create some XPath/XPathFilter references
+		 */
+
+
+		ref[7] = sig->createReference(MAKE_UNICODE_STRING(""),
+			DSIGConstants::s_unicodeStrURISHA1);
+		sig->setXPFNSPrefix(MAKE_UNICODE_STRING("xpf"));
+		DSIGTransformXPathFilter * xpf = ref[7]->appendXPathFilterTransform();
+		xpf->appendFilter(DSIGXPathFilterExpr::FILTER_INTERSECT, MAKE_UNICODE_STRING("//ADoc/category"));
+
+		ref[8] = sig->createReference(MAKE_UNICODE_STRING(""),
+			DSIGConstants::s_unicodeStrURISHA1);
+		/*		ref[5]->appendXPathTransform("ancestor-or-self::dsig:Signature", 
+				"xmlns:dsig=http://www.w3.org/2000/09/xmldsig#"); */
+
+		DSIGTransformXPath * x = ref[8]->appendXPathTransform("count(ancestor-or-self::dsig:Signature | \
+here()/ancestor::dsig:Signature[1]) > \
+count(ancestor-or-self::dsig:Signature)");
+		x->setNamespace("dsig", "http://www.w3.org/2000/09/xmldsig#");
+
+		refCount = 9;
+
+#endif
+	
+		/*
+		 * Sign the document, using an HMAC algorithm and the key "secret"
+		 */
+
+
+		sig->appendKeyName(MAKE_UNICODE_STRING("The secret key is \"secret\""));
+
+		// Append a test DNames
+
+		DSIGKeyInfoX509 * x509 = sig->appendX509Data();
+		x509->setX509SubjectName(s_tstDName);
+
+		// Append a test PGPData element
+		sig->appendPGPData(s_tstPGPKeyID, s_tstPGPKeyPacket);
+
+		// Append an SPKIData element
+		DSIGKeyInfoSPKIData * spki = sig->appendSPKIData(s_tstSexp1);
+		spki->appendSexp(s_tstSexp2);
+
+		// Append a MgmtData element
+		sig->appendMgmtData(s_tstMgmtData);
+
+		sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+		sig->sign();
+
+		// Output the document post signature if necessary
+		outputDoc(impl, doc);
+
+		cerr << endl << "Doc signed OK - Checking values against Known Good" << endl;
+
+		unsigned char buf[128];
+		XMLSize_t len;
+
+		/*
+		 * Validate the reference hash values from known good
+		 */
+
+		int i;
+		for (i = 0; i < refCount; ++i) {
+
+			cerr << "Calculating hash for reference " << i << " ... ";
+
+			len = (int) ref[i]->calculateHash(buf, 128);
+
+			cerr << " Done\nChecking -> ";
+
+			if (len != 20) {
+				cerr << "Bad (Length = " << len << ")" << endl;
+				exit (1);
+			}
+
+			for (int j = 0; j < 20; ++j) {
+
+				if (buf[j] != createdDocRefs[i][j]) {
+					cerr << "Bad at location " << j << endl;
+					exit (1);
+				}
+			
+			}
+			cerr << "Good.\n";
+
+		}
+
+		/*
+		 * Verify the signature check works
+		 */
+
+		cerr << "Running \"verifySignatureOnly()\" on calculated signature ... ";
+		if (sig->verifySignatureOnly()) {
+			cerr << "OK" << endl;
+		}
+		else {
+			cerr << "Failed" << endl;
+			char * e = XMLString::transcode(sig->getErrMsgs());
+			cout << e << endl;
+			XSEC_RELEASE_XMLCH(e);
+			exit(1);
+		}
+
+		/*
 		 * Change the document and ensure the signature fails.
 		 */
 
-		cerr << "Setting incorrect key in Signature object" << endl;
-		sig->setSigningKey(createHMACKey((unsigned char *) "badsecret"));
+		cerr << "Setting incorrect key in Signature object" << endl;
+		sig->setSigningKey(createHMACKey((unsigned char *) "badsecret"));
+
+		cerr << "Running \"verifySignatureOnly()\" on calculated signature ... ";
+		if (!sig->verifySignatureOnly()) {
+			cerr << "OK (Signature bad)" << endl;
+		}
+		else {
+			cerr << "Failed (signature OK but should be bad)" << endl;
+			exit(1);
+		}
+
+		// Don't need the signature now the DOM structure is in place
+		prov.releaseSignature(sig);
+
+		/*
+		 * Now serialise the document to memory so we can re-parse and check from scratch
+		 */
+
+		cerr << "Serialising the document to a memory buffer ... ";
+
+		MemBufFormatTarget *formatTarget = new MemBufFormatTarget();
+
+		DOMLSSerializer   *theSerializer = ((DOMImplementationLS*)impl)->createLSSerializer();
+
+		// Get the config so we can set up pretty printing
+		DOMConfiguration *dc = theSerializer->getDomConfig();
+		dc->setParameter(XMLUni::fgDOMWRTFormatPrettyPrint, false);
+        
+		// Now create an output object to format to UTF-8
+		DOMLSOutput *theOutput = ((DOMImplementationLS*)impl)->createLSOutput();
+		Janitor<DOMLSOutput> j_theOutput(theOutput);
+        
+		theOutput->setEncoding(MAKE_UNICODE_STRING("UTF-8"));
+		theOutput->setByteStream(formatTarget);
+
+		theSerializer->write(doc,theOutput);
+
+		// Copy to a new buffer
+		len = formatTarget->getLen();
+		char * mbuf = new char [len + 1];
+		memcpy(mbuf, formatTarget->getRawBuffer(), len);
+		mbuf[len] = '\0';
+#if 0
+		cout << mbuf << endl;
+#endif
+		delete theSerializer;
+		delete formatTarget;
+
+		cerr << "done\nParsing memory buffer back to DOM ... ";
+
+		// Also release the document so that we can re-load from scratch
+
+		doc->release();
+
+		/*
+		 * Re-parse
+		 */
+
+		XercesDOMParser parser;
+		
+		parser.setDoNamespaces(true);
+		parser.setCreateEntityReferenceNodes(true);
+
+		MemBufInputSource* memIS = new MemBufInputSource ((const XMLByte*) mbuf, 
+																len, "XSECMem");
+
+		parser.parse(*memIS);
+		doc = parser.adoptDocument();
+
+
+		delete(memIS);
+		delete[] mbuf;
+
+		cerr << "done\nValidating signature ...";
+
+		/*
+		 * Validate signature
+		 */
+
+		sig = prov.newSignatureFromDOM(doc);
+		sig->load();
+		sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+
+		safeBuffer beforeVerify, afterVerify;
+		XMLSize_t beforeLen, afterLen;
+		serialiseToBuffer(impl, doc, beforeVerify, beforeLen);
+
+		if (sig->verify()) {
+			cerr << "OK" << endl;
+		}
+		else {
+			cerr << "Failed\n" << endl;
+			char * e = XMLString::transcode(sig->getErrMsgs());
+			cerr << e << endl;
+			XSEC_RELEASE_XMLCH(e);
+			exit(1);
+		}
+
+		/*
+		 * Verification (including the XPath and XPath Filter references)
+		 * must leave the DOM exactly as it found it
+		 */
+
+		cerr << "Checking the document is unchanged by verify() ... ";
+		serialiseToBuffer(impl, doc, afterVerify, afterLen);
+
+		if (beforeLen != afterLen ||
+			memcmp(beforeVerify.rawBuffer(), afterVerify.rawBuffer(), beforeLen) != 0) {
+			cerr << "no - serialisation differs" << endl;
+			exit(1);
+		}
+		cerr << "yes" << endl;
+
+		/*
+		 * Ensure DNames are read back in and decoded properly
+		 */
+
+		DSIGKeyInfoList * kil = sig->getKeyInfoList();
+		int nki = (int) kil->getSize();
+
+		cerr << "Checking Distinguished name is decoded correctly ... ";
+		for (i = 0; i < nki; ++i) {
+
+			if (kil->item(i)->getKeyInfoType() == DSIGKeyInfo::KEYINFO_X509) {
+
+				if (strEquals(s_tstDName, ((DSIGKeyInfoX509 *) kil->item(i))->getX509SubjectName())) {
+					cerr << "yes" << endl;
+				}
+				else {
+					cerr << "decoded incorrectly" << endl;;
+					exit (1);
+				}
+			}
+			if (kil->item(i)->getKeyInfoType() == DSIGKeyInfo::KEYINFO_PGPDATA) {
+				
+				cerr << "Validating PGPData read back OK ... ";
+
+				DSIGKeyInfoPGPData * p = (DSIGKeyInfoPGPData *)kil->item(i);
+
+				if (!(strEquals(p->getKeyID(), s_tstPGPKeyID) &&
+					strEquals(p->getKeyPacket(), s_tstPGPKeyPacket))) {
+
+					cerr << "no!";
+					exit(1);
+				}
+
+				cerr << "yes\n";
+			}
+			if (kil->item(i)->getKeyInfoType() == DSIGKeyInfo::KEYINFO_SPKIDATA) {
+				
+				cerr << "Validating SPKIData read back OK ... ";
+
+				DSIGKeyInfoSPKIData * s = (DSIGKeyInfoSPKIData *)kil->item(i);
+
+				if (s->getSexpSize() != 2) {
+					cerr << "no - expected two S-expressions";
+					exit(1);
+				}
+
+				if (!(strEquals(s->getSexp(0), s_tstSexp1) &&
+					strEquals(s->getSexp(1), s_tstSexp2))) {
+
+					cerr << "no!";
+					exit(1);
+				}
+
+				cerr << "yes\n";
+			}
+			if (kil->item(i)->getKeyInfoType() == DSIGKeyInfo::KEYINFO_MGMTDATA) {
+				
+				cerr << "Validating MgmtData read back OK ... ";
+
+				DSIGKeyInfoMgmtData * m = (DSIGKeyInfoMgmtData *)kil->item(i);
+
+				if (!strEquals(m->getData(), s_tstMgmtData)) {
+
+					cerr << "no!";
+					exit(1);
+				}
+
+				cerr << "yes\n";
+			}
+		}
+	}
+
+	catch (const XSECException &e)
+	{
+		cerr << "An error occurred during signature processing\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
+		
+	}	
+	catch (const XSECCryptoException &e)
+	{
+		cerr << "A cryptographic error occurred during signature processing\n   Message: "
+		<< e.getMsg() << endl;
+		exit(1);
+	}
+
+	// Output the document post signature if necessary
+	outputDoc(impl, doc);
+
+	doc->release();
+
+}
+
+// --------------------------------------------------------------------------------
+//           Unit tests for test encrypt/Decrypt
+// --------------------------------------------------------------------------------
+
+void unitTestCipherReference(DOMImplementation * impl) {
+
+	DOMDocument *doc = impl->createDocument(
+				0,                    // root element namespace URI.
+				MAKE_UNICODE_STRING("ADoc"),            // root element name
+				NULL);// DOMDocumentType());  // document type object (DTD).
+
+	DOMElement *rootElem = doc->getDocumentElement();
+
+	// Use key k to wrap a test key, decrypt it and make sure it is still OK
+	XSECProvider prov;
+	XENCCipher * cipher;
+
+	try {
+
+		cipher = prov.newCipher(doc);
+
+		cerr << "Creating CipherReference ... ";
+
+		XENCEncryptedData * xenc = 
+			cipher->createEncryptedData(XENCCipherData::REFERENCE_TYPE, DSIGConstants::s_unicodeStrURIAES128_CBC, MAKE_UNICODE_STRING("#CipherText"));
+
+		rootElem->appendChild(xenc->getElement());
+
+		// Now create the data that is referenced
+		DOMElement * cipherVal = doc->createElement(MAKE_UNICODE_STRING("MyCipherValue"));
+		rootElem->appendChild(cipherVal);
+		cipherVal->setAttributeNS(NULL, MAKE_UNICODE_STRING("Id"), MAKE_UNICODE_STRING("CipherText"));
+		cipherVal->setIdAttributeNS(NULL, MAKE_UNICODE_STRING("Id"), true);
+
+		cipherVal->appendChild(doc->createTextNode(MAKE_UNICODE_STRING((char *) s_tstBase64EncodedString)));
 
-		cerr << "Running \"verifySignatureOnly()\" on calculated signature ... ";
-		if (!sig->verifySignatureOnly()) {
-			cerr << "OK (Signature bad)" << endl;
+		// Now add the transforms necessary to decrypt
+		XENCCipherReference *cref = xenc->getCipherData()->getCipherReference();
+
+		if (cref == NULL) {
+			cerr << "Failed - no CipherReference object" << endl;
+			exit(1);
+		}
+
+		cerr << "done ... appending XPath and Base64 transforms ... ";
+
+		//cref->appendXPathTransform("self::text()[parent::rep:CipherValue[@Id="example1"]]");
+		cref->appendXPathTransform("self::text()[parent::MyCipherValue[@Id=\"CipherText\"]]");
+		cref->appendBase64Transform();
+
+		cerr << "done ... decrypting ... ";
+
+		// Create a key
+		XSECCryptoSymmetricKey * ks =
+				XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_128);
+		ks->setKey((unsigned char *) s_keyStr, 16);
+
+		cipher->setKey(ks);
+
+		// Now try to decrypt
+		DOMNode * n = findXENCNode(doc, "EncryptedData");
+
+		XSECBinTXFMInputStream *is = cipher->decryptToBinInputStream((DOMElement *) n);
+		Janitor<XSECBinTXFMInputStream> j_is(is);
+
+		XMLByte buf[1024];
+
+		cerr << "done ... comparing to known good ... ";
+
+		XMLSize_t bytesRead = is->readBytes(buf, 1024);
+		buf[bytesRead] = '\0';
+		if (strcmp((char *) buf, s_tstDecryptedString) == 0) {
+			cerr << "OK" << endl;
 		}
 		else {
-			cerr << "Failed (signature OK but should be bad)" << endl;
-			exit(1);
+			cerr << "failed - bad compare of decrypted data" << endl;
 		}
 
-		// Don't need the signature now the DOM structure is in place
-		prov.releaseSignature(sig);
+	}
 
-		/*
-		 * Now serialise the document to memory so we can re-parse and check from scratch
-		 */
+	catch (const XSECException &e)
+	{
+		cerr << "failed\n";
+		cerr << "An error occurred during signature processing\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
+		
+	}	
+	catch (const XSECCryptoException &e)
+	{
+		cerr << "failed\n";
+		cerr << "A cryptographic error occurred during signature processing\n   Message: "
+		<< e.getMsg() << endl;
+		exit(1);
+	}
 
-		cerr << "Serialising the document to a memory buffer ... ";
+	outputDoc(impl, doc);
+	doc->release();
 
-		MemBufFormatTarget *formatTarget = new MemBufFormatTarget();
+}
 
-		DOMLSSerializer   *theSerializer = ((DOMImplementationLS*)impl)->createLSSerializer();
 
-		// Get the config so we can set up pretty printing
-		DOMConfiguration *dc = theSerializer->getDomConfig();
-		dc->setParameter(XMLUni::fgDOMWRTFormatPrettyPrint, false);
-        
-		// Now create an output object to format to UTF-8
-		DOMLSOutput *theOutput = ((DOMImplementationLS*)impl)->createLSOutput();
-		Janitor<DOMLSOutput> j_theOutput(theOutput);
-        
-		theOutput->setEncoding(MAKE_UNICODE_STRING("UTF-8"));
-		theOutput->setByteStream(formatTarget);
+void unitTestStreamEncrypt(DOMImplementation *impl) {
 
-		theSerializer->write(doc,theOutput);
+	DOMDocument *doc = impl->createDocument(
+				0,                    // root element namespace URI.
+				MAKE_UNICODE_STRING("ADoc"),            // root element name
+				NULL);// DOMDocumentType());  // document type object (DTD).
 
-		// Copy to a new buffer
-		len = formatTarget->getLen();
-		char * mbuf = new char [len + 1];
-		memcpy(mbuf, formatTarget->getRawBuffer(), len);
-		mbuf[len] = '\0';
-#if 0
-		cout << mbuf << endl;
-#endif
-		delete theSerializer;
-		delete formatTarget;
+	XSECProvider prov;
+	XENCCipher * cipher;
 
-		cerr << "done\nParsing memory buffer back to DOM ... ";
+	try {
 
-		// Also release the document so that we can re-load from scratch
+		cerr << "Streaming encryption to a format target ... ";
 
-		doc->release();
+		cipher = prov.newCipher(doc);
 
-		/*
-		 * Re-parse
-		 */
+		XSECCryptoSymmetricKey * ks =
+				XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_128);
+		ks->setKey((unsigned char *) s_keyStr, 16);
+		cipher->setKey(ks);
+
+		MemBufFormatTarget target;
+		BinMemInputStream * plain = new BinMemInputStream((const XMLByte *) s_tstDecryptedString,
+			(XMLSize_t) strlen(s_tstDecryptedString));
+
+		cipher->encryptBinInputStream(plain, &target, DSIGConstants::s_unicodeStrURIAES128_CBC);
+
+		cerr << "done ... re-parsing ... ";
 
 		XercesDOMParser parser;
-		
 		parser.setDoNamespaces(true);
-		parser.setCreateEntityReferenceNodes(true);
 
-		MemBufInputSource* memIS = new MemBufInputSource ((const XMLByte*) mbuf, 
-																len, "XSECMem");
+		MemBufInputSource memIS(target.getRawBuffer(), target.getLen(), "XSECMem");
+		parser.parse(memIS);
+		DOMDocument * encDoc = parser.adoptDocument();
+		Janitor<DOMDocument> j_encDoc(encDoc);
 
-		parser.parse(*memIS);
-		doc = parser.adoptDocument();
+		cerr << "done ... decrypting ... ";
 
+		XENCCipher * decCipher = prov.newCipher(encDoc);
+		ks = XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_128);
+		ks->setKey((unsigned char *) s_keyStr, 16);
+		decCipher->setKey(ks);
 
-		delete(memIS);
-		delete[] mbuf;
+		XSECBinTXFMInputStream *is = decCipher->decryptToBinInputStream(encDoc->getDocumentElement());
+		Janitor<XSECBinTXFMInputStream> j_is(is);
 
-		cerr << "done\nValidating signature ...";
+		XMLByte buf[1024];
+		XMLSize_t bytesRead = is->readBytes(buf, 1023);
+		buf[bytesRead] = '\0';
 
-		/*
-		 * Validate signature
-		 */
+		if (strcmp((char *) buf, s_tstDecryptedString) != 0) {
+			cerr << "failed - bad compare of decrypted data" << endl;
+			exit(1);
+		}
 
-		sig = prov.newSignatureFromDOM(doc);
-		sig->load();
-		sig->setSigningKey(createHMACKey((unsigned char *) "secret"));
+		cerr << "OK ... streamed decrypt ... ";
 
-		if (sig->verify()) {
-			cerr << "OK" << endl;
+		ks = XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_128);
+		ks->setKey((unsigned char *) s_keyStr, 16);
+		decCipher->setKey(ks);
+
+		MemBufFormatTarget plainTarget;
+		decCipher->decryptBinInputStream(
+			new BinMemInputStream(target.getRawBuffer(), target.getLen()), &plainTarget);
+
+		if (plainTarget.getLen() == strlen(s_tstDecryptedString) &&
+			memcmp(plainTarget.getRawBuffer(), s_tstDecryptedString, plainTarget.getLen()) == 0) {
+			cerr << "OK ... truncated input ... ";
 		}
 		else {
-			cerr << "Failed\n" << endl;
-			char * e = XMLString::transcode(sig->getErrMsgs());
-			cerr << e << endl;
-			XSEC_RELEASE_XMLCH(e);
+			cerr << "failed - bad compare of decrypted data" << endl;
 			exit(1);
 		}
 
-		/*
-		 * Ensure DNames are read back in and decoded properly
-		 */
+		// Cut the document off just before the CipherValue end tag, so
+		// all of the cipher text is there but the value is never closed
 
-		DSIGKeyInfoList * kil = sig->getKeyInfoList();
-		int nki = (int) kil->getSize();
+		std::string enc((const char *) target.getRawBuffer(), target.getLen());
+		std::string::size_type cut = enc.rfind("CipherValue>");
+		if (cut != std::string::npos)
+			cut = enc.rfind("</", cut);
+		if (cut == std::string::npos) {
+			cerr << "failed - no CipherValue end tag in output" << endl;
+			exit(1);
+		}
 
-		cerr << "Checking Distinguished name is decoded correctly ... ";
-		for (i = 0; i < nki; ++i) {
+		ks = XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_128);
+		ks->setKey((unsigned char *) s_keyStr, 16);
+		decCipher->setKey(ks);
 
-			if (kil->item(i)->getKeyInfoType() == DSIGKeyInfo::KEYINFO_X509) {
+		bool threw = false;
+		MemBufFormatTarget truncTarget;
+		try {
+			decCipher->decryptBinInputStream(
+				new BinMemInputStream((const XMLByte *) enc.c_str(), cut), &truncTarget);
+		}
+		catch (const XSECException &e) {
+			threw = (e.getType() == XSECException::CipherError);
+		}
 
-				if (strEquals(s_tstDName, ((DSIGKeyInfoX509 *) kil->item(i))->getX509SubjectName())) {
-					cerr << "yes" << endl;
-				}
-				else {
-					cerr << "decoded incorrectly" << endl;;
-					exit (1);
-				}
+		if (!threw) {
+			cerr << "failed - truncated CipherValue was decrypted" << endl;
+			exit(1);
+		}
+
+		cerr << "OK" << endl;
+
+	}
+
+	catch (const XSECException &e)
+	{
+		cerr << "failed\n";
+		cerr << "An error occurred during stream encryption\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
+
+	}
+	catch (const XSECCryptoException &e)
+	{
+		cerr << "failed\n";
+		cerr << "A cryptographic error occurred during stream encryption\n   Message: "
+		<< e.getMsg() << endl;
+		exit(1);
+	}
+
+	doc->release();
+
+}
+
+void unitTestParallelDecrypt(DOMImplementation *impl) {
+
+	// Decrypt a large CBC cipher text split across threads and make sure
+	// we get the original back
+
+	cerr << "Parallel CBC decryption ... ";
+
+	DOMDocument *doc = impl->createDocument(
+				0,                    // root element namespace URI.
+				MAKE_UNICODE_STRING("ADoc"),            // root element name
+				NULL);// DOMDocumentType());  // document type object (DTD).
+
+	XSECProvider prov;
+
+	const XMLSize_t plainLen = 300007;
+	XMLByte * plain = new XMLByte[plainLen];
+	ArrayJanitor<XMLByte> j_plain(plain);
+	for (XMLSize_t i = 0; i < plainLen; ++i)
+		plain[i] = (XMLByte) (i * 7 + (i >> 8));
+
+	try {
+
+		XENCCipher * cipher = prov.newCipher(doc);
+		XSECCryptoSymmetricKey * ks =
+				XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_256);
+		ks->setKey((unsigned char *) s_keyStr, 32);
+		cipher->setKey(ks);
+
+		MemBufFormatTarget target;
+		cipher->encryptBinInputStream(new BinMemInputStream(plain, plainLen),
+			&target, DSIGConstants::s_unicodeStrURIAES256_CBC);
+
+		XSECPlatformUtils::SetParallelDecryption(4, 16384);
+
+		ks = XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_256);
+		ks->setKey((unsigned char *) s_keyStr, 32);
+		cipher->setKey(ks);
+
+		// Count the chunks that really were split across threads
+		XSECMetrics metrics;
+		XSECPlatformUtils::SetMetricsSink(&metrics);
+
+		MemBufFormatTarget plainTarget;
+		try {
+			cipher->decryptBinInputStream(
+				new BinMemInputStream(target.getRawBuffer(), target.getLen()), &plainTarget);
+		}
+		catch (...) {
+			XSECPlatformUtils::SetMetricsSink(NULL);
+			XSECPlatformUtils::SetParallelDecryption(1);
+			throw;
+		}
+
+		XSECPlatformUtils::SetMetricsSink(NULL);
+		XSECPlatformUtils::SetParallelDecryption(1);
+
+		if (plainTarget.getLen() != plainLen ||
+			memcmp(plainTarget.getRawBuffer(), plain, plainLen) != 0) {
+			cerr << "failed - bad compare of decrypted data" << endl;
+			exit(1);
+		}
+
+#if defined (XSEC_HAVE_OPENSSL) && defined (XSEC_OPENSSL_CANSET_PADDING)
+		if (!g_useWinCAPI && !g_useNSS) {
+
+			// 300K through a 16K threshold is well over ten parallel chunks
+			XSECMetricStatistics stats;
+			metrics.getStatistics(XSEC_METRIC_PARALLEL_DECRYPT, stats);
+
+			if (stats.count < 10 || stats.bytes < 10 * 16384) {
+				cerr << "failed - decryption did not run in parallel" << endl;
+				exit(1);
 			}
-			if (kil->item(i)->getKeyInfoType() == DSIGKeyInfo::KEYINFO_PGPDATA) {
-				
-				cerr << "Validating PGPData read back OK ... ";
 
-				DSIGKeyInfoPGPData * p = (DSIGKeyInfoPGPData *)kil->item(i);
+		}
+#endif
+
+	}
+	catch (const XSECException &e)
+	{
+		cerr << "failed\n";
+		cerr << "An error occurred during parallel decryption\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
+
+	}
+	catch (const XSECCryptoException &e)
+	{
+		cerr << "failed\n";
+		cerr << "A cryptographic error occurred during parallel decryption\n   Message: "
+		<< e.getMsg() << endl;
+		exit(1);
+	}
+
+	doc->release();
+	cerr << "OK" << endl;
 
-				if (!(strEquals(p->getKeyID(), s_tstPGPKeyID) &&
-					strEquals(p->getKeyPacket(), s_tstPGPKeyPacket))) {
+}
 
-					cerr << "no!";
-					exit(1);
-				}
+void unitTestBulkElementEncrypt(DOMImplementation *impl) {
 
-				cerr << "yes\n";
-			}
-			if (kil->item(i)->getKeyInfoType() == DSIGKeyInfo::KEYINFO_SPKIDATA) {
-				
-				cerr << "Validating SPKIData read back OK ... ";
+	// Encrypt a run of sibling elements in one go, then decrypt them
+	// all and make sure we are back where we started
 
-				DSIGKeyInfoSPKIData * s = (DSIGKeyInfoSPKIData *)kil->item(i);
+	cerr << "Bulk element encryption and decryption ... ";
 
-				if (s->getSexpSize() != 2) {
-					cerr << "no - expected two S-expressions";
-					exit(1);
-				}
+	DOMDocument *doc = impl->createDocument(
+				0,                    // root element namespace URI.
+				MAKE_UNICODE_STRING("ADoc"),            // root element name
+				NULL);// DOMDocumentType());  // document type object (DTD).
 
-				if (!(strEquals(s->getSexp(0), s_tstSexp1) &&
-					strEquals(s->getSexp(1), s_tstSexp2))) {
+	DOMElement *rootElem = doc->getDocumentElement();
 
-					cerr << "no!";
-					exit(1);
-				}
+	const int count = 32;
+	DOMElement * elements[count];
 
-				cerr << "yes\n";
-			}
-			if (kil->item(i)->getKeyInfoType() == DSIGKeyInfo::KEYINFO_MGMTDATA) {
-				
-				cerr << "Validating MgmtData read back OK ... ";
+	for (int i = 0; i < count; ++i) {
+		elements[i] = doc->createElement(MAKE_UNICODE_STRING("Field"));
+		elements[i]->appendChild(doc->createTextNode(MAKE_UNICODE_STRING(s_tstDecryptedString)));
+		rootElem->appendChild(elements[i]);
+	}
 
-				DSIGKeyInfoMgmtData * m = (DSIGKeyInfoMgmtData *)kil->item(i);
+	XSECProvider prov;
 
-				if (!strEquals(m->getData(), s_tstMgmtData)) {
+	try {
 
-					cerr << "no!";
-					exit(1);
-				}
+		XENCCipher * cipher = prov.newCipher(doc);
+		XSECCryptoSymmetricKey * ks =
+				XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_128);
+		ks->setKey((unsigned char *) s_keyStr, 16);
+		cipher->setKey(ks);
 
-				cerr << "yes\n";
+		cipher->encryptElements(elements, count, DSIGConstants::s_unicodeStrURIAES128_CBC, NULL, 4);
+
+		int i = 0;
+		for (DOMNode * n = rootElem->getFirstChild(); n != NULL; n = n->getNextSibling()) {
+			if (!strEquals(getXENCLocalName(n), "EncryptedData")) {
+				cerr << "failed - element not replaced by EncryptedData" << endl;
+				exit(1);
 			}
+			elements[i++] = (DOMElement *) n;
 		}
-	}
 
+		if (i != count) {
+			cerr << "failed - wrong number of EncryptedData elements" << endl;
+			exit(1);
+		}
+
+		cipher->decryptElements(elements, count, 4);
+
+		i = 0;
+		for (DOMNode * n = rootElem->getFirstChild(); n != NULL; n = n->getNextSibling()) {
+			char * t = XMLString::transcode(n->getTextContent());
+			bool ok = strEquals(n->getNodeName(), "Field") && strcmp(t, s_tstDecryptedString) == 0;
+			XSEC_RELEASE_XMLCH(t);
+			if (!ok) {
+				cerr << "failed - bad compare of decrypted element" << endl;
+				exit(1);
+			}
+			++i;
+		}
+
+		if (i != count) {
+			cerr << "failed - wrong number of decrypted elements" << endl;
+			exit(1);
+		}
+
+	}
 	catch (const XSECException &e)
 	{
-		cerr << "An error occurred during signature processing\n   Message: ";
+		cerr << "failed\n";
+		cerr << "An error occurred during bulk encryption\n   Message: ";
 		char * ce = XMLString::transcode(e.getMsg());
 		cerr << ce << endl;
 		delete ce;
 		exit(1);
-		
-	}	
+
+	}
 	catch (const XSECCryptoException &e)
 	{
-		cerr << "A cryptographic error occurred during signature processing\n   Message: "
+		cerr << "failed\n";
+		cerr << "A cryptographic error occurred during bulk encryption\n   Message: "
 		<< e.getMsg() << endl;
 		exit(1);
 	}
 
-	// Output the document post signature if necessary
-	outputDoc(impl, doc);
-
 	doc->release();
+	cerr << "OK" << endl;
 
 }
 
-// --------------------------------------------------------------------------------
-//           Unit tests for test encrypt/Decrypt
-// --------------------------------------------------------------------------------
+void unitTestKeyCache(DOMImplementation *impl) {
 
-void unitTestCipherReference(DOMImplementation * impl) {
+	// Unwrap the same key twice through a cache.  The second time round
+	// the KEK is replaced with the wrong key, so the unwrap can only
+	// succeed if the cached value is used
+
+	cerr << "Unwrapped key cache ... ";
 
 	DOMDocument *doc = impl->createDocument(
 				0,                    // root element namespace URI.
 				MAKE_UNICODE_STRING("ADoc"),            // root element name
 				NULL);// DOMDocumentType());  // document type object (DTD).
 
-	DOMElement *rootElem = doc->getDocumentElement();
-
-	// Use key k to wrap a test key, decrypt it and make sure it is still OK
 	XSECProvider prov;
-	XENCCipher * cipher;
+	XENCKeyCache cache(4, 60);
 
 	try {
 
-		cipher = prov.newCipher(doc);
+		static unsigned char toEncryptStr[] = "A test key to use for da";
+		unsigned int toEncryptLen = (unsigned int) strlen((char *) toEncryptStr);
 
-		cerr << "Creating CipherReference ... ";
+		XENCCipher * cipher = prov.newCipher(doc);
+		XSECCryptoSymmetricKey * ks =
+				XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_128);
+		ks->setKey((unsigned char *) s_keyStr, 16);
+		cipher->setKEK(ks);
 
-		XENCEncryptedData * xenc = 
-			cipher->createEncryptedData(XENCCipherData::REFERENCE_TYPE, DSIGConstants::s_unicodeStrURIAES128_CBC, MAKE_UNICODE_STRING("#CipherText"));
+		XENCEncryptedKey * encryptedKey =
+			cipher->encryptKey(toEncryptStr, toEncryptLen, DSIGConstants::s_unicodeStrURIKW_AES128);
+		Janitor<XENCEncryptedKey> j_encryptedKey(encryptedKey);
 
-		rootElem->appendChild(xenc->getElement());
+		cipher->setKeyCache(&cache, MAKE_UNICODE_STRING("tstKEK"));
 
-		// Now create the data that is referenced
-		DOMElement * cipherVal = doc->createElement(MAKE_UNICODE_STRING("MyCipherValue"));
-		rootElem->appendChild(cipherVal);
-		cipherVal->setAttributeNS(NULL, MAKE_UNICODE_STRING("Id"), MAKE_UNICODE_STRING("CipherText"));
-		cipherVal->setIdAttributeNS(NULL, MAKE_UNICODE_STRING("Id"), true);
+		XMLByte decBuf[64];
+		int len = cipher->decryptKey(encryptedKey, decBuf, 64);
 
-		cipherVal->appendChild(doc->createTextNode(MAKE_UNICODE_STRING((char *) s_tstBase64EncodedString)));
+		ks = XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_128);
+		ks->setKey((unsigned char *) &s_keyStr[16], 16);
+		cipher->setKEK(ks);
 
-		// Now add the transforms necessary to decrypt
-		XENCCipherReference *cref = xenc->getCipherData()->getCipherReference();
+		memset(decBuf, 0, 64);
+		len = cipher->decryptKey(encryptedKey, decBuf, 64);
 
-		if (cref == NULL) {
-			cerr << "Failed - no CipherReference object" << endl;
+		if (len != (int) toEncryptLen || memcmp(decBuf, toEncryptStr, toEncryptLen) != 0 ||
+			cache.getHits() != 1 || cache.getMisses() != 1 || cache.getSize() != 1) {
+
+			cerr << "failed - key not served from cache" << endl;
 			exit(1);
+
 		}
 
-		cerr << "done ... appending XPath and Base64 transforms ... ";
+		// A different KEK identity must not see the cached key
+		cipher->setKeyCache(&cache, MAKE_UNICODE_STRING("otherKEK"));
 
-		//cref->appendXPathTransform("self::text()[parent::rep:CipherValue[@Id="example1"]]");
-		cref->appendXPathTransform("self::text()[parent::MyCipherValue[@Id=\"CipherText\"]]");
-		cref->appendBase64Transform();
+		bool threw = false;
+		try {
+			cipher->decryptKey(encryptedKey, decBuf, 64);
+		}
+		catch (const XSECCryptoException &) {
+			threw = true;
+		}
+		catch (const XSECException &) {
+			threw = true;
+		}
 
-		cerr << "done ... decrypting ... ";
+		if (!threw || cache.getMisses() != 2) {
+			cerr << "failed - cached key returned for the wrong KEK" << endl;
+			exit(1);
+		}
 
-		// Create a key
-		XSECCryptoSymmetricKey * ks =
-				XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_128);
-		ks->setKey((unsigned char *) s_keyStr, 16);
+		cache.clear();
+		if (cache.getSize() != 0) {
+			cerr << "failed - cache not cleared" << endl;
+			exit(1);
+		}
 
-		cipher->setKey(ks);
+	}
+	catch (const XSECException &e)
+	{
+		cerr << "failed\n";
+		cerr << "An error occurred during key cache tests\n   Message: ";
+		char * ce = XMLString::transcode(e.getMsg());
+		cerr << ce << endl;
+		delete ce;
+		exit(1);
 
-		// Now try to decrypt
-		DOMNode * n = findXENCNode(doc, "EncryptedData");
+	}
+	catch (const XSECCryptoException &e)
+	{
+		cerr << "failed\n";
+		cerr << "A cryptographic error occurred during key cache tests\n   Message: "
+		<< e.getMsg() << endl;
+		exit(1);
+	}
 
-		XSECBinTXFMInputStream *is = cipher->decryptToBinInputStream((DOMElement *) n);
-		Janitor<XSECBinTXFMInputStream> j_is(is);
+	doc->release();
+	cerr << "OK" << endl;
 
-		XMLByte buf[1024];
+}
 
-		cerr << "done ... comparing to known good ... ";
+void unitTestKeyAgreement(DOMImplementation *impl) {
+
+	// Wrap a key to an EC public key using ECDH-ES, then unwrap it with
+	// the private key and the AgreementMethod in the EncryptedKey
+
+#if defined (XSEC_HAVE_OPENSSL) && defined (XSEC_OPENSSL_HAVE_EC)
+
+	cerr << "ECDH-ES key agreement ... ";
+
+	DOMDocument *doc = impl->createDocument(
+				0,                    // root element namespace URI.
+				MAKE_UNICODE_STRING("ADoc"),            // root element name
+				NULL);// DOMDocumentType());  // document type object (DTD).
+
+	XSECProvider prov;
+
+	BIO * bioMem = BIO_new(BIO_s_mem());
+	BIO_puts(bioMem, s_tstECPrivateKey);
+	EVP_PKEY * pk = PEM_read_bio_PrivateKey(bioMem, NULL, NULL, NULL);
+	OpenSSLCryptoKeyEC * ecKey = new OpenSSLCryptoKeyEC(pk);
+	BIO_free(bioMem);
+	EVP_PKEY_free(pk);
+
+	try {
+
+		static unsigned char toEncryptStr[] = "A test key to use for da";
+		unsigned int toEncryptLen = (unsigned int) strlen((char *) toEncryptStr);
+
+		XENCCipher * cipher = prov.newCipher(doc);
+		cipher->setKEK(ecKey->clone());
+
+		XENCEncryptedKey * encryptedKey =
+			cipher->encryptKey(toEncryptStr, toEncryptLen, DSIGConstants::s_unicodeStrURIKW_AES128);
+		Janitor<XENCEncryptedKey> j_encryptedKey(encryptedKey);
+
+		DSIGKeyInfoList * kil = encryptedKey->getKeyInfoList();
+		if (kil->getSize() != 1 ||
+			kil->item(0)->getKeyInfoType() != DSIGKeyInfo::KEYINFO_AGREEMENTMETHOD) {
+
+			cerr << "failed - no AgreementMethod in EncryptedKey" << endl;
+			exit(1);
 
-		XMLSize_t bytesRead = is->readBytes(buf, 1024);
-		buf[bytesRead] = '\0';
-		if (strcmp((char *) buf, s_tstDecryptedString) == 0) {
-			cerr << "OK" << endl;
 		}
-		else {
-			cerr << "failed - bad compare of decrypted data" << endl;
+
+		cipher->setKEK(ecKey);
+
+		XMLByte decBuf[64];
+		int len = cipher->decryptKey(encryptedKey, decBuf, 64);
+
+		if (len != (int) toEncryptLen || memcmp(decBuf, toEncryptStr, toEncryptLen) != 0) {
+
+			cerr << "failed - decrypted key does not match" << endl;
+			exit(1);
+
 		}
 
 	}
-
 	catch (const XSECException &e)
 	{
 		cerr << "failed\n";
-		cerr << "An error occurred during signature processing\n   Message: ";
+		cerr << "An error occurred during key agreement tests\n   Message: ";
 		char * ce = XMLString::transcode(e.getMsg());
 		cerr << ce << endl;
 		delete ce;
 		exit(1);
-		
-	}	
+
+	}
 	catch (const XSECCryptoException &e)
 	{
 		cerr << "failed\n";
-		cerr << "A cryptographic error occurred during signature processing\n   Message: "
+		cerr << "A cryptographic error occurred during key agreement tests\n   Message: "
 		<< e.getMsg() << endl;
 		exit(1);
 	}
 
-	outputDoc(impl, doc);
 	doc->release();
+	cerr << "OK" << endl;
 
-}
+#else
 
+	cerr << "Skipped ECDH-ES key agreement test (requires OpenSSL EC support)" << endl;
+
+#endif
+
+}
 
 void unitTestElementContentEncrypt(DOMImplementation *impl, XSECCryptoKey * key, const XMLCh* algorithm, bool doElementContent) {
 
@@ -1925,6 +3952,144 @@ void unitTestSmallElement(DOMImplementation *impl) {
 }
 
 
+void unitTestPaddedKeyWrap(void) {
+
+	// RFC 5649 directly against the key: known answers for 192 and 256 bit
+	// KEKs, then round trips of lengths that are not a multiple of 8 for
+	// every KEK size, and a tampered wrap that must not unwrap
+
+	static const unsigned char kek[24] = {
+		0x58, 0x40, 0xdf, 0x6e, 0x29, 0xb0, 0x2a, 0xf1, 0xab, 0x49, 0x3b, 0x70,
+		0x5b, 0xf1, 0x6e, 0xa1, 0xae, 0x83, 0x38, 0xf4, 0xdc, 0xc1, 0x76, 0xa8
+	};
+	static const unsigned char kek256[32] = {
+		0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b,
+		0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+		0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f
+	};
+
+	static const unsigned char key20[] = {
+		0xc3, 0x7b, 0x7e, 0x64, 0x92, 0x58, 0x43, 0x40, 0xbe, 0xd1,
+		0x22, 0x07, 0x80, 0x89, 0x41, 0x15, 0x50, 0x68, 0xf7, 0x38
+	};
+	static const unsigned char wrap20[] = {
+		0x13, 0x8b, 0xde, 0xaa, 0x9b, 0x8f, 0xa7, 0xfc, 0x61, 0xf9, 0x77, 0x42,
+		0xe7, 0x22, 0x48, 0xee, 0x5a, 0xe6, 0xae, 0x53, 0x60, 0xd1, 0xae, 0x6a,
+		0x5f, 0x54, 0xf3, 0x73, 0xfa, 0x54, 0x3b, 0x6a
+	};
+	static const unsigned char key7[] = {
+		0x46, 0x6f, 0x72, 0x50, 0x61, 0x73, 0x69
+	};
+	static const unsigned char wrap7[] = {
+		0xaf, 0xbe, 0xb0, 0xf0, 0x7d, 0xfb, 0xf5, 0x41,
+		0x92, 0x00, 0xf2, 0xcc, 0xb5, 0x0b, 0xb2, 0x4f
+	};
+	static const unsigned char wrap13[] = {
+		0x1a, 0x39, 0xf5, 0x7a, 0x72, 0x6d, 0x3d, 0x8e, 0x66, 0x77, 0xcc, 0x04,
+		0x91, 0x15, 0x18, 0x5a, 0x14, 0x6f, 0xda, 0x70, 0x7f, 0x1b, 0x5f, 0x46
+	};
+
+	cerr << "AES key wrap with padding known answers ... ";
+
+	unsigned char plain[40];
+	unsigned char wrapped[64];
+	unsigned char unwrapped[64];
+	unsigned int len;
+
+	for (int i = 0; i < 40; ++i)
+		plain[i] = (unsigned char) (i * 29 + 3);
+
+	try {
+
+		XSECCryptoSymmetricKey * ks =
+			XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_192);
+		Janitor<XSECCryptoSymmetricKey> j_ks(ks);
+		ks->setKey(kek, 24);
+
+		len = ks->wrapKey(key20, 20, wrapped, 64, true);
+		if (len != sizeof(wrap20) || memcmp(wrapped, wrap20, len) != 0) {
+			cerr << "bad - 20 byte key with 192 bit KEK" << endl;
+			exit(1);
+		}
+
+		len = ks->wrapKey(key7, 7, wrapped, 64, true);
+		if (len != sizeof(wrap7) || memcmp(wrapped, wrap7, len) != 0) {
+			cerr << "bad - 7 byte key with 192 bit KEK" << endl;
+			exit(1);
+		}
+
+		XSECCryptoSymmetricKey * ks256 =
+			XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_256);
+		Janitor<XSECCryptoSymmetricKey> j_ks256(ks256);
+		ks256->setKey(kek256, 32);
+
+		len = ks256->wrapKey(kek256, 13, wrapped, 64, true);
+		if (len != sizeof(wrap13) || memcmp(wrapped, wrap13, len) != 0) {
+			cerr << "bad - 13 byte key with 256 bit KEK" << endl;
+			exit(1);
+		}
+
+		cerr << "OK" << endl;
+		cerr << "AES key wrap with padding round trips ... ";
+
+		static const XSECCryptoSymmetricKey::SymmetricKeyType types[] = {
+			XSECCryptoSymmetricKey::KEY_AES_128,
+			XSECCryptoSymmetricKey::KEY_AES_192,
+			XSECCryptoSymmetricKey::KEY_AES_256
+		};
+
+		for (int t = 0; t < 3; ++t) {
+
+			XSECCryptoSymmetricKey * k =
+				XSECPlatformUtils::g_cryptoProvider->keySymmetric(types[t]);
+			Janitor<XSECCryptoSymmetricKey> j_k(k);
+			k->setKey(kek256, 16 + 8 * t);
+
+			for (unsigned int inLen = 1; inLen <= 40; ++inLen) {
+
+				len = k->wrapKey(plain, inLen, wrapped, 64, true);
+				if (len != ((inLen + 7) / 8) * 8 + 8) {
+					cerr << "bad - wrapped length for " << inLen << " bytes" << endl;
+					exit(1);
+				}
+
+				unsigned int outLen = k->unwrapKey(wrapped, len, unwrapped, 64, true);
+				if (outLen != inLen || memcmp(unwrapped, plain, inLen) != 0) {
+					cerr << "bad - round trip of " << inLen << " bytes" << endl;
+					exit(1);
+				}
+
+			}
+
+			// Tampering with the wrapped key must be caught
+			len = k->wrapKey(plain, 13, wrapped, 64, true);
+			wrapped[len - 1] ^= 0x01;
+
+			bool caught = false;
+			try {
+				k->unwrapKey(wrapped, len, unwrapped, 64, true);
+			}
+			catch (const XSECCryptoException &) {
+				caught = true;
+			}
+
+			if (!caught) {
+				cerr << "bad - tampered wrap accepted" << endl;
+				exit(1);
+			}
+
+		}
+
+		cerr << "OK" << endl;
+
+	}
+	catch (const XSECCryptoException &e) {
+		cerr << "failed\n" << e.getMsg() << endl;
+		exit(1);
+	}
+
+}
+
 void unitTestKeyEncrypt(
         DOMImplementation* impl,
         XSECCryptoKey* k,
@@ -2178,6 +4343,29 @@ void unitTestEncrypt(DOMImplementation *impl) {
 			ks->setKey((unsigned char *) s_keyStr, 32);
 		
 			unitTestKeyEncrypt(impl, ks, DSIGConstants::s_unicodeStrURIKW_AES256);
+
+			cerr << "AES 128 key wrap with padding... ";
+
+			ks = XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_128);
+			ks->setKey((unsigned char *) s_keyStr, 16);
+
+			unitTestKeyEncrypt(impl, ks, DSIGConstants::s_unicodeStrURIKW_AES128_PAD);
+
+			cerr << "AES 192 key wrap with padding... ";
+
+			ks = XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_192);
+			ks->setKey((unsigned char *) s_keyStr, 24);
+
+			unitTestKeyEncrypt(impl, ks, DSIGConstants::s_unicodeStrURIKW_AES192_PAD);
+
+			cerr << "AES 256 key wrap with padding... ";
+
+			ks = XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_256);
+			ks->setKey((unsigned char *) s_keyStr, 32);
+
+			unitTestKeyEncrypt(impl, ks, DSIGConstants::s_unicodeStrURIKW_AES256_PAD);
+
+			unitTestPaddedKeyWrap();
 		}
 
 		else 
@@ -2271,6 +4459,13 @@ void unitTestEncrypt(DOMImplementation *impl) {
 #endif
 		cerr << "Misc. encryption tests" << endl;
 		unitTestSmallElement(impl);
+		if (g_haveAES) {
+			unitTestStreamEncrypt(impl);
+			unitTestParallelDecrypt(impl);
+			unitTestBulkElementEncrypt(impl);
+			unitTestKeyCache(impl);
+			unitTestKeyAgreement(impl);
+		}
 	}
 	catch (const XSECCryptoException &e)
 	{
@@ -70,6 +70,15 @@ bool TXFMBase::nameSpacesExpanded(void) const {
 
 }
 
+bool TXFMBase::nameSpacesVirtual(void) const {
+
+	if (mp_nse == NULL && input != NULL)
+		return input->nameSpacesVirtual();
+
+	return false;
+
+}
+
 void TXFMBase::expandNameSpaces(void) {
 
 	if (mp_nse != NULL || (input != NULL && input->nameSpacesExpanded()))
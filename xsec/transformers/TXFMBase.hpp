@@ -32,6 +32,7 @@
 #define TXFMBASE_INCLUDE
 
 #include <xsec/canon/XSECC14n20010315.hpp>
+#include <xsec/framework/XSECMemory.hpp>
 #include <xsec/utils/XSECNameSpaceExpander.hpp>
 #include <xsec/utils/XSECXPathNodeList.hpp>
 
@@ -61,7 +62,7 @@ class TXFMChain;
  */
 
 
-class XSEC_EXPORT TXFMBase {
+class XSEC_EXPORT TXFMBase : public XSECMemory {
 
 protected:
 
@@ -113,6 +114,10 @@ public:
 
 	// Name space expansion handling
 	virtual bool nameSpacesExpanded(void) const;
+	// True if namespace nodes in the output node-set are implied by their
+	// element rather than having been expanded into the DOM.  Passed down
+	// the chain until something expands or builds a new document
+	virtual bool nameSpacesVirtual(void) const;
 	virtual void expandNameSpaces(void);
 	void deleteExpandedNameSpaces(void);
 
@@ -36,7 +36,7 @@
 
 XERCES_CPP_NAMESPACE_USE
 
-TXFMBase64::TXFMBase64(DOMDocument *doc, bool decode) : TXFMBase(doc) {
+TXFMBase64::TXFMBase64(DOMDocument *doc, bool decode) : TXFMBase(doc), m_metrics(XSEC_METRIC_BASE64) {
 
 	m_complete = false;					// Nothing yet to output
 	m_remaining = 0;
@@ -126,7 +126,9 @@ unsigned int TXFMBase64::readBytes(XMLByte * const toFill, unsigned int maxToFil
 		if (m_complete == false && m_remaining == 0) {
 
 			unsigned int sz = input->readBytes(m_inputBuffer, 1024);
-		
+			bool timed = XSECMetricTimer::isEnabled();
+			XMLUInt64 start = (timed ? XSECMetricTimer::now() : 0);
+
 			if (m_doDecode) {
 				
 				if (sz == 0) {
@@ -145,6 +147,9 @@ unsigned int TXFMBase64::readBytes(XMLByte * const toFill, unsigned int maxToFil
 				else
 					m_remaining = mp_b64->encode(m_inputBuffer, sz, m_outputBuffer, 2048);
 			}
+
+			if (timed)
+				m_metrics.add(start, sz);
 		}
 
 	}
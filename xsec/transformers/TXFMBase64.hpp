@@ -30,6 +30,7 @@
 
 #include <xsec/transformers/TXFMBase.hpp>
 #include <xsec/enc/XSECCryptoBase64.hpp>
+#include <xsec/framework/XSECMetrics.hpp>
  
 /**
  * \brief Transformer to handle base64 transforms
@@ -68,5 +69,7 @@ private:
 	unsigned int		m_remaining;				// How much data is left in the buffer?
 	XSECCryptoBase64 *	mp_b64;
 	bool				m_doDecode;					// Are we encoding or decoding?
+	XSECMetricAccumulator
+						m_metrics;
 };
 
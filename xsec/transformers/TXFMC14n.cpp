@@ -32,16 +32,23 @@
 #include <xsec/framework/XSECException.hpp>
 #include <xsec/transformers/TXFMParser.hpp>
 #include <xsec/framework/XSECError.hpp>
+#include <xsec/framework/XSECTrace.hpp>
+#include <xsec/utils/XSECPlatformUtils.hpp>
 
 XERCES_CPP_NAMESPACE_USE
 
-TXFMC14n::TXFMC14n(DOMDocument *doc) : TXFMBase(doc) {
+TXFMC14n::TXFMC14n(DOMDocument *doc) : TXFMBase(doc), m_metrics(XSEC_METRIC_C14N),
+	m_traceStart(0), m_traced(false) {
 
 	mp_c14n = NULL;
 
 }
 TXFMC14n::~TXFMC14n() {
 
+	// Output was never read to the end
+	if (m_traceStart != 0)
+		endTrace();
+
 	if (mp_c14n != NULL) {
 		delete mp_c14n;
 	}
@@ -110,6 +117,9 @@ void TXFMC14n::setInput(TXFMBase *newInput) {
 	mp_c14n->setCommentsProcessing(keepComments);			// By default we strip comments
 	// Do we use the namespace map?
 	mp_c14n->setUseNamespaceStack(!input->nameSpacesExpanded());
+	mp_c14n->setVirtualNamespaceNodes(input->nameSpacesVirtual());
+	// Split large documents across threads?
+	mp_c14n->setParallelProcessing(XSECPlatformUtils::GetCanonicalizationThreads());
 
 }
 
@@ -174,6 +184,32 @@ unsigned int TXFMC14n::readBytes(XMLByte * const toFill, unsigned int maxToFill)
 
 		return 0;
 
-	return (unsigned int) mp_c14n->outputBuffer(toFill, maxToFill);
+	// Canonicalisation is traced as a single span from the first read to
+	// the last, rather than an event per buffer
+	if (m_traceStart == 0 && !m_traced && XSECTrace::isEnabled())
+		m_traceStart = XSECMetricTimer::now();
+
+	unsigned int ret;
+
+	if (!XSECMetricTimer::isEnabled())
+		ret = (unsigned int) mp_c14n->outputBuffer(toFill, maxToFill);
+	else {
+		XMLUInt64 start = XSECMetricTimer::now();
+		ret = (unsigned int) mp_c14n->outputBuffer(toFill, maxToFill);
+		m_metrics.add(start, ret);
+	}
+
+	if (ret == 0 && m_traceStart != 0)
+		endTrace();
+
+	return ret;
+
+}
+
+void TXFMC14n::endTrace() {
+
+	XSECTrace::event("c14n", NULL, m_traceStart);
+	m_traceStart = 0;
+	m_traced = true;
 
 }
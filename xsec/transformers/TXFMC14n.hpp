@@ -30,6 +30,7 @@
 #include <xsec/utils/XSECSafeBuffer.hpp>
 #include <xsec/canon/XSECC14n20010315.hpp>
 #include <xsec/utils/XSECNameSpaceExpander.hpp>
+#include <xsec/framework/XSECMetrics.hpp>
 
 /**
  * \brief Transformer to handle canonicalization transforms
@@ -69,5 +70,11 @@ public:
 private:
     TXFMC14n();
 
+    // Report the span over which output was produced
+    void endTrace();
+
     XSECC14n20010315* mp_c14n;
+    XSECMetricAccumulator m_metrics;
+    XMLUInt64 m_traceStart;         // When output began (0 if not tracing)
+    bool m_traced;
 };
@@ -33,6 +33,7 @@
 #define TXFMCHAIN_INCLUDE
 
 #include <xsec/framework/XSECDefs.hpp>
+#include <xsec/framework/XSECMemory.hpp>
 
 class TXFMBase;
 
@@ -44,7 +45,7 @@ class TXFMBase;
  */
 
 
-class XSEC_EXPORT TXFMChain {
+class XSEC_EXPORT TXFMChain : public XSECMemory {
 
 public:
 
@@ -31,6 +31,7 @@
 #include <xsec/framework/XSECDefs.hpp>
 #include <xsec/transformers/TXFMCipher.hpp>
 #include <xsec/utils/XSECPlatformUtils.hpp>
+#include <xsec/framework/XSECError.hpp>
 #include <xsec/framework/XSECException.hpp>
 
 XERCES_CPP_NAMESPACE_USE
@@ -44,6 +45,10 @@ TXFMBase(doc),
 m_doEncrypt(encrypt),
 m_taglen(taglen),
 mp_cipher(NULL),
+m_inputSize(2048),
+mp_inputBuffer(NULL),
+mp_outputBuffer(NULL),
+m_outputOffset(0),
 m_remaining(0) {
 
     if (key && key->getKeyType() == XSECCryptoKey::KEY_SYMMETRIC)
@@ -68,11 +73,37 @@ m_remaining(0) {
 		throw;
 	}
 
+	// Large CBC decrypts can be split across threads by the provider, but
+	// only if the input is handed over in big enough pieces
+	if (!m_doEncrypt && mode == XSECCryptoSymmetricKey::MODE_CBC &&
+		XSECPlatformUtils::GetParallelDecryptionThreads() > 1) {
+
+		unsigned int threshold = XSECPlatformUtils::GetParallelDecryptionThreshold();
+		if (threshold > m_inputSize)
+			m_inputSize = (threshold + 15) & ~15U;	// Keep whole blocks
+
+	}
+
+	m_outputSize = m_inputSize + 1024;
+
+	try {
+		XSECnew(mp_inputBuffer, unsigned char[m_inputSize + 2]);
+		XSECnew(mp_outputBuffer, unsigned char[m_outputSize]);
+	}
+	catch (...) {
+		delete[] mp_inputBuffer;
+		delete mp_cipher;
+		mp_cipher = NULL;
+		throw;
+	}
+
 };
 
 TXFMCipher::~TXFMCipher() {
 
 		delete mp_cipher;
+		delete[] mp_inputBuffer;
+		delete[] mp_outputBuffer;
 
 };
 
@@ -123,11 +154,9 @@ unsigned int TXFMCipher::readBytes(XMLByte * const toFill, unsigned int maxToFil
 			// Copy anything remaining in the buffer to the output
 
 			fill = (leftToFill > m_remaining ? m_remaining : leftToFill);
-			memcpy(&toFill[ret], m_outputBuffer, fill);
-
-			if (fill < m_remaining)
-				memmove(m_outputBuffer, m_outputBuffer + fill, (m_remaining - fill));
+			memcpy(&toFill[ret], &mp_outputBuffer[m_outputOffset], fill);
 
+			m_outputOffset += fill;
 			m_remaining -= fill;
 			leftToFill -= fill;
 			ret += fill;
@@ -137,27 +166,37 @@ unsigned int TXFMCipher::readBytes(XMLByte * const toFill, unsigned int maxToFil
 
 		if (m_complete == false && m_remaining == 0) {
 
-			unsigned int sz = input->readBytes(m_inputBuffer, 2048);
-		
+			m_outputOffset = 0;
+
+			unsigned int sz = input->readBytes(mp_inputBuffer, m_inputSize);
+
+			// For big reads, fill the buffer so the provider sees whole blocks
+			if (m_inputSize > 2048 && sz > 0) {
+				unsigned int more;
+				while (sz < m_inputSize &&
+					(more = input->readBytes(&mp_inputBuffer[sz], m_inputSize - sz)) > 0)
+					sz += more;
+			}
+
 			XSECCryptoSymmetricKey * symCipher = 
 				(XSECCryptoSymmetricKey*) mp_cipher;
 			if (m_doEncrypt) {
 					
 				if (sz == 0) {
 					m_complete = true;
-					m_remaining = symCipher->encryptFinish(m_outputBuffer, 3072, m_taglen);
+					m_remaining = symCipher->encryptFinish(mp_outputBuffer, m_outputSize, m_taglen);
 				}
 				else
-					m_remaining = symCipher->encrypt(m_inputBuffer, m_outputBuffer, sz, 3072);
+					m_remaining = symCipher->encrypt(mp_inputBuffer, mp_outputBuffer, sz, m_outputSize);
 			}
 			else {
 
 				if (sz == 0) {
 					m_complete = true;
-					m_remaining = symCipher->decryptFinish(m_outputBuffer, 3072);
+					m_remaining = symCipher->decryptFinish(mp_outputBuffer, m_outputSize);
 				}
 				else
-					m_remaining = symCipher->decrypt(m_inputBuffer, m_outputBuffer, sz, 3072);
+					m_remaining = symCipher->decrypt(mp_inputBuffer, mp_outputBuffer, sz, m_outputSize);
 			}
 		}
 
@@ -80,8 +80,11 @@ private:
     unsigned int            m_taglen;           // Length of Authentication Tag for AEAD ciphers
 	XSECCryptoKey			* mp_cipher;		// Crypto implementation
 	bool					m_complete;
-	unsigned char			m_inputBuffer[2050];
-	unsigned char			m_outputBuffer[3072];	// Always keep 2K of data
+	unsigned int			m_inputSize;		// Cipher text read per operation
+	unsigned char			* mp_inputBuffer;
+	unsigned char			* mp_outputBuffer;	// Input size + 1K
+	unsigned int			m_outputSize;
+	unsigned int			m_outputOffset;		// Start of remaining output
 	unsigned int			m_remaining;		// Amount remaining in output
 
 };
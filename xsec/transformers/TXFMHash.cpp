@@ -29,9 +29,36 @@
 #include <xsec/framework/XSECException.hpp>
 #include <xsec/transformers/TXFMHash.hpp>
 #include <xsec/utils/XSECPlatformUtils.hpp>
+#include <xsec/framework/XSECMetrics.hpp>
+#include <xsec/dsig/DSIGConstants.hpp>
 
 XERCES_CPP_NAMESPACE_USE
 
+// Name the hash for the metrics breakdown
+
+static const XMLCh* getHashURI(XSECCryptoHash::HashType type) {
+
+    switch (type) {
+
+    case XSECCryptoHash::HASH_SHA1 :
+        return DSIGConstants::s_unicodeStrURISHA1;
+    case XSECCryptoHash::HASH_MD5 :
+        return DSIGConstants::s_unicodeStrURIMD5;
+    case XSECCryptoHash::HASH_SHA224 :
+        return DSIGConstants::s_unicodeStrURISHA224;
+    case XSECCryptoHash::HASH_SHA256 :
+        return DSIGConstants::s_unicodeStrURISHA256;
+    case XSECCryptoHash::HASH_SHA384 :
+        return DSIGConstants::s_unicodeStrURISHA384;
+    case XSECCryptoHash::HASH_SHA512 :
+        return DSIGConstants::s_unicodeStrURISHA512;
+    default :
+        return NULL;
+
+    }
+
+}
+
 TXFMHash::TXFMHash(DOMDocument* doc, XSECCryptoHash::HashType type, const XSECCryptoKey* key) :
     TXFMBase(doc), mp_h(NULL), md_value(NULL), md_len(0), toOutput(0) {
 
@@ -100,13 +127,34 @@ void TXFMHash::setInput(TXFMBase* inputT) {
     unsigned char buffer[1024];
     unsigned int size;
 
-    while ((size = input->readBytes((XMLByte *) buffer, 1024)) != 0) {
-        mp_h->hash(buffer, size);
+    if (!XSECMetricTimer::isEnabled()) {
+
+        while ((size = input->readBytes((XMLByte *) buffer, 1024)) != 0) {
+            mp_h->hash(buffer, size);
+        }
+
+        // Finalise
+
+        md_len = mp_h->finish(md_value, XSECPlatformUtils::g_cryptoProvider->getMaxHashSize());
+
     }
+    else {
 
-    // Finalise
+        // Only time the hashing, not the transforms feeding it
+        XSECMetricAccumulator metrics(XSEC_METRIC_DIGEST, getHashURI(mp_h->getHashType()));
+        XMLUInt64 start;
 
-    md_len = mp_h->finish(md_value, XSECPlatformUtils::g_cryptoProvider->getMaxHashSize());
+        while ((size = input->readBytes((XMLByte *) buffer, 1024)) != 0) {
+            start = XSECMetricTimer::now();
+            mp_h->hash(buffer, size);
+            metrics.add(start, size);
+        }
+
+        start = XSECMetricTimer::now();
+        md_len = mp_h->finish(md_value, XSECPlatformUtils::g_cryptoProvider->getMaxHashSize());
+        metrics.add(start, 0);
+
+    }
 
     toOutput = md_len;
 }
@@ -71,7 +71,8 @@ TXFMParser::~TXFMParser() {
 
 bool TXFMParser::nameSpacesExpanded(void) const {
 
-	// NOTE : Do not check inputs as this has its own document
+	// NOTE : Do not check inputs as this has its own document, so any
+	// expansion only ever touches the parsed copy
 
 	return (mp_nse != NULL);
 
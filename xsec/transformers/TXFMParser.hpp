@@ -70,6 +70,7 @@ public:
 
 	// Name space management
 	virtual bool nameSpacesExpanded(void) const;
+	virtual bool nameSpacesVirtual(void) const {return false;}
 	virtual void expandNameSpaces(void);
 
 	
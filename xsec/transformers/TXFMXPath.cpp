@@ -243,6 +243,39 @@ void TXFMXPath::setInput(TXFMBase *newInput) {
 
 }
 
+// Intersect with a node-set whose namespace nodes are implied by their
+// element (see TXFMBase::nameSpacesVirtual).  Namespace attributes expanded
+// for this transform are kept if their owner element is in the input
+
+void intersectVirtualNS(XSECXPathNodeList &lst, const XSECXPathNodeList &toIntersect) {
+
+	XSECXPathNodeList ret;
+	const XMLCh * name;
+
+	const DOMNode * n = lst.getFirstNode();
+	while (n != NULL) {
+
+		if (toIntersect.hasNode(n))
+			ret.addNode(n);
+
+		else if (n->getNodeType() == DOMNode::ATTRIBUTE_NODE) {
+
+			name = n->getNodeName();
+			if (XMLString::compareNString(name, DSIGConstants::s_unicodeStrXmlns, 5) == 0 &&
+				(name[5] == chNull || name[5] == chColon) &&
+				toIntersect.hasNode(((const DOMAttr *) n)->getOwnerElement()))
+				ret.addNode(n);
+
+		}
+
+		n = lst.getNextNode();
+
+	}
+
+	lst = ret;
+
+}
+
 bool separator(unsigned char c) {
 
 	if (c >= 'a' && c <= 'z')
@@ -478,7 +511,10 @@ void TXFMXPath::evaluateExpr(DOMNode *h, safeBuffer inexpr) {
 		if (inputType == DOM_NODE_XPATH_NODESET) {
 			//the input list was a XPATH nodeset, so we must intersect the 
 			// results of the XPath processing done above with the input nodeset
-			m_XPathMap.intersect(input->getXPathNodeList());
+			if (input->nameSpacesVirtual())
+				intersectVirtualNS(m_XPathMap, input->getXPathNodeList());
+			else
+				m_XPathMap.intersect(input->getXPathNodeList());
 		}
 	}
 
@@ -62,6 +62,14 @@ XSEC_DECLARE_XERCES_CLASS(DOMNamedNodeMap);
 
 /**
  * \brief Transformer to handle XPath transforms
+ *
+ * Xalan only sees namespace nodes that exist as attributes, so this
+ * transform still expands namespaces into the input document (and adds
+ * the XPath namespace context to the document element) while it runs.
+ * The document is restored once the Reference is done with the chain,
+ * but it is not safe to verify the same document on several threads
+ * if an XPath transform is in use.
+ *
  * @ingroup internal
  */
 
@@ -158,7 +158,6 @@ void TXFMXPathFilter::setInput(TXFMBase* newInput) {
         }
 
         input = parser;
-        parser->expandNameSpaces();
     }
     else {
         input = newInput;
@@ -167,8 +166,9 @@ void TXFMXPathFilter::setInput(TXFMBase* newInput) {
     // Set up for the new document
     document = input->getDocument();
 
-    // Expand if necessary
-    this->expandNameSpaces();
+    // No need to expand name spaces.  Filter 2.0 selects whole subtrees, so a
+    // namespace node is in the output exactly when its element is, and
+    // consumers of the node-set can work that out without touching the DOM
 
     keepComments = input->getCommentsStatus();
 }
@@ -633,6 +633,12 @@ TXFMBase::nodeType TXFMXPathFilter::getNodeType() const {
     return TXFMBase::DOM_NODE_XPATH_NODESET;
 }
 
+bool TXFMXPathFilter::nameSpacesVirtual() const {
+    // If something upstream already expanded the document, the expanded
+    // attributes are in the node-set like any other
+    return !nameSpacesExpanded();
+}
+
 // Methods to get output data
 
 unsigned int TXFMXPathFilter::readBytes(XMLByte* const toFill, unsigned int maxToFill) {
@@ -74,6 +74,9 @@ public:
     virtual TXFMBase::ioType getOutputType() const;
     virtual TXFMBase::nodeType getNodeType() const;
 
+    // Namespace nodes follow their element, so the DOM is never expanded
+    virtual bool nameSpacesVirtual(void) const;
+
     // XPathFilter unique
 
     void evaluateExprs(DSIGTransformXPathFilter::exprVectorType* exprs);
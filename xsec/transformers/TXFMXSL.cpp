@@ -77,7 +77,8 @@ CallbackSizeType TransformXSLOutputFn(const char * s, CallbackSizeType sz, void
 
 bool TXFMXSL::nameSpacesExpanded(void) const {
 
-	// NOTE : Do not check inputs as this has its own document
+	// NOTE : Do not check inputs as this has its own document, so any
+	// expansion only ever touches the transform output
 
 	return (mp_nse != NULL);
 
@@ -95,6 +95,7 @@ public:
 	// We do our own name spaces - we have a new document!
 	
 	virtual bool nameSpacesExpanded(void) const;
+	virtual bool nameSpacesVirtual(void) const {return false;}
 	virtual void expandNameSpaces(void);
 
 
@@ -124,6 +124,115 @@ const XMLCh * getXKMSLocalName(const DOMNode *node) {
 }
 #endif
 
+// --------------------------------------------------------------------------------
+//           Classify namespace URIs
+// --------------------------------------------------------------------------------
+
+XSECNamespaceType getXSECNamespaceType(const XMLCh * uri) {
+
+	if (uri == NULL)
+		return XSEC_NS_OTHER;
+
+	// All the URIs we know about are distinguished by length bar one pair,
+	// so at most two full compares are ever made
+
+	switch (XMLString::stringLen(uri)) {
+
+	case 31 :
+#ifdef XSEC_XKMS_ENABLED
+		if (XMLString::equals(uri, XKMSConstants::s_unicodeStrURIXKMS))
+			return XSEC_NS_XKMS;
+#endif
+		break;
+
+	case 32 :
+		if (XMLString::equals(uri, DSIGConstants::s_unicodeStrURIXENC11))
+			return XSEC_NS_XENC11;
+		break;
+
+	case 33 :
+		if (XMLString::equals(uri, DSIGConstants::s_unicodeStrURIXENC))
+			return XSEC_NS_XENC;
+		if (XMLString::equals(uri, DSIGConstants::s_unicodeStrURIDSIG11))
+			return XSEC_NS_DSIG11;
+		break;
+
+	case 34 :
+		if (XMLString::equals(uri, DSIGConstants::s_unicodeStrURIDSIG))
+			return XSEC_NS_DSIG;
+		break;
+
+	case 39 :
+		if (XMLString::equals(uri, DSIGConstants::s_unicodeStrURIEC))
+			return XSEC_NS_EC;
+		break;
+
+	case 41 :
+		if (XMLString::equals(uri, DSIGConstants::s_unicodeStrURIXPF))
+			return XSEC_NS_XPF;
+		break;
+
+	default :
+		break;
+
+	}
+
+	return XSEC_NS_OTHER;
+
+}
+
+// --------------------------------------------------------------------------------
+//           Look up a name in a sorted table
+// --------------------------------------------------------------------------------
+
+int findSortedName(const XMLCh * name, const XMLCh * const * table, int count) {
+
+	if (name == NULL)
+		return -1;
+
+	int lo = 0;
+	int hi = count - 1;
+
+	while (lo <= hi) {
+
+		int mid = (lo + hi) / 2;
+		int res = XMLString::compareString(name, table[mid]);
+
+		if (res == 0)
+			return mid;
+		if (res < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+
+	}
+
+	return -1;
+
+}
+
+// --------------------------------------------------------------------------------
+//           Compare with a non-ASCII char string
+// --------------------------------------------------------------------------------
+
+bool strEqualsTranscoded(const XMLCh * str1, const char * str2) {
+
+	bool ret;
+	XMLCh * str2XMLCh = XMLString::transcode(str2);
+
+	if (str2XMLCh != NULL) {
+
+		ret = (XMLString::compareString(str1, str2XMLCh) == 0);
+		XSEC_RELEASE_XMLCH(str2XMLCh);
+
+	}
+	else
+		ret = false;
+
+	return ret;
+
+}
+
 // --------------------------------------------------------------------------------
 //           Find a nominated DSIG node in a document
 // --------------------------------------------------------------------------------
@@ -347,6 +456,21 @@ XMLCh * transcodeFromUTF8(const unsigned char * src) {
 
 	// Take a UTF-8 buffer and transcode to UTF-16
 
+	// Plain ASCII needs no transcoder
+	XMLSize_t asciiLen = 0;
+	while (src[asciiLen] != 0 && src[asciiLen] < 0x80)
+		++asciiLen;
+
+	if (src[asciiLen] == 0) {
+
+		XMLCh * ret = (XMLCh *) XMLPlatformUtils::fgMemoryManager->allocate((asciiLen + 1) * sizeof(XMLCh));
+		for (XMLSize_t i = 0; i <= asciiLen; ++i)
+			ret[i] = (XMLCh) src[i];
+
+		return ret;
+
+	}
+
 	safeBuffer fullDest;
 	fullDest.sbXMLChIn(DSIGConstants::s_unicodeStrEmpty);
 	XMLCh outputBuf[2050];
@@ -406,42 +530,8 @@ char * transcodeToUTF8(const XMLCh * src) {
 
 	// Take a UTF-16 buffer and transcode to UTF-8
 
-	safeBuffer fullDest("");
-	unsigned char outputBuf[2050];
-
-	// Grab a transcoder
-	XMLTransService::Codes failReason;
-
-	XMLTranscoder* t =
-		XMLPlatformUtils::fgTransService->makeNewTranscoderFor("UTF-8",
-						   failReason,
-						   2*1024,
-						   XMLPlatformUtils::fgMemoryManager);
-	Janitor<XMLTranscoder> j_t(t);
-
-	// Need to loop through, 2K at a time
-	XMLSize_t charactersEaten, charactersOutput;
-	XMLSize_t totalCharsEaten = 0;
-	XMLSize_t charsToEat = XMLString::stringLen(src);
-
-	while (totalCharsEaten < charsToEat) {
-
-		XMLSize_t toEat = charsToEat - totalCharsEaten;
-
-		if (toEat > 2048)
-			toEat = 2048;
-
-		charactersOutput = t->transcodeTo(&src[totalCharsEaten],
-						toEat,
-						(unsigned char * const) outputBuf,
-						2048,
-						charactersEaten,
-						XMLTranscoder::UnRep_RepChar);
-
-		outputBuf[charactersOutput] = '\0';
-		fullDest.sbStrcatIn((char *) outputBuf);
-		totalCharsEaten += charactersEaten;
-	}
+	safeBuffer fullDest;
+	fullDest.sbUTF8In(src);
 
 	// Dup and output
 	return XMLString::replicate(fullDest.rawCharBuffer());
@@ -36,6 +36,7 @@
 #include <xsec/utils/XSECPlatformUtils.hpp>
 #include <xsec/utils/XSECSafeBuffer.hpp>
 #include <xsec/dsig/DSIGConstants.hpp>
+#include <xsec/framework/XSECEnv.hpp>
 
 // Xerces
 
@@ -80,6 +81,17 @@ const XMLCh XSEC_EXPORT * getXENC11LocalName(const XERCES_CPP_NAMESPACE_QUALIFIE
 #ifdef XSEC_XKMS_ENABLED
 const XMLCh XSEC_EXPORT * getXKMSLocalName(const XERCES_CPP_NAMESPACE_QUALIFIER DOMNode *node);
 #endif
+
+// Classify a namespace URI (see XSECEnv::getNamespaceType for the cached
+// version)
+
+XSECNamespaceType XSEC_EXPORT getXSECNamespaceType(const XMLCh * uri);
+
+// Binary search for name in a table sorted by XMLString::compareString.
+// Returns the index of the entry, or -1 if it is not there.
+
+int XSEC_EXPORT findSortedName(const XMLCh * name, const XMLCh * const * table, int count);
+
 // --------------------------------------------------------------------------------
 //           Do UTF-8 <-> UTF-16 transcoding
 // --------------------------------------------------------------------------------
@@ -159,41 +171,45 @@ bool strEquals (const char * str1, const char *str2) {
 
 }
 
-inline 
-bool strEquals (const char * str1, const XMLCh * str2) {
+// Mixed comparisons are almost always against ASCII literals (element
+// and attribute names, well known URIs).  These are compared directly,
+// without transcoding (and so allocating) the literal.  Anything
+// outside ASCII falls back to a transcoded compare.
 
-	bool ret;
-	XMLCh * str1XMLCh = XMLString::transcode(str1);
+bool XSEC_EXPORT strEqualsTranscoded(const XMLCh * str1, const char * str2);
 
-	if (str1XMLCh != NULL) {
+inline
+bool strEquals (const XMLCh * str1, const char * str2) {
 
-		ret = (XMLString::compareString(str1XMLCh, str2) == 0);
-		XSEC_RELEASE_XMLCH(str1XMLCh);
+	if (str2 == NULL)
+		return false;
 
-	}
-	else
-		ret = false;
+	// As for XMLString::compareString, NULL matches the empty string
+	if (str1 == NULL)
+		return (*str2 == 0);
 
-	return ret;
+	const unsigned char * s2 = (const unsigned char *) str2;
+	while (*s2 != 0 && *s2 < 0x80) {
 
-}
+		if (*str1 != (XMLCh) *s2)
+			return false;
 
-inline 
-bool strEquals (const XMLCh * str1, const char * str2) {
+		++str1;
+		++s2;
 
-	bool ret;
-	XMLCh * str2XMLCh = XMLString::transcode(str2);
+	}
 
-	if (str2XMLCh != NULL) {
+	if (*s2 == 0)
+		return (*str1 == 0);
 
-		ret = (XMLString::compareString(str1, str2XMLCh) == 0);
-		XSEC_RELEASE_XMLCH(str2XMLCh);
+	return strEqualsTranscoded(str1, (const char *) s2);
 
-	}
-	else
-		ret = false;
+}
+
+inline
+bool strEquals (const char * str1, const XMLCh * str2) {
 
-	return ret;
+	return strEquals(str2, str1);
 
 }
 
@@ -40,8 +40,6 @@ XSECNameSpaceExpander::XSECNameSpaceExpander(DOMDocument *d) {
 
 	mp_doc = d;
 	mp_fragment = d->getDocumentElement();
-	XSECnew(mp_formatter, XSECSafeBufferFormatter("UTF-8",XMLFormatter::NoEscapes, 
-												XMLFormatter::UnRep_CharRef));
 
 	m_expanded = false;
 	
@@ -51,8 +49,6 @@ XSECNameSpaceExpander::XSECNameSpaceExpander(DOMElement *f) {
 
 	mp_doc = NULL;
 	mp_fragment = f;
-	XSECnew(mp_formatter, XSECSafeBufferFormatter("UTF-8",XMLFormatter::NoEscapes, 
-												XMLFormatter::UnRep_CharRef));
 
 	m_expanded = false;
 	
@@ -60,9 +56,6 @@ XSECNameSpaceExpander::XSECNameSpaceExpander(DOMElement *f) {
 
 XSECNameSpaceExpander::~XSECNameSpaceExpander() {
 
-	if (mp_formatter != NULL)
-		delete mp_formatter;
-
 }
 
 void XSECNameSpaceExpander::recurse(DOMElement *n) {
@@ -78,7 +71,7 @@ void XSECNameSpaceExpander::recurse(DOMElement *n) {
 
 	DOMNamedNodeMap *nmap = n->getAttributes();
 
-	safeBuffer pname, pURI, nURI;
+	const XMLCh *pname;
 	DOMNode *finder;
 
 	XSECNameSpaceEntry * tmpEnt;
@@ -86,26 +79,27 @@ void XSECNameSpaceExpander::recurse(DOMElement *n) {
 	for (XMLSize_t i = 0; i < psize; i++) {
 
 		// Run through each parent node to find namespaces
-		pname << (*mp_formatter << pmap->item(i)->getNodeName());
+		pname = pmap->item(i)->getNodeName();
 
-		// See if this is an xmlns node
+		// See if this is an xmlns node (compare in place - only names that
+		// are actually added need to be transcoded)
 		
-		if (pname.sbStrncmp("xmlns", 5) == 0) {
+		if (XMLString::compareNString(pname, DSIGConstants::s_unicodeStrXmlns, 5) == 0) {
 
 			// It is - see if it already exists
-			finder = nmap->getNamedItem(pname.sbStrToXMLCh());
+			finder = nmap->getNamedItem(pname);
 			if (finder == 0) {
 
 				// Need to add
 				n->setAttributeNS(DSIGConstants::s_unicodeStrURIXMLNS, 
-					pmap->item(i)->getNodeName(),
+					pname,
 					pmap->item(i)->getNodeValue());
 
 				// Add it to the list so it can be removed later
 				XSECnew(tmpEnt, XSECNameSpaceEntry);
-				tmpEnt->m_name.sbStrcpyIn(pname);
+				tmpEnt->m_name.sbUTF8In(pname);
 				tmpEnt->mp_node = n;
-				tmpEnt->mp_att = nmap->getNamedItem(pname.sbStrToXMLCh());
+				tmpEnt->mp_att = nmap->getNamedItem(pname);
 				m_lst.push_back(tmpEnt);
 
 			}
@@ -89,6 +89,13 @@ struct XSECNameSpaceEntry {
  * removes the propogated nodes when it goes out of scope (or when
  * deleteAddedNamespaces() is called).
  *
+ * @note Expansion modifies the document, so it is only used where the XPath
+ * engine itself has to see namespace nodes (the XPath transform), or on a
+ * document private to a transform (parsed or XSLT output).  The
+ * canonicaliser resolves in-scope namespaces from its own stack, and XPath
+ * Filter 2.0 node-sets treat namespace nodes as implied by their element
+ * (TXFMBase::nameSpacesVirtual()), so neither writes to the DOM.
+ *
  */
 
 
@@ -167,7 +174,6 @@ private:  // Functions
 	XERCES_CPP_NAMESPACE_QUALIFIER DOMElement                      
 									* mp_fragment;  // If we are doing a fragment
 	bool							m_expanded;		// Have we expanded already?
-	XSECSafeBufferFormatter			* mp_formatter;
 
 };
 
@@ -32,6 +32,8 @@
 
 #include <xsec/utils/XSECPlatformUtils.hpp>
 #include <xsec/framework/XSECError.hpp>
+#include <xsec/framework/XSECMemory.hpp>
+#include <xsec/framework/XSECTrace.hpp>
 #include <xsec/dsig/DSIGConstants.hpp>
 #include <xsec/dsig/DSIGSignature.hpp>
 #include <xsec/xkms/XKMSConstants.hpp>
@@ -39,6 +41,7 @@
 #include <xsec/transformers/TXFMOutputFile.hpp>
 
 #include "../xenc/impl/XENCCipherImpl.hpp"
+#include "../utils/XSECThreadPool.hpp"
 
 XERCES_CPP_NAMESPACE_USE
 
@@ -60,10 +63,16 @@ XSECCryptoProvider * XSECPlatformUtils::g_cryptoProvider = NULL;
 
 // Have a const copy for external usage
 const XSECAlgorithmMapper * XSECPlatformUtils::g_algorithmMapper = NULL;
+MemoryManager * XSECPlatformUtils::g_memoryManager = NULL;
+XSECMetricsSink * XSECPlatformUtils::g_metricsSink = NULL;
+XSECTraceSink * XSECPlatformUtils::g_traceSink = NULL;
 
 XSECAlgorithmMapper * internalMapper = NULL;
 
 XSECPlatformUtils::TransformFactory* XSECPlatformUtils::g_loggingSink = NULL;
+unsigned int XSECPlatformUtils::g_c14nThreads = 1;
+unsigned int XSECPlatformUtils::g_decryptThreads = 1;
+unsigned int XSECPlatformUtils::g_decryptThreshold = XSEC_PARALLEL_DECRYPT_THRESHOLD;
 
 // Determine default crypto provider
 
@@ -88,11 +97,19 @@ TXFMBase* TXFMOutputFileFactory(DOMDocument* doc) {
 
 }
 
-void XSECPlatformUtils::Initialise(XSECCryptoProvider * p) {
+void XSECPlatformUtils::Initialise(XSECCryptoProvider * p, MemoryManager * manager,
+								   XSECMetricsSink * metrics) {
 
 	if (++initCount > 1)
 		return;
 
+	// Set up internal allocation
+	g_memoryManager = manager;
+	XSECMemory::initialise();
+	XSECTrace::initialise();
+
+	g_metricsSink = metrics;
+
 	if (p != NULL)
 		g_cryptoProvider = p;
 	else
@@ -142,11 +159,54 @@ void XSECPlatformUtils::SetReferenceLoggingSink(TransformFactory* factory) {
 
 }
 
+void XSECPlatformUtils::SetMetricsSink(XSECMetricsSink * metrics) {
+
+    g_metricsSink = metrics;
+
+}
+
+void XSECPlatformUtils::SetTraceSink(XSECTraceSink * trace) {
+
+    g_traceSink = trace;
+
+}
+
 TXFMBase* XSECPlatformUtils::GetReferenceLoggingSink(DOMDocument* doc) {
 
     return (g_loggingSink ? g_loggingSink(doc) : NULL);
 }
 
+void XSECPlatformUtils::SetCanonicalizationThreads(unsigned int threads) {
+
+    g_c14nThreads = (threads == 0 ? XSECThreadPool::getProcessorCount() : threads);
+
+}
+
+unsigned int XSECPlatformUtils::GetCanonicalizationThreads(void) {
+
+    return g_c14nThreads;
+
+}
+
+void XSECPlatformUtils::SetParallelDecryption(unsigned int threads, unsigned int threshold) {
+
+    g_decryptThreads = (threads == 0 ? XSECThreadPool::getProcessorCount() : threads);
+    g_decryptThreshold = threshold;
+
+}
+
+unsigned int XSECPlatformUtils::GetParallelDecryptionThreads(void) {
+
+    return g_decryptThreads;
+
+}
+
+unsigned int XSECPlatformUtils::GetParallelDecryptionThreshold(void) {
+
+    return g_decryptThreshold;
+
+}
+
 void XSECPlatformUtils::Terminate(void) {
 
 	if (--initCount > 0)
@@ -163,6 +223,12 @@ void XSECPlatformUtils::Terminate(void) {
 	XKMSConstants::destroy();
 #endif
 
+	XSECMemory::terminate();
+	XSECTrace::terminate();
+	g_memoryManager = NULL;
+	g_metricsSink = NULL;
+	g_traceSink = NULL;
+
 }
 
 void XSECPlatformUtils::registerAlgorithmHandler(
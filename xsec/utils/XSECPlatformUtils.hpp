@@ -38,12 +38,19 @@
 #include <xsec/framework/XSECDefs.hpp>
 #include <xsec/enc/XSECCryptoProvider.hpp>
 
+XSEC_DECLARE_XERCES_CLASS(MemoryManager);
+
 class TXFMBase;
 class XSECAlgorithmMapper;
 class XSECAlgorithmHandler;
+class XSECMetricsSink;
+class XSECTraceSink;
 
 #include <stdio.h>
 
+// Default size above which a cipher text is decrypted in parallel
+#define XSEC_PARALLEL_DECRYPT_THRESHOLD		(1024 * 1024)
+
 /**
  * \brief High level library interface class.
  * @ingroup internal
@@ -107,6 +114,41 @@ public :
 
 	static const XSECAlgorithmMapper * g_algorithmMapper;
 
+	/**
+	 * \brief The memory manager for internal objects
+	 *
+	 * The short lived objects the library creates while processing (see
+	 * XSECMemory) are allocated from this memory manager when no XSECArena
+	 * is active.  If NULL, the global heap is used.
+	 *
+	 * @note Set via XSECPlatformUtils::Initialise().
+	 */
+
+	static XERCES_CPP_NAMESPACE_QUALIFIER MemoryManager * g_memoryManager;
+
+	/**
+	 * \brief The sink for timings and counters
+	 *
+	 * If not NULL, the library reports how long each stage of processing
+	 * takes (see XSECMetricStage) to this sink.
+	 *
+	 * @note Set via XSECPlatformUtils::Initialise() or
+	 * XSECPlatformUtils::SetMetricsSink().
+	 */
+
+	static XSECMetricsSink * g_metricsSink;
+
+	/**
+	 * \brief The sink for trace events
+	 *
+	 * If not NULL, the library reports each Reference, transform and
+	 * stage of processing it traces (see XSECTraceSink) to this sink.
+	 *
+	 * @note Set via XSECPlatformUtils::SetTraceSink().
+	 */
+
+	static XSECTraceSink * g_traceSink;
+
 	/**
 	 * \brief Initialise the library
 	 *
@@ -118,9 +160,16 @@ public :
 	 * @param p A pointer to a XSECCryptoProvider object that the library 
 	 * should use for cryptographic functions.  If p == NULL, the library
 	 * will instantiate an OpenSSLCryptoProvider object.
+	 * @param manager The memory manager to allocate internal objects from,
+	 * or NULL for the global heap.  Ownership is not taken, and the manager
+	 * must remain valid until after Terminate() is called.
+	 * @param metrics Sink to report timings and counters to (e.g. an
+	 * XSECMetrics), or NULL to disable them.  Ownership is not taken.
 	 */
 
-	static void Initialise(XSECCryptoProvider * p = NULL);
+	static void Initialise(XSECCryptoProvider * p = NULL,
+		XERCES_CPP_NAMESPACE_QUALIFIER MemoryManager * manager = NULL,
+		XSECMetricsSink * metrics = NULL);
 
 	/**
 	 * \brief Set a new crypto provider
@@ -195,6 +244,30 @@ public :
      */
     static void SetReferenceLoggingSink(TransformFactory* factory);
 
+	/**
+	 * \brief Set (or clear) the sink for timings and counters
+	 *
+	 * @note This is not thread safe.  It should be called while no other
+	 * threads are using the library.
+	 * @param metrics The sink, or NULL to stop measuring.  Ownership is
+	 * not taken, and the sink must remain valid until it is replaced or
+	 * Terminate() is called.
+	 */
+
+	static void SetMetricsSink(XSECMetricsSink * metrics);
+
+	/**
+	 * \brief Set (or clear) the sink for trace events
+	 *
+	 * @note This is not thread safe.  It should be called while no other
+	 * threads are using the library.
+	 * @param trace The sink (e.g. an XSECTraceWriter), or NULL to stop
+	 * tracing.  Ownership is not taken, and the sink must remain valid
+	 * until it is replaced or Terminate() is called.
+	 */
+
+	static void SetTraceSink(XSECTraceSink * trace);
+
     /**
      * \brief Returns a transform for logging of Reference processing
      *
@@ -203,6 +276,62 @@ public :
      */
     static TXFMBase* GetReferenceLoggingSink(XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument* doc);
 
+	/**
+	 * \brief Set the number of threads used to canonicalise whole documents
+	 *
+	 * When more than one thread is requested, canonicalisation of a document
+	 * (e.g. a URI="" Reference) splits the children of the document element
+	 * into partitions that are processed concurrently and then digested in
+	 * order.  The output is identical to the serial case.  The default is 1.
+	 *
+	 * @note This is not thread safe.  It should be called prior to any real
+	 * usage of the library.
+	 * @param threads Number of threads to use, or 0 for one per processor
+	 */
+
+	static void SetCanonicalizationThreads(unsigned int threads);
+
+	/**
+	 * \brief Returns the number of threads used to canonicalise documents
+	 */
+
+	static unsigned int GetCanonicalizationThreads(void);
+
+	/**
+	 * \brief Set up parallel decryption of large CBC cipher texts
+	 *
+	 * CBC decryption of each block only depends on the previous cipher
+	 * text block, so a large cipher text can be split into pieces that
+	 * are decrypted concurrently.  When more than one thread is requested,
+	 * providers that support it (currently OpenSSL) decrypt any single
+	 * input of at least threshold bytes this way, and the decryption
+	 * transform reads cipher text in blocks of that size.  Output and
+	 * padding checks are identical to the serial case.  The default is 1
+	 * thread (i.e. off).
+	 *
+	 * Encryption is always serial.
+	 *
+	 * @note This is not thread safe.  It should be called prior to any real
+	 * usage of the library.
+	 * @param threads Number of threads to use, or 0 for one per processor
+	 * @param threshold Smallest input (in bytes) to split across threads
+	 */
+
+	static void SetParallelDecryption(unsigned int threads,
+		unsigned int threshold = XSEC_PARALLEL_DECRYPT_THRESHOLD);
+
+	/**
+	 * \brief Returns the number of threads used to decrypt large inputs
+	 */
+
+	static unsigned int GetParallelDecryptionThreads(void);
+
+	/**
+	 * \brief Returns the smallest input that is decrypted in parallel
+	 */
+
+	static unsigned int GetParallelDecryptionThreshold(void);
+
 	/**
 	 * \brief Terminate
 	 *
@@ -218,6 +347,9 @@ public :
 
 private:
 	static TransformFactory* g_loggingSink;
+	static unsigned int g_c14nThreads;
+	static unsigned int g_decryptThreads;
+	static unsigned int g_decryptThreshold;
 };
 
 
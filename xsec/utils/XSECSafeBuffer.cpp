@@ -616,12 +616,125 @@ void safeBuffer::sbXMLChCat8(const char * str) {
 
 	checkBufferType(BUFFER_UNICODE);
 
+	// Nearly everything passed in is plain ASCII, which can be widened
+	// directly rather than going through a transcoder
+
+	const unsigned char * s = (const unsigned char *) str;
+	XMLSize_t sLen = 0;
+	while (s[sLen] != 0 && s[sLen] < 0x80)
+		++sLen;
+
+	if (s[sLen] == 0) {
+
+		XMLSize_t len = XMLString::stringLen((XMLCh *) buffer);
+		checkAndExpand((len + sLen + 2) * size_XMLCh);
+
+		XMLCh * out = ((XMLCh *) buffer) + len;
+		for (XMLSize_t i = 0; i < sLen; ++i)
+			out[i] = (XMLCh) s[i];
+		out[sLen] = 0;
+
+		return;
+
+	}
+
 	XMLCh * toAdd = transcodeFromUTF8((const unsigned char *) str);
 	sbXMLChCat(toAdd);
 	XSEC_RELEASE_XMLCH(toAdd);
 
 }
 
+// UTF-16 to UTF-8 conversion.  This is stateless, so unlike a Xerces
+// XMLFormatter can be used from any number of objects and threads at once.
+
+static XMLSize_t encodeUTF8(const XMLCh * in, XMLSize_t len, unsigned char * out) {
+
+	XMLSize_t i = 0;
+	unsigned char * o = out;
+
+	while (i < len) {
+
+		// Fast path - check four characters at a time for anything
+		// outside ASCII
+
+		while (i + 4 <= len) {
+
+			XMLUInt64 w;
+			memcpy(&w, in + i, sizeof(w));
+			if ((w & 0xFF80FF80FF80FF80ULL) != 0)
+				break;
+
+			o[0] = (unsigned char) in[i];
+			o[1] = (unsigned char) in[i + 1];
+			o[2] = (unsigned char) in[i + 2];
+			o[3] = (unsigned char) in[i + 3];
+			o += 4;
+			i += 4;
+
+		}
+
+		if (i >= len)
+			break;
+
+		unsigned int c = in[i++];
+
+		if (c < 0x80) {
+			*o++ = (unsigned char) c;
+		}
+		else if (c < 0x800) {
+			*o++ = (unsigned char) (0xC0 | (c >> 6));
+			*o++ = (unsigned char) (0x80 | (c & 0x3F));
+		}
+		else if (c >= 0xD800 && c <= 0xDBFF && i < len &&
+				 in[i] >= 0xDC00 && in[i] <= 0xDFFF) {
+
+			// Surrogate pair
+			c = 0x10000 + ((c - 0xD800) << 10) + (in[i++] - 0xDC00);
+			*o++ = (unsigned char) (0xF0 | (c >> 18));
+			*o++ = (unsigned char) (0x80 | ((c >> 12) & 0x3F));
+			*o++ = (unsigned char) (0x80 | ((c >> 6) & 0x3F));
+			*o++ = (unsigned char) (0x80 | (c & 0x3F));
+
+		}
+		else {
+
+			// Includes unpaired surrogates, which are passed through
+			// as their code unit
+			*o++ = (unsigned char) (0xE0 | (c >> 12));
+			*o++ = (unsigned char) (0x80 | ((c >> 6) & 0x3F));
+			*o++ = (unsigned char) (0x80 | (c & 0x3F));
+
+		}
+
+	}
+
+	return (XMLSize_t) (o - out);
+
+}
+
+void safeBuffer::sbUTF8In(const XMLCh * in) {
+
+	sbUTF8In(in, (in == NULL ? 0 : XMLString::stringLen(in)));
+
+}
+
+void safeBuffer::sbUTF8In(const XMLCh * in, XMLSize_t len) {
+
+	// Each UTF-16 code unit takes at most three bytes
+
+	if (len > (XERCES_SIZE_MAX - DEFAULT_SAFE_BUFFER_SIZE) / 3) {
+		throw XSECException(XSECException::SafeBufferError,
+			"Buffer has grown too large");
+	}
+
+	checkAndExpand(len * 3 + 1);
+
+	XMLSize_t n = (len == 0 ? 0 : encodeUTF8(in, len, buffer));
+	buffer[n] = '\0';
+	m_bufferType = BUFFER_CHAR;
+
+}
+
 // Get functions
 
 XMLSize_t safeBuffer::sbStrlen(void) const {
@@ -142,6 +142,8 @@ public:
 	void sbXMLChCat(const XMLCh *str);			// Append a UTF-16 string to the buffer
 	void sbXMLChCat(const char * str);			// Append a (transcoded) local string to the buffer
 	void sbXMLChCat8(const char * str);			// Append a (transcoded) UTF-8 string to the buffer
+	void sbUTF8In(const XMLCh * in);			// Create a UTF-8 string from UTF-16
+	void sbUTF8In(const XMLCh * in, XMLSize_t len);	// As above, for len characters
 
 	// Sensitive data functions
 	void isSensitive(void);
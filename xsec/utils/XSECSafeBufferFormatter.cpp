@@ -28,6 +28,7 @@
 
 #include <xsec/utils/XSECSafeBufferFormatter.hpp>
 #include <xercesc/util/XMLString.hpp>
+#include <xercesc/util/XMLUni.hpp>
 #include <xsec/framework/XSECError.hpp>
 
 XERCES_CPP_NAMESPACE_USE
@@ -37,36 +38,54 @@ XERCES_CPP_NAMESPACE_USE
 XSECSafeBufferFormatter::XSECSafeBufferFormatter(
 						const XMLCh * const			outEncoding,
 						const XMLFormatter::EscapeFlags	escapeFlags,
-						const XMLFormatter::UnRepFlags unrepFlags) {
+						const XMLFormatter::UnRepFlags unrepFlags) :
+	formatter(NULL),
+	m_escapeFlags(escapeFlags),
+	m_unRepFlags(unrepFlags) {
 
+	mp_outEncoding = XMLString::replicate(outEncoding);
+	init();
 
-	sbf = new sbFormatTarget();
-	sbf->setBuffer(&formatBuffer);
-
-	formatter = new XMLFormatter(outEncoding,
-					0,
-					sbf,
-					escapeFlags,
-					unrepFlags);
 }
 
+XSECSafeBufferFormatter::XSECSafeBufferFormatter(
+						const char * const outEncoding,
+						const XMLFormatter::EscapeFlags	escapeFlags,
+						const XMLFormatter::UnRepFlags unrepFlags) :
+	formatter(NULL),
+	m_escapeFlags(escapeFlags),
+	m_unRepFlags(unrepFlags) {
 
+	mp_outEncoding = XMLString::transcode(outEncoding);
+	init();
 
+}
 
+void XSECSafeBufferFormatter::init(void) {
 
-XSECSafeBufferFormatter::XSECSafeBufferFormatter(
-						const char * const outEncoding,
-						const XMLFormatter::EscapeFlags	escapeFlags,
-						const XMLFormatter::UnRepFlags unrepFlags) {
+	m_isUTF8 = (XMLString::compareIString(mp_outEncoding, XMLUni::fgUTF8EncodingString) == 0);
 
 	sbf = new sbFormatTarget();
 	sbf->setBuffer(&formatBuffer);
 
-	formatter = new XMLFormatter(outEncoding,
+	// Anything other than UTF-8 goes through Xerces from the start, so
+	// an unknown encoding is reported here as it always was
+	if (!m_isUTF8)
+		makeFormatter();
+
+}
+
+void XSECSafeBufferFormatter::makeFormatter(void) {
+
+	if (formatter != NULL)
+		return;
+
+	formatter = new XMLFormatter(mp_outEncoding,
 					0,
 					sbf,
-					escapeFlags,
-					unrepFlags);
+					m_escapeFlags,
+					m_unRepFlags);
+
 }
 
 // Destructor
@@ -79,6 +98,8 @@ XSECSafeBufferFormatter::~XSECSafeBufferFormatter() {
 	if (sbf != NULL)
 		delete sbf;
 
+	XSEC_RELEASE_XMLCH(mp_outEncoding);
+
 }
 
 // Reimplementation of XMLFormatter functions
@@ -89,13 +110,22 @@ void  XSECSafeBufferFormatter::formatBuf (
 				 const XMLFormatter::EscapeFlags escapeFlags,
 				 const XMLFormatter::UnRepFlags unrepFlags) {
 
+	makeFormatter();
 
+	// Output from the fast path will not have moved the format target on
+	sbf->setOffset(formatBuffer.sbStrlen());
 	formatter->formatBuf(toFormat, count, escapeFlags, unrepFlags);
 
 }
 
 XSECSafeBufferFormatter&  XSECSafeBufferFormatter::operator<< (const XMLCh *const toFormat) {
 
+	if (m_isUTF8 && m_escapeFlags == XMLFormatter::NoEscapes) {
+		formatBuffer.sbUTF8In(toFormat);
+		return *this;
+	}
+
+	makeFormatter();
 	sbf->reset();
 	*formatter << toFormat;
 
@@ -106,6 +136,12 @@ XSECSafeBufferFormatter&  XSECSafeBufferFormatter::operator<< (const XMLCh *cons
 XSECSafeBufferFormatter&
      XSECSafeBufferFormatter::operator<< (const XMLCh toFormat) {
 
+	if (m_isUTF8 && m_escapeFlags == XMLFormatter::NoEscapes) {
+		formatBuffer.sbUTF8In(&toFormat, 1);
+		return *this;
+	}
+
+	makeFormatter();
 	sbf->reset();
 	*formatter << toFormat;
 	return *this;
@@ -114,31 +150,38 @@ XSECSafeBufferFormatter&
 
 const XMLCh*  XSECSafeBufferFormatter::getEncodingName ()const {
 
+	if (formatter == NULL)
+		return mp_outEncoding;
+
 	return formatter->getEncodingName();
 
 }
 
 void  XSECSafeBufferFormatter::setEscapeFlags (const XMLFormatter::EscapeFlags newFlags) {
 
-	formatter->setEscapeFlags(newFlags);
+	m_escapeFlags = newFlags;
+	if (formatter != NULL)
+		formatter->setEscapeFlags(newFlags);
 
 }
 void  XSECSafeBufferFormatter::setUnRepFlags (const XMLFormatter::UnRepFlags newFlags) {
 
-	formatter->setUnRepFlags(newFlags);
+	m_unRepFlags = newFlags;
+	if (formatter != NULL)
+		formatter->setUnRepFlags(newFlags);
 
 }
 
 XSECSafeBufferFormatter&  XSECSafeBufferFormatter::operator<< (const XMLFormatter::EscapeFlags newFlags) {
 
-	*formatter << newFlags;
+	setEscapeFlags(newFlags);
 	return *this;
 
 }
 
 XSECSafeBufferFormatter&  XSECSafeBufferFormatter::operator<< (const XMLFormatter::UnRepFlags newFlags) {
 
-	*formatter << newFlags;
+	setUnRepFlags(newFlags);
 	return *this;
 
 }
@@ -153,4 +196,3 @@ safeBuffer& operator<< (safeBuffer &to, const XSECSafeBufferFormatter & from) {
 	return to;
 
 }
-
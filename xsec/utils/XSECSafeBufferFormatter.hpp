@@ -69,6 +69,7 @@ public:
     };
 
 	void reset(void) {m_offset = 0;(*m_buffer)[0] = '\0';}
+	void setOffset(XMLSize_t offset) {m_offset = offset;}
 
 private:
 
@@ -83,7 +84,12 @@ private:
  * \brief Formatter for outputting to a safeBuffer
  *
  * The XSECSafeBufferFormatter class is used as an internal class
- * to perform encoding translations with a safeBuffer as a target
+ * to perform encoding translations with a safeBuffer as a target.
+ *
+ * Plain UTF-8 output (the common case) is done with
+ * safeBuffer::sbUTF8In, and the underlying Xerces XMLFormatter is only
+ * created if an escaping or non UTF-8 output is actually needed.  Code
+ * that just needs UTF-8 should call safeBuffer::sbUTF8In directly.
  */
 
 class XSEC_EXPORT XSECSafeBufferFormatter {
@@ -93,6 +99,13 @@ class XSEC_EXPORT XSECSafeBufferFormatter {
 	safeBuffer			formatBuffer;		// Storage of translated strings
 	sbFormatTarget		* sbf;				// Format target used by XMLFormatter
 
+	XMLCh				* mp_outEncoding;	// Held until the formatter is needed
+	bool				m_isUTF8;
+	XERCES_CPP_NAMESPACE_QUALIFIER XMLFormatter::EscapeFlags
+						m_escapeFlags;
+	XERCES_CPP_NAMESPACE_QUALIFIER XMLFormatter::UnRepFlags
+						m_unRepFlags;
+
 public:
 
 	// Constructor
@@ -148,6 +161,10 @@ public:
 
 private:
 
+	// Create the Xerces formatter on first use
+	void init(void);
+	void makeFormatter(void);
+
 	// Unimplemented
 
 	XSECSafeBufferFormatter() {};
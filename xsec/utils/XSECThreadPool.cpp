@@ -0,0 +1,392 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XSECThreadPool := Minimal portable worker pool used to run independent
+ *                   pieces of work (canonicalisation partitions etc.)
+ *                   concurrently
+ *
+ * $Id$
+ *
+ */
+
+// XSEC
+
+#include <xsec/framework/XSECError.hpp>
+
+#include "XSECThreadPool.hpp"
+
+#if defined(_WIN32)
+#	include <process.h>
+#	include <windows.h>
+#else
+#	include <pthread.h>
+#	include <unistd.h>
+#endif
+
+XERCES_CPP_NAMESPACE_USE
+
+// --------------------------------------------------------------------------------
+//           Synchronisation
+// --------------------------------------------------------------------------------
+
+// Xerces only provides a mutex, and the workers need to sleep between
+// rounds, so the native primitives are used directly
+
+struct XSECThreadPoolSync {
+
+#if defined(_WIN32)
+	CRITICAL_SECTION			m_lock;
+	CONDITION_VARIABLE			m_work;		// Signalled when a round starts
+	CONDITION_VARIABLE			m_done;		// Signalled when a round ends
+	std::vector<HANDLE>			m_handles;
+
+	XSECThreadPoolSync() {
+		InitializeCriticalSection(&m_lock);
+		InitializeConditionVariable(&m_work);
+		InitializeConditionVariable(&m_done);
+	}
+	~XSECThreadPoolSync() {DeleteCriticalSection(&m_lock);}
+
+	void lock(void) {EnterCriticalSection(&m_lock);}
+	void unlock(void) {LeaveCriticalSection(&m_lock);}
+	void waitWork(void) {SleepConditionVariableCS(&m_work, &m_lock, INFINITE);}
+	void waitDone(void) {SleepConditionVariableCS(&m_done, &m_lock, INFINITE);}
+	void signalWork(void) {WakeAllConditionVariable(&m_work);}
+	void signalDone(void) {WakeAllConditionVariable(&m_done);}
+#else
+	pthread_mutex_t				m_lock;
+	pthread_cond_t				m_work;		// Signalled when a round starts
+	pthread_cond_t				m_done;		// Signalled when a round ends
+	std::vector<pthread_t>		m_handles;
+
+	XSECThreadPoolSync() {
+		pthread_mutex_init(&m_lock, NULL);
+		pthread_cond_init(&m_work, NULL);
+		pthread_cond_init(&m_done, NULL);
+	}
+	~XSECThreadPoolSync() {
+		pthread_cond_destroy(&m_done);
+		pthread_cond_destroy(&m_work);
+		pthread_mutex_destroy(&m_lock);
+	}
+
+	void lock(void) {pthread_mutex_lock(&m_lock);}
+	void unlock(void) {pthread_mutex_unlock(&m_lock);}
+	void waitWork(void) {pthread_cond_wait(&m_work, &m_lock);}
+	void waitDone(void) {pthread_cond_wait(&m_done, &m_lock);}
+	void signalWork(void) {pthread_cond_broadcast(&m_work);}
+	void signalDone(void) {pthread_cond_broadcast(&m_done);}
+#endif
+
+};
+
+class XSECThreadPoolLock {
+
+public:
+
+	XSECThreadPoolLock(XSECThreadPoolSync * sync) : mp_sync(sync) {mp_sync->lock();}
+	~XSECThreadPoolLock() {mp_sync->unlock();}
+
+private:
+
+	XSECThreadPoolSync			* mp_sync;
+
+	XSECThreadPoolLock(const XSECThreadPoolLock &);
+	XSECThreadPoolLock & operator = (const XSECThreadPoolLock &);
+
+};
+
+// --------------------------------------------------------------------------------
+//           Thread entry point
+// --------------------------------------------------------------------------------
+
+#if defined(_WIN32)
+
+static unsigned __stdcall XSECThreadPoolEntry(void * arg) {
+
+	((XSECThreadPool *) arg)->workerLoop();
+	return 0;
+
+}
+
+#else
+
+extern "C" {
+
+static void * XSECThreadPoolEntry(void * arg) {
+
+	((XSECThreadPool *) arg)->workerLoop();
+	return NULL;
+
+}
+
+}
+
+#endif
+
+// --------------------------------------------------------------------------------
+//           Construct/Destruct
+// --------------------------------------------------------------------------------
+
+XSECThreadPool::XSECThreadPool(unsigned int threads) :
+	m_threads(threads),
+	m_nextTask(0),
+	mp_xsecError(NULL),
+	mp_cryptoError(NULL),
+	m_unknownError(false),
+	mp_sync(NULL),
+	m_started(0),
+	m_wakeups(0),
+	m_busy(0),
+	m_shutdown(false) {
+
+	if (m_threads == 0)
+		m_threads = getProcessorCount();
+
+	XSECnew(mp_sync, XSECThreadPoolSync());
+
+}
+
+XSECThreadPool::~XSECThreadPool() {
+
+	if (m_started > 0) {
+
+		mp_sync->lock();
+		m_shutdown = true;
+		mp_sync->signalWork();
+		mp_sync->unlock();
+
+		for (XMLSize_t i = 0; i < m_started; ++i) {
+#if defined(_WIN32)
+			WaitForSingleObject(mp_sync->m_handles[i], INFINITE);
+			CloseHandle(mp_sync->m_handles[i]);
+#else
+			pthread_join(mp_sync->m_handles[i], NULL);
+#endif
+		}
+
+	}
+
+	delete mp_sync;
+
+	if (mp_xsecError != NULL)
+		delete mp_xsecError;
+	if (mp_cryptoError != NULL)
+		delete mp_cryptoError;
+
+}
+
+unsigned int XSECThreadPool::getProcessorCount(void) {
+
+#if defined(_WIN32)
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return (si.dwNumberOfProcessors > 0 ? (unsigned int) si.dwNumberOfProcessors : 1);
+#elif defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0 ? (unsigned int) n : 1);
+#else
+	return 1;
+#endif
+
+}
+
+void XSECThreadPool::startWorkers(XMLSize_t workers) {
+
+	// Only ever called between rounds, so new workers find nothing to do
+	// until the next round starts
+
+	mp_sync->m_handles.reserve(workers);
+
+	while (m_started < workers) {
+
+#if defined(_WIN32)
+		uintptr_t h = _beginthreadex(NULL, 0, XSECThreadPoolEntry, this, 0, NULL);
+		if (h == 0)
+			break;
+		mp_sync->m_handles.push_back((HANDLE) h);
+#else
+		pthread_t h;
+		if (pthread_create(&h, NULL, XSECThreadPoolEntry, this) != 0)
+			break;
+		mp_sync->m_handles.push_back(h);
+#endif
+
+		++m_started;
+
+	}
+
+}
+
+// --------------------------------------------------------------------------------
+//           Task handling
+// --------------------------------------------------------------------------------
+
+void XSECThreadPool::addTask(XSECThreadTask * task) {
+
+	m_tasks.push_back(task);
+
+}
+
+XSECThreadTask * XSECThreadPool::nextTask(void) {
+
+	XSECThreadPoolLock lock(mp_sync);
+
+	// Stop handing out work once something has gone wrong
+	if (m_nextTask >= m_tasks.size() ||
+		mp_xsecError != NULL || mp_cryptoError != NULL || m_unknownError)
+		return NULL;
+
+	return m_tasks[m_nextTask++];
+
+}
+
+void XSECThreadPool::runTasks(void) {
+
+	XSECThreadTask * t;
+
+	while ((t = nextTask()) != NULL) {
+
+		try {
+			t->run();
+		}
+		catch (const XSECException &e) {
+			XSECThreadPoolLock lock(mp_sync);
+			if (mp_xsecError == NULL && mp_cryptoError == NULL && !m_unknownError)
+				mp_xsecError = new XSECException(e);
+		}
+		catch (const XSECCryptoException &e) {
+			XSECThreadPoolLock lock(mp_sync);
+			if (mp_xsecError == NULL && mp_cryptoError == NULL && !m_unknownError)
+				mp_cryptoError = new XSECCryptoException(e);
+		}
+		catch (...) {
+			XSECThreadPoolLock lock(mp_sync);
+			m_unknownError = true;
+		}
+
+	}
+
+}
+
+void XSECThreadPool::workerLoop(void) {
+
+	// Each round hands out one wake-up per worker.  A worker that comes
+	// back round quickly may take a second one (and find no tasks left),
+	// which is harmless - a round only ends once every wake-up is finished
+
+	mp_sync->lock();
+
+	for (;;) {
+
+		while (!m_shutdown && m_wakeups == 0)
+			mp_sync->waitWork();
+
+		if (m_shutdown)
+			break;
+
+		--m_wakeups;
+		mp_sync->unlock();
+
+		runTasks();
+
+		mp_sync->lock();
+		if (--m_busy == 0)
+			mp_sync->signalDone();
+
+	}
+
+	mp_sync->unlock();
+
+}
+
+void XSECThreadPool::runAll(void) {
+
+	XMLSize_t workers = m_tasks.size();
+	if (workers > m_threads)
+		workers = m_threads;
+
+	m_nextTask = 0;
+
+	if (workers <= 1) {
+
+		// Nothing to gain from a separate thread
+		for (XMLSize_t i = 0; i < m_tasks.size(); ++i) {
+			try {
+				m_tasks[i]->run();
+			}
+			catch (...) {
+				m_tasks.clear();
+				throw;
+			}
+		}
+		m_tasks.clear();
+		return;
+
+	}
+
+	// Top up the workers.  The calling thread does not take part, so that
+	// it is always available to clean up
+	startWorkers(workers);
+
+	if (m_started == 0) {
+
+		// If we could not start anything, do the work ourselves
+		runTasks();
+
+	}
+	else {
+
+		XSECThreadPoolLock lock(mp_sync);
+
+		m_wakeups = m_busy = m_started;
+		mp_sync->signalWork();
+
+		while (m_busy > 0)
+			mp_sync->waitDone();
+
+	}
+
+	m_tasks.clear();
+
+	// Re-throw anything that went wrong in a worker
+	if (mp_xsecError != NULL) {
+		XSECException e(*mp_xsecError);
+		delete mp_xsecError;
+		mp_xsecError = NULL;
+		throw e;
+	}
+
+	if (mp_cryptoError != NULL) {
+		XSECCryptoException e(*mp_cryptoError);
+		delete mp_cryptoError;
+		mp_cryptoError = NULL;
+		throw e;
+	}
+
+	if (m_unknownError) {
+		m_unknownError = false;
+		throw XSECException(XSECException::InternalError,
+			"XSECThreadPool::runAll - unknown error in worker thread");
+	}
+
+}
@@ -0,0 +1,179 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XSECThreadPool := Minimal portable worker pool used to run independent
+ *                   pieces of work (canonicalisation partitions etc.)
+ *                   concurrently
+ *
+ * $Id$
+ *
+ */
+
+#ifndef XSECTHREADPOOL_INCLUDE
+#define XSECTHREADPOOL_INCLUDE
+
+#include <xsec/framework/XSECDefs.hpp>
+
+#include <vector>
+
+class XSECException;
+class XSECCryptoException;
+struct XSECThreadPoolSync;
+
+/**
+ * \addtogroup internal
+ * @{
+ */
+
+/**
+ * \brief A single unit of work to be run by an XSECThreadPool
+ *
+ * Tasks are owned by the caller, and must remain valid until
+ * XSECThreadPool::runAll() returns.
+ */
+
+class XSEC_EXPORT XSECThreadTask {
+
+public:
+
+	XSECThreadTask() {}
+	virtual ~XSECThreadTask() {}
+
+	/**
+	 * \brief Do the work
+	 *
+	 * Called exactly once from a worker thread.  Any XSECException or
+	 * XSECCryptoException thrown is caught by the pool and re-thrown
+	 * in the calling thread once all tasks have completed.
+	 */
+
+	virtual void run(void) = 0;
+
+};
+
+/**
+ * \brief Run a set of tasks over a fixed number of threads
+ *
+ * Worker threads are started by the first runAll() that needs them and
+ * then wait for the next call, so a pool that is re-used (for each file
+ * of a batch, say) only pays for starting its threads once.  They are
+ * stopped and joined when the pool is destroyed.
+ *
+ * This header is not installed - the pool is for use within the library
+ * and its tools only.
+ *
+ * @note An individual pool is not thread safe - it should only be driven
+ * by a single thread.
+ */
+
+class XSEC_EXPORT XSECThreadPool {
+
+public:
+
+	/**
+	 * \brief Create a pool
+	 *
+	 * No threads are started until they are needed.
+	 *
+	 * @param threads Maximum number of worker threads to use.  A value of
+	 * 0 means use one thread per available processor.
+	 */
+
+	XSECThreadPool(unsigned int threads = 0);
+
+	/**
+	 * \brief Stop and join the worker threads
+	 */
+
+	~XSECThreadPool();
+
+	/**
+	 * \brief Queue a task
+	 *
+	 * @param task The task to run.  Ownership is not taken.
+	 */
+
+	void addTask(XSECThreadTask * task);
+
+	/**
+	 * \brief Run all queued tasks and wait for them to complete
+	 *
+	 * Tasks are handed out to workers in the order they were added.  If only
+	 * one task is queued (or the pool was created with one thread) it is run
+	 * directly in the calling thread.  Otherwise any further workers needed
+	 * (up to the thread count) are started, and all of the workers are woken.
+	 * On return the task queue is empty and the workers are idle.
+	 *
+	 * If any task threw, the first exception caught is re-thrown here after
+	 * all workers have been joined.
+	 */
+
+	void runAll(void);
+
+	/**
+	 * \brief Maximum number of workers this pool will start
+	 */
+
+	unsigned int getThreadCount(void) const {return m_threads;}
+
+	/**
+	 * \brief Number of processors available to this process
+	 */
+
+	static unsigned int getProcessorCount(void);
+
+	// Internal - called by the worker threads
+	void workerLoop(void);
+
+private:
+
+	XSECThreadTask * nextTask(void);
+	void runTasks(void);
+	void startWorkers(XMLSize_t workers);
+
+	typedef std::vector<XSECThreadTask *> TaskVectorType;
+
+	unsigned int			m_threads;
+	TaskVectorType			m_tasks;
+	XMLSize_t				m_nextTask;
+
+	// First error captured from a worker
+	XSECException			* mp_xsecError;
+	XSECCryptoException		* mp_cryptoError;
+	bool					m_unknownError;
+
+	// Worker threads and the state they wait on (all guarded by mp_sync)
+	XSECThreadPoolSync		* mp_sync;
+	XMLSize_t				m_started;		// Threads running
+	XMLSize_t				m_wakeups;		// Wake-ups not yet taken this round
+	XMLSize_t				m_busy;			// Wake-ups not yet finished this round
+	bool					m_shutdown;
+
+	// Unimplemented
+	XSECThreadPool(const XSECThreadPool &);
+	XSECThreadPool & operator = (const XSECThreadPool &);
+
+};
+
+/** @} */
+
+#endif /* XSECTHREADPOOL_INCLUDE */
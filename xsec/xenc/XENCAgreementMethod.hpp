@@ -0,0 +1,242 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XENCAgreementMethod := Interface definition for AgreementMethod element
+ *
+ * $Id$
+ *
+ */
+
+#ifndef XENCAGREEMENTMETHOD_INCLUDE
+#define XENCAGREEMENTMETHOD_INCLUDE
+
+// XSEC Includes
+
+#include <xsec/framework/XSECDefs.hpp>
+#include <xsec/dsig/DSIGKeyInfo.hpp>
+
+class DSIGKeyInfoList;
+
+XSEC_DECLARE_XERCES_CLASS(DOMElement);
+
+/**
+ * @ingroup xenc
+ */
+
+/**
+ * @brief Interface definition for the AgreementMethod object
+ *
+ * The \<AgreementMethod\> element appears in the KeyInfo of an
+ * EncryptedKey when the key encryption key is derived by key
+ * agreement (XML Encryption 1.1 section 5.6) rather than being
+ * known to both parties in advance.
+ *
+ * The library supports ECDH-ES with the ConcatKDF key derivation
+ * function.  In this case the OriginatorKeyInfo holds the sender's
+ * ephemeral EC public key.
+ *
+ * In general, this class should not be used directly.  The XENCCipher
+ * class will create and process AgreementMethod elements when an EC
+ * key is used as the KEK.
+ *
+ * The schema definition for AgreementMethod is as follows:
+ *
+ * \verbatim
+  <element name="AgreementMethod" type="xenc:AgreementMethodType"/>
+  <complexType name="AgreementMethodType" mixed="true">
+    <sequence>
+      <element name="KA-Nonce" minOccurs="0" type="base64Binary"/>
+      <!-- <element ref="ds:DigestMethod" minOccurs="0"/> -->
+      <any namespace="##other" minOccurs="0" maxOccurs="unbounded"/>
+      <element name="OriginatorKeyInfo" minOccurs="0" type="ds:KeyInfoType"/>
+      <element name="RecipientKeyInfo" minOccurs="0" type="ds:KeyInfoType"/>
+    </sequence>
+    <attribute name="Algorithm" type="anyURI" use="required"/>
+  </complexType>
+\endverbatim
+ *
+ * with the KeyDerivationMethod and ConcatKDF parameters taken from the
+ * xenc11 namespace :
+ *
+ * \verbatim
+  <element name="KeyDerivationMethod" type="xenc11:KeyDerivationMethodType"/>
+  <complexType name="KeyDerivationMethodType">
+    <sequence>
+      <any namespace="##any" minOccurs="0" maxOccurs="unbounded"/>
+    </sequence>
+    <attribute name="Algorithm" type="anyURI" use="required"/>
+  </complexType>
+
+  <element name="ConcatKDFParams" type="xenc11:ConcatKDFParamsType"/>
+  <complexType name="ConcatKDFParamsType">
+    <sequence>
+      <element ref="ds:DigestMethod"/>
+    </sequence>
+    <attribute name="AlgorithmID" type="hexBinary"/>
+    <attribute name="PartyUInfo" type="hexBinary"/>
+    <attribute name="PartyVInfo" type="hexBinary"/>
+    <attribute name="SuppPubInfo" type="hexBinary"/>
+    <attribute name="SuppPrivInfo" type="hexBinary"/>
+  </complexType>
+\endverbatim
+ */
+
+class XSEC_EXPORT XENCAgreementMethod : public DSIGKeyInfo {
+
+	/** @name Constructors and Destructors */
+	//@{
+
+protected:
+
+	XENCAgreementMethod(const XSECEnv * env) : DSIGKeyInfo(env) {};
+
+public:
+
+	virtual ~XENCAgreementMethod() {};
+
+	//@}
+
+	/** @name Getter Methods */
+	//@{
+
+	/**
+	 * \brief Get the key agreement algorithm
+	 *
+	 * @returns the URI representing the algorithm (e.g. ECDH-ES)
+	 */
+
+	virtual const XMLCh * getAlgorithm(void) const = 0;
+
+	/**
+	 * \brief Get the key derivation algorithm
+	 *
+	 * @returns the Algorithm of the xenc11:KeyDerivationMethod, or NULL
+	 * if there is none
+	 */
+
+	virtual const XMLCh * getKeyDerivationMethod(void) const = 0;
+
+	/**
+	 * \brief Get the digest used by ConcatKDF
+	 *
+	 * @returns the Algorithm of the ds:DigestMethod within the
+	 * xenc11:ConcatKDFParams, or NULL if there is none
+	 */
+
+	virtual const XMLCh * getDigestMethod(void) const = 0;
+
+	/**
+	 * \brief Get the ConcatKDF AlgorithmID
+	 *
+	 * @returns the hex encoded bit string, or NULL if not set
+	 */
+
+	virtual const XMLCh * getAlgorithmID(void) const = 0;
+
+	/**
+	 * \brief Get the ConcatKDF PartyUInfo
+	 *
+	 * @returns the hex encoded bit string, or NULL if not set
+	 */
+
+	virtual const XMLCh * getPartyUInfo(void) const = 0;
+
+	/**
+	 * \brief Get the ConcatKDF PartyVInfo
+	 *
+	 * @returns the hex encoded bit string, or NULL if not set
+	 */
+
+	virtual const XMLCh * getPartyVInfo(void) const = 0;
+
+	/**
+	 * \brief Get the KeyInfo of the originator
+	 *
+	 * For ECDH-ES this holds the ephemeral public key.
+	 *
+	 * @returns the list of KeyInfo elements within OriginatorKeyInfo
+	 */
+
+	virtual const DSIGKeyInfoList * getOriginatorKeyInfoList(void) const = 0;
+
+	/**
+	 * \brief Get the KeyInfo of the recipient
+	 *
+	 * @returns the list of KeyInfo elements within RecipientKeyInfo
+	 */
+
+	virtual const DSIGKeyInfoList * getRecipientKeyInfoList(void) const = 0;
+
+	/**
+	 * \brief Get the DOM Element Node of this structure
+	 *
+	 * @returns the DOM Element Node representing the \<AgreementMethod\> element
+	 */
+
+	virtual XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * getElement(void) const = 0;
+
+	//@}
+
+	/** @name Setter Methods */
+	//@{
+
+	/**
+	 * \brief Set ConcatKDF as the key derivation method
+	 *
+	 * Creates the xenc11:KeyDerivationMethod and xenc11:ConcatKDFParams
+	 * elements (replacing any existing key derivation method).
+	 *
+	 * @param digestMethod URI of the digest to use
+	 * @param algorithmID Hex encoded AlgorithmID (or NULL)
+	 * @param partyUInfo Hex encoded PartyUInfo (or NULL)
+	 * @param partyVInfo Hex encoded PartyVInfo (or NULL)
+	 */
+
+	virtual void setConcatKDF(const XMLCh * digestMethod,
+							  const XMLCh * algorithmID,
+							  const XMLCh * partyUInfo,
+							  const XMLCh * partyVInfo) = 0;
+
+	/**
+	 * \brief Set the originator's EC public key
+	 *
+	 * Creates an OriginatorKeyInfo holding a dsig11:ECKeyValue.
+	 *
+	 * @param curveName URI of the named curve
+	 * @param publicKey Base64 encoded public key
+	 */
+
+	virtual void setOriginatorECKeyValue(const XMLCh * curveName,
+										 const XMLCh * publicKey) = 0;
+
+	//@}
+
+private:
+
+	// Unimplemented
+	XENCAgreementMethod();
+	XENCAgreementMethod(const XENCAgreementMethod &);
+	XENCAgreementMethod & operator = (const XENCAgreementMethod &);
+
+};
+
+#endif /* XENCAGREEMENTMETHOD_INCLUDE */
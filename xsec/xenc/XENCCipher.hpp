@@ -40,11 +40,13 @@
 XSEC_DECLARE_XERCES_CLASS(DOMElement);
 XSEC_DECLARE_XERCES_CLASS(DOMDocument);
 XSEC_DECLARE_XERCES_CLASS(BinInputStream);
+XSEC_DECLARE_XERCES_CLASS(XMLFormatTarget);
 
 class XSECCryptoKey;
 class XENCEncryptedData;
 class XENCEncryptedKey;
 class XSECKeyInfoResolver;
+class XENCKeyCache;
 class XSECBinTXFMInputStream;
 class TXFMChain;
 
@@ -172,6 +174,34 @@ public:
 
     virtual XERCES_CPP_NAMESPACE_QUALIFIER DOMNode* decryptElementDetached() = 0;
 
+    /**
+     * \brief Decrypt a set of EncryptedData elements in place
+     *
+     * Each element must be the root of an \<EncryptedData\> structure of
+     * type "#Element" or "#Content".  Keys are resolved for all of the
+     * elements first (using the set key, the KeyInfoResolver or any
+     * EncryptedKey in the KeyInfo, as for decryptElement()), and the
+     * cipher text is read (resolving any CipherReference) on the calling
+     * thread.  A resolved key is reused for as long as consecutive
+     * elements carry an identical KeyInfo, so a key shared by the batch
+     * is only unwrapped once.  Only the decryption itself is shared
+     * across a pool of threads; the workers never touch the DOM.  All of
+     * the plain text is parsed before the first element is replaced, so
+     * if any decryption or parse fails, the document is left unchanged.
+     *
+     * @param elements Array of EncryptedData elements to decrypt
+     * @param count Number of elements in the array
+     * @param threads Number of threads to use, or 0 for one per processor
+     * @throws XSECException if any decryption fails, or if an element
+     * is not a valid EncryptedData DOM structure.
+     */
+
+    virtual void decryptElements(
+        XERCES_CPP_NAMESPACE_QUALIFIER DOMElement** elements,
+        XMLSize_t count,
+        unsigned int threads = 0
+    ) = 0;
+
     /**
      * \brief Decrypt the nominated element and put the output to an InputStream.
      *
@@ -193,6 +223,59 @@ public:
         XERCES_CPP_NAMESPACE_QUALIFIER DOMElement* element
     ) = 0;
 
+    /**
+     * \brief Decrypt the nominated element straight to an output target
+     *
+     * As for decryptToBinInputStream(), but the plain text is pushed to
+     * the target in blocks as it is decrypted.  A CipherReference is
+     * read from its URI as a stream, so the cipher text never needs to
+     * be held in memory.
+     *
+     * @param element Root of EncryptedData DOM structure to decrypt
+     * @param target Where to write the plain text
+     * @throws XSECException if the decryption fails, or if this is
+     * not a valid EncryptedData DOM structure.
+     */
+
+    virtual void decryptToFormatTarget(
+        XERCES_CPP_NAMESPACE_QUALIFIER DOMElement* element,
+        XERCES_CPP_NAMESPACE_QUALIFIER XMLFormatTarget* target
+    ) = 0;
+
+    /**
+     * \brief Decrypt a serialised EncryptedData straight to an output target
+     *
+     * Reads a serialised \<EncryptedData\> element (for example the output
+     * of the streaming encryptBinInputStream() call) from the input stream.
+     * Only the markup ahead of the CipherValue is parsed into a DOM, to
+     * find the algorithm and key.  The CipherValue itself is base64
+     * decoded and decrypted as it is read and the plain text written to
+     * the target in blocks, so memory use for CBC modes does not depend
+     * on the size of the data.  Anything following the CipherValue
+     * (such as EncryptionProperties) is not read.
+     *
+     * If the stream holds a CipherReference rather than a CipherValue,
+     * the whole (small) element is parsed and the reference is streamed
+     * as for decryptToFormatTarget().
+     *
+     * @note Plain text is written before decryption completes, so if an
+     * exception is thrown the caller must discard anything written.  GCM
+     * is authenticated before any plain text is released, and so is
+     * buffered in memory.
+     *
+     * @param encryptedData Stream to read the EncryptedData from.
+     * Ownership is taken.
+     * @param target Where to write the plain text
+     * @throws XSECException if the decryption fails, if this is
+     * not a valid EncryptedData structure, or if the input ends before
+     * the CipherValue end tag.
+     */
+
+    virtual void decryptBinInputStream(
+        XERCES_CPP_NAMESPACE_QUALIFIER BinInputStream* encryptedData,
+        XERCES_CPP_NAMESPACE_QUALIFIER XMLFormatTarget* target
+    ) = 0;
+
     /**
      * \brief Decrypt a key
      *
@@ -271,6 +354,39 @@ public:
         const XMLCh* algorithmURI
     ) = 0;
 
+    /**
+     * \brief Encrypt a set of elements in place with one key
+     *
+     * Encrypts each of the elements (and their children) with the
+     * currently set symmetric key, as for encryptElement().  The elements
+     * are serialised on the calling thread and only the encryption is
+     * shared across a pool of threads.  The EncryptedData structures
+     * (including any EncryptedKey copies) are completed before the first
+     * element is replaced, so if any encryption fails, the document is
+     * left unchanged.
+     *
+     * If an EncryptedKey (normally the shared key, encrypted with
+     * encryptKey()) is passed in, a copy is placed in the KeyInfo of each
+     * EncryptedData.
+     *
+     * @param elements Array of elements to encrypt
+     * @param count Number of elements in the array
+     * @param algorithmURI algorithm URI to set
+     * @param encryptedKey Optional EncryptedKey to copy into each
+     * EncryptedData.  Ownership is taken.
+     * @param threads Number of threads to use, or 0 for one per processor
+     * @throws XSECException if any encryption fails, or if an element
+     * has no parent.
+     */
+
+    virtual void encryptElements(
+        XERCES_CPP_NAMESPACE_QUALIFIER DOMElement** elements,
+        XMLSize_t count,
+        const XMLCh* algorithmURI,
+        XENCEncryptedKey* encryptedKey = NULL,
+        unsigned int threads = 0
+    ) = 0;
+
     /**
      * \brief Encrypt the children of the nominated element
      *
@@ -317,6 +433,11 @@ public:
      *
      * Encrypts the passed in data and creates an EncryptedKey element
      *
+     * If the KEK is an EC public key, an ephemeral key pair is generated
+     * and the key wrap key is agreed using ECDH-ES and ConcatKDF.  The
+     * algorithmURI must then be a key wrap algorithm, and an
+     * AgreementMethod is added to the KeyInfo of the EncryptedKey.
+     *
      * @param keyBuffer The key data to encrypt
      * @param keyLen Bytes to encrypt
      * @param algorithmURI algorithm URI to set
@@ -373,6 +494,37 @@ public:
         const XMLCh* algorithmURI
     ) = 0;
 
+    /**
+     * \brief Encrypt an input stream straight to an output target
+     *
+     * Reads the plain text from a BinInputStream and writes a serialised
+     * EncryptedData element (UTF-8, no XML declaration) to the target.
+     * The base64 cipher text is written as it is produced, so the plain
+     * and cipher text are never held in memory or in the DOM - memory use
+     * does not depend on the size of the input.
+     *
+     * The envelope is the same as that created by the in-memory
+     * encryptBinInputStream() call.
+     *
+     * @note Only bulk symmetric algorithms can be streamed.  The
+     * algorithm handler must support appendEncryptCipherTXFM().
+     *
+     * @param plainText The InputStream to read the plain text from.
+     * Ownership is taken.
+     * @param target Where to write the EncryptedData element
+     * @param algorithmURI algorithm URI to set
+     * @param encryptedKey Optional EncryptedKey to place in the KeyInfo
+     * of the EncryptedData.  Ownership is taken, as for
+     * XENCEncryptedData::appendEncryptedKey().
+     */
+
+    virtual void encryptBinInputStream(
+        XERCES_CPP_NAMESPACE_QUALIFIER BinInputStream* plainText,
+        XERCES_CPP_NAMESPACE_QUALIFIER XMLFormatTarget* target,
+        const XMLCh* algorithmURI,
+        XENCEncryptedKey* encryptedKey = NULL
+    ) = 0;
+
     //@}
     /** @name Getter Functions */
     //@{
@@ -459,12 +611,36 @@ public:
      * @note This key will only be used to decrypt EncryptedKey elements.
      * To set a key for decrypting an EncryptedData use #setKey instead.
      *
+     * An EC private key is used with the AgreementMethod of an EncryptedKey
+     * (ECDH-ES) to derive the key wrap key.
+     *
      * @param key Key to use
      * @note This function will take ownership of the key and delete it when done.
      */
 
     virtual void setKEK(XSECCryptoKey* key) = 0;
 
+    /**
+     * \brief Register a cache for unwrapped keys
+     *
+     * When a cache is set, keys decrypted from EncryptedKey elements using
+     * the KEK passed to #setKEK are stored in the cache, and later requests
+     * to decrypt the same EncryptedKey (same CipherValue and EncryptionMethod
+     * parameters) are served from it without using the KEK.
+     *
+     * The cache cannot tell keys apart itself, so the caller must supply
+     * an identity string that is unique to the KEK (a certificate
+     * fingerprint or key name, for example).  Keys resolved through a
+     * KeyInfoResolver are never cached, as their identity is not known.
+     *
+     * @param cache The cache to use, or NULL to stop caching.  The cache
+     * remains the property of the caller and may be shared between ciphers.
+     * @param kekIdentity Identity of the KEK the cached keys belong to.
+     * The string is copied.
+     */
+
+    virtual void setKeyCache(XENCKeyCache* cache, const XMLCh* kekIdentity) = 0;
+
     /**
      * \brief Register a KeyInfoResolver
      *
@@ -518,6 +694,20 @@ public:
 
     virtual void setExclusiveC14nSerialisation(bool flag) = 0;
 
+    /**
+     * \brief Re-target the cipher at a new document
+     *
+     * Discards the current EncryptedData, the key and the KEK, and binds
+     * the cipher to a new document.  Settings (namespace prefix, pretty
+     * printing, serialisation mode, key cache and KeyInfo resolver) are
+     * kept, as is the de-serialisation parser, so re-using a cipher is
+     * cheaper than releasing it and creating a new one.
+     *
+     * @param doc The document to operate on from now on
+     */
+
+    virtual void reset(XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument* doc) = 0;
+
     //@}
 
     /** @name Creation and loading Functions */
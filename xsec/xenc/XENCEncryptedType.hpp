@@ -46,6 +46,7 @@ class DSIGKeyInfoSPKIData;
 class DSIGKeyInfoMgmtData;
 class XENCEncryptionMethod;
 class XENCEncryptedKey;
+class XENCAgreementMethod;
 
 /**
  * @ingroup xenc
@@ -377,6 +378,20 @@ public:
 	 */
 
 	virtual void appendEncryptedKey(XENCEncryptedKey * encryptedKey) = 0;
+
+	/**
+	 * \brief Append an already created AgreementMethod.
+	 *
+	 * Used by XENCCipher when the key encryption key of an EncryptedKey
+	 * is derived by key agreement.
+	 *
+	 * @note The agreementMethod becomes the property of the owning EncryptedType
+	 * object and will be deleted upon its destruction.
+	 *
+	 * @param agreementMethod A pointer to the AgreementMethod
+	 */
+
+	virtual void appendAgreementMethod(XENCAgreementMethod * agreementMethod) = 0;
 	//@}
 
 private:
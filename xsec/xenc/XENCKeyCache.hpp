@@ -0,0 +1,215 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XENCKeyCache := Bounded cache of unwrapped content encryption keys
+ *
+ * $Id$
+ *
+ */
+
+#ifndef XENCKEYCACHE_INCLUDE
+#define XENCKEYCACHE_INCLUDE
+
+// XSEC Includes
+
+#include <xsec/framework/XSECDefs.hpp>
+
+#include <xercesc/util/Mutexes.hpp>
+
+#include <map>
+#include <string>
+
+/**
+ * @ingroup xenc
+ */
+
+/** @name Key cache limits */
+//@{
+
+/** Size (in bytes) of the identifiers used to index the cache */
+#define XENC_KEYCACHE_ID_SIZE		32
+/** Largest unwrapped key that will be held in the cache */
+#define XENC_KEYCACHE_MAX_KEY_SIZE	64
+
+//@}
+
+/**
+ * @brief Cache of content encryption keys unwrapped from EncryptedKey elements
+ *
+ * When the same EncryptedKey is received many times (for example a key
+ * shared between a large number of messages) the asymmetric decrypt of the
+ * wrapped key dominates the cost of decryption.  An XENCKeyCache can be
+ * registered with one or more XENCCipher objects via XENCCipher::setKeyCache()
+ * so that each wrapped key is only unwrapped once.
+ *
+ * Entries are indexed by a SHA-256 digest (calculated by the cipher) over the
+ * identity of the key encryption key, the EncryptionMethod parameters and
+ * the CipherValue of the EncryptedKey.  The raw key bytes are held in a single
+ * block of memory that is locked into RAM where the platform allows it, and
+ * are overwritten when an entry is evicted, expires or the cache is deleted.
+ *
+ * The cache holds at most a fixed number of entries.  When full, expired
+ * entries are re-used first and then the least recently used entry.
+ *
+ * All methods are thread safe, so a single cache can be shared between
+ * ciphers in different threads.
+ */
+
+class XSEC_EXPORT XENCKeyCache {
+
+public:
+
+	/** @name Constructors and Destructors */
+	//@{
+
+	/**
+	 * \brief Create a cache
+	 *
+	 * @param maxEntries Maximum number of keys held at any one time
+	 * @param ttlSeconds Number of seconds an entry remains valid after
+	 * it was stored.  0 means entries never expire (they are still subject
+	 * to eviction when the cache is full).
+	 */
+
+	XENCKeyCache(unsigned int maxEntries = 256, unsigned int ttlSeconds = 300);
+
+	~XENCKeyCache();
+
+	//@}
+
+	/** @name Cache operations */
+	//@{
+
+	/**
+	 * \brief Find a key
+	 *
+	 * @param id Identifier of XENC_KEYCACHE_ID_SIZE bytes
+	 * @param key Buffer to copy the key into
+	 * @param maxKeySize Size of the key buffer
+	 * @returns The length of the key, or 0 if there is no valid entry (or
+	 * the key does not fit in the buffer)
+	 */
+
+	unsigned int lookup(const unsigned char * id,
+						unsigned char * key,
+						unsigned int maxKeySize);
+
+	/**
+	 * \brief Add a key
+	 *
+	 * Keys longer than XENC_KEYCACHE_MAX_KEY_SIZE are silently ignored.
+	 * An existing entry for the same identifier is replaced.
+	 *
+	 * @param id Identifier of XENC_KEYCACHE_ID_SIZE bytes
+	 * @param key The unwrapped key
+	 * @param keyLen Length of the key
+	 */
+
+	void store(const unsigned char * id,
+			   const unsigned char * key,
+			   unsigned int keyLen);
+
+	/**
+	 * \brief Remove (and cleanse) all entries
+	 */
+
+	void clear(void);
+
+	//@}
+
+	/** @name Statistics */
+	//@{
+
+	/** \brief Number of successful lookups */
+	unsigned long getHits(void) const {return m_hits;}
+
+	/** \brief Number of lookups that did not find a valid entry */
+	unsigned long getMisses(void) const {return m_misses;}
+
+	/** \brief Number of valid entries discarded to make room */
+	unsigned long getEvictions(void) const {return m_evictions;}
+
+	/** \brief Number of entries discarded because their TTL expired */
+	unsigned long getExpirations(void) const {return m_expirations;}
+
+	/** \brief Hits as a fraction of all lookups (0 if none made) */
+	double getHitRate(void) const;
+
+	/** \brief Number of entries currently held */
+	unsigned int getSize(void) const;
+
+	/** \brief Maximum number of entries */
+	unsigned int getMaxEntries(void) const {return m_maxEntries;}
+
+	/**
+	 * \brief Was the key storage locked into memory?
+	 *
+	 * Locking can fail (e.g. because of RLIMIT_MEMLOCK).  The cache still
+	 * works, but the keys may be paged to disk.
+	 */
+
+	bool isLocked(void) const {return m_locked;}
+
+	/** \brief Reset the hit/miss/eviction counters */
+	void resetStatistics(void);
+
+	//@}
+
+private:
+
+	struct Slot {
+		std::string		id;
+		unsigned int	keyLen;
+		unsigned long	stored;
+		unsigned long	lastUsed;
+		bool			inUse;
+	};
+
+	typedef std::map<std::string, unsigned int> SlotMapType;
+
+	void releaseSlot(unsigned int s);
+	unsigned int findFreeSlot(unsigned long now);
+	bool isExpired(const Slot & slot, unsigned long now) const;
+
+	unsigned int				m_maxEntries;
+	unsigned int				m_ttl;
+	Slot						* mp_slots;
+	unsigned char				* mp_keys;		// m_maxEntries * XENC_KEYCACHE_MAX_KEY_SIZE
+	XMLSize_t					m_keysSize;
+	bool						m_locked;
+	SlotMapType					m_index;
+	unsigned long				m_useCounter;
+
+	unsigned long				m_hits;
+	unsigned long				m_misses;
+	unsigned long				m_evictions;
+	unsigned long				m_expirations;
+
+	mutable XERCES_CPP_NAMESPACE_QUALIFIER XMLMutex	m_mutex;
+
+	// Unimplemented
+	XENCKeyCache(const XENCKeyCache &);
+	XENCKeyCache & operator = (const XENCKeyCache &);
+
+};
+
+#endif /* XENCKEYCACHE_INCLUDE */
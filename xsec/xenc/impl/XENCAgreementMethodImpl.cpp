@@ -0,0 +1,436 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XENCAgreementMethodImpl := Implementation of AgreementMethod
+ *
+ * $Id$
+ *
+ */
+
+#include <xsec/framework/XSECDefs.hpp>
+#include <xsec/framework/XSECError.hpp>
+#include <xsec/framework/XSECEnv.hpp>
+#include <xsec/dsig/DSIGKeyInfoValue.hpp>
+
+#include "XENCAgreementMethodImpl.hpp"
+#include "../../utils/XSECDOMUtils.hpp"
+
+#include <xercesc/dom/DOM.hpp>
+#include <xercesc/util/XMLUniDefs.hpp>
+
+XERCES_CPP_NAMESPACE_USE
+
+// --------------------------------------------------------------------------------
+//			Attribute names
+// --------------------------------------------------------------------------------
+
+static XMLCh s_AlgorithmID[] = {
+
+	chLatin_A,
+	chLatin_l,
+	chLatin_g,
+	chLatin_o,
+	chLatin_r,
+	chLatin_i,
+	chLatin_t,
+	chLatin_h,
+	chLatin_m,
+	chLatin_I,
+	chLatin_D,
+	chNull
+};
+
+static XMLCh s_PartyUInfo[] = {
+
+	chLatin_P,
+	chLatin_a,
+	chLatin_r,
+	chLatin_t,
+	chLatin_y,
+	chLatin_U,
+	chLatin_I,
+	chLatin_n,
+	chLatin_f,
+	chLatin_o,
+	chNull
+};
+
+static XMLCh s_PartyVInfo[] = {
+
+	chLatin_P,
+	chLatin_a,
+	chLatin_r,
+	chLatin_t,
+	chLatin_y,
+	chLatin_V,
+	chLatin_I,
+	chLatin_n,
+	chLatin_f,
+	chLatin_o,
+	chNull
+};
+
+// Declare a namespace prefix on an element we create
+
+static void setNamespace(DOMElement * e, const XMLCh * prefix, const XMLCh * uri) {
+
+	safeBuffer str;
+
+	if (prefix[0] == chNull) {
+		str.sbTranscodeIn("xmlns");
+	}
+	else {
+		str.sbTranscodeIn("xmlns:");
+		str.sbXMLChCat(prefix);
+	}
+
+	e->setAttributeNS(DSIGConstants::s_unicodeStrURIXMLNS, str.rawXMLChBuffer(), uri);
+
+}
+
+// --------------------------------------------------------------------------------
+//			Constructors and Destructors
+// --------------------------------------------------------------------------------
+
+XENCAgreementMethodImpl::XENCAgreementMethodImpl(const XSECEnv * env) :
+XENCAgreementMethod(env),
+mp_agreementMethodElement(NULL),
+mp_algorithmAttr(NULL),
+mp_keyDerivationMethodElement(NULL),
+mp_kdfAlgorithmAttr(NULL),
+mp_digestAlgorithmAttr(NULL),
+mp_algorithmIDAttr(NULL),
+mp_partyUInfoAttr(NULL),
+mp_partyVInfoAttr(NULL),
+mp_originatorKeyInfoElement(NULL),
+m_originatorKeyInfoList(env),
+m_recipientKeyInfoList(env) {
+
+}
+
+XENCAgreementMethodImpl::XENCAgreementMethodImpl(
+		const XSECEnv * env,
+		DOMElement * element) :
+XENCAgreementMethod(env),
+mp_agreementMethodElement(element),
+mp_algorithmAttr(NULL),
+mp_keyDerivationMethodElement(NULL),
+mp_kdfAlgorithmAttr(NULL),
+mp_digestAlgorithmAttr(NULL),
+mp_algorithmIDAttr(NULL),
+mp_partyUInfoAttr(NULL),
+mp_partyVInfoAttr(NULL),
+mp_originatorKeyInfoElement(NULL),
+m_originatorKeyInfoList(env),
+m_recipientKeyInfoList(env) {
+
+	mp_keyInfoDOMNode = element;
+
+}
+
+XENCAgreementMethodImpl::~XENCAgreementMethodImpl() {
+
+}
+
+// --------------------------------------------------------------------------------
+//			Load from DOM
+// --------------------------------------------------------------------------------
+
+void XENCAgreementMethodImpl::loadKeyInfoList(DOMElement * e, DSIGKeyInfoList & l) {
+
+	DOMElement * c = findFirstElementChild(e);
+
+	while (c != NULL) {
+		l.addXMLKeyInfo(c);
+		c = findNextElementChild(c);
+	}
+
+}
+
+void XENCAgreementMethodImpl::loadKeyDerivationMethod(DOMElement * kdm) {
+
+	mp_keyDerivationMethodElement = kdm;
+	mp_kdfAlgorithmAttr = kdm->getAttributeNodeNS(NULL, DSIGConstants::s_unicodeStrAlgorithm);
+
+	if (mp_kdfAlgorithmAttr == NULL) {
+		throw XSECException(XSECException::ExpectedXENCChildNotFound,
+			"XENCAgreementMethod::load - Cannot find Algorithm Attribute in KeyDerivationMethod element");
+	}
+
+	DOMElement * params = findFirstElementChild(kdm);
+
+	while (params != NULL && !strEquals(getXENC11LocalName(params), "ConcatKDFParams"))
+		params = findNextElementChild(params);
+
+	if (params == NULL)
+		return;
+
+	mp_algorithmIDAttr = params->getAttributeNodeNS(NULL, s_AlgorithmID);
+	mp_partyUInfoAttr = params->getAttributeNodeNS(NULL, s_PartyUInfo);
+	mp_partyVInfoAttr = params->getAttributeNodeNS(NULL, s_PartyVInfo);
+
+	DOMElement * dm = findFirstElementChild(params);
+
+	if (dm == NULL || !strEquals(getDSIGLocalName(dm), "DigestMethod") ||
+		(mp_digestAlgorithmAttr = dm->getAttributeNodeNS(NULL, DSIGConstants::s_unicodeStrAlgorithm)) == NULL) {
+
+		throw XSECException(XSECException::ExpectedXENCChildNotFound,
+			"XENCAgreementMethod::load - ConcatKDFParams requires a DigestMethod with an Algorithm");
+	}
+
+}
+
+void XENCAgreementMethodImpl::load() {
+
+	if (mp_agreementMethodElement == NULL) {
+
+		throw XSECException(XSECException::ExpectedXENCChildNotFound,
+			"XENCAgreementMethod::load - called on empty DOM");
+
+	}
+
+	if (!strEquals(getXENCLocalName(mp_agreementMethodElement), "AgreementMethod")) {
+
+		throw XSECException(XSECException::ExpectedXENCChildNotFound,
+			"XENCAgreementMethod::load - called on non AgreementMethod node");
+
+	}
+
+	mp_algorithmAttr =
+		mp_agreementMethodElement->getAttributeNodeNS(NULL,
+			DSIGConstants::s_unicodeStrAlgorithm);
+
+	if (mp_algorithmAttr == NULL) {
+
+		throw XSECException(XSECException::ExpectedXENCChildNotFound,
+			"XENCAgreementMethod::load - Cannot find Algorithm Attribute");
+
+	}
+
+	// Check for known children.  Anything else (KA-Nonce etc.) is ignored
+	DOMElement * c = findFirstElementChild(mp_agreementMethodElement);
+
+	while (c != NULL) {
+
+		if (strEquals(getXENC11LocalName(c), "KeyDerivationMethod")) {
+
+			loadKeyDerivationMethod(c);
+
+		}
+
+		else if (strEquals(getXENCLocalName(c), "OriginatorKeyInfo")) {
+
+			mp_originatorKeyInfoElement = c;
+			loadKeyInfoList(c, m_originatorKeyInfoList);
+
+		}
+
+		else if (strEquals(getXENCLocalName(c), "RecipientKeyInfo")) {
+
+			loadKeyInfoList(c, m_recipientKeyInfoList);
+
+		}
+
+		c = findNextElementChild(c);
+
+	}
+
+}
+
+// --------------------------------------------------------------------------------
+//			Create from scratch
+// --------------------------------------------------------------------------------
+
+DOMElement * XENCAgreementMethodImpl::createBlankAgreementMethod(const XMLCh * algorithm) {
+
+	safeBuffer str;
+	DOMDocument *doc = mp_env->getParentDocument();
+	const XMLCh * prefix = mp_env->getXENCNSPrefix();
+
+	makeQName(str, prefix, "AgreementMethod");
+
+	mp_agreementMethodElement = doc->createElementNS(DSIGConstants::s_unicodeStrURIXENC, str.rawXMLChBuffer());
+	mp_keyInfoDOMNode = mp_agreementMethodElement;
+
+	// The element sits inside a ds:KeyInfo, so the xenc namespace may not
+	// be in scope
+	setNamespace(mp_agreementMethodElement, prefix, DSIGConstants::s_unicodeStrURIXENC);
+
+	mp_agreementMethodElement->setAttributeNS(NULL,
+						DSIGConstants::s_unicodeStrAlgorithm,
+						algorithm);
+	mp_algorithmAttr =
+		mp_agreementMethodElement->getAttributeNodeNS(NULL,
+													  DSIGConstants::s_unicodeStrAlgorithm);
+
+	mp_env->doPrettyPrint(mp_agreementMethodElement);
+
+	return mp_agreementMethodElement;
+
+}
+
+// --------------------------------------------------------------------------------
+//			Getter functions
+// --------------------------------------------------------------------------------
+
+const XMLCh * XENCAgreementMethodImpl::getAlgorithm(void) const {
+
+	return (mp_algorithmAttr != NULL ? mp_algorithmAttr->getNodeValue() : NULL);
+
+}
+
+const XMLCh * XENCAgreementMethodImpl::getKeyDerivationMethod(void) const {
+
+	return (mp_kdfAlgorithmAttr != NULL ? mp_kdfAlgorithmAttr->getNodeValue() : NULL);
+
+}
+
+const XMLCh * XENCAgreementMethodImpl::getDigestMethod(void) const {
+
+	return (mp_digestAlgorithmAttr != NULL ? mp_digestAlgorithmAttr->getNodeValue() : NULL);
+
+}
+
+const XMLCh * XENCAgreementMethodImpl::getAlgorithmID(void) const {
+
+	return (mp_algorithmIDAttr != NULL ? mp_algorithmIDAttr->getNodeValue() : NULL);
+
+}
+
+const XMLCh * XENCAgreementMethodImpl::getPartyUInfo(void) const {
+
+	return (mp_partyUInfoAttr != NULL ? mp_partyUInfoAttr->getNodeValue() : NULL);
+
+}
+
+const XMLCh * XENCAgreementMethodImpl::getPartyVInfo(void) const {
+
+	return (mp_partyVInfoAttr != NULL ? mp_partyVInfoAttr->getNodeValue() : NULL);
+
+}
+
+// --------------------------------------------------------------------------------
+//			Setter functions
+// --------------------------------------------------------------------------------
+
+void XENCAgreementMethodImpl::setConcatKDF(const XMLCh * digestMethod,
+										   const XMLCh * algorithmID,
+										   const XMLCh * partyUInfo,
+										   const XMLCh * partyVInfo) {
+
+	if (mp_agreementMethodElement == NULL) {
+		throw XSECException(XSECException::ExpectedXENCChildNotFound,
+			"XENCAgreementMethod::setConcatKDF - called on empty DOM");
+	}
+
+	// Replace whatever was there
+	if (mp_keyDerivationMethodElement != NULL) {
+		mp_agreementMethodElement->removeChild(mp_keyDerivationMethodElement);
+		mp_keyDerivationMethodElement->release();
+		mp_keyDerivationMethodElement = NULL;
+		mp_algorithmIDAttr = mp_partyUInfoAttr = mp_partyVInfoAttr = NULL;
+	}
+
+	safeBuffer str;
+	DOMDocument *doc = mp_env->getParentDocument();
+	const XMLCh * prefix11 = mp_env->getXENC11NSPrefix();
+	const XMLCh * prefixDS = mp_env->getDSIGNSPrefix();
+
+	makeQName(str, prefix11, "KeyDerivationMethod");
+	DOMElement * kdm = doc->createElementNS(DSIGConstants::s_unicodeStrURIXENC11, str.rawXMLChBuffer());
+	setNamespace(kdm, prefix11, DSIGConstants::s_unicodeStrURIXENC11);
+	kdm->setAttributeNS(NULL, DSIGConstants::s_unicodeStrAlgorithm, DSIGConstants::s_unicodeStrURICONCAT_KDF);
+
+	makeQName(str, prefix11, "ConcatKDFParams");
+	DOMElement * params = doc->createElementNS(DSIGConstants::s_unicodeStrURIXENC11, str.rawXMLChBuffer());
+	if (algorithmID != NULL)
+		params->setAttributeNS(NULL, s_AlgorithmID, algorithmID);
+	if (partyUInfo != NULL)
+		params->setAttributeNS(NULL, s_PartyUInfo, partyUInfo);
+	if (partyVInfo != NULL)
+		params->setAttributeNS(NULL, s_PartyVInfo, partyVInfo);
+
+	makeQName(str, prefixDS, "DigestMethod");
+	DOMElement * dm = doc->createElementNS(DSIGConstants::s_unicodeStrURIDSIG, str.rawXMLChBuffer());
+	setNamespace(dm, prefixDS, DSIGConstants::s_unicodeStrURIDSIG);
+	dm->setAttributeNS(NULL, DSIGConstants::s_unicodeStrAlgorithm, digestMethod);
+
+	mp_env->doPrettyPrint(params);
+	params->appendChild(dm);
+	mp_env->doPrettyPrint(params);
+
+	mp_env->doPrettyPrint(kdm);
+	kdm->appendChild(params);
+	mp_env->doPrettyPrint(kdm);
+
+	// KeyDerivationMethod comes before the KeyInfo children
+	if (mp_originatorKeyInfoElement != NULL)
+		mp_agreementMethodElement->insertBefore(kdm, mp_originatorKeyInfoElement);
+	else
+		mp_agreementMethodElement->appendChild(kdm);
+	mp_env->doPrettyPrint(mp_agreementMethodElement);
+
+	loadKeyDerivationMethod(kdm);
+
+}
+
+void XENCAgreementMethodImpl::setOriginatorECKeyValue(const XMLCh * curveName,
+													  const XMLCh * publicKey) {
+
+	if (mp_agreementMethodElement == NULL) {
+		throw XSECException(XSECException::ExpectedXENCChildNotFound,
+			"XENCAgreementMethod::setOriginatorECKeyValue - called on empty DOM");
+	}
+
+	if (mp_originatorKeyInfoElement == NULL) {
+
+		safeBuffer str;
+		DOMDocument *doc = mp_env->getParentDocument();
+
+		makeQName(str, mp_env->getXENCNSPrefix(), "OriginatorKeyInfo");
+		mp_originatorKeyInfoElement = doc->createElementNS(DSIGConstants::s_unicodeStrURIXENC, str.rawXMLChBuffer());
+
+		// OriginatorKeyInfo is of type ds:KeyInfoType
+		setNamespace(mp_originatorKeyInfoElement, mp_env->getDSIGNSPrefix(), DSIGConstants::s_unicodeStrURIDSIG);
+		setNamespace(mp_originatorKeyInfoElement, mp_env->getDSIG11NSPrefix(), DSIGConstants::s_unicodeStrURIDSIG11);
+
+		mp_agreementMethodElement->appendChild(mp_originatorKeyInfoElement);
+		mp_env->doPrettyPrint(mp_agreementMethodElement);
+		mp_env->doPrettyPrint(mp_originatorKeyInfoElement);
+
+	}
+
+	DSIGKeyInfoValue * v;
+	XSECnew(v, DSIGKeyInfoValue(mp_env));
+
+	try {
+		mp_originatorKeyInfoElement->appendChild(v->createBlankECKeyValue(curveName, publicKey));
+	}
+	catch (...) {
+		delete v;
+		throw;
+	}
+
+	mp_env->doPrettyPrint(mp_originatorKeyInfoElement);
+	m_originatorKeyInfoList.addKeyInfo(v);
+
+}
@@ -0,0 +1,119 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XENCAgreementMethodImpl := Implementation of AgreementMethod
+ *
+ * $Id$
+ *
+ */
+
+#ifndef XENCAGREEMENTMETHODIMPL_INCLUDE
+#define XENCAGREEMENTMETHODIMPL_INCLUDE
+
+// XSEC Includes
+
+#include <xsec/framework/XSECDefs.hpp>
+#include <xsec/xenc/XENCAgreementMethod.hpp>
+#include <xsec/dsig/DSIGKeyInfoList.hpp>
+
+class XSECEnv;
+
+XSEC_DECLARE_XERCES_CLASS(DOMNode);
+
+class XENCAgreementMethodImpl : public XENCAgreementMethod {
+
+public:
+
+	XENCAgreementMethodImpl(const XSECEnv * env);
+	XENCAgreementMethodImpl(
+		const XSECEnv * env,
+		XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * element
+	);
+	virtual ~XENCAgreementMethodImpl();
+
+	// Load elements
+	void load();
+
+	// Create from scratch
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * createBlankAgreementMethod(
+						const XMLCh * algorithm);
+
+	// Interface
+	virtual const XMLCh * getAlgorithm(void) const;
+	virtual const XMLCh * getKeyDerivationMethod(void) const;
+	virtual const XMLCh * getDigestMethod(void) const;
+	virtual const XMLCh * getAlgorithmID(void) const;
+	virtual const XMLCh * getPartyUInfo(void) const;
+	virtual const XMLCh * getPartyVInfo(void) const;
+	virtual const DSIGKeyInfoList * getOriginatorKeyInfoList(void) const
+		{return &m_originatorKeyInfoList;}
+	virtual const DSIGKeyInfoList * getRecipientKeyInfoList(void) const
+		{return &m_recipientKeyInfoList;}
+	virtual XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * getElement(void) const
+		{return mp_agreementMethodElement;}
+
+	virtual void setConcatKDF(const XMLCh * digestMethod,
+							  const XMLCh * algorithmID,
+							  const XMLCh * partyUInfo,
+							  const XMLCh * partyVInfo);
+	virtual void setOriginatorECKeyValue(const XMLCh * curveName,
+										 const XMLCh * publicKey);
+
+	// DSIGKeyInfo interface
+	virtual keyInfoType getKeyInfoType(void) const {return DSIGKeyInfo::KEYINFO_AGREEMENTMETHOD;}
+	virtual const XMLCh * getKeyName(void) const {return NULL;}
+
+private:
+
+	// Unimplemented
+	XENCAgreementMethodImpl();
+	XENCAgreementMethodImpl(const XENCAgreementMethodImpl &);
+	XENCAgreementMethodImpl & operator = (const XENCAgreementMethodImpl &);
+
+	void loadKeyDerivationMethod(XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * kdm);
+	void loadKeyInfoList(XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * e, DSIGKeyInfoList & l);
+
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMElement
+								* mp_agreementMethodElement;	// Node at head of structure
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode
+								* mp_algorithmAttr;
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMElement
+								* mp_keyDerivationMethodElement;
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode
+								* mp_kdfAlgorithmAttr;
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode
+								* mp_digestAlgorithmAttr;
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode
+								* mp_algorithmIDAttr;
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode
+								* mp_partyUInfoAttr;
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode
+								* mp_partyVInfoAttr;
+	XERCES_CPP_NAMESPACE_QUALIFIER DOMElement
+								* mp_originatorKeyInfoElement;
+
+	DSIGKeyInfoList				m_originatorKeyInfoList;
+	DSIGKeyInfoList				m_recipientKeyInfoList;
+
+};
+
+#endif /* XENCAGREEMENTMETHODIMPL_INCLUDE */
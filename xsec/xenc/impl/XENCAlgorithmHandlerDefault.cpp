@@ -62,18 +62,12 @@ unsigned char s_3DES_CMS_IV [] = {
     0x05
 };
 
-unsigned char s_AES_IV [] = {
+static bool isAESKeyWrapPad(const XMLCh* uri) {
 
-    0xA6,
-    0xA6,
-    0xA6,
-    0xA6,
-    0xA6,
-    0xA6,
-    0xA6,
-    0xA6
-
-};
+    return strEquals(uri, DSIGConstants::s_unicodeStrURIKW_AES128_PAD) ||
+        strEquals(uri, DSIGConstants::s_unicodeStrURIKW_AES192_PAD) ||
+        strEquals(uri, DSIGConstants::s_unicodeStrURIKW_AES256_PAD);
+}
 
 // --------------------------------------------------------------------------------
 //            Compare URI to key type
@@ -205,12 +199,12 @@ void XENCAlgorithmHandlerDefault::mapURIToKey(const XMLCh* uri,
 unsigned int XENCAlgorithmHandlerDefault::unwrapKeyAES(
         TXFMChain* cipherText,
         const XSECCryptoKey* key,
+        bool doPad,
         safeBuffer& result) const {
 
     // Cat the encrypted key
     XMLByte buf[_MY_MAX_KEY_SIZE];
-    XMLByte aesBuf[16];
-    XMLByte aesOutBuf[16];
+    XMLByte outBuf[_MY_MAX_KEY_SIZE];
     TXFMBase* b = cipherText->getLastTxfm();
     unsigned int sz = (unsigned int) b->readBytes(buf, _MY_MAX_KEY_SIZE);
 
@@ -225,70 +219,45 @@ unsigned int XENCAlgorithmHandlerDefault::unwrapKeyAES(
     }
 
     // Find number of blocks, and ensure we are a multiple of 64 bits
-    if (sz % 8 != 0) {
+    if (sz % 8 != 0 || sz < 16) {
         throw XSECException(XSECException::CipherError,
             "XENCAlgorithmHandlerDefault - AES wrapped key not a multiple of 64");
     }
 
-    // Do the decrypt - this cast will throw if wrong, but we should
-    // not have been able to get through algorithm checks otherwise
+    // Do the unwrap - this cast will throw if wrong, but we should
+    // not have been able to get through algorithm checks otherwise.
+    // The key does the whole unwrap, so providers can keep the key
+    // schedule for the KEK rather than rebuilding it for every block
     XSECCryptoSymmetricKey* sk = (XSECCryptoSymmetricKey*) key;
 
-    int blocks = sz / 8;
-    int n = blocks - 1;
-    for (int j = 5; j >= 0; j--) {
-        for (int i = n ; i > 0 ; --i) {
-
-            // Gather blocks to decrypt
-            // A
-            memcpy(aesBuf, buf, 8);
-            // Ri
-            memcpy(&aesBuf[8], &buf[8* i], 8);
-            // A mod t
-            aesBuf[7] ^= ((n * j) + i);
-
-            // do decrypt
-            sk->decryptInit(false, XSECCryptoSymmetricKey::MODE_ECB);        // No padding
-            int sz = sk->decrypt(aesBuf, aesOutBuf, 16, 16);
-            sz += sk->decryptFinish(&aesOutBuf[sz], 16 - sz);
-
-            if (sz != 16) {
-                throw XSECException(XSECException::CipherError,
-                    "XENCAlgorithmHandlerDefault - Error performing decrypt in AES Unwrap");
-            }
+    unsigned int len;
 
-            // Copy back to where we are
-            // A
-            memcpy(buf, aesOutBuf, 8);
-            // Ri
-            memcpy(&buf[8 * i], &aesOutBuf[8], 8);
-        }
+    try {
+        len = sk->unwrapKey(buf, sz, outBuf, _MY_MAX_KEY_SIZE, doPad);
     }
-
-    // Check is valid
-    if (memcmp(buf, s_AES_IV, 8) != 0) {
+    catch (const XSECCryptoException&) {
         throw XSECException(XSECException::CipherError,
-            "XENCAlgorithmHandlerDefault - decrypt failed - AES IV is not correct");
+            "XENCAlgorithmHandlerDefault - decrypt failed - AES key unwrap failed");
     }
 
     // Copy to safebuffer
-    result.sbMemcpyIn(&buf[8], n * 8);
+    result.sbMemcpyIn(outBuf, len);
+    memset(outBuf, 0, len);
 
-    return n * 8;
+    return len;
 }
 
 bool XENCAlgorithmHandlerDefault::wrapKeyAES(
         TXFMChain* cipherText,
         const XSECCryptoKey* key,
+        bool doPad,
         safeBuffer& result) const {
 
     // get the raw key
-    XMLByte buf[_MY_MAX_KEY_SIZE + 8];
-    memcpy(buf, s_AES_IV, 8);
-    XMLByte aesBuf[16];
-    XMLByte aesOutBuf[32];  // Give this an extra block for WinCAPI
+    XMLByte buf[_MY_MAX_KEY_SIZE];
+    XMLByte outBuf[_MY_MAX_KEY_SIZE + 16];
     TXFMBase* b = cipherText->getLastTxfm();
-    unsigned int sz = (unsigned int) b->readBytes(&buf[8], _MY_MAX_KEY_SIZE);
+    unsigned int sz = (unsigned int) b->readBytes(buf, _MY_MAX_KEY_SIZE);
 
     if (sz <= 0) {
         throw XSECException(XSECException::CipherError,
@@ -301,45 +270,17 @@ bool XENCAlgorithmHandlerDefault::wrapKeyAES(
     }
 
     // Find number of blocks, and ensure we are a multiple of 64 bits
-    if (sz % 8 != 0) {
+    if (!doPad && sz % 8 != 0) {
         throw XSECException(XSECException::CipherError,
             "XENCAlgorithmHandlerDefault - AES wrapped key not a multiple of 64");
     }
 
-    // Do the decrypt - this cast will throw if wrong, but we should
+    // Do the wrap - this cast will throw if wrong, but we should
     // not have been able to get through algorithm checks otherwise
     XSECCryptoSymmetricKey* sk = (XSECCryptoSymmetricKey*) key;
 
-    int n = sz / 8;
-
-    for (int j = 0; j <= 5; ++j) {
-        for (int i = 1 ; i <= n ; ++i) {
-
-            // Gather blocks to decrypt
-            // A
-            memcpy(aesBuf, buf, 8);
-            // Ri
-            memcpy(&aesBuf[8], &buf[8 * i], 8);
-
-            // do encrypt
-            sk->encryptInit(false, XSECCryptoSymmetricKey::MODE_ECB);
-            int sz = sk->encrypt(aesBuf, aesOutBuf, 16, 32);
-            sz += sk->encryptFinish(&aesOutBuf[sz], 32 - sz);
-
-            if (sz != 16) {
-                throw XSECException(XSECException::CipherError,
-                    "XENCAlgorithmHandlerDefault - Error performing encrypt in AES wrap");
-            }
-
-            // Copy back to where we are
-            // A
-            memcpy(buf, aesOutBuf, 8);
-            // A mod t
-            buf[7] ^= ((n * j) + i);
-            // Ri
-            memcpy(&buf[8 * i], &aesOutBuf[8], 8);
-        }
-    }
+    unsigned int wrappedLen = sk->wrapKey(buf, sz, outBuf, _MY_MAX_KEY_SIZE + 16, doPad);
+    memset(buf, 0, sz);
 
     // Now we have to base64 encode
     XSECCryptoBase64* b64 = XSECPlatformUtils::g_cryptoProvider->base64();
@@ -351,12 +292,12 @@ bool XENCAlgorithmHandlerDefault::wrapKeyAES(
 
     Janitor<XSECCryptoBase64> j_b64(b64);
     unsigned char* b64Buffer;
-    int bufLen = ((n + 1) * 8) * 3;
+    int bufLen = wrappedLen * 3;
     XSECnew(b64Buffer, unsigned char[bufLen + 1]);// Overkill
     ArrayJanitor<unsigned char> j_b64Buffer(b64Buffer);
 
     b64->encodeInit();
-    int outputLen = b64->encode (buf, (n+1) * 8, b64Buffer, bufLen);
+    int outputLen = b64->encode (outBuf, wrappedLen, b64Buffer, bufLen);
     outputLen += b64->encodeFinish(&b64Buffer[outputLen], bufLen - outputLen);
     b64Buffer[outputLen] = '\0';
 
@@ -588,6 +529,33 @@ bool XENCAlgorithmHandlerDefault::appendDecryptCipherTXFM(
     return true;
 }
 
+bool XENCAlgorithmHandlerDefault::appendEncryptCipherTXFM(
+        TXFMChain* plainText,
+        XENCEncryptionMethod* encryptionMethod,
+        const XSECCryptoKey* key,
+        XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument* doc
+        ) const {
+
+    XSECCryptoKey::KeyType kt;
+    XSECCryptoSymmetricKey::SymmetricKeyType skt;
+    bool isKeyWrap = false;
+    XSECCryptoSymmetricKey::SymmetricKeyMode skm;
+    unsigned int taglen;
+
+    mapURIToKey(encryptionMethod->getAlgorithm(), key, kt, skt, isKeyWrap, skm, taglen);
+
+    // Key transport and key wrap need the whole input, so only bulk
+    // symmetric algorithms (including GCM) can be streamed
+    if (kt != XSECCryptoKey::KEY_SYMMETRIC || isKeyWrap == true)
+        return false;
+
+    TXFMCipher* tcipher;
+    XSECnew(tcipher, TXFMCipher(doc, key, true, skm, taglen));
+    plainText->appendTxfm(tcipher);
+
+    return true;
+}
+
 
 // --------------------------------------------------------------------------------
 //            GCM SafeBuffer decryption
@@ -809,7 +777,7 @@ unsigned int XENCAlgorithmHandlerDefault::decryptToSafeBuffer(
             skt == XSECCryptoSymmetricKey::KEY_AES_192 ||
             skt == XSECCryptoSymmetricKey::KEY_AES_256) {
 
-            return unwrapKeyAES(cipherText, key, result);
+            return unwrapKeyAES(cipherText, key, isAESKeyWrapPad(encryptionMethod->getAlgorithm()), result);
         }
         else if (skt == XSECCryptoSymmetricKey::KEY_3DES_192) {
             return unwrapKey3DES(cipherText, key, result);
@@ -1018,7 +986,7 @@ bool XENCAlgorithmHandlerDefault::encryptToSafeBuffer(
             skt == XSECCryptoSymmetricKey::KEY_AES_192 ||
             skt == XSECCryptoSymmetricKey::KEY_AES_256) {
 
-            return wrapKeyAES(plainText, key, result);
+            return wrapKeyAES(plainText, key, isAESKeyWrapPad(encryptionMethod->getAlgorithm()), result);
         }
 
         if (skt == XSECCryptoSymmetricKey::KEY_3DES_192) {
@@ -1060,25 +1028,31 @@ XSECCryptoKey* XENCAlgorithmHandlerDefault::createKeyForURI(
 
     XSECCryptoSymmetricKey* sk = NULL;
 
-    if (strEquals(uri, DSIGConstants::s_unicodeStrURI3DES_CBC)) {
+    // Key wrap URIs are accepted so that a KEK derived by key agreement
+    // can be created for the wrap algorithm of an EncryptedKey
+
+    if (strEquals(uri, DSIGConstants::s_unicodeStrURI3DES_CBC) || strEquals(uri, DSIGConstants::s_unicodeStrURIKW_3DES)) {
         if (keyLen < 192 / 8)
             throw XSECException(XSECException::CipherError, 
                 "XENCAlgorithmHandlerDefault - key size was invalid");
         sk = XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_3DES_192);
     }
-    else if (strEquals(uri, DSIGConstants::s_unicodeStrURIAES128_CBC) || strEquals(uri, DSIGConstants::s_unicodeStrURIAES128_GCM)) {
+    else if (strEquals(uri, DSIGConstants::s_unicodeStrURIAES128_CBC) || strEquals(uri, DSIGConstants::s_unicodeStrURIAES128_GCM) ||
+             strEquals(uri, DSIGConstants::s_unicodeStrURIKW_AES128) || strEquals(uri, DSIGConstants::s_unicodeStrURIKW_AES128_PAD)) {
         if (keyLen < 128 / 8)
             throw XSECException(XSECException::CipherError, 
                 "XENCAlgorithmHandlerDefault - key size was invalid");
         sk = XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_128);
     }
-    else if (strEquals(uri, DSIGConstants::s_unicodeStrURIAES192_CBC) || strEquals(uri, DSIGConstants::s_unicodeStrURIAES192_GCM)) {
+    else if (strEquals(uri, DSIGConstants::s_unicodeStrURIAES192_CBC) || strEquals(uri, DSIGConstants::s_unicodeStrURIAES192_GCM) ||
+             strEquals(uri, DSIGConstants::s_unicodeStrURIKW_AES192) || strEquals(uri, DSIGConstants::s_unicodeStrURIKW_AES192_PAD)) {
         if (keyLen < 192 / 8)
             throw XSECException(XSECException::CipherError, 
                 "XENCAlgorithmHandlerDefault - key size was invalid");
         sk = XSECPlatformUtils::g_cryptoProvider->keySymmetric(XSECCryptoSymmetricKey::KEY_AES_192);
     }
-    else if (strEquals(uri, DSIGConstants::s_unicodeStrURIAES256_CBC) || strEquals(uri, DSIGConstants::s_unicodeStrURIAES256_GCM)) {
+    else if (strEquals(uri, DSIGConstants::s_unicodeStrURIAES256_CBC) || strEquals(uri, DSIGConstants::s_unicodeStrURIAES256_GCM) ||
+             strEquals(uri, DSIGConstants::s_unicodeStrURIKW_AES256) || strEquals(uri, DSIGConstants::s_unicodeStrURIKW_AES256_PAD)) {
         if (keyLen < 256 / 8)
             throw XSECException(XSECException::CipherError, 
                 "XENCAlgorithmHandlerDefault - key size was invalid");
@@ -63,6 +63,13 @@ public:
 		XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument * doc
 	) const;
 
+	virtual bool appendEncryptCipherTXFM(
+		TXFMChain * plainText,
+		XENCEncryptionMethod * encryptionMethod,
+		const XSECCryptoKey * key,
+		XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument * doc
+	) const;
+
 	virtual bool encryptToSafeBuffer(
 		TXFMChain * plainText,
 		XENCEncryptionMethod * encryptionMethod,
@@ -143,6 +150,7 @@ private:
 	unsigned int unwrapKeyAES(
    		TXFMChain * cipherText,
 		const XSECCryptoKey * key,
+		bool doPad,
 		safeBuffer & result) const;
 
 	unsigned int unwrapKey3DES(
@@ -153,6 +161,7 @@ private:
 	bool wrapKeyAES(
    		TXFMChain * cipherText,
 		const XSECCryptoKey * key,
+		bool doPad,
 		safeBuffer & result) const;
 
 	bool wrapKey3DES(
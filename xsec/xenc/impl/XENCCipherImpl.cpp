@@ -35,9 +35,15 @@
 #include <xsec/framework/XSECDefs.hpp>
 #include <xsec/framework/XSECEnv.hpp>
 #include <xsec/framework/XSECError.hpp>
+#include <xsec/framework/XSECMetrics.hpp>
 #include <xsec/enc/XSECCryptoKey.hpp>
+#include <xsec/enc/XSECCryptoHash.hpp>
+#include <xsec/enc/XSECCryptoKeyEC.hpp>
+#include <xsec/dsig/DSIGKeyInfoList.hpp>
+#include <xsec/dsig/DSIGKeyInfoValue.hpp>
 #include <xsec/transformers/TXFMChain.hpp>
 #include <xsec/transformers/TXFMBase.hpp>
+#include <xsec/transformers/TXFMBase64.hpp>
 #include <xsec/transformers/TXFMC14n.hpp>
 #include <xsec/transformers/TXFMSB.hpp>
 #include <xsec/transformers/TXFMURL.hpp>
@@ -45,21 +51,35 @@
 #include <xsec/transformers/TXFMConcatChains.hpp>
 #include <xsec/utils/XSECPlatformUtils.hpp>
 #include <xsec/utils/XSECBinTXFMInputStream.hpp>
+#include <xsec/xenc/XENCKeyCache.hpp>
 
 #include "XENCCipherImpl.hpp"
 #include "XENCEncryptedDataImpl.hpp"
 #include "XENCEncryptedKeyImpl.hpp"
 #include "XENCEncryptionMethodImpl.hpp"
+#include "XENCAgreementMethodImpl.hpp"
 #include "XENCAlgorithmHandlerDefault.hpp"
 #include "../../utils/XSECAutoPtr.hpp"
+#include "../../utils/XSECThreadPool.hpp"
 #include "../../utils/XSECDOMUtils.hpp"
 
 #include <xercesc/dom/DOMNode.hpp>
 #include <xercesc/dom/DOMElement.hpp>
+#include <xercesc/dom/DOMImplementation.hpp>
+#include <xercesc/dom/DOMLSSerializer.hpp>
+#include <xercesc/framework/XMLFormatter.hpp>
+#include <xercesc/framework/MemBufInputSource.hpp>
 #include <xercesc/util/XMLUniDefs.hpp>
 #include <xercesc/parsers/XercesDOMParser.hpp>
-#include <xercesc/framework/MemBufInputSource.hpp>
+#include <xercesc/sax/InputSource.hpp>
+#include <xercesc/util/BinInputStream.hpp>
 #include <xercesc/util/Janitor.hpp>
+#include <xercesc/util/SecurityManager.hpp>
+
+#include <set>
+#include <string>
+#include <vector>
+#include <string.h>
 
 // With all the characters - just uplift entire thing
 
@@ -81,12 +101,26 @@ const XMLCh s_noData[] = { chLatin_n, chLatin_o, chLatin_D, chLatin_a, chLatin_t
 
 const XMLCh s_ds[] = { chLatin_d, chLatin_s, chNull };
 
+// Placeholder for the CipherValue of a streamed EncryptedData
+#define XENC_STREAM_MARKER "xsecStreamedCipherValue"
+
+// Size of the blocks written to the target when streaming
+#define XENC_STREAM_CHUNK 8192
+
+// Algorithm to report an operation under in the metrics
+static const XMLCh * getMethodAlgorithm(const XENCEncryptionMethod * method) {
+
+    return (method != NULL ? method->getAlgorithm() : NULL);
+
+}
+
 // --------------------------------------------------------------------------------
 //			Constructors
 // --------------------------------------------------------------------------------
 
 XENCCipherImpl::XENCCipherImpl(DOMDocument * doc) :
-    mp_doc(doc), mp_encryptedData(NULL), mp_key(NULL), mp_kek(NULL), mp_keyInfoResolver(NULL) {
+    mp_doc(doc), mp_encryptedData(NULL), mp_key(NULL), mp_kek(NULL), mp_keyCache(NULL), mp_keyInfoResolver(NULL),
+    mp_nsContextNode(NULL), m_nsContextLen(0), mp_parser(NULL), mp_securityManager(NULL) {
 
     XSECnew(mp_env, XSECEnv(doc));
     mp_env->setDSIGNSPrefix(s_ds);
@@ -113,6 +147,13 @@ XENCCipherImpl::~XENCCipherImpl() {
     if (mp_keyInfoResolver != NULL)
         delete mp_keyInfoResolver;
 
+    // Parser refers to the security manager, so goes first
+    if (mp_parser != NULL)
+        delete mp_parser;
+
+    if (mp_securityManager != NULL)
+        delete mp_securityManager;
+
 }
 
 // --------------------------------------------------------------------------------
@@ -136,9 +177,9 @@ void XENCCipherImpl::Initialise(void) {
     XSECPlatformUtils::registerAlgorithmHandler(DSIGConstants::s_unicodeStrURIKW_AES128, def);
     XSECPlatformUtils::registerAlgorithmHandler(DSIGConstants::s_unicodeStrURIKW_AES192, def);
     XSECPlatformUtils::registerAlgorithmHandler(DSIGConstants::s_unicodeStrURIKW_AES256, def);
-    //XSECPlatformUtils::registerAlgorithmHandler(DSIGConstants::s_unicodeStrURIKW_AES128_PAD, def);
-    //XSECPlatformUtils::registerAlgorithmHandler(DSIGConstants::s_unicodeStrURIKW_AES192_PAD, def);
-    //XSECPlatformUtils::registerAlgorithmHandler(DSIGConstants::s_unicodeStrURIKW_AES256_PAD, def);
+    XSECPlatformUtils::registerAlgorithmHandler(DSIGConstants::s_unicodeStrURIKW_AES128_PAD, def);
+    XSECPlatformUtils::registerAlgorithmHandler(DSIGConstants::s_unicodeStrURIKW_AES192_PAD, def);
+    XSECPlatformUtils::registerAlgorithmHandler(DSIGConstants::s_unicodeStrURIKW_AES256_PAD, def);
     XSECPlatformUtils::registerAlgorithmHandler(DSIGConstants::s_unicodeStrURIRSA_1_5, def);
     XSECPlatformUtils::registerAlgorithmHandler(DSIGConstants::s_unicodeStrURIRSA_OAEP_MGFP1, def);
     XSECPlatformUtils::registerAlgorithmHandler(DSIGConstants::s_unicodeStrURIRSA_OAEP, def);
@@ -182,6 +223,39 @@ XENCEncryptedData * XENCCipherImpl::getEncryptedData() const {
     return mp_encryptedData;
 
 }
+// --------------------------------------------------------------------------------
+//			Re-use
+// --------------------------------------------------------------------------------
+
+void XENCCipherImpl::reset(DOMDocument * doc) {
+
+    if (mp_encryptedData != NULL) {
+        delete mp_encryptedData;
+        mp_encryptedData = NULL;
+    }
+
+    if (mp_key != NULL) {
+        delete mp_key;
+        mp_key = NULL;
+    }
+
+    if (mp_kek != NULL) {
+        delete mp_kek;
+        mp_kek = NULL;
+    }
+
+    m_keyDerived = false;
+    m_kekDerived = false;
+
+    // The cached namespace context belongs to the old document
+    mp_nsContextNode = NULL;
+    m_nsContextLen = 0;
+
+    mp_doc = doc;
+    mp_env->setParentDocument(doc);
+
+}
+
 // --------------------------------------------------------------------------------
 //			Keys
 // --------------------------------------------------------------------------------
@@ -206,16 +280,152 @@ void XENCCipherImpl::setKEK(XSECCryptoKey * key) {
 
 }
 
+void XENCCipherImpl::setKeyCache(XENCKeyCache * cache, const XMLCh * kekIdentity) {
+
+    if (cache != NULL && (kekIdentity == NULL || *kekIdentity == 0)) {
+        throw XSECException(XSECException::CipherError,
+            "XENCCipherImpl::setKeyCache - A KEK identity is required to use a key cache");
+    }
+
+    mp_keyCache = cache;
+    m_kekIdentity.sbStrcpyIn("");
+    if (cache != NULL)
+        m_kekIdentity.sbXMLChIn(kekIdentity);
+
+}
+
 // --------------------------------------------------------------------------------
 //			Serialise/Deserialise an element
 // --------------------------------------------------------------------------------
 
-DOMDocumentFragment * XENCCipherImpl::deSerialise(safeBuffer &content, DOMNode * ctx) {
+// Input stream that hands the parser the wrapper start tag, the decrypted
+// content and the wrapper end tag in turn, so they never need to be joined
+// into a single buffer
 
-    DOMDocumentFragment * result;
+class XENCDeSerialiseInputStream : public BinInputStream {
+
+public:
+
+    XENCDeSerialiseInputStream(const XMLByte * prefix, XMLSize_t prefixLen,
+                               const XMLByte * content, XMLSize_t contentLen,
+                               const XMLByte * trailer, XMLSize_t trailerLen) :
+        m_segment(0), m_offset(0), m_pos(0) {
+
+        mp_segment[0] = prefix;
+        m_segmentLen[0] = prefixLen;
+        mp_segment[1] = content;
+        m_segmentLen[1] = contentLen;
+        mp_segment[2] = trailer;
+        m_segmentLen[2] = trailerLen;
+
+    }
+
+    virtual XMLFilePos curPos() const {return m_pos;}
+    virtual const XMLCh* getContentType() const {return NULL;}
+
+    virtual XMLSize_t readBytes(XMLByte * const toFill, const XMLSize_t maxToRead) {
+
+        XMLSize_t done = 0;
+
+        while (done < maxToRead && m_segment < 3) {
+
+            XMLSize_t avail = m_segmentLen[m_segment] - m_offset;
+            if (avail == 0) {
+                ++m_segment;
+                m_offset = 0;
+                continue;
+            }
+
+            if (avail > maxToRead - done)
+                avail = maxToRead - done;
+
+            memcpy(&toFill[done], &mp_segment[m_segment][m_offset], avail);
+            m_offset += avail;
+            done += avail;
+
+        }
+
+        m_pos += done;
+        return done;
+
+    }
+
+private:
+
+    const XMLByte   * mp_segment[3];
+    XMLSize_t       m_segmentLen[3];
+    int             m_segment;
+    XMLSize_t       m_offset;
+    XMLFilePos      m_pos;
+
+};
+
+class XENCDeSerialiseInputSource : public InputSource {
+
+public:
+
+    XENCDeSerialiseInputSource(const XMLByte * prefix, XMLSize_t prefixLen,
+                               const XMLByte * content, XMLSize_t contentLen,
+                               const XMLByte * trailer, XMLSize_t trailerLen) :
+        InputSource("XSECMem"),
+        mp_prefix(prefix), m_prefixLen(prefixLen),
+        mp_content(content), m_contentLen(contentLen),
+        mp_trailer(trailer), m_trailerLen(trailerLen) {}
+
+    virtual BinInputStream * makeStream() const {
+        return new XENCDeSerialiseInputStream(mp_prefix, m_prefixLen,
+                                              mp_content, m_contentLen,
+                                              mp_trailer, m_trailerLen);
+    }
+
+private:
+
+    const XMLByte   * mp_prefix;
+    XMLSize_t       m_prefixLen;
+    const XMLByte   * mp_content;
+    XMLSize_t       m_contentLen;
+    const XMLByte   * mp_trailer;
+    XMLSize_t       m_trailerLen;
+
+};
+
+struct XENCXMLChLess {
+    bool operator()(const XMLCh * a, const XMLCh * b) const {
+        return XMLString::compareString(a, b) < 0;
+    }
+};
+
+XercesDOMParser * XENCCipherImpl::getParser(void) {
+
+    if (mp_parser == NULL) {
+
+        XSECnew(mp_securityManager, SecurityManager);
+        mp_securityManager->setEntityExpansionLimit(XSEC_ENTITY_EXPANSION_LIMIT);
+
+        XSECnew(mp_parser, XercesDOMParser);
+        mp_parser->setDoNamespaces(true);
+        mp_parser->setLoadExternalDTD(false);
+        mp_parser->setSecurityManager(mp_securityManager);
+
+    }
+
+    return mp_parser;
+
+}
+
+const safeBuffer & XENCCipherImpl::getNSContext(DOMNode * ctx, XMLSize_t & len) {
+
+    DOMNode * ctxParent = ctx->getParentNode();
+
+    // Elements that share a parent (e.g. a run of EncryptedAssertions)
+    // share a context, so only build it when the parent changes
+    if (ctxParent != NULL && ctxParent == mp_nsContextNode) {
+        len = m_nsContextLen;
+        return m_nsContext;
+    }
 
     // Create the context to parse the document against
-    safeBuffer sb, sbt;
+    safeBuffer sb;
     sb.sbXMLChIn(DSIGConstants::s_unicodeStrEmpty);
     //sb.sbXMLChAppendCh(chUnicodeMarker);
     //sb.sbXMLChCat8("<?xml version=\"1.0\" encoding=\"UTF-16\"?><");
@@ -223,9 +433,10 @@ DOMDocumentFragment * XENCCipherImpl::deSerialise(safeBuffer &content, DOMNode *
     sb.sbXMLChCat(s_tagname);
 
     // Run through each node up to the document node and find any
-    // xmlns: nodes that may be needed during the parse of the decrypted content
+    // xmlns: nodes that may be needed during the parse of the decrypted content.
+    // The nearest declaration of each name wins, so remember what we've seen
 
-    DOMNode * ctxParent = ctx->getParentNode();
+    std::set<const XMLCh *, XENCXMLChLess> seen;
     DOMNode * wk = ctxParent;
 
     while (wk != NULL) {
@@ -239,26 +450,17 @@ DOMDocumentFragment * XENCCipherImpl::deSerialise(safeBuffer &content, DOMNode *
 
         for (XMLSize_t i = 0; i < length; ++i) {
             DOMNode * att = atts->item(i);
-            if (strEquals(att->getNodeName(), DSIGConstants::s_unicodeStrXmlns) ||
-                    (XMLString::compareNString(att->getNodeName(), DSIGConstants::s_unicodeStrXmlns, 5) == 0 &&
-                            att->getNodeName()[5] == chColon)) {
+            const XMLCh * name = att->getNodeName();
+            if (strEquals(name, DSIGConstants::s_unicodeStrXmlns) ||
+                    (XMLString::compareNString(name, DSIGConstants::s_unicodeStrXmlns, 5) == 0 &&
+                            name[5] == chColon)) {
 
                 // Check to see if this node has already been found
-                DOMNode * p = ctxParent;
-                bool found = false;
-                while (p != wk) {
-                    DOMNamedNodeMap * tstAtts = p->getAttributes();
-                    if (tstAtts != NULL && tstAtts->getNamedItem(att->getNodeName()) != NULL) {
-                        found = true;
-                        break;
-                    }
-                    p = p->getParentNode();
-                }
-                if (found == false) {
+                if (seen.insert(name).second) {
 
                     // This is an attribute node that needs to be added
                     sb.sbXMLChAppendCh(chSpace);
-                    sb.sbXMLChCat(att->getNodeName());
+                    sb.sbXMLChCat(name);
                     sb.sbXMLChAppendCh(chEqual);
                     sb.sbXMLChAppendCh(chDoubleQuote);
                     sb.sbXMLChCat(att->getNodeValue());
@@ -271,9 +473,24 @@ DOMDocumentFragment * XENCCipherImpl::deSerialise(safeBuffer &content, DOMNode *
     sb.sbXMLChAppendCh(chCloseAngle);
 
     char* prefix = transcodeToUTF8(sb.rawXMLChBuffer());
-    sbt = prefix;
+    m_nsContext.sbStrcpyIn(prefix);
     XSEC_RELEASE_XMLCH(prefix);
 
+    m_nsContextLen = strlen(m_nsContext.rawCharBuffer());
+    mp_nsContextNode = ctxParent;
+
+    len = m_nsContextLen;
+    return m_nsContext;
+
+}
+
+DOMDocumentFragment * XENCCipherImpl::deSerialise(safeBuffer &content, DOMNode * ctx) {
+
+    DOMDocumentFragment * result;
+
+    XMLSize_t prefixLen;
+    const safeBuffer & prefix = getNSContext(ctx, prefixLen);
+
     const char * crcb = content.rawCharBuffer();
     int offset = 0;
     if (crcb[0] == '<' && crcb[1] == '?') {
@@ -286,62 +503,62 @@ DOMDocumentFragment * XENCCipherImpl::deSerialise(safeBuffer &content, DOMNode *
             offset = i + 1;
     }
 
-    sbt.sbStrcatIn(&crcb[offset]);
-
     // Terminate the string
-    sb.sbXMLChIn(DSIGConstants::s_unicodeStrEmpty);
-    sb.sbXMLChAppendCh(chOpenAngle);
-    sb.sbXMLChAppendCh(chForwardSlash);
-    sb.sbXMLChCat(s_tagname);
-    sb.sbXMLChAppendCh(chCloseAngle);
+    static const char s_trailer[] = "</fragment>";
 
-    char* trailer = transcodeToUTF8(sb.rawXMLChBuffer());
-    sbt.sbStrcatIn(trailer);
-    XSEC_RELEASE_XMLCH(trailer);
+    XMLSize_t contentLen = strlen(&crcb[offset]);
+    XSECMetricTimer timer(XSEC_METRIC_LOAD);
+    timer.setBytes(contentLen);
 
-    // Create an input source
-    XMLSize_t bytes = XMLString::stringLen(sbt.rawCharBuffer());
-    MemBufInputSource memIS((const XMLByte*) sbt.rawBuffer(), bytes, "XSECMem");
+    // Parse the three pieces in place
+    XENCDeSerialiseInputSource memIS(
+        (const XMLByte *) prefix.rawCharBuffer(), prefixLen,
+        (const XMLByte *) &crcb[offset], contentLen,
+        (const XMLByte *) s_trailer, sizeof(s_trailer) - 1);
 
-    XercesDOMParser parser;
-    parser.setDoNamespaces(true);
-    parser.setLoadExternalDTD(false);
+    getParser();
 
-    SecurityManager securityManager;
-    securityManager.setEntityExpansionLimit(XSEC_ENTITY_EXPANSION_LIMIT);
-    parser.setSecurityManager(&securityManager);
+    try {
 
-    parser.parse(memIS);
-    XMLSize_t errorCount = parser.getErrorCount();
-    if (errorCount > 0)
-        throw XSECException(XSECException::CipherError, "Errors occurred during de-serialisation of decrypted element content");
+        mp_parser->parse(memIS);
+        XMLSize_t errorCount = mp_parser->getErrorCount();
+        if (errorCount > 0)
+            throw XSECException(XSECException::CipherError, "Errors occurred during de-serialisation of decrypted element content");
 
-    DOMDocument * doc = parser.getDocument();
+        DOMDocument * doc = mp_parser->getDocument();
 
-    // Create a DocumentFragment to hold the children of the parsed doc element
-    DOMDocument *ctxDocument = ctx->getOwnerDocument();
-    result = ctxDocument->createDocumentFragment();
-    Janitor<DOMDocumentFragment> j_result(result);
+        // Create a DocumentFragment to hold the children of the parsed doc element
+        DOMDocument *ctxDocument = ctx->getOwnerDocument();
+        result = ctxDocument->createDocumentFragment();
+        Janitor<DOMDocumentFragment> j_result(result);
 
-    // Now get the children of the document into a DOC fragment
-    DOMNode * fragElt = doc->getDocumentElement();
-    DOMNode * child;
+        // Now get the children of the document into a DOC fragment
+        DOMNode * fragElt = doc->getDocumentElement();
+        DOMNode * child;
 
-    if (fragElt != NULL) {
-        child = fragElt->getFirstChild();
-    } else {
+        if (fragElt != NULL) {
+            child = fragElt->getFirstChild();
+        } else {
 
-        throw XSECException(XSECException::CipherError, "XENCCipher::deSerialse - re-parsed document unexpectedly empty");
-    }
+            throw XSECException(XSECException::CipherError, "XENCCipher::deSerialse - re-parsed document unexpectedly empty");
+        }
 
-    while (child != NULL) {
-        result->appendChild(ctxDocument->importNode(child, true));
-        child = child->getNextSibling();
-    }
+        while (child != NULL) {
+            result->appendChild(ctxDocument->importNode(child, true));
+            child = child->getNextSibling();
+        }
 
-    // Done!
+        // Done!  Release the parsed document so the parser can be re-used
+
+        j_result.release();
+        mp_parser->resetDocumentPool();
+
+    }
+    catch (...) {
+        mp_parser->resetDocumentPool();
+        throw;
+    }
 
-    j_result.release();
     return result;
 }
 
@@ -471,8 +688,10 @@ DOMNode * XENCCipherImpl::decryptElementDetached() {
     // Make sure we have a key before we do anything else too drastic
     if (mp_key == NULL) {
 
-        if (mp_keyInfoResolver != NULL)
+        if (mp_keyInfoResolver != NULL) {
+            XSECMetricTimer timer(XSEC_METRIC_KEY_RESOLUTION);
             mp_key = mp_keyInfoResolver->resolveKey(mp_encryptedData->getKeyInfoList());
+        }
 
         if (mp_key == NULL) {
 
@@ -513,6 +732,7 @@ DOMNode * XENCCipherImpl::decryptElementDetached() {
 
     if (handler != NULL) {
 
+        XSECMetricTimer timer(XSEC_METRIC_DECRYPT, getMethodAlgorithm(mp_encryptedData->getEncryptionMethod()));
         decryptLen = handler->decryptToSafeBuffer(c, mp_encryptedData->getEncryptionMethod(), mp_key,
             mp_env->getParentDocument(), sb);
     } else {
@@ -563,10 +783,14 @@ DOMDocument * XENCCipherImpl::decryptElement() {
 //			Decrypt data to an input stream
 // --------------------------------------------------------------------------------
 
-XSECBinTXFMInputStream * XENCCipherImpl::decryptToBinInputStream(
-    XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * element
+TXFMChain * XENCCipherImpl::createDecryptTXFMChain(
+    XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * element,
+    XERCES_CPP_NAMESPACE_QUALIFIER BinInputStream * cipherValue
 ) {
 
+    // If the cipher text is supplied separately, it is ours
+    Janitor<BinInputStream> j_cipherValue(cipherValue);
+
     const XSECAlgorithmHandler *handler;
 
     // First of all load the element
@@ -588,8 +812,10 @@ XSECBinTXFMInputStream * XENCCipherImpl::decryptToBinInputStream(
     // Make sure we have a key before we do anything else too drastic
     if (mp_key == NULL) {
 
-        if (mp_keyInfoResolver != NULL)
-        mp_key = mp_keyInfoResolver->resolveKey(mp_encryptedData->getKeyInfoList());
+        if (mp_keyInfoResolver != NULL) {
+            XSECMetricTimer timer(XSEC_METRIC_KEY_RESOLUTION);
+            mp_key = mp_keyInfoResolver->resolveKey(mp_encryptedData->getKeyInfoList());
+        }
 
         if (mp_key == NULL) {
 
@@ -607,7 +833,27 @@ XSECBinTXFMInputStream * XENCCipherImpl::decryptToBinInputStream(
     }
 
     // Get the raw encrypted data
-    TXFMChain * c = mp_encryptedData->createCipherTXFMChain();
+    TXFMChain * c;
+
+    if (cipherValue != NULL) {
+
+        // Base64 cipher text read straight from the caller's stream
+        TXFMURL * uri;
+        XSECnew(uri, TXFMURL(mp_doc, NULL));
+
+        uri->setInput(cipherValue);
+        j_cipherValue.release();
+
+        XSECnew(c, TXFMChain(uri));
+
+        TXFMBase64 * tb64;
+        XSECnew(tb64, TXFMBase64(mp_doc));
+        c->appendTxfm(tb64);
+
+    }
+    else
+        c = mp_encryptedData->createCipherTXFMChain();
+
     Janitor<TXFMChain> j_c(c);
 
     // Get the Algorithm handler for the algorithm
@@ -650,6 +896,18 @@ XSECBinTXFMInputStream * XENCCipherImpl::decryptToBinInputStream(
 
     }
 
+    j_c.release();
+    return c;
+
+}
+
+XSECBinTXFMInputStream * XENCCipherImpl::decryptToBinInputStream(
+    XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * element
+) {
+
+    TXFMChain * c = createDecryptTXFMChain(element, NULL);
+    Janitor<TXFMChain> j_c(c);
+
     // Wrap in a Bin input stream
     XSECBinTXFMInputStream * ret;
     ret = new XSECBinTXFMInputStream(c); // Probs with MSVC++ mean no XSECnew
@@ -660,162 +918,1036 @@ XSECBinTXFMInputStream * XENCCipherImpl::decryptToBinInputStream(
 }
 
 // --------------------------------------------------------------------------------
-//			Decrypt a key in an XENCEncryptedKey element
+//			Decrypt data to a format target
 // --------------------------------------------------------------------------------
 
-int XENCCipherImpl::decryptKey(XENCEncryptedKey * encryptedKey, XMLByte * rawKey, int maxKeySize) {
+static void writeChainToTarget(TXFMChain * c, XMLFormatTarget * target) {
 
-    // Check KEK is valid
-    if (m_kekDerived && mp_kek) {
-        delete mp_kek;
-        mp_kek = NULL;
-    }
+    XMLByte buf[XENC_STREAM_CHUNK];
+    unsigned int sz;
+    TXFMBase * last = c->getLastTxfm();
 
-    // Make sure we have a key before we do anything else too drastic
-    if (mp_kek == NULL) {
+    while ((sz = last->readBytes(buf, XENC_STREAM_CHUNK)) > 0)
+        target->writeChars(buf, sz, NULL);
 
-        if (mp_keyInfoResolver != NULL)
-            mp_kek = mp_keyInfoResolver->resolveKey(encryptedKey->getKeyInfoList());
+    target->flush();
 
-        if (mp_kek == NULL) {
+    // Don't leave plain text lying around on the stack
+    memset(buf, 0, XENC_STREAM_CHUNK);
 
-            throw XSECException(XSECException::CipherError, "XENCCipherImpl::decryptKey - No KEK set and cannot resolve");
-        }
-        m_kekDerived = true;
+}
+
+void XENCCipherImpl::decryptToFormatTarget(
+    XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * element,
+    XERCES_CPP_NAMESPACE_QUALIFIER XMLFormatTarget * target
+) {
+
+    if (target == NULL) {
+        throw XSECException(XSECException::CipherError,
+            "XENCCipherImpl::decryptToFormatTarget - No output target");
     }
 
-    // Get the raw encrypted data
-    TXFMChain * c = ((XENCEncryptedKeyImpl *) encryptedKey)->createCipherTXFMChain();
+    TXFMChain * c = createDecryptTXFMChain(element, NULL);
     Janitor<TXFMChain> j_c(c);
 
-    // Get the Algorithm handler for the algorithm
-    XENCEncryptionMethod * encryptionMethod = encryptedKey->getEncryptionMethod();
-    const XSECAlgorithmHandler *handler;
+    writeChainToTarget(c, target);
 
-    if (encryptionMethod != NULL) {
+}
 
-        handler = XSECPlatformUtils::g_algorithmMapper->mapURIToHandler(encryptedKey->getEncryptionMethod()->getAlgorithm());
+// Reads a serialised EncryptedData.  The markup up to the start of the
+// CipherValue is gathered so that it can be parsed; the stream then hands
+// out the base64 content of the CipherValue, stopping at its end tag.
 
-    }
+class XENCCipherValueInputStream : public BinInputStream {
 
-    else {
+public:
 
-        handler = XSECPlatformUtils::g_algorithmMapper->mapURIToHandler(XSECAlgorithmMapper::s_defaultEncryptionMapping);
+    XENCCipherValueInputStream(BinInputStream * in) :
+        mp_in(in), m_envLen(0), m_scan(0), m_bufPos(0), m_bufLen(0),
+        m_inEntity(false), m_done(false), m_pos(0) {}
 
-    }
+    virtual ~XENCCipherValueInputStream() {delete mp_in;}
 
-    safeBuffer sb("");
-    unsigned int keySize;
+    // Read up to the start of the CipherValue of the (first) EncryptedData.
+    // The envelope is closed off so that it can be parsed.  Returns false,
+    // with the whole of the input in the envelope, if there is no CipherValue.
+    bool readEnvelope(safeBuffer & envelope, XMLSize_t & envelopeLen);
 
-    if (handler != NULL) {
+    virtual XMLFilePos curPos() const {return m_pos;}
+    virtual const XMLCh* getContentType() const {return NULL;}
+    virtual XMLSize_t readBytes(XMLByte * const toFill, const XMLSize_t maxToRead);
 
-        keySize = handler->decryptToSafeBuffer(c, encryptedKey->getEncryptionMethod(), mp_kek, mp_env->getParentDocument(), sb);
-    } else {
+private:
 
-        // Very strange if we get here - any problems should throw an
-        // exception in the AlgorithmMapper.
+    enum ScanResult {
+        SCAN_MORE,          // Need more input
+        SCAN_FOUND          // Positioned just after the CipherValue start tag
+    };
 
-        throw XSECException(XSECException::CipherError,
-            "XENCCipherImpl::decryptElement - Error retrieving a handler for algorithm");
+    ScanResult scan(void);
 
-    }
+    BinInputStream              * mp_in;
+    safeBuffer                  m_env;
+    XMLSize_t                   m_envLen;
+    XMLSize_t                   m_scan;         // Next unscanned byte of m_env
+    std::vector<std::string>    m_open;         // QNames of open elements
+    XMLByte                     m_buf[XENC_STREAM_CHUNK];
+    XMLSize_t                   m_bufPos;
+    XMLSize_t                   m_bufLen;
+    bool                        m_inEntity;
+    bool                        m_done;
+    XMLFilePos                  m_pos;
 
-    keySize = (keySize < (unsigned int) maxKeySize ? keySize : (unsigned int) maxKeySize);
-    memcpy(rawKey, sb.rawBuffer(), keySize);
+};
 
-    return keySize;
-}
-// --------------------------------------------------------------------------------
-//			Decrypt a key from a DOM structure
-// --------------------------------------------------------------------------------
+static XMLSize_t findSequence(const char * b, XMLSize_t from, XMLSize_t len, const char * seq) {
 
-int XENCCipherImpl::decryptKey(DOMElement * keyNode, XMLByte * rawKey, int maxKeySize) {
+    XMLSize_t seqLen = strlen(seq);
 
-    XENCEncryptedKey * encryptedKey = loadEncryptedKey(keyNode);
-    Janitor<XENCEncryptedKey> j_encryptedKey(encryptedKey);
+    for (XMLSize_t i = from; i + seqLen <= len; ++i) {
+        if (memcmp(&b[i], seq, seqLen) == 0)
+            return i;
+    }
 
-    // Now decrypt!
-    return decryptKey(encryptedKey, rawKey, maxKeySize);
+    return len;
 
 }
 
-XENCEncryptedKey * XENCCipherImpl::loadEncryptedKey(DOMElement * keyNode) {
+static const char * localPart(const std::string & qname) {
 
-    XENCEncryptedKeyImpl * encryptedKey;
-    XSECnew(encryptedKey, XENCEncryptedKeyImpl(mp_env, keyNode));
-    Janitor<XENCEncryptedKeyImpl> j_encryptedKey(encryptedKey);
+    std::string::size_type colon = qname.find(':');
+    return qname.c_str() + (colon == std::string::npos ? 0 : colon + 1);
 
-    // Load
-    encryptedKey->load();
+}
 
-    j_encryptedKey.release();
-    return encryptedKey;
+XENCCipherValueInputStream::ScanResult XENCCipherValueInputStream::scan(void) {
 
-}
-// --------------------------------------------------------------------------------
-//			Encrypt a BinInputStream
-// --------------------------------------------------------------------------------
+    const char * b = m_env.rawCharBuffer();
 
-XENCEncryptedData * XENCCipherImpl::encryptBinInputStream(
-    XERCES_CPP_NAMESPACE_QUALIFIER BinInputStream * plainText,
-    const XMLCh * algorithmURI) {
+    while (m_scan < m_envLen) {
 
-    TXFMURL * uri;
-    XSECnew(uri, TXFMURL(mp_doc, NULL));
+        if (b[m_scan] != '<') {
+            ++m_scan;
+            continue;
+        }
 
-    uri->setInput(plainText);
-    TXFMChain c(uri);
+        XMLSize_t i = m_scan + 1;
+        XMLSize_t end;
 
-    return encryptTXFMChain(&c, algorithmURI);
+        if (m_envLen - i < 9)
+            return SCAN_MORE;       // Enough to recognise any markup
 
-}
+        if (memcmp(&b[i], "!--", 3) == 0) {
+            end = findSequence(b, i + 3, m_envLen, "-->");
+            if (end == m_envLen)
+                return SCAN_MORE;
+            m_scan = end + 3;
+            continue;
+        }
 
-// --------------------------------------------------------------------------------
-//			Encrypt a TXFMChain
-// --------------------------------------------------------------------------------
+        if (memcmp(&b[i], "![CDATA[", 8) == 0) {
+            end = findSequence(b, i + 8, m_envLen, "]]>");
+            if (end == m_envLen)
+                return SCAN_MORE;
+            m_scan = end + 3;
+            continue;
+        }
 
-XENCEncryptedData * XENCCipherImpl::encryptTXFMChain(TXFMChain * plainText, const XMLCh * algorithmURI) {
+        if (b[i] == '?' || b[i] == '!') {
+
+            // PI or DOCTYPE (which may have an internal subset)
+            int depth = 0;
+            for (end = i; end < m_envLen; ++end) {
+                if (b[end] == '[')
+                    ++depth;
+                else if (b[end] == ']')
+                    --depth;
+                else if (b[end] == '>' && depth <= 0)
+                    break;
+            }
+            if (end == m_envLen)
+                return SCAN_MORE;
+            m_scan = end + 1;
+            continue;
 
-    // Make sure we have a key before we do anything too drastic
-    if (mp_key == NULL) {
-        throw XSECException(XSECException::CipherError, "XENCCipherImpl::encryptTXFMChain - No key set");
-    }
-    else if (algorithmURI == NULL) {
-        throw XSECException(XSECException::CipherError, "XENCCipherImpl::encryptTXFMChain - No algorithm set");
-    }
+        }
 
-    // Create the element with a dummy encrypted value
+        // Element start or end tag - find the end, allowing for quoted '>'
+        char quote = 0;
+        for (end = i; end < m_envLen; ++end) {
+            if (quote != 0) {
+                if (b[end] == quote)
+                    quote = 0;
+            }
+            else if (b[end] == '"' || b[end] == '\'')
+                quote = b[end];
+            else if (b[end] == '>')
+                break;
+        }
+        if (end == m_envLen)
+            return SCAN_MORE;
 
-    if (mp_encryptedData != NULL) {
-        delete mp_encryptedData;
-        mp_encryptedData = NULL;
-    }
+        m_scan = end + 1;
 
-    XSECnew(mp_encryptedData, XENCEncryptedDataImpl(mp_env));
-    mp_encryptedData->createBlankEncryptedData(XENCCipherData::VALUE_TYPE, algorithmURI, s_noData);
+        if (b[i] == '/') {
+            if (!m_open.empty())
+                m_open.pop_back();
+            continue;
+        }
 
-    // Perform the encryption
-    const XSECAlgorithmHandler *handler = XSECPlatformUtils::g_algorithmMapper->mapURIToHandler(algorithmURI);
-    if (!handler) {
-        // Very strange if we get here - any problems should throw an
-        // exception in the AlgorithmMapper.
+        if (b[end - 1] == '/')
+            continue;               // Empty element
 
-        throw XSECException(XSECException::CipherError,
-            "XENCCipherImpl::encryptTXFMChain - Error retrieving a handler for algorithm");
-    }
+        XMLSize_t nameEnd = i;
+        while (nameEnd < end && b[nameEnd] != '/' && b[nameEnd] != ' ' &&
+               b[nameEnd] != '\t' && b[nameEnd] != '\r' && b[nameEnd] != '\n')
+            ++nameEnd;
 
-    safeBuffer sb;
-    handler->encryptToSafeBuffer(plainText, mp_encryptedData->getEncryptionMethod(), mp_key, mp_env->getParentDocument(), sb);
+        std::string qname(&b[i], nameEnd - i);
 
-    // Set the value
-    XENCCipherValue * val = mp_encryptedData->getCipherData()->getCipherValue();
+        // Only the CipherValue of an EncryptedData - not that of an
+        // EncryptedKey in its KeyInfo
+        bool found = (strcmp(localPart(qname), "CipherValue") == 0 &&
+            m_open.size() >= 2 &&
+            strcmp(localPart(m_open[m_open.size() - 1]), "CipherData") == 0 &&
+            strcmp(localPart(m_open[m_open.size() - 2]), "EncryptedData") == 0);
 
-    val->setCipherString(sb.sbStrToXMLCh());
+        m_open.push_back(qname);
+
+        if (found)
+            return SCAN_FOUND;
+
+    }
+
+    return SCAN_MORE;
+
+}
+
+bool XENCCipherValueInputStream::readEnvelope(safeBuffer & envelope, XMLSize_t & envelopeLen) {
+
+    XMLSize_t sz;
+
+    while ((sz = mp_in->readBytes(m_buf, XENC_STREAM_CHUNK)) > 0) {
+
+        m_env.sbMemcpyIn(m_envLen, m_buf, sz);
+        m_envLen += sz;
+
+        if (scan() == SCAN_FOUND) {
+
+            // Anything read past the start tag is the start of the value
+            m_bufLen = m_envLen - m_scan;
+            memcpy(m_buf, &(m_env.rawBuffer()[m_scan]), m_bufLen);
+
+            envelope.sbMemcpyIn(m_env.rawBuffer(), m_scan);
+            envelopeLen = m_scan;
+
+            // Close everything that is open
+            while (!m_open.empty()) {
+                std::string close = "</" + m_open.back() + ">";
+                envelope.sbMemcpyIn(envelopeLen, close.c_str(), close.size());
+                envelopeLen += close.size();
+                m_open.pop_back();
+            }
+
+            return true;
+
+        }
+
+    }
+
+    m_done = true;
+    envelope.sbMemcpyIn(m_env.rawBuffer(), m_envLen);
+    envelopeLen = m_envLen;
+
+    return false;
+
+}
+
+XMLSize_t XENCCipherValueInputStream::readBytes(XMLByte * const toFill, const XMLSize_t maxToRead) {
+
+    XMLSize_t done = 0;
+
+    while (done < maxToRead && !m_done) {
+
+        if (m_bufPos == m_bufLen) {
+
+            m_bufPos = 0;
+            m_bufLen = mp_in->readBytes(m_buf, XENC_STREAM_CHUNK);
+            if (m_bufLen == 0) {
+                // Only the end tag finishes the value - a cut off document
+                // must not decrypt as though it were complete
+                m_done = true;
+                throw XSECException(XSECException::CipherError,
+                    "XENCCipherValueInputStream::readBytes - unexpected end of input in CipherValue");
+            }
+
+        }
+
+        XMLByte c = m_buf[m_bufPos++];
+
+        if (m_inEntity) {
+            // Character references (e.g. &#13;) are never base64 data
+            if (c == ';')
+                m_inEntity = false;
+        }
+        else if (c == '&')
+            m_inEntity = true;
+        else if (c == '<')
+            m_done = true;          // End of the CipherValue
+        else
+            toFill[done++] = c;
+
+    }
+
+    m_pos += done;
+    return done;
+
+}
+
+static DOMElement * findEncryptedDataElement(DOMNode * n) {
+
+    while (n != NULL) {
+
+        if (n->getNodeType() == DOMNode::ELEMENT_NODE) {
+
+            if (strEquals(getXENCLocalName(n), "EncryptedData"))
+                return (DOMElement *) n;
+
+            DOMElement * ret = findEncryptedDataElement(n->getFirstChild());
+            if (ret != NULL)
+                return ret;
+
+        }
+
+        n = n->getNextSibling();
+
+    }
+
+    return NULL;
+
+}
+
+void XENCCipherImpl::decryptBinInputStream(
+    XERCES_CPP_NAMESPACE_QUALIFIER BinInputStream * encryptedData,
+    XERCES_CPP_NAMESPACE_QUALIFIER XMLFormatTarget * target
+) {
+
+    XENCCipherValueInputStream * cv;
+    XSECnew(cv, XENCCipherValueInputStream(encryptedData));
+    Janitor<XENCCipherValueInputStream> j_cv(cv);
+
+    if (target == NULL) {
+        throw XSECException(XSECException::CipherError,
+            "XENCCipherImpl::decryptBinInputStream - No output target");
+    }
+
+    // Parse the envelope
+    safeBuffer envelope;
+    XMLSize_t envelopeLen;
+    bool haveValue = cv->readEnvelope(envelope, envelopeLen);
+
+    MemBufInputSource memIS(envelope.rawBuffer(), envelopeLen, "XSECMem");
+
+    XercesDOMParser * parser = getParser();
+    parser->parse(memIS);
+
+    if (parser->getErrorCount() > 0) {
+        parser->resetDocumentPool();
+        throw XSECException(XSECException::CipherError,
+            "XENCCipherImpl::decryptBinInputStream - Errors occurred parsing the EncryptedData");
+    }
+
+    DOMDocument * doc = parser->adoptDocument();
+
+    try {
+
+        DOMNode * element = NULL;
+
+        if (haveValue) {
+
+            // The CipherValue is the end of the last open chain
+            DOMNode * n = doc->getDocumentElement();
+            while (n != NULL && n->getLastChild() != NULL)
+                n = n->getLastChild();
+
+            if (n != NULL && n->getParentNode() != NULL)
+                element = n->getParentNode()->getParentNode();
+
+        }
+        else
+            element = findEncryptedDataElement(doc->getDocumentElement());
+
+        if (element == NULL || element->getNodeType() != DOMNode::ELEMENT_NODE) {
+            throw XSECException(XSECException::CipherError,
+                "XENCCipherImpl::decryptBinInputStream - No EncryptedData found in input");
+        }
+
+        // The chain takes the cipher value stream, even if it throws
+        if (haveValue)
+            j_cv.release();
+
+        TXFMChain * c = createDecryptTXFMChain((DOMElement *) element, haveValue ? cv : NULL);
+        Janitor<TXFMChain> j_c(c);
+
+        writeChainToTarget(c, target);
+
+    }
+    catch (...) {
+        delete mp_encryptedData;
+        mp_encryptedData = NULL;
+        doc->release();
+        throw;
+    }
+
+    // The loaded EncryptedData refers to the envelope, which goes now
+    delete mp_encryptedData;
+    mp_encryptedData = NULL;
+    doc->release();
+
+}
+
+// --------------------------------------------------------------------------------
+//			Key cache identifiers
+// --------------------------------------------------------------------------------
+
+// Each field is preceded by its length so that no two different inputs hash
+// the same way (e.g. moving characters from one parameter to the next)
+
+static void hashKeyCacheField(XSECCryptoHash * h, const XMLCh * str) {
+
+    unsigned char len[4];
+    XMLSize_t bytes = (str == NULL ? 0 : XMLString::stringLen(str) * sizeof(XMLCh));
+
+    len[0] = (unsigned char) (bytes >> 24);
+    len[1] = (unsigned char) (bytes >> 16);
+    len[2] = (unsigned char) (bytes >> 8);
+    len[3] = (unsigned char) bytes;
+
+    h->hash(len, 4);
+    if (bytes > 0)
+        h->hash((unsigned char *) str, (unsigned int) bytes);
+
+}
+
+// Find the AgreementMethod (if any) in the KeyInfo of an EncryptedKey
+
+static XENCAgreementMethod * findAgreementMethod(XENCEncryptedKey * encryptedKey) {
+
+    DSIGKeyInfoList * kil = encryptedKey->getKeyInfoList();
+    if (kil == NULL)
+        return NULL;
+
+    for (DSIGKeyInfoList::size_type i = 0; i < kil->getSize(); ++i) {
+        if (kil->item(i)->getKeyInfoType() == DSIGKeyInfo::KEYINFO_AGREEMENTMETHOD)
+            return (XENCAgreementMethod *) kil->item(i);
+    }
+
+    return NULL;
+
+}
+
+// Find the originator's EC public key
+
+static const DSIGKeyInfoValue * findOriginatorKey(const XENCAgreementMethod * am) {
+
+    const DSIGKeyInfoList * kil = am->getOriginatorKeyInfoList();
+
+    for (DSIGKeyInfoList::size_type i = 0; i < kil->getSize(); ++i) {
+        if (kil->item(i)->getKeyInfoType() == DSIGKeyInfo::KEYINFO_VALUE_EC)
+            return (const DSIGKeyInfoValue *) kil->item(i);
+    }
+
+    throw XSECException(XSECException::CipherError,
+        "XENCCipherImpl - AgreementMethod has no originator EC public key");
+
+}
+
+// Everything an agreed key depends on other than our own key
+
+static void hashAgreementMethod(XSECCryptoHash * h, const XENCAgreementMethod * am,
+    const DSIGKeyInfoValue * originator) {
+
+    hashKeyCacheField(h, am->getAlgorithm());
+    hashKeyCacheField(h, am->getKeyDerivationMethod());
+    hashKeyCacheField(h, am->getDigestMethod());
+    hashKeyCacheField(h, am->getAlgorithmID());
+    hashKeyCacheField(h, am->getPartyUInfo());
+    hashKeyCacheField(h, am->getPartyVInfo());
+    hashKeyCacheField(h, originator->getECNamedCurve());
+    hashKeyCacheField(h, originator->getECPublicKey());
+
+}
+
+bool XENCCipherImpl::calculateKeyCacheId(XENCEncryptedKey * encryptedKey, unsigned char * id) {
+
+    // Only inline cipher text can be identified without fetching it
+    XENCCipherData * cd = encryptedKey->getCipherData();
+    if (cd == NULL || cd->getCipherDataType() != XENCCipherData::VALUE_TYPE ||
+        cd->getCipherValue() == NULL)
+        return false;
+
+    XSECCryptoHash * h = XSECPlatformUtils::g_cryptoProvider->hash(XSECCryptoHash::HASH_SHA256);
+    Janitor<XSECCryptoHash> j_h(h);
+
+    hashKeyCacheField(h, m_kekIdentity.rawXMLChBuffer());
+
+    XENCEncryptionMethod * em = encryptedKey->getEncryptionMethod();
+    if (em != NULL) {
+        hashKeyCacheField(h, em->getAlgorithm());
+        hashKeyCacheField(h, em->getDigestMethod());
+        hashKeyCacheField(h, em->getMGF());
+        hashKeyCacheField(h, em->getOAEPparams());
+    }
+    else {
+        hashKeyCacheField(h, XSECAlgorithmMapper::s_defaultEncryptionMapping);
+        hashKeyCacheField(h, NULL);
+        hashKeyCacheField(h, NULL);
+        hashKeyCacheField(h, NULL);
+    }
+
+    hashKeyCacheField(h, cd->getCipherValue()->getCipherString());
+
+    // With key agreement the KEK comes from the originator's key and the
+    // KDF parameters, so the same cipher text under a different agreement
+    // is a different key
+    const XENCAgreementMethod * am = findAgreementMethod(encryptedKey);
+    if (am != NULL)
+        hashAgreementMethod(h, am, findOriginatorKey(am));
+
+    return (h->finish(id, XENC_KEYCACHE_ID_SIZE) == XENC_KEYCACHE_ID_SIZE);
+
+}
+
+// --------------------------------------------------------------------------------
+//			Key agreement
+// --------------------------------------------------------------------------------
+
+// Largest ECDH shared secret (P-521) and derived key we expect to handle
+#define XENC_AGREEMENT_MAX_SECRET	128
+#define XENC_AGREEMENT_MAX_KEY		32
+
+static bool isECKey(const XSECCryptoKey * k) {
+
+    XSECCryptoKey::KeyType kt = k->getKeyType();
+    return (kt == XSECCryptoKey::KEY_EC_PUBLIC ||
+            kt == XSECCryptoKey::KEY_EC_PRIVATE ||
+            kt == XSECCryptoKey::KEY_EC_PAIR);
+
+}
+
+// Size of the KEK needed by a key wrap algorithm
+
+static unsigned int agreementKeyLength(const XMLCh * keyWrapURI) {
+
+    if (strEquals(keyWrapURI, DSIGConstants::s_unicodeStrURIKW_AES128) ||
+        strEquals(keyWrapURI, DSIGConstants::s_unicodeStrURIKW_AES128_PAD))
+        return 16;
+
+    if (strEquals(keyWrapURI, DSIGConstants::s_unicodeStrURIKW_AES192) ||
+        strEquals(keyWrapURI, DSIGConstants::s_unicodeStrURIKW_AES192_PAD) ||
+        strEquals(keyWrapURI, DSIGConstants::s_unicodeStrURIKW_3DES))
+        return 24;
+
+    if (strEquals(keyWrapURI, DSIGConstants::s_unicodeStrURIKW_AES256) ||
+        strEquals(keyWrapURI, DSIGConstants::s_unicodeStrURIKW_AES256_PAD))
+        return 32;
+
+    throw XSECException(XSECException::CipherError,
+        "XENCCipherImpl - Key agreement requires a key wrap algorithm for the EncryptedKey");
+
+}
+
+// Append a ConcatKDF parameter (a hex encoded bit string whose first octet
+// gives the number of padding bits) to the OtherInfo buffer
+
+static void appendOtherInfo(const XMLCh * hex, safeBuffer & otherInfo, unsigned int & len) {
+
+    if (hex == NULL || *hex == 0)
+        return;
+
+    XSECAutoPtrChar h(hex);
+    unsigned int hexLen = (unsigned int) strlen(h.get());
+
+    if (hexLen % 2 != 0 || hexLen < 2 || h.get()[0] != '0' || h.get()[1] != '0') {
+        throw XSECException(XSECException::CipherError,
+            "XENCCipherImpl - ConcatKDF parameters must be whole octet hex strings");
+    }
+
+    for (unsigned int i = 2; i < hexLen; i += 2) {
+
+        unsigned int v = 0;
+        for (unsigned int j = i; j < i + 2; ++j) {
+            char c = h.get()[j];
+            v <<= 4;
+            if (c >= '0' && c <= '9')
+                v |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                v |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                v |= c - 'A' + 10;
+            else
+                throw XSECException(XSECException::CipherError,
+                    "XENCCipherImpl - ConcatKDF parameter is not a hex string");
+        }
+
+        otherInfo[len++] = (unsigned char) v;
+
+    }
+
+}
+
+// ECDH followed by ConcatKDF (NIST SP 800-56A 5.8.1).  Returns the number of
+// key bytes written to key.
+
+static unsigned int agreeKey(const XENCAgreementMethod * am,
+                             const XSECCryptoKeyEC * privateKey,
+                             const XSECCryptoKeyEC * publicKey,
+                             const XMLCh * keyWrapURI,
+                             unsigned char * key) {
+
+    if (!strEquals(am->getAlgorithm(), DSIGConstants::s_unicodeStrURIECDH_ES)) {
+        throw XSECException(XSECException::CipherError,
+            "XENCCipherImpl - Unsupported key agreement algorithm");
+    }
+
+    if (!strEquals(am->getKeyDerivationMethod(), DSIGConstants::s_unicodeStrURICONCAT_KDF) ||
+        am->getDigestMethod() == NULL) {
+        throw XSECException(XSECException::CipherError,
+            "XENCCipherImpl - Key agreement requires ConcatKDF with a DigestMethod");
+    }
+
+    unsigned int keyLen = agreementKeyLength(keyWrapURI);
+
+    unsigned char z[XENC_AGREEMENT_MAX_SECRET];
+    unsigned int zLen = privateKey->deriveSharedSecret(publicKey, z, XENC_AGREEMENT_MAX_SECRET);
+
+    safeBuffer otherInfo;
+    otherInfo.isSensitive();
+    unsigned int otherInfoLen = 0;
+    appendOtherInfo(am->getAlgorithmID(), otherInfo, otherInfoLen);
+    appendOtherInfo(am->getPartyUInfo(), otherInfo, otherInfoLen);
+    appendOtherInfo(am->getPartyVInfo(), otherInfo, otherInfoLen);
+
+    XSECCryptoHash * h = XSECPlatformUtils::g_cryptoProvider->hash(am->getDigestMethod());
+    if (h == NULL) {
+        memset(z, 0, sizeof(z));
+        throw XSECException(XSECException::CipherError,
+            "XENCCipherImpl - Unsupported ConcatKDF DigestMethod");
+    }
+    Janitor<XSECCryptoHash> j_h(h);
+
+    // K(i) = H(counter || Z || OtherInfo), concatenated until we have enough
+    unsigned char digest[XSEC_MAX_HASH_SIZE];
+    unsigned int done = 0;
+
+    for (unsigned int counter = 1; done < keyLen; ++counter) {
+
+        unsigned char ctr[4];
+        ctr[0] = (unsigned char) (counter >> 24);
+        ctr[1] = (unsigned char) (counter >> 16);
+        ctr[2] = (unsigned char) (counter >> 8);
+        ctr[3] = (unsigned char) counter;
+
+        h->reset();
+        h->hash(ctr, 4);
+        h->hash(z, zLen);
+        if (otherInfoLen > 0)
+            h->hash((unsigned char *) otherInfo.rawBuffer(), otherInfoLen);
+
+        unsigned int dLen = h->finish(digest, XSEC_MAX_HASH_SIZE);
+        unsigned int n = (keyLen - done < dLen ? keyLen - done : dLen);
+        memcpy(&key[done], digest, n);
+        done += n;
+
+    }
+
+    memset(digest, 0, sizeof(digest));
+    memset(z, 0, sizeof(z));
+
+    return keyLen;
+
+}
+
+XSECCryptoKey * XENCCipherImpl::createAgreedKey(XENCAgreementMethod * am, const XMLCh * keyWrapURI) {
+
+    const DSIGKeyInfoValue * originator = findOriginatorKey(am);
+
+    // A derived key depends only on our key, the originator's (ephemeral)
+    // key and the KDF parameters, so senders that re-use an ephemeral key
+    // only cost us one agreement
+    unsigned char cacheId[XENC_KEYCACHE_ID_SIZE];
+    bool useCache = (mp_keyCache != NULL && !m_kekDerived);
+
+    if (useCache) {
+
+        XSECCryptoHash * h = XSECPlatformUtils::g_cryptoProvider->hash(XSECCryptoHash::HASH_SHA256);
+        Janitor<XSECCryptoHash> j_h(h);
+
+        hashKeyCacheField(h, m_kekIdentity.rawXMLChBuffer());
+        hashAgreementMethod(h, am, originator);
+        hashKeyCacheField(h, keyWrapURI);
+
+        useCache = (h->finish(cacheId, XENC_KEYCACHE_ID_SIZE) == XENC_KEYCACHE_ID_SIZE);
+
+    }
+
+    const XSECAlgorithmHandler * handler =
+        XSECPlatformUtils::g_algorithmMapper->mapURIToHandler(keyWrapURI);
+
+    if (handler == NULL) {
+        throw XSECException(XSECException::CipherError,
+            "XENCCipherImpl::createAgreedKey - Error retrieving a handler for key wrap algorithm");
+    }
+
+    unsigned char key[XENC_AGREEMENT_MAX_KEY];
+    unsigned int keyLen = 0;
+
+    if (useCache)
+        keyLen = mp_keyCache->lookup(cacheId, key, XENC_AGREEMENT_MAX_KEY);
+
+    if (keyLen == 0) {
+
+        XSECCryptoKeyEC * originatorKey = XSECPlatformUtils::g_cryptoProvider->keyEC();
+        Janitor<XSECCryptoKeyEC> j_originatorKey(originatorKey);
+
+        XSECAutoPtrChar curve(originator->getECNamedCurve());
+        XSECAutoPtrChar pub(originator->getECPublicKey());
+        originatorKey->loadPublicKeyBase64(curve.get(), pub.get(), (unsigned int) strlen(pub.get()));
+
+        keyLen = agreeKey(am, (XSECCryptoKeyEC *) mp_kek, originatorKey, keyWrapURI, key);
+
+        if (useCache)
+            mp_keyCache->store(cacheId, key, keyLen);
+
+    }
+
+    XSECCryptoKey * ret = handler->createKeyForURI(keyWrapURI, key, keyLen);
+    memset(key, 0, sizeof(key));
+
+    return ret;
+
+}
+
+// --------------------------------------------------------------------------------
+//			Decrypt a key in an XENCEncryptedKey element
+// --------------------------------------------------------------------------------
+
+int XENCCipherImpl::decryptKey(XENCEncryptedKey * encryptedKey, XMLByte * rawKey, int maxKeySize) {
+
+    // A cached key can only be trusted if it was unwrapped by the KEK
+    // the caller named, so resolved KEKs bypass the cache
+    unsigned char cacheId[XENC_KEYCACHE_ID_SIZE];
+    bool useCache = (mp_keyCache != NULL && mp_kek != NULL && !m_kekDerived &&
+        calculateKeyCacheId(encryptedKey, cacheId));
+
+    if (useCache) {
+
+        unsigned int cached = mp_keyCache->lookup(cacheId, rawKey, (unsigned int) maxKeySize);
+        if (cached > 0)
+            return (int) cached;
+
+    }
+
+    // Check KEK is valid
+    if (m_kekDerived && mp_kek) {
+        delete mp_kek;
+        mp_kek = NULL;
+    }
+
+    // Make sure we have a key before we do anything else too drastic
+    if (mp_kek == NULL) {
+
+        if (mp_keyInfoResolver != NULL) {
+            XSECMetricTimer timer(XSEC_METRIC_KEY_RESOLUTION);
+            mp_kek = mp_keyInfoResolver->resolveKey(encryptedKey->getKeyInfoList());
+        }
+
+        if (mp_kek == NULL) {
+
+            throw XSECException(XSECException::CipherError, "XENCCipherImpl::decryptKey - No KEK set and cannot resolve");
+        }
+        m_kekDerived = true;
+    }
+
+    // Get the raw encrypted data
+    TXFMChain * c = ((XENCEncryptedKeyImpl *) encryptedKey)->createCipherTXFMChain();
+    Janitor<TXFMChain> j_c(c);
+
+    // Get the Algorithm handler for the algorithm
+    XENCEncryptionMethod * encryptionMethod = encryptedKey->getEncryptionMethod();
+    const XSECAlgorithmHandler *handler;
+
+    if (encryptionMethod != NULL) {
+
+        handler = XSECPlatformUtils::g_algorithmMapper->mapURIToHandler(encryptedKey->getEncryptionMethod()->getAlgorithm());
+
+    }
+
+    else {
+
+        handler = XSECPlatformUtils::g_algorithmMapper->mapURIToHandler(XSECAlgorithmMapper::s_defaultEncryptionMapping);
+
+    }
+
+    // An EC KEK is our half of a key agreement - the key that actually
+    // wraps the content key is derived from it and the AgreementMethod
+    XSECCryptoKey * kek = mp_kek;
+    XSECCryptoKey * agreedKey = NULL;
+
+    XENCAgreementMethod * am = findAgreementMethod(encryptedKey);
+    if (am != NULL && isECKey(mp_kek)) {
+
+        if (encryptionMethod == NULL) {
+            throw XSECException(XSECException::CipherError,
+                "XENCCipherImpl::decryptKey - Key agreement requires an EncryptionMethod");
+        }
+
+        agreedKey = createAgreedKey(am, encryptionMethod->getAlgorithm());
+        kek = agreedKey;
+
+    }
+    Janitor<XSECCryptoKey> j_agreedKey(agreedKey);
+
+    safeBuffer sb("");
+    sb.isSensitive();
+    unsigned int keySize;
+
+    if (handler != NULL) {
+
+        XSECMetricTimer timer(XSEC_METRIC_DECRYPT, getMethodAlgorithm(encryptedKey->getEncryptionMethod()));
+        keySize = handler->decryptToSafeBuffer(c, encryptedKey->getEncryptionMethod(), kek, mp_env->getParentDocument(), sb);
+    } else {
+
+        // Very strange if we get here - any problems should throw an
+        // exception in the AlgorithmMapper.
+
+        throw XSECException(XSECException::CipherError,
+            "XENCCipherImpl::decryptElement - Error retrieving a handler for algorithm");
+
+    }
+
+    // Only cache the complete key - a truncated copy would be wrong for
+    // a later caller with a larger buffer
+    if (useCache && keySize <= (unsigned int) maxKeySize)
+        mp_keyCache->store(cacheId, sb.rawBuffer(), keySize);
+
+    keySize = (keySize < (unsigned int) maxKeySize ? keySize : (unsigned int) maxKeySize);
+    memcpy(rawKey, sb.rawBuffer(), keySize);
+
+    return keySize;
+}
+// --------------------------------------------------------------------------------
+//			Decrypt a key from a DOM structure
+// --------------------------------------------------------------------------------
+
+int XENCCipherImpl::decryptKey(DOMElement * keyNode, XMLByte * rawKey, int maxKeySize) {
+
+    XENCEncryptedKey * encryptedKey = loadEncryptedKey(keyNode);
+    Janitor<XENCEncryptedKey> j_encryptedKey(encryptedKey);
+
+    // Now decrypt!
+    return decryptKey(encryptedKey, rawKey, maxKeySize);
+
+}
+
+XENCEncryptedKey * XENCCipherImpl::loadEncryptedKey(DOMElement * keyNode) {
+
+    XENCEncryptedKeyImpl * encryptedKey;
+    XSECnew(encryptedKey, XENCEncryptedKeyImpl(mp_env, keyNode));
+    Janitor<XENCEncryptedKeyImpl> j_encryptedKey(encryptedKey);
+
+    // Load
+    encryptedKey->load();
+
+    j_encryptedKey.release();
+    return encryptedKey;
+
+}
+// --------------------------------------------------------------------------------
+//			Encrypt a BinInputStream
+// --------------------------------------------------------------------------------
+
+XENCEncryptedData * XENCCipherImpl::encryptBinInputStream(
+    XERCES_CPP_NAMESPACE_QUALIFIER BinInputStream * plainText,
+    const XMLCh * algorithmURI) {
+
+    TXFMURL * uri;
+    XSECnew(uri, TXFMURL(mp_doc, NULL));
+
+    uri->setInput(plainText);
+    TXFMChain c(uri);
+
+    return encryptTXFMChain(&c, algorithmURI);
+
+}
+
+// --------------------------------------------------------------------------------
+//			Encrypt a TXFMChain
+// --------------------------------------------------------------------------------
+
+XENCEncryptedData * XENCCipherImpl::encryptTXFMChain(TXFMChain * plainText, const XMLCh * algorithmURI) {
+
+    // Make sure we have a key before we do anything too drastic
+    if (mp_key == NULL) {
+        throw XSECException(XSECException::CipherError, "XENCCipherImpl::encryptTXFMChain - No key set");
+    }
+    else if (algorithmURI == NULL) {
+        throw XSECException(XSECException::CipherError, "XENCCipherImpl::encryptTXFMChain - No algorithm set");
+    }
+
+    // Create the element with a dummy encrypted value
+
+    if (mp_encryptedData != NULL) {
+        delete mp_encryptedData;
+        mp_encryptedData = NULL;
+    }
+
+    XSECnew(mp_encryptedData, XENCEncryptedDataImpl(mp_env));
+    mp_encryptedData->createBlankEncryptedData(XENCCipherData::VALUE_TYPE, algorithmURI, s_noData);
+
+    // Perform the encryption
+    const XSECAlgorithmHandler *handler = XSECPlatformUtils::g_algorithmMapper->mapURIToHandler(algorithmURI);
+    if (!handler) {
+        // Very strange if we get here - any problems should throw an
+        // exception in the AlgorithmMapper.
+
+        throw XSECException(XSECException::CipherError,
+            "XENCCipherImpl::encryptTXFMChain - Error retrieving a handler for algorithm");
+    }
+
+    safeBuffer sb;
+    {
+        XSECMetricTimer timer(XSEC_METRIC_ENCRYPT, algorithmURI);
+        handler->encryptToSafeBuffer(plainText, mp_encryptedData->getEncryptionMethod(), mp_key, mp_env->getParentDocument(), sb);
+    }
+
+    // Set the value
+    XENCCipherValue * val = mp_encryptedData->getCipherData()->getCipherValue();
+
+    val->setCipherString(sb.sbStrToXMLCh());
 
     return mp_encryptedData;
 
 }
 
+// --------------------------------------------------------------------------------
+//			Encrypt a BinInputStream to a format target
+// --------------------------------------------------------------------------------
+
+void XENCCipherImpl::encryptBinInputStream(
+    XERCES_CPP_NAMESPACE_QUALIFIER BinInputStream * plainText,
+    XERCES_CPP_NAMESPACE_QUALIFIER XMLFormatTarget * target,
+    const XMLCh * algorithmURI,
+    XENCEncryptedKey * encryptedKey) {
+
+    // Ownership of the plain text and encrypted key is ours whatever happens
+    Janitor<BinInputStream> j_plainText(plainText);
+    Janitor<XENCEncryptedKey> j_encryptedKey(encryptedKey);
+
+    if (mp_key == NULL) {
+        throw XSECException(XSECException::CipherError, "XENCCipherImpl::encryptBinInputStream - No key set");
+    }
+    else if (algorithmURI == NULL) {
+        throw XSECException(XSECException::CipherError, "XENCCipherImpl::encryptBinInputStream - No algorithm set");
+    }
+    else if (target == NULL) {
+        throw XSECException(XSECException::CipherError, "XENCCipherImpl::encryptBinInputStream - No output target");
+    }
+
+    // Create the envelope with a placeholder where the cipher text will go
+
+    if (mp_encryptedData != NULL) {
+        delete mp_encryptedData;
+        mp_encryptedData = NULL;
+    }
+
+    XSECAutoPtrXMLCh marker(XENC_STREAM_MARKER);
+
+    try {
+
+        XSECnew(mp_encryptedData, XENCEncryptedDataImpl(mp_env));
+        mp_encryptedData->createBlankEncryptedData(XENCCipherData::VALUE_TYPE, algorithmURI, marker.get());
+
+        if (encryptedKey != NULL) {
+            mp_encryptedData->appendEncryptedKey(encryptedKey);
+            j_encryptedKey.release();
+        }
+
+        // Set up the chain - plain text, cipher, base64
+        const XSECAlgorithmHandler *handler = XSECPlatformUtils::g_algorithmMapper->mapURIToHandler(algorithmURI);
+        if (!handler) {
+            throw XSECException(XSECException::CipherError,
+                "XENCCipherImpl::encryptBinInputStream - Error retrieving a handler for algorithm");
+        }
+
+        TXFMURL * uri;
+        XSECnew(uri, TXFMURL(mp_doc, NULL));
+
+        uri->setInput(plainText);
+        j_plainText.release();
+        TXFMChain c(uri);
+
+        if (!handler->appendEncryptCipherTXFM(&c, mp_encryptedData->getEncryptionMethod(), mp_key, mp_env->getParentDocument())) {
+            throw XSECException(XSECException::CipherError,
+                "XENCCipherImpl::encryptBinInputStream - Algorithm cannot be used for streamed encryption");
+        }
+
+        TXFMBase64 * tb64;
+        XSECnew(tb64, TXFMBase64(mp_doc, false));
+        c.appendTxfm(tb64);
+
+        // Serialise the (small) envelope and split it around the placeholder
+
+        DOMLSSerializer * ser = mp_env->getParentDocument()->getImplementation()->createLSSerializer();
+        XMLCh * serialised;
+
+        try {
+            serialised = ser->writeToString(mp_encryptedData->getElement());
+        }
+        catch (...) {
+            ser->release();
+            throw;
+        }
+        ser->release();
+
+        safeBuffer envelope;
+        envelope << (*(mp_env->getSBFormatter()) << serialised);
+        XMLString::release(&serialised);
+
+        const char * env = envelope.rawCharBuffer();
+        const char * placeholder = strstr(env, ">" XENC_STREAM_MARKER "<");
+
+        if (placeholder == NULL || strstr(placeholder + 1, XENC_STREAM_MARKER) != NULL) {
+            throw XSECException(XSECException::CipherError,
+                "XENCCipherImpl::encryptBinInputStream - Unable to locate CipherValue in serialised envelope");
+        }
+
+        const char * trailer = placeholder + strlen(XENC_STREAM_MARKER) + 1;
+
+        // Now write it out, with the cipher text streamed in the middle
+
+        target->writeChars((const XMLByte *) env, (XMLSize_t) (placeholder + 1 - env), NULL);
+
+        XMLByte buf[XENC_STREAM_CHUNK];
+        unsigned int sz;
+        TXFMBase * last = c.getLastTxfm();
+
+        while ((sz = last->readBytes(buf, XENC_STREAM_CHUNK)) > 0)
+            target->writeChars(buf, sz, NULL);
+
+        target->writeChars((const XMLByte *) trailer, (XMLSize_t) strlen(trailer), NULL);
+        target->flush();
+
+    }
+    catch (...) {
+        // Don't leave a half built envelope behind
+        delete mp_encryptedData;
+        mp_encryptedData = NULL;
+        throw;
+    }
+
+}
+
 // --------------------------------------------------------------------------------
 //			Encrypt a key
 // --------------------------------------------------------------------------------
@@ -889,8 +2021,70 @@ XENCEncryptedKey * XENCCipherImpl::encryptKey(
         throw XSECException(XSECException::CipherError, "XENCCipherImpl::encryptKey - Error retrieving a handler for algorithm");
     }
 
+    // An EC KEK is the recipient's public key.  Agree a wrapping key with
+    // a fresh ephemeral key pair (ECDH-ES) and record how in the KeyInfo
+    XSECCryptoKey * kek = mp_kek;
+    XSECCryptoKey * agreedKey = NULL;
+    XENCAgreementMethodImpl * am = NULL;
+
+    if (isECKey(mp_kek)) {
+
+        const XSECCryptoKeyEC * recipient = (const XSECCryptoKeyEC *) mp_kek;
+        XSECCryptoKeyEC * ephemeral = recipient->generateKeyPair();
+        Janitor<XSECCryptoKeyEC> j_ephemeral(ephemeral);
+
+        if (ephemeral->getCurveName() == NULL) {
+            throw XSECException(XSECException::CipherError,
+                "XENCCipherImpl::encryptKey - Key agreement requires a named curve");
+        }
+
+        XSECnew(am, XENCAgreementMethodImpl(mp_env));
+        Janitor<XENCAgreementMethodImpl> j_am(am);
+        am->createBlankAgreementMethod(DSIGConstants::s_unicodeStrURIECDH_ES);
+
+        // AlgorithmID identifies the wrap algorithm as a bit string
+        safeBuffer algorithmID;
+        algorithmID.sbStrcpyIn("00");
+        XSECAutoPtrChar wrapURI(algorithmURI);
+        static const char hexDigits[] = "0123456789ABCDEF";
+        for (const char * p = wrapURI.get(); *p != 0; ++p) {
+            char hx[3];
+            hx[0] = hexDigits[((unsigned char) *p) >> 4];
+            hx[1] = hexDigits[((unsigned char) *p) & 0x0F];
+            hx[2] = 0;
+            algorithmID.sbStrcatIn(hx);
+        }
+
+        XSECAutoPtrXMLCh xAlgorithmID(algorithmID.rawCharBuffer());
+        am->setConcatKDF(DSIGConstants::s_unicodeStrURISHA256, xAlgorithmID.get(), s_noData, s_noData);
+
+        char pub[1024];
+        ephemeral->getPublicKeyBase64(pub, 1024);
+        XSECAutoPtrXMLCh xCurve(ephemeral->getCurveName());
+        XSECAutoPtrXMLCh xPub(pub);
+        am->setOriginatorECKeyValue(xCurve.get(), xPub.get());
+
+        unsigned char key[XENC_AGREEMENT_MAX_KEY];
+        unsigned int keyLen = agreeKey(am, ephemeral, recipient, algorithmURI, key);
+
+        agreedKey = handler->createKeyForURI(algorithmURI, key, keyLen);
+        memset(key, 0, sizeof(key));
+        kek = agreedKey;
+
+        j_am.release();
+
+    }
+    Janitor<XSECCryptoKey> j_agreedKey(agreedKey);
+
+    // Once in the KeyInfo the AgreementMethod is owned by the EncryptedKey
+    if (am != NULL)
+        encryptedKey->appendAgreementMethod(am);
+
     safeBuffer sb;
-    handler->encryptToSafeBuffer(c, encryptedKey->getEncryptionMethod(), mp_kek, mp_env->getParentDocument(), sb);
+    {
+        XSECMetricTimer timer(XSEC_METRIC_ENCRYPT, algorithmURI);
+        handler->encryptToSafeBuffer(c, encryptedKey->getEncryptionMethod(), kek, mp_env->getParentDocument(), sb);
+    }
 
     // Set the value
     XENCCipherValue * val = encryptedKey->getCipherData()->getCipherValue();
@@ -984,6 +2178,465 @@ DOMDocument * XENCCipherImpl::encryptElement(DOMElement * element, const XMLCh *
 
 }
 
+// --------------------------------------------------------------------------------
+//			Bulk encryption and decryption of elements
+// --------------------------------------------------------------------------------
+
+// Drain a chain into a buffer.  Used to do all the DOM work (C14n, URI
+// resolution, transforms) on the calling thread, so the workers only
+// ever see bytes.
+
+static unsigned int readChainToSafeBuffer(TXFMChain * c, safeBuffer & sb) {
+
+    XMLByte buf[XENC_STREAM_CHUNK];
+    unsigned int sz;
+    unsigned int len = 0;
+    TXFMBase * last = c->getLastTxfm();
+
+    while ((sz = last->readBytes(buf, XENC_STREAM_CHUNK)) > 0) {
+        sb.sbMemcpyIn(len, buf, sz);
+        len += sz;
+    }
+
+    memset(buf, 0, XENC_STREAM_CHUNK);
+
+    return len;
+
+}
+
+// Encrypt the serialised form of one element.  The element is
+// canonicalised on the calling thread - the worker never touches the
+// DOM.  The EncryptedData is created beforehand and filled in afterwards.
+
+class XENCElementEncryptTask : public XSECThreadTask {
+
+public:
+
+    XENCElementEncryptTask(DOMDocument * doc,
+                           const XSECAlgorithmHandler * handler,
+                           XENCEncryptionMethod * encryptionMethod,
+                           const XSECCryptoKey * key) :
+        mp_doc(doc), mp_handler(handler), mp_encryptionMethod(encryptionMethod),
+        mp_key(key), m_plainTextLen(0) {}
+
+    virtual ~XENCElementEncryptTask() {
+
+        m_plainText.cleanseBuffer();
+
+    }
+
+    // Called on the calling thread, before the pool is run
+    void serialise(DOMElement * element, bool exclusive) {
+
+        TXFMDocObject * tdocObj;
+        XSECnew(tdocObj, TXFMDocObject(mp_doc));
+        TXFMChain c(tdocObj);
+
+        tdocObj->setInput(mp_doc, element);
+
+        TXFMC14n *tc14n;
+        XSECnew(tc14n, TXFMC14n(mp_doc));
+        c.appendTxfm(tc14n);
+
+        tc14n->activateComments();
+        if (exclusive)
+            tc14n->setExclusive();
+
+        m_plainTextLen = readChainToSafeBuffer(&c, m_plainText);
+
+    }
+
+    virtual void run(void) {
+
+        TXFMSB * tsb;
+        XSECnew(tsb, TXFMSB(mp_doc));
+        TXFMChain c(tsb);
+
+        tsb->setInput(m_plainText, m_plainTextLen);
+
+        XSECMetricTimer timer(XSEC_METRIC_ENCRYPT, getMethodAlgorithm(mp_encryptionMethod));
+        mp_handler->encryptToSafeBuffer(&c, mp_encryptionMethod, mp_key, mp_doc, m_result);
+
+    }
+
+    safeBuffer & getResult(void) {return m_result;}
+
+private:
+
+    DOMDocument                 * mp_doc;
+    const XSECAlgorithmHandler  * mp_handler;
+    XENCEncryptionMethod        * mp_encryptionMethod;
+    const XSECCryptoKey         * mp_key;
+    safeBuffer                  m_plainText;
+    unsigned int                m_plainTextLen;
+    safeBuffer                  m_result;
+
+};
+
+// Decrypt one loaded EncryptedData to a buffer.  The cipher text is read
+// (including any CipherReference resolution) on the calling thread and
+// handed over as bytes.
+
+class XENCElementDecryptTask : public XSECThreadTask {
+
+public:
+
+    XENCElementDecryptTask(DOMDocument * doc,
+                           XENCEncryptedDataImpl * encryptedData,
+                           const XSECAlgorithmHandler * handler,
+                           XSECCryptoKey * key) :
+        mp_doc(doc), mp_encryptedData(encryptedData), mp_handler(handler),
+        mp_key(key), m_cipherTextLen(0), m_resultLen(0) {}
+
+    virtual ~XENCElementDecryptTask() {
+
+        delete mp_key;
+        m_result.cleanseBuffer();
+
+    }
+
+    // Called on the calling thread, before the pool is run
+    void readCipherText(TXFMChain * c) {
+
+        m_cipherTextLen = readChainToSafeBuffer(c, m_cipherText);
+
+    }
+
+    virtual void run(void) {
+
+        TXFMSB * tsb;
+        XSECnew(tsb, TXFMSB(mp_doc));
+        TXFMChain c(tsb);
+
+        tsb->setInput(m_cipherText, m_cipherTextLen);
+
+        XSECMetricTimer timer(XSEC_METRIC_DECRYPT, getMethodAlgorithm(mp_encryptedData->getEncryptionMethod()));
+        m_resultLen = mp_handler->decryptToSafeBuffer(&c, mp_encryptedData->getEncryptionMethod(),
+            mp_key, mp_doc, m_result);
+        m_result[m_resultLen] = '\0';
+
+    }
+
+    XENCEncryptedDataImpl * getEncryptedData(void) {return mp_encryptedData;}
+    safeBuffer & getResult(void) {return m_result;}
+
+private:
+
+    DOMDocument                 * mp_doc;
+    XENCEncryptedDataImpl       * mp_encryptedData;
+    const XSECAlgorithmHandler  * mp_handler;
+    XSECCryptoKey               * mp_key;
+    safeBuffer                  m_cipherText;
+    unsigned int                m_cipherTextLen;
+    safeBuffer                  m_result;
+    unsigned int                m_resultLen;
+
+};
+
+void XENCCipherImpl::encryptElements(
+    XERCES_CPP_NAMESPACE_QUALIFIER DOMElement ** elements,
+    XMLSize_t count,
+    const XMLCh * algorithmURI,
+    XENCEncryptedKey * encryptedKey,
+    unsigned int threads) {
+
+    Janitor<XENCEncryptedKey> j_encryptedKey(encryptedKey);
+
+    // Check everything up front, before the DOM is touched
+    if (mp_key == NULL) {
+        throw XSECException(XSECException::CipherError, "XENCCipherImpl::encryptElements - No key set");
+    }
+    else if (algorithmURI == NULL) {
+        throw XSECException(XSECException::CipherError, "XENCCipherImpl::encryptElements - No algorithm set");
+    }
+    else if (mp_key->getKeyType() != XSECCryptoKey::KEY_SYMMETRIC) {
+        throw XSECException(XSECException::CipherError, "XENCCipherImpl::encryptElements - Key must be symmetric");
+    }
+
+    for (XMLSize_t i = 0; i < count; ++i) {
+        if (elements[i] == NULL || elements[i]->getParentNode() == NULL) {
+            throw XSECException(XSECException::CipherError,
+                "XENCCipherImpl::encryptElements - Passed in element has no parent");
+        }
+    }
+
+    const XSECAlgorithmHandler *handler = XSECPlatformUtils::g_algorithmMapper->mapURIToHandler(algorithmURI);
+    if (!handler) {
+        throw XSECException(XSECException::CipherError,
+            "XENCCipherImpl::encryptElements - Error retrieving a handler for algorithm");
+    }
+
+    if (mp_encryptedData != NULL) {
+        delete mp_encryptedData;
+        mp_encryptedData = NULL;
+    }
+
+    // Create the (detached) EncryptedData structures first, as the workers
+    // must not change the document
+
+    std::vector<XENCEncryptedDataImpl *> encryptedData;
+    std::vector<XENCElementEncryptTask *> tasks;
+    encryptedData.reserve(count);
+    tasks.reserve(count);
+
+    try {
+
+        for (XMLSize_t i = 0; i < count; ++i) {
+
+            XENCEncryptedDataImpl * ed;
+            XSECnew(ed, XENCEncryptedDataImpl(mp_env));
+            encryptedData.push_back(ed);
+            ed->createBlankEncryptedData(XENCCipherData::VALUE_TYPE, algorithmURI, s_noData);
+
+            XENCElementEncryptTask * t;
+            XSECnew(t, XENCElementEncryptTask(mp_doc, handler, ed->getEncryptionMethod(), mp_key));
+            tasks.push_back(t);
+
+            t->serialise(elements[i], m_useExcC14nSerialisation);
+
+        }
+
+        XSECThreadPool pool(threads);
+        for (XMLSize_t i = 0; i < count; ++i)
+            pool.addTask(tasks[i]);
+
+        pool.runAll();
+
+        // Finish off the EncryptedData structures.  Anything that can fail
+        // happens here, before the document is changed
+
+        for (XMLSize_t i = 0; i < count; ++i) {
+
+            XENCEncryptedDataImpl * ed = encryptedData[i];
+
+            ed->getCipherData()->getCipherValue()->setCipherString(tasks[i]->getResult().sbStrToXMLCh());
+            ed->setType(DSIGConstants::s_unicodeStrURIXENC_ELEMENT);
+
+            if (encryptedKey != NULL) {
+
+                XENCEncryptedKey * ek;
+                if (i == count - 1) {
+                    ek = encryptedKey;
+                    j_encryptedKey.release();
+                }
+                else
+                    ek = loadEncryptedKey((DOMElement *) encryptedKey->getElement()->cloneNode(true));
+
+                ed->appendEncryptedKey(ek);
+
+            }
+
+        }
+
+        // Commit
+
+        for (XMLSize_t i = 0; i < count; ++i) {
+
+            elements[i]->getParentNode()->replaceChild(encryptedData[i]->getElement(), elements[i]);
+            elements[i]->release();
+
+        }
+
+    }
+    catch (...) {
+
+        for (XMLSize_t i = 0; i < tasks.size(); ++i)
+            delete tasks[i];
+        for (XMLSize_t i = 0; i < encryptedData.size(); ++i) {
+            if (encryptedData[i]->getElement()->getParentNode() == NULL)
+                encryptedData[i]->getElement()->release();
+            delete encryptedData[i];
+        }
+        throw;
+
+    }
+
+    // The last one stays as the current working object
+    for (XMLSize_t i = 0; i < count; ++i) {
+        delete tasks[i];
+        if (i + 1 < count)
+            delete encryptedData[i];
+    }
+
+    if (count > 0)
+        mp_encryptedData = encryptedData[count - 1];
+
+}
+
+static bool sameKeyInfo(const DSIGKeyInfoList * a, const DSIGKeyInfoList * b) {
+
+    // Conservative - any difference at all (even whitespace) means the
+    // key is resolved again
+
+    if (a->getSize() != b->getSize())
+        return false;
+
+    for (size_t i = 0; i < a->getSize(); ++i) {
+
+        const DOMNode * na = a->item(i)->getKeyInfoDOMNode();
+        const DOMNode * nb = b->item(i)->getKeyInfoDOMNode();
+
+        if (na == NULL || nb == NULL || !na->isEqualNode(nb))
+            return false;
+
+    }
+
+    return true;
+
+}
+
+void XENCCipherImpl::decryptElements(
+    XERCES_CPP_NAMESPACE_QUALIFIER DOMElement ** elements,
+    XMLSize_t count,
+    unsigned int threads) {
+
+    if (mp_encryptedData != NULL) {
+        delete mp_encryptedData;
+        mp_encryptedData = NULL;
+    }
+
+    // A key left over from an earlier call must not be reused
+
+    if (m_keyDerived && mp_key) {
+        delete mp_key;
+        mp_key = NULL;
+    }
+
+    std::vector<XENCElementDecryptTask *> tasks;
+    std::vector<DOMDocumentFragment *> frags;
+    tasks.reserve(count);
+    frags.reserve(count);
+
+    try {
+
+        // Load everything and sort out keys and handlers serially
+
+        for (XMLSize_t i = 0; i < count; ++i) {
+
+            XSECnew(mp_encryptedData, XENCEncryptedDataImpl(mp_env, elements[i]));
+            mp_encryptedData->load();
+
+            const XMLCh * typeURI = mp_encryptedData->getType();
+
+            if (typeURI != NULL && !strEquals(typeURI, DSIGConstants::s_unicodeStrURIXENC_ELEMENT) &&
+                !strEquals(typeURI, DSIGConstants::s_unicodeStrURIXENC_CONTENT)) {
+
+                throw XSECException(XSECException::CipherError,
+                    "XENCCipherImpl::decryptElements - Type not Element or Content");
+
+            }
+
+            // Elements encrypted together normally carry the same KeyInfo
+            // (the same EncryptedKey, say), so only resolve the key again
+            // when it differs from the previous element's
+
+            if (m_keyDerived && mp_key && !(tasks.size() > 0 &&
+                    sameKeyInfo(tasks.back()->getEncryptedData()->getKeyInfoList(),
+                                mp_encryptedData->getKeyInfoList()))) {
+                delete mp_key;
+                mp_key = NULL;
+            }
+
+            if (mp_key == NULL) {
+
+                if (mp_keyInfoResolver != NULL) {
+                    XSECMetricTimer timer(XSEC_METRIC_KEY_RESOLUTION);
+                    mp_key = mp_keyInfoResolver->resolveKey(mp_encryptedData->getKeyInfoList());
+                }
+
+                if (mp_key == NULL)
+                    mp_key = decryptKeyFromKeyInfoList(mp_encryptedData->getKeyInfoList());
+
+                if (mp_key == NULL) {
+                    throw XSECException(XSECException::CipherError,
+                        "XENCCipherImpl::decryptElements - No key set and cannot resolve");
+                }
+
+                m_keyDerived = true;
+
+            }
+
+            XENCEncryptionMethod * encryptionMethod = mp_encryptedData->getEncryptionMethod();
+            const XSECAlgorithmHandler * handler = XSECPlatformUtils::g_algorithmMapper->mapURIToHandler(
+                encryptionMethod != NULL ? encryptionMethod->getAlgorithm() : XSECAlgorithmMapper::s_defaultEncryptionMapping);
+
+            if (handler == NULL) {
+                throw XSECException(XSECException::CipherError,
+                    "XENCCipherImpl::decryptElements - Error retrieving a handler for algorithm");
+            }
+
+            // Each worker gets its own copy of the key
+            XSECCryptoKey * key = mp_key->clone();
+            Janitor<XSECCryptoKey> j_key(key);
+
+            XENCElementDecryptTask * t;
+            XSECnew(t, XENCElementDecryptTask(mp_env->getParentDocument(), mp_encryptedData, handler, key));
+            j_key.release();
+            tasks.push_back(t);
+            mp_encryptedData = NULL;
+
+            TXFMChain * c = t->getEncryptedData()->createCipherTXFMChain();
+            Janitor<TXFMChain> j_c(c);
+            t->readCipherText(c);
+
+        }
+
+        XSECThreadPool pool(threads);
+        for (XMLSize_t i = 0; i < count; ++i)
+            pool.addTask(tasks[i]);
+
+        pool.runAll();
+
+        // Parse all the plain text back in before changing anything
+
+        for (XMLSize_t i = 0; i < count; ++i) {
+            frags.push_back(deSerialise(tasks[i]->getResult(),
+                tasks[i]->getEncryptedData()->getElement()));
+        }
+
+        // Commit
+
+        for (XMLSize_t i = 0; i < count; ++i) {
+
+            DOMElement * element = tasks[i]->getEncryptedData()->getElement();
+
+            if (frags[i] != NULL) {
+
+                element->getParentNode()->replaceChild(frags[i], element);
+                frags[i]->release();
+                frags[i] = NULL;
+                element->release();
+
+            }
+
+        }
+
+    }
+    catch (...) {
+
+        delete mp_encryptedData;
+        mp_encryptedData = NULL;
+
+        for (XMLSize_t i = 0; i < frags.size(); ++i) {
+            if (frags[i] != NULL)
+                frags[i]->release();
+        }
+
+        for (XMLSize_t i = 0; i < tasks.size(); ++i) {
+            delete tasks[i]->getEncryptedData();
+            delete tasks[i];
+        }
+        throw;
+
+    }
+
+    for (XMLSize_t i = 0; i < count; ++i) {
+        delete tasks[i]->getEncryptedData();
+        delete tasks[i];
+    }
+
+}
+
 // --------------------------------------------------------------------------------
 //			Encrypt an element's children
 // --------------------------------------------------------------------------------
@@ -33,8 +33,8 @@
 
 #include <xsec/framework/XSECDefs.hpp>
 #include <xsec/xenc/XENCCipher.hpp>
+#include <xsec/utils/XSECSafeBuffer.hpp>
 
-class safeBuffer;
 class XSECProvider;
 class XENCEncryptedDataImpl;
 class TXFMChain;
@@ -42,9 +42,12 @@ class XSECEnv;
 class XSECKeyInfoResolver;
 class XSECPlatformUtils;
 class DSIGKeyInfoList;
+class XENCAgreementMethod;
 
 XSEC_DECLARE_XERCES_CLASS(DOMNode);
 XSEC_DECLARE_XERCES_CLASS(DOMDocumentFragment);
+XSEC_DECLARE_XERCES_CLASS(XercesDOMParser);
+XSEC_DECLARE_XERCES_CLASS(SecurityManager);
 
 class XENCCipherImpl : public  XENCCipher {
 
@@ -62,9 +65,22 @@ public:
 		decryptElement();
 	XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * 
 		decryptElementDetached();
+	virtual void decryptElements(
+		XERCES_CPP_NAMESPACE_QUALIFIER DOMElement ** elements,
+		XMLSize_t count,
+		unsigned int threads = 0
+	);
 	XSECBinTXFMInputStream * decryptToBinInputStream(
 		XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * element
 	);
+	virtual void decryptToFormatTarget(
+		XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * element,
+		XERCES_CPP_NAMESPACE_QUALIFIER XMLFormatTarget * target
+	);
+	virtual void decryptBinInputStream(
+		XERCES_CPP_NAMESPACE_QUALIFIER BinInputStream * encryptedData,
+		XERCES_CPP_NAMESPACE_QUALIFIER XMLFormatTarget * target
+	);
 
 	// Decrypting Keys
 	virtual int decryptKey(XENCEncryptedKey * encryptedKey, 
@@ -81,6 +97,13 @@ public:
 	XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument * encryptElement(
 		XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * element,
 		const XMLCh * uri);
+	virtual void encryptElements(
+		XERCES_CPP_NAMESPACE_QUALIFIER DOMElement ** elements,
+		XMLSize_t count,
+		const XMLCh * algorithmURI,
+		XENCEncryptedKey * encryptedKey = NULL,
+		unsigned int threads = 0
+	);
 	virtual XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument * encryptElementContent(
 		XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * element,
 		const XMLCh * algorithmURI);
@@ -109,6 +132,12 @@ public:
 		TXFMChain * plainText,
 		const XMLCh * algorithmURI
 	);
+	virtual void encryptBinInputStream(
+		XERCES_CPP_NAMESPACE_QUALIFIER BinInputStream * plainText,
+		XERCES_CPP_NAMESPACE_QUALIFIER XMLFormatTarget * target,
+		const XMLCh * algorithmURI,
+		XENCEncryptedKey * encryptedKey = NULL
+	);
 
 	// Getter methods
 	XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument * getDocument() const
@@ -121,11 +150,13 @@ public:
 	// Setter methods
 	void setKey(XSECCryptoKey * key);
 	void setKEK(XSECCryptoKey * key);
+	void setKeyCache(XENCKeyCache * cache, const XMLCh * kekIdentity);
 	void setKeyInfoResolver(const XSECKeyInfoResolver * resolver);
 
 	void setXENCNSPrefix(const XMLCh * prefix);
 	void setPrettyPrint(bool flag);
 	void setExclusiveC14nSerialisation(bool flag);
+	void reset(XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument * doc);
 
 	// Creation methods
 	XENCEncryptedData * createEncryptedData(XENCCipherData::XENCCipherDataType type,
@@ -156,7 +187,15 @@ private:
 								safeBuffer &content, 
 								XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * ctx
 							);
+	const safeBuffer & getNSContext(XERCES_CPP_NAMESPACE_QUALIFIER DOMNode * ctx,
+							XMLSize_t & len);
 	XSECCryptoKey * decryptKeyFromKeyInfoList(DSIGKeyInfoList * kil);
+	bool calculateKeyCacheId(XENCEncryptedKey * encryptedKey, unsigned char * id);
+	XSECCryptoKey * createAgreedKey(XENCAgreementMethod * am, const XMLCh * keyWrapURI);
+	TXFMChain * createDecryptTXFMChain(
+							XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * element,
+							XERCES_CPP_NAMESPACE_QUALIFIER BinInputStream * cipherValue);
+	XERCES_CPP_NAMESPACE_QUALIFIER XercesDOMParser * getParser(void);
 
 	// Unimplemented constructor
 	XENCCipherImpl();
@@ -175,6 +214,10 @@ private:
 	XSECCryptoKey			* mp_kek;
 	bool					m_kekDerived;		// Was this derived or loaded?
 
+	// Cache of unwrapped keys (not owned) and the identity of the KEK
+	XENCKeyCache			* mp_keyCache;
+	safeBuffer				m_kekIdentity;
+
 	// Environment
 	XSECEnv					* mp_env;
 
@@ -184,6 +227,18 @@ private:
 	// Use exclusive canonicalisation?
 	bool					m_useExcC14nSerialisation;
 
+	// De-serialisation state, kept between calls.  The namespace context is
+	// the UTF-8 wrapper start tag for the last parent seen, and the parser
+	// (with its security manager) is re-used rather than built per element
+	const XERCES_CPP_NAMESPACE_QUALIFIER DOMNode
+							* mp_nsContextNode;
+	safeBuffer				m_nsContext;
+	XMLSize_t				m_nsContextLen;
+	XERCES_CPP_NAMESPACE_QUALIFIER XercesDOMParser
+							* mp_parser;
+	XERCES_CPP_NAMESPACE_QUALIFIER SecurityManager
+							* mp_securityManager;
+
 	friend class XSECProvider;
 	friend class XSECPlatformUtils;
 
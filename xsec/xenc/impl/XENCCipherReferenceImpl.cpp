@@ -284,12 +284,7 @@ void XENCCipherReferenceImpl::load(void) {
 
 		mp_transformsElement = c;
 
-		XSECSafeBufferFormatter * formatter;
-		XSECnew(formatter, XSECSafeBufferFormatter("UTF-8",XMLFormatter::NoEscapes, 
-												XMLFormatter::UnRep_CharRef));
-		Janitor<XSECSafeBufferFormatter> j_formatter(formatter);
-
-		mp_transformList = DSIGReference::loadTransforms(c, formatter, mp_env);
+		mp_transformList = DSIGReference::loadTransforms(c, NULL, mp_env);
 
 	}
 
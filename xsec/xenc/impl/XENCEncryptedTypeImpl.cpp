@@ -32,11 +32,13 @@
 #include <xsec/framework/XSECDefs.hpp>
 #include <xsec/framework/XSECEnv.hpp>
 #include <xsec/framework/XSECError.hpp>
+#include <xsec/framework/XSECMetrics.hpp>
 #include <xsec/transformers/TXFMBase64.hpp>
 #include <xsec/transformers/TXFMChain.hpp>
 #include <xsec/transformers/TXFMSB.hpp>
 #include <xsec/transformers/TXFMC14n.hpp>
 #include <xsec/xenc/XENCEncryptedKey.hpp>
+#include <xsec/xenc/XENCAgreementMethod.hpp>
 
 #include "XENCCipherImpl.hpp"
 #include "XENCCipherDataImpl.hpp"
@@ -195,6 +197,8 @@ void XENCEncryptedTypeImpl::load() {
 
 	}
 
+	XSECMetricTimer timer(XSEC_METRIC_LOAD);
+
 	// Type
 	mp_typeAttr = mp_encryptedTypeElement->getAttributeNodeNS(NULL, s_Type);
 	// MimeType
@@ -207,7 +211,7 @@ void XENCEncryptedTypeImpl::load() {
 	
 	DOMElement *tmpElt = (DOMElement *) findFirstChildOfType(mp_encryptedTypeElement, DOMNode::ELEMENT_NODE);
 
-	if (tmpElt != NULL && strEquals(getXENCLocalName(tmpElt), s_EncryptionMethod)) {
+	if (tmpElt != NULL && strEquals(mp_env->getLocalName(tmpElt, XSEC_NS_XENC), s_EncryptionMethod)) {
 
 		XSECnew(mp_encryptionMethod, XENCEncryptionMethodImpl(mp_env, tmpElt));
 		mp_encryptionMethod->load();
@@ -216,7 +220,7 @@ void XENCEncryptedTypeImpl::load() {
 
 	}
 
-	if (tmpElt != NULL && strEquals(getDSIGLocalName(tmpElt), s_KeyInfo)) {
+	if (tmpElt != NULL && strEquals(mp_env->getLocalName(tmpElt, XSEC_NS_DSIG), s_KeyInfo)) {
 
 		// Load
 		mp_keyInfoElement = tmpElt;
@@ -228,7 +232,7 @@ void XENCEncryptedTypeImpl::load() {
 
 	}
 
-	if (tmpElt != NULL && strEquals(getXENCLocalName(tmpElt), s_CipherData)) {
+	if (tmpElt != NULL && strEquals(mp_env->getLocalName(tmpElt, XSEC_NS_XENC), s_CipherData)) {
 
 		mp_cipherDataElement = tmpElt;
 
@@ -533,6 +537,13 @@ void XENCEncryptedTypeImpl::appendEncryptedKey(XENCEncryptedKey * encryptedKey)
 
 }
 
+void XENCEncryptedTypeImpl::appendAgreementMethod(XENCAgreementMethod * agreementMethod) {
+
+	createKeyInfoElement();
+	m_keyInfoList.addAndInsertKeyInfo(agreementMethod);
+
+}
+
 // --------------------------------------------------------------------------------
 //			Type URI handling
 // --------------------------------------------------------------------------------
@@ -197,6 +197,7 @@ public:
     */
     
     virtual void appendEncryptedKey(XENCEncryptedKey * encryptedKey);
+    virtual void appendAgreementMethod(XENCAgreementMethod * agreementMethod);
 
 	// Get methods
 	virtual const XMLCh * getType() const;
@@ -0,0 +1,324 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * XSEC
+ *
+ * XENCKeyCache := Bounded cache of unwrapped content encryption keys
+ *
+ * $Id$
+ *
+ */
+
+// XSEC Includes
+
+#include <xsec/framework/XSECError.hpp>
+#include <xsec/xenc/XENCKeyCache.hpp>
+
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#	include <windows.h>
+#else
+#	include <sys/types.h>
+#	include <sys/mman.h>
+#	if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#		define MAP_ANONYMOUS MAP_ANON
+#	endif
+#endif
+
+XERCES_CPP_NAMESPACE_USE
+
+// --------------------------------------------------------------------------------
+//           Key storage
+// --------------------------------------------------------------------------------
+
+// Keys live in a dedicated block so that it can be locked into RAM and is never
+// shared with (or reallocated into) general heap memory.
+
+static unsigned char * allocateKeyStore(XMLSize_t size, bool & locked) {
+
+	unsigned char * ret = NULL;
+	locked = false;
+
+#if defined(_WIN32)
+
+	ret = (unsigned char *) VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (ret != NULL)
+		locked = (VirtualLock(ret, size) != 0);
+
+#elif defined(MAP_ANONYMOUS)
+
+	void * m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (m != MAP_FAILED) {
+		ret = (unsigned char *) m;
+		locked = (mlock(ret, size) == 0);
+	}
+
+#else
+
+	ret = new unsigned char[size];
+
+#endif
+
+	if (ret == NULL) {
+		throw XSECException(XSECException::MemoryAllocationFail,
+			"XENCKeyCache - Unable to allocate key storage");
+	}
+
+	return ret;
+
+}
+
+static void releaseKeyStore(unsigned char * store, XMLSize_t size, bool locked) {
+
+#if defined(_WIN32)
+
+	if (locked)
+		VirtualUnlock(store, size);
+	VirtualFree(store, 0, MEM_RELEASE);
+
+#elif defined(MAP_ANONYMOUS)
+
+	if (locked)
+		munlock(store, size);
+	munmap(store, size);
+
+#else
+
+	delete[] store;
+
+#endif
+
+}
+
+static void cleanse(unsigned char * buf, XMLSize_t len) {
+
+	// volatile so the compiler cannot drop the writes
+	volatile unsigned char * p = buf;
+	for (XMLSize_t i = 0; i < len; ++i)
+		p[i] = 0;
+
+}
+
+// --------------------------------------------------------------------------------
+//           Construct/Destruct
+// --------------------------------------------------------------------------------
+
+XENCKeyCache::XENCKeyCache(unsigned int maxEntries, unsigned int ttlSeconds) :
+	m_maxEntries(maxEntries > 0 ? maxEntries : 1),
+	m_ttl(ttlSeconds),
+	mp_slots(NULL),
+	mp_keys(NULL),
+	m_locked(false),
+	m_useCounter(0),
+	m_hits(0),
+	m_misses(0),
+	m_evictions(0),
+	m_expirations(0) {
+
+	m_keysSize = (XMLSize_t) m_maxEntries * XENC_KEYCACHE_MAX_KEY_SIZE;
+	mp_keys = allocateKeyStore(m_keysSize, m_locked);
+	cleanse(mp_keys, m_keysSize);
+
+	XSECnew(mp_slots, Slot[m_maxEntries]);
+	for (unsigned int i = 0; i < m_maxEntries; ++i) {
+		mp_slots[i].keyLen = 0;
+		mp_slots[i].stored = 0;
+		mp_slots[i].lastUsed = 0;
+		mp_slots[i].inUse = false;
+	}
+
+}
+
+XENCKeyCache::~XENCKeyCache() {
+
+	cleanse(mp_keys, m_keysSize);
+	releaseKeyStore(mp_keys, m_keysSize, m_locked);
+	delete[] mp_slots;
+
+}
+
+// --------------------------------------------------------------------------------
+//           Slot management
+// --------------------------------------------------------------------------------
+
+bool XENCKeyCache::isExpired(const Slot & slot, unsigned long now) const {
+
+	return (m_ttl != 0 && now - slot.stored >= m_ttl);
+
+}
+
+void XENCKeyCache::releaseSlot(unsigned int s) {
+
+	cleanse(&mp_keys[s * XENC_KEYCACHE_MAX_KEY_SIZE], XENC_KEYCACHE_MAX_KEY_SIZE);
+	m_index.erase(mp_slots[s].id);
+	mp_slots[s].id.erase();
+	mp_slots[s].keyLen = 0;
+	mp_slots[s].inUse = false;
+
+}
+
+unsigned int XENCKeyCache::findFreeSlot(unsigned long now) {
+
+	unsigned int lru = 0;
+	bool haveLru = false;
+
+	for (unsigned int i = 0; i < m_maxEntries; ++i) {
+
+		if (!mp_slots[i].inUse)
+			return i;
+
+		if (isExpired(mp_slots[i], now)) {
+			++m_expirations;
+			releaseSlot(i);
+			return i;
+		}
+
+		if (!haveLru || mp_slots[i].lastUsed < mp_slots[lru].lastUsed) {
+			lru = i;
+			haveLru = true;
+		}
+
+	}
+
+	++m_evictions;
+	releaseSlot(lru);
+	return lru;
+
+}
+
+// --------------------------------------------------------------------------------
+//           Cache operations
+// --------------------------------------------------------------------------------
+
+unsigned int XENCKeyCache::lookup(const unsigned char * id,
+								  unsigned char * key,
+								  unsigned int maxKeySize) {
+
+	std::string sid((const char *) id, XENC_KEYCACHE_ID_SIZE);
+	unsigned long now = (unsigned long) time(NULL);
+
+	XMLMutexLock lock(&m_mutex);
+
+	SlotMapType::iterator i = m_index.find(sid);
+	if (i == m_index.end()) {
+		++m_misses;
+		return 0;
+	}
+
+	unsigned int s = i->second;
+	if (isExpired(mp_slots[s], now)) {
+		++m_expirations;
+		++m_misses;
+		releaseSlot(s);
+		return 0;
+	}
+
+	if (mp_slots[s].keyLen > maxKeySize) {
+		++m_misses;
+		return 0;
+	}
+
+	memcpy(key, &mp_keys[s * XENC_KEYCACHE_MAX_KEY_SIZE], mp_slots[s].keyLen);
+	mp_slots[s].lastUsed = ++m_useCounter;
+	++m_hits;
+
+	return mp_slots[s].keyLen;
+
+}
+
+void XENCKeyCache::store(const unsigned char * id,
+						 const unsigned char * key,
+						 unsigned int keyLen) {
+
+	if (keyLen == 0 || keyLen > XENC_KEYCACHE_MAX_KEY_SIZE)
+		return;
+
+	std::string sid((const char *) id, XENC_KEYCACHE_ID_SIZE);
+	unsigned long now = (unsigned long) time(NULL);
+
+	XMLMutexLock lock(&m_mutex);
+
+	unsigned int s;
+	SlotMapType::iterator i = m_index.find(sid);
+
+	if (i != m_index.end()) {
+		s = i->second;
+		cleanse(&mp_keys[s * XENC_KEYCACHE_MAX_KEY_SIZE], XENC_KEYCACHE_MAX_KEY_SIZE);
+	}
+	else {
+		s = findFreeSlot(now);
+		mp_slots[s].id = sid;
+		mp_slots[s].inUse = true;
+		m_index[sid] = s;
+	}
+
+	memcpy(&mp_keys[s * XENC_KEYCACHE_MAX_KEY_SIZE], key, keyLen);
+	mp_slots[s].keyLen = keyLen;
+	mp_slots[s].stored = now;
+	mp_slots[s].lastUsed = ++m_useCounter;
+
+}
+
+void XENCKeyCache::clear(void) {
+
+	XMLMutexLock lock(&m_mutex);
+
+	for (unsigned int i = 0; i < m_maxEntries; ++i) {
+		if (mp_slots[i].inUse)
+			releaseSlot(i);
+	}
+
+}
+
+// --------------------------------------------------------------------------------
+//           Statistics
+// --------------------------------------------------------------------------------
+
+double XENCKeyCache::getHitRate(void) const {
+
+	XMLMutexLock lock(&m_mutex);
+
+	unsigned long total = m_hits + m_misses;
+	if (total == 0)
+		return 0.0;
+
+	return (double) m_hits / (double) total;
+
+}
+
+unsigned int XENCKeyCache::getSize(void) const {
+
+	XMLMutexLock lock(&m_mutex);
+	return (unsigned int) m_index.size();
+
+}
+
+void XENCKeyCache::resetStatistics(void) {
+
+	XMLMutexLock lock(&m_mutex);
+
+	m_hits = 0;
+	m_misses = 0;
+	m_evictions = 0;
+	m_expirations = 0;
+
+}
@@ -150,6 +150,60 @@ void XKMSMessageFactoryImpl::setXKMSNSPrefix(const XMLCh * prefix) {
 //           DOM Based construction
 // --------------------------------------------------------------------------------
 
+// Message element names, sorted for findSortedName().  Must be kept in step
+// with the enum below.
+
+namespace {
+
+enum XKMSMessageName {
+
+	XKMS_MSG_CompoundRequest,
+	XKMS_MSG_CompoundResult,
+	XKMS_MSG_LocateRequest,
+	XKMS_MSG_LocateResult,
+	XKMS_MSG_PendingRequest,
+	XKMS_MSG_RecoverRequest,
+	XKMS_MSG_RecoverResult,
+	XKMS_MSG_RegisterRequest,
+	XKMS_MSG_RegisterResult,
+	XKMS_MSG_ReissueRequest,
+	XKMS_MSG_ReissueResult,
+	XKMS_MSG_Result,
+	XKMS_MSG_RevokeRequest,
+	XKMS_MSG_RevokeResult,
+	XKMS_MSG_StatusRequest,
+	XKMS_MSG_StatusResult,
+	XKMS_MSG_ValidateRequest,
+	XKMS_MSG_ValidateResult,
+	XKMS_MSG_COUNT
+
+};
+
+const XMLCh * const s_messageNames[XKMS_MSG_COUNT] = {
+
+	XKMSConstants::s_tagCompoundRequest,
+	XKMSConstants::s_tagCompoundResult,
+	XKMSConstants::s_tagLocateRequest,
+	XKMSConstants::s_tagLocateResult,
+	XKMSConstants::s_tagPendingRequest,
+	XKMSConstants::s_tagRecoverRequest,
+	XKMSConstants::s_tagRecoverResult,
+	XKMSConstants::s_tagRegisterRequest,
+	XKMSConstants::s_tagRegisterResult,
+	XKMSConstants::s_tagReissueRequest,
+	XKMSConstants::s_tagReissueResult,
+	XKMSConstants::s_tagResult,
+	XKMSConstants::s_tagRevokeRequest,
+	XKMSConstants::s_tagRevokeResult,
+	XKMSConstants::s_tagStatusRequest,
+	XKMSConstants::s_tagStatusResult,
+	XKMSConstants::s_tagValidateRequest,
+	XKMSConstants::s_tagValidateResult
+
+};
+
+}
+
 XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 						XERCES_CPP_NAMESPACE_QUALIFIER DOMElement * elt) {
 
@@ -167,9 +221,12 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 	}
 
 	// See if this is a known element
-	const XMLCh * name = getXKMSLocalName(elt);
+	int msg = findSortedName(env->getLocalName(elt, XSEC_NS_XKMS),
+		s_messageNames, XKMS_MSG_COUNT);
+
+	switch (msg) {
 
-	if (strEquals(name, XKMSConstants::s_tagCompoundRequest)) {
+	case XKMS_MSG_CompoundRequest : {
 
 		// This is a <CompoundRequest> message
 		XKMSCompoundRequestImpl * ret;
@@ -181,7 +238,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	if (strEquals(name, XKMSConstants::s_tagCompoundResult)) {
+	case XKMS_MSG_CompoundResult : {
 
 		// This is a <CompoundResult> message
 		XKMSCompoundResultImpl * ret;
@@ -193,7 +250,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	if (strEquals(name, XKMSConstants::s_tagLocateRequest)) {
+	case XKMS_MSG_LocateRequest : {
 
 		// This is a <LocateRequest> message
 		XKMSLocateRequestImpl * ret;
@@ -205,7 +262,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	if (strEquals(name, XKMSConstants::s_tagValidateRequest)) {
+	case XKMS_MSG_ValidateRequest : {
 
 		// This is a <ValidateRequest> message
 		XKMSValidateRequestImpl * ret;
@@ -217,7 +274,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	else if (strEquals(name, XKMSConstants::s_tagLocateResult)) {
+	case XKMS_MSG_LocateResult : {
 
 		// This is a <LocateRequest> message
 		XKMSLocateResultImpl * ret;
@@ -231,7 +288,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	else if (strEquals(name, XKMSConstants::s_tagValidateResult)) {
+	case XKMS_MSG_ValidateResult : {
 
 		// This is a <LocateRequest> message
 		XKMSValidateResultImpl * ret;
@@ -245,7 +302,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	else if (strEquals(name, XKMSConstants::s_tagResult)) {
+	case XKMS_MSG_Result : {
 
 		// This is a <LocateRequest> message
 		XKMSResultImpl * ret;
@@ -259,7 +316,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	else if (strEquals(name, XKMSConstants::s_tagPendingRequest)) {
+	case XKMS_MSG_PendingRequest : {
 
 		// This is a <PendingRequest> message
 		XKMSPendingRequestImpl * ret;
@@ -273,7 +330,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	else if (strEquals(name, XKMSConstants::s_tagStatusRequest)) {
+	case XKMS_MSG_StatusRequest : {
 
 		// This is a <StatusRequest> message
 		XKMSStatusRequestImpl * ret;
@@ -287,7 +344,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	else if (strEquals(name, XKMSConstants::s_tagStatusResult)) {
+	case XKMS_MSG_StatusResult : {
 
 		// This is a <StatusRequest> message
 		XKMSStatusResultImpl * ret;
@@ -301,7 +358,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	else if (strEquals(name, XKMSConstants::s_tagRegisterRequest)) {
+	case XKMS_MSG_RegisterRequest : {
 
 		// This is a <PendingRequest> message
 		XKMSRegisterRequestImpl * ret;
@@ -315,7 +372,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	else if (strEquals(name, XKMSConstants::s_tagRegisterResult)) {
+	case XKMS_MSG_RegisterResult : {
 
 		// This is a <RegisterResult> message
 		XKMSRegisterResultImpl * ret;
@@ -328,7 +385,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 		return (XKMSRegisterResult *) ret;
 
 	}
-	else if (strEquals(name, XKMSConstants::s_tagRevokeRequest)) {
+	case XKMS_MSG_RevokeRequest : {
 
 		// This is a <RevokeRequest> message
 		XKMSRevokeRequestImpl * ret;
@@ -342,7 +399,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	else if (strEquals(name, XKMSConstants::s_tagRevokeResult)) {
+	case XKMS_MSG_RevokeResult : {
 
 		// This is a <RevokeResult> message
 		XKMSRevokeResultImpl * ret;
@@ -356,7 +413,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	else if (strEquals(name, XKMSConstants::s_tagRecoverRequest)) {
+	case XKMS_MSG_RecoverRequest : {
 
 		// This is a <RevokeRequest> message
 		XKMSRecoverRequestImpl * ret;
@@ -370,7 +427,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	else if (strEquals(name, XKMSConstants::s_tagRecoverResult)) {
+	case XKMS_MSG_RecoverResult : {
 
 		// This is a <RecoverResult> message
 		XKMSRecoverResultImpl * ret;
@@ -384,7 +441,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	else if (strEquals(name, XKMSConstants::s_tagReissueRequest)) {
+	case XKMS_MSG_ReissueRequest : {
 
 		// This is a <ReissueRequest> message
 		XKMSReissueRequestImpl * ret;
@@ -398,7 +455,7 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
-	else if (strEquals(name, XKMSConstants::s_tagReissueResult)) {
+	case XKMS_MSG_ReissueResult : {
 
 		// This is a <RevokeResult> message
 		XKMSReissueResultImpl * ret;
@@ -412,6 +469,11 @@ XKMSMessageAbstractType * XKMSMessageFactoryImpl::newMessageFromDOM(
 
 	}
 
+	default :
+		break;
+
+	}
+
 	delete env;
 	return NULL;
 